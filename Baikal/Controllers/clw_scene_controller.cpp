@@ -7,8 +7,13 @@
 #include "SceneGraph/texture.h"
 #include "SceneGraph/Collector/collector.h"
 #include "SceneGraph/iterator.h"
+#include "SceneGraph/IO/tiled_image.h"
 #include "Utils/distribution1d.h"
+#include "Utils/distribution2d.h"
+#include "Utils/light_bvh.h"
 #include "Utils/log.h"
+#include "Utils/vertex_compression.h"
+#include "math/mathutils.h"
 
 
 #include <chrono>
@@ -16,6 +21,11 @@
 #include <stack>
 #include <vector>
 #include <array>
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <unordered_set>
+#include <cmath>
 
 using namespace RadeonRays;
 
@@ -27,10 +37,18 @@ namespace Baikal
     }
 
 
+    // Device memory for virtual texture tiles
+    static const std::size_t kDefaultTileCacheSize = 256 * 1024 * 1024;
+    // Max number of missing tiles requested per update
+    static const std::size_t kMaxTileRequests = 1024;
+
     ClwSceneController::ClwSceneController(CLWContext context, RadeonRays::IntersectionApi* api)
     : m_default_material(SingleBxdf::Create(SingleBxdf::BxdfType::kLambert))
     , m_context(context)
     , m_api(api)
+    , m_tile_cache_size(kDefaultTileCacheSize)
+    , m_vertex_layout(VertexLayout::kFull)
+    , m_num_spill_files(0)
     {
         auto acc_type = "fatbvh";
         auto builder_type = "sah";
@@ -54,6 +72,18 @@ namespace Baikal
     {
     }
 
+    int ClwSceneController::GetMaterialIndex(Shape const& shape, Collector& mat_collector) const
+    {
+        // Check if shape has a material and use default if not
+        auto material = shape.GetMaterial();
+        if (!material)
+        {
+            material = m_default_material;
+        }
+
+        return static_cast<int>(mat_collector.GetItemIndex(material));
+    }
+
     static void SplitMeshesAndInstances(Iterator& shape_iter, std::set<Mesh::Ptr>& meshes, std::set<Instance::Ptr>& instances, std::set<Mesh::Ptr>& excluded_meshes)
     {
         // Clear all sets
@@ -98,54 +128,164 @@ namespace Baikal
         }
     }
 
-    static std::size_t GetShapeIdx(Iterator& shape_iter, Shape::Ptr shape)
+    // Arrange shapes in GPU order: meshes, then excluded meshes, then instances.
+    static void BuildShapeList(Iterator& shape_iter, std::vector<Shape::Ptr>& shape_list, std::size_t& num_meshes, std::size_t& num_excluded_meshes)
     {
         std::set<Mesh::Ptr> meshes;
         std::set<Mesh::Ptr> excluded_meshes;
         std::set<Instance::Ptr> instances;
         SplitMeshesAndInstances(shape_iter, meshes, instances, excluded_meshes);
-        
-        std::size_t idx = 0;
-        for (auto& i : meshes)
+
+        shape_list.clear();
+        shape_list.reserve(meshes.size() + excluded_meshes.size() + instances.size());
+        shape_list.insert(shape_list.end(), meshes.cbegin(), meshes.cend());
+        shape_list.insert(shape_list.end(), excluded_meshes.cbegin(), excluded_meshes.cend());
+        shape_list.insert(shape_list.end(), instances.cbegin(), instances.cend());
+
+        num_meshes = meshes.size();
+        num_excluded_meshes = excluded_meshes.size();
+    }
+
+    // Rebuild shape list along with shape to index mapping. This happens once
+    // per compile and the result is shared by shapes, intersector and lights updates.
+    static void UpdateShapeList(Scene1 const& scene, ClwScene& out)
+    {
+        auto shape_iter = scene.CreateShapeIterator();
+        BuildShapeList(*shape_iter, out.shape_list, out.num_meshes, out.num_excluded_meshes);
+
+        out.shape_indices.clear();
+        out.shape_indices.reserve(out.shape_list.size());
+
+        for (auto i = 0u; i < out.shape_list.size(); ++i)
         {
-            if (i == shape)
-            {
-                return idx;
-            }
-            
-            ++idx;
+            out.shape_indices.emplace(out.shape_list[i], static_cast<int>(i));
+        }
+    }
+
+    // Pools are (re)allocated with headroom, so that incremental
+    // updates usually fit into already existing GPU buffers.
+    static std::size_t GetPoolCapacity(std::size_t required_size)
+    {
+        return std::max<std::size_t>(required_size + required_size / 2, 1);
+    }
+
+    // Vertex ranges occupy an even number of elements, so they start at even
+    // offsets and compact uvs (two per uvs element) share vertex offsets
+    static std::size_t GetVertexRangeSize(std::size_t num_vertices)
+    {
+        return (num_vertices + 1) & ~std::size_t(1);
+    }
+
+    // Get the mesh which holds geometry for a shape
+    static Mesh::Ptr GetGeometry(Shape::Ptr shape)
+    {
+        if (auto instance = std::dynamic_pointer_cast<Instance>(shape))
+        {
+            return std::static_pointer_cast<Mesh>(instance->GetBaseShape());
         }
 
-        for (auto& i : excluded_meshes)
+        return std::static_pointer_cast<Mesh>(shape);
+    }
+
+    static void SetShapeTransform(matrix const& transform, ClwScene::Shape& shape)
+    {
+        shape.transform.m0 = { transform.m00, transform.m01, transform.m02, transform.m03 };
+        shape.transform.m1 = { transform.m10, transform.m11, transform.m12, transform.m13 };
+        shape.transform.m2 = { transform.m20, transform.m21, transform.m22, transform.m23 };
+        shape.transform.m3 = { transform.m30, transform.m31, transform.m32, transform.m33 };
+    }
+
+    static RadeonRays::Shape* CreateIntersectorMesh(RadeonRays::IntersectionApi* api, Mesh const& mesh)
+    {
+        return api->CreateMesh(
+                               // Vertices starting from the first one
+                               (float*)mesh.GetVertices(),
+                               // Number of vertices
+                               static_cast<int>(mesh.GetNumVertices()),
+                               // Stride
+                               sizeof(float3),
+                               // TODO: make API signature const
+                               reinterpret_cast<int const*>(mesh.GetIndices()),
+                               // Index stride
+                               0,
+                               // All triangles
+                               nullptr,
+                               // Number of primitives
+                               static_cast<int>(mesh.GetNumIndices() / 3)
+                               );
+    }
+
+    // Refill material id ranges of the shapes whose material index has changed.
+    // Shapes are passed along with their current material indices.
+    static void UpdateMaterialIdRanges(CLWContext context, std::vector<std::pair<Shape::Ptr, int>> const& shape_materials, ClwScene& out)
+    {
+        // Staging storage should not move until all the writes are complete,
+        // so calculate its size upfront.
+        std::size_t staging_size = 0;
+        for (auto& item : shape_materials)
         {
-            if (i == shape)
+            auto const& allocation = out.shape_allocations.at(item.first);
+
+            if (allocation.material_idx != item.second)
             {
-                return idx;
+                staging_size += allocation.num_matids;
             }
+        }
 
-            ++idx;
+        if (staging_size == 0)
+        {
+            return;
         }
-        
-        for (auto& i : instances)
+
+        std::vector<int> staging(staging_size);
+        std::size_t num_matids_written = 0;
+
+        for (auto& item : shape_materials)
         {
-            if (i == shape)
+            auto& allocation = out.shape_allocations.at(item.first);
+
+            if (allocation.material_idx == item.second)
             {
-                return idx;
+                continue;
             }
-            
-            ++idx;
+
+            auto matids = staging.data() + num_matids_written;
+            std::fill(matids, matids + allocation.num_matids, item.second);
+
+            if (allocation.num_matids > 0)
+            {
+                context.WriteBuffer(0, out.materialids, matids, allocation.matid_offset, allocation.num_matids);
+            }
+
+            allocation.material_idx = item.second;
+            num_matids_written += allocation.num_matids;
         }
 
-        return -1;
+        context.Finish(0);
     }
 
     void ClwSceneController::UpdateIntersector(Scene1 const& scene, ClwScene& out) const
     {
-        // Detach and delete all shapes
+        // Meshes with unchanged geometry keep their intersector shapes,
+        // everything else (instances included) is recreated.
+        std::set<RadeonRays::Shape*> cached_shapes;
+        for (auto& allocation : out.mesh_allocations)
+        {
+            if (allocation.second.isect_shape)
+            {
+                cached_shapes.emplace(allocation.second.isect_shape);
+            }
+        }
+
+        // Detach all shapes and delete stale ones
         for (auto& shape : out.isect_shapes)
         {
             m_api->DetachShape(shape);
-            m_api->DeleteShape(shape);
+
+            if (cached_shapes.find(shape) == cached_shapes.cend())
+            {
+                m_api->DeleteShape(shape);
+            }
         }
 
         // Clear shapes cache
@@ -155,148 +295,72 @@ namespace Baikal
         // not to visible_shapes.
         out.visible_shapes.clear();
 
-        // Create new shapes
-        auto shape_iter = scene.CreateShapeIterator();
-        
-        if (!shape_iter->IsValid())
+        if (out.shape_list.empty())
         {
             throw std::runtime_error("No shapes in the scene");
         }
-        
-        // Split all shapes into meshes and instances sets.
-        std::set<Mesh::Ptr> meshes;
-        // Excluded shapes are shapes which are not in the scene,
-        // but references by at least one instance.
-        std::set<Mesh::Ptr> excluded_meshes;
-        std::set<Instance::Ptr> instances;
-        SplitMeshesAndInstances(*shape_iter, meshes, instances, excluded_meshes);
-        
-        // Keep shape->rr shape association for
-        // instance base shape lookup.
-        std::map<Shape::Ptr, RadeonRays::Shape*> rr_shapes;
-        
+
+        auto num_geometry = out.num_meshes + out.num_excluded_meshes;
+
         // Start from ID 1
-        // Handle meshes
         int id = 1;
-        for (auto& iter : meshes)
+        for (auto i = 0u; i < out.shape_list.size(); ++i)
         {
-            auto mesh = iter;
-            
-            auto shape = m_api->CreateMesh(
-                                           // Vertices starting from the first one
-                                           (float*)mesh->GetVertices(),
-                                           // Number of vertices
-                                           static_cast<int>(mesh->GetNumVertices()),
-                                           // Stride
-                                           sizeof(float3),
-                                           // TODO: make API signature const
-                                           reinterpret_cast<int const*>(mesh->GetIndices()),
-                                           // Index stride
-                                           0,
-                                           // All triangles
-                                           nullptr,
-                                           // Number of primitives
-                                           static_cast<int>(mesh->GetNumIndices() / 3)
-                                           );
-            
-            auto transform = mesh->GetTransform();
-            shape->SetTransform(transform, inverse(transform));
-            shape->SetId(id++);
-            shape->SetMask(iter->GetVisibilityMask());
+            auto const& item = out.shape_list[i];
+            RadeonRays::Shape* shape = nullptr;
 
-            out.isect_shapes.push_back(shape);
-            out.visible_shapes.push_back(shape);
-            rr_shapes[mesh] = shape;
-        }
+            if (i < num_geometry)
+            {
+                auto mesh = std::static_pointer_cast<Mesh>(item);
+                auto& allocation = out.mesh_allocations.at(mesh);
 
-        // Handle excluded meshes
-        for (auto& iter : excluded_meshes)
-        {
-            auto mesh = iter;
-            
-            auto shape = m_api->CreateMesh(
-                                           // Vertices starting from the first one
-                                           (float*)mesh->GetVertices(),
-                                           // Number of vertices
-                                           static_cast<int>(mesh->GetNumVertices()),
-                                           // Stride
-                                           sizeof(float3),
-                                           // TODO: make API signature const
-                                           reinterpret_cast<int const*>(mesh->GetIndices()),
-                                           // Index stride
-                                           0,
-                                           // All triangles
-                                           nullptr,
-                                           // Number of primitives
-                                           static_cast<int>(mesh->GetNumIndices() / 3)
-                                           );
-
-            auto transform = mesh->GetTransform();
-            shape->SetTransform(transform, inverse(transform));
-            shape->SetId(id++);
-            out.isect_shapes.push_back(shape);
-            rr_shapes[mesh] = shape;
-        }
-        
-        // Handle instances
-        for (auto& iter: instances)
-        {
-            auto instance = iter;
-            auto rr_mesh = rr_shapes[instance->GetBaseShape()];
-            auto shape = m_api->CreateInstance(rr_mesh);
-            
-            auto transform = instance->GetTransform();
+                if (!allocation.isect_shape)
+                {
+                    allocation.isect_shape = CreateIntersectorMesh(m_api, *mesh);
+                }
+
+                shape = allocation.isect_shape;
+            }
+            else
+            {
+                // Instances reference intersector shapes of their base meshes
+                auto instance = std::static_pointer_cast<Instance>(item);
+                auto rr_mesh = out.mesh_allocations.at(instance->GetBaseShape()).isect_shape;
+                shape = m_api->CreateInstance(rr_mesh);
+            }
+
+            auto transform = item->GetTransform();
             shape->SetTransform(transform, inverse(transform));
             shape->SetId(id++);
+
+            if (i < out.num_meshes)
+            {
+                shape->SetMask(item->GetVisibilityMask());
+            }
+
             out.isect_shapes.push_back(shape);
-            out.visible_shapes.push_back(shape);
+
+            // Excluded meshes are not visible
+            if (i < out.num_meshes || i >= num_geometry)
+            {
+                out.visible_shapes.push_back(shape);
+            }
         }
     }
 
     void ClwSceneController::UpdateIntersectorTransforms(Scene1 const& scene, ClwScene& out) const
     {
-        // Create new shapes
-        auto shape_iter = scene.CreateShapeIterator();
-
-        if (!shape_iter->IsValid())
+        if (out.shape_list.empty())
         {
             throw std::runtime_error("No shapes in the scene");
         }
 
-        // Split all shapes into meshes and instances sets.
-        std::set<Mesh::Ptr> meshes;
-        // Excluded shapes are shapes which are not in the scene,
-        // but references by at least one instance.
-        std::set<Mesh::Ptr> excluded_meshes;
-        std::set<Instance::Ptr> instances;
-        SplitMeshesAndInstances(*shape_iter, meshes, instances, excluded_meshes);
-
+        // Intersector shapes follow shape list order
         auto rr_iter = out.isect_shapes.begin();
 
-        // Start from ID 1
-        // Handle meshes
-        for (auto& iter : meshes)
-        {
-            auto mesh = iter;
-            auto transform = mesh->GetTransform();
-            (*rr_iter)->SetTransform(transform, inverse(transform));
-            ++rr_iter;
-        }
-
-        // Handle excluded meshes
-        for (auto& iter : excluded_meshes)
-        {
-            auto mesh = iter;
-            auto transform = mesh->GetTransform();
-            (*rr_iter)->SetTransform(transform, inverse(transform));
-            ++rr_iter;
-        }
-
-        // Handle instances
-        for (auto& iter : instances)
+        for (auto& shape : out.shape_list)
         {
-            auto instance = iter;
-            auto transform = instance->GetTransform();
+            auto transform = shape->GetTransform();
             (*rr_iter)->SetTransform(transform, inverse(transform));
             ++rr_iter;
         }
@@ -345,423 +409,419 @@ namespace Baikal
     
     void ClwSceneController::UpdateShapes(Scene1 const& scene, Collector& mat_collector, Collector& tex_collector, ClwScene& out) const
     {
-        std::size_t num_vertices = 0;
-        std::size_t num_normals = 0;
-        std::size_t num_uvs = 0;
-        std::size_t num_indices = 0;
-        std::size_t num_material_ids = 0;
-        
-        std::size_t num_vertices_written = 0;
-        std::size_t num_normals_written = 0;
-        std::size_t num_uvs_written = 0;
-        std::size_t num_indices_written = 0;
-        std::size_t num_matids_written = 0;
-        std::size_t num_shapes_written = 0;
-        
-        auto shape_iter = scene.CreateShapeIterator();
-        
-        // Sort shapes into meshes and instances sets.
-        std::set<Mesh::Ptr> meshes;
-        // Excluded meshes are meshes which are not in the scene,
-        // but are references by at least one instance.
-        std::set<Mesh::Ptr> excluded_meshes;
-        std::set<Instance::Ptr> instances;
-        SplitMeshesAndInstances(*shape_iter, meshes, instances, excluded_meshes);
-        
-        // Calculate GPU array sizes. Do that only for meshes,
-        // since instances do not occupy space in vertex buffers.
-        // However instances still have their own material ids.
-        for (auto& iter : meshes)
-        {
-            auto mesh = iter;
-            
-            num_vertices += mesh->GetNumVertices();
-            num_normals += mesh->GetNumNormals();
-            num_uvs += mesh->GetNumUVs();
-            num_indices += mesh->GetNumIndices();
-            num_material_ids += mesh->GetNumIndices() / 3;
-        }
-        
-        // Excluded meshes still occupy space in vertex buffers.
-        for (auto& iter : excluded_meshes)
-        {
-            auto mesh = iter;
-            
-            num_vertices += mesh->GetNumVertices();
-            num_normals += mesh->GetNumNormals();
-            num_uvs += mesh->GetNumUVs();
-            num_indices += mesh->GetNumIndices();
-            num_material_ids += mesh->GetNumIndices() / 3;
-        }
-        
-        // Instances only occupy material IDs space.
-        for (auto& iter : instances)
-        {
-            auto instance = iter;
-            auto mesh = std::static_pointer_cast<Mesh>(instance->GetBaseShape());
-            num_material_ids += mesh->GetNumIndices() / 3;
-        }
+        // Shape set has changed, so rebuild the list first
+        UpdateShapeList(scene, out);
 
-        LogInfo("Creating vertex buffer...\n");
-        // Create CL arrays
-        out.vertices = m_context.CreateBuffer<float3>(num_vertices, CL_MEM_READ_ONLY);
+        out.world_bounds = scene.GetWorldAABB();
 
-        LogInfo("Creating normal buffer...\n");
-        out.normals = m_context.CreateBuffer<float3>(num_normals, CL_MEM_READ_ONLY);
+        // Meshes occupying space in vertex and index pools.
+        // Excluded meshes still occupy space there, instances do not.
+        auto num_geometry = out.num_meshes + out.num_excluded_meshes;
+        std::vector<Mesh::Ptr> geometry;
+        geometry.reserve(num_geometry);
 
-        LogInfo("Creating UV buffer...\n");
-        out.uvs = m_context.CreateBuffer<float2>(num_uvs, CL_MEM_READ_ONLY);
+        for (auto i = 0u; i < num_geometry; ++i)
+        {
+            geometry.push_back(std::static_pointer_cast<Mesh>(out.shape_list[i]));
+        }
 
-        LogInfo("Creating index buffer...\n");
-        out.indices = m_context.CreateBuffer<int>(num_indices, CL_MEM_READ_ONLY);
+        // All shapes in GPU order along with their material indices.
+        // Excluded meshes are never shaded, so they do not need materials.
+        std::vector<std::pair<Shape::Ptr, int>> shape_materials;
+        shape_materials.reserve(out.shape_list.size());
 
-        // Total number of entries in shapes GPU array
-        auto num_shapes = meshes.size() + excluded_meshes.size() + instances.size();
-        out.shapes = m_context.CreateBuffer<ClwScene::Shape>(num_shapes, CL_MEM_READ_ONLY);
-        out.materialids = m_context.CreateBuffer<int>(num_material_ids, CL_MEM_READ_ONLY);
-        
-        float3* vertices = nullptr;
-        float3* normals = nullptr;
-        float2* uvs = nullptr;
-        int* indices = nullptr;
-        int* matids = nullptr;
-        ClwScene::Shape* shapes = nullptr;
-        
-        // Map arrays and prepare to write data
-        LogInfo("Mapping buffers...\n");
-        m_context.MapBuffer(0, out.vertices, CL_MAP_WRITE, &vertices);
-        m_context.MapBuffer(0, out.normals, CL_MAP_WRITE, &normals);
-        m_context.MapBuffer(0, out.uvs, CL_MAP_WRITE, &uvs);
-        m_context.MapBuffer(0, out.indices, CL_MAP_WRITE, &indices);
-        m_context.MapBuffer(0, out.materialids, CL_MAP_WRITE, &matids);
-        m_context.MapBuffer(0, out.shapes, CL_MAP_WRITE, &shapes).Wait();
-
-        // Keep associated shapes data for instance look up.
-        // We retrieve data from here while serializing instances,
-        // using base shape lookup.
-        std::map<Mesh::Ptr, ClwScene::Shape> shape_data;
-        // Handle meshes
-        for (auto& iter : meshes)
-        {
-            auto mesh = iter;
-            
-            // Get pointers data
-            auto mesh_vertex_array = mesh->GetVertices();
-            auto mesh_num_vertices = mesh->GetNumVertices();
-            
-            auto mesh_normal_array = mesh->GetNormals();
-            auto mesh_num_normals = mesh->GetNumNormals();
-            
-            auto mesh_uv_array = mesh->GetUVs();
-            auto mesh_num_uvs = mesh->GetNumUVs();
-            
-            auto mesh_index_array = mesh->GetIndices();
-            auto mesh_num_indices = mesh->GetNumIndices();
-            
-            // Prepare shape descriptor
-            ClwScene::Shape shape;
-            shape.numprims = static_cast<int>(mesh_num_indices / 3);
-            shape.startvtx = static_cast<int>(num_vertices_written);
-            shape.startidx = static_cast<int>(num_indices_written);
-            shape.start_material_idx = static_cast<int>(num_matids_written);
-            
-            auto transform = mesh->GetTransform();
-            shape.transform.m0 = { transform.m00, transform.m01, transform.m02, transform.m03 };
-            shape.transform.m1 = { transform.m10, transform.m11, transform.m12, transform.m13 };
-            shape.transform.m2 = { transform.m20, transform.m21, transform.m22, transform.m23 };
-            shape.transform.m3 = { transform.m30, transform.m31, transform.m32, transform.m33 };
-            
-            shape.linearvelocity = float3(0.0f, 0.f, 0.f);
-            shape.angularvelocity = float3(0.f, 0.f, 0.f, 1.f);
-            
-            shape_data[mesh] = shape;
-            
-            std::copy(mesh_vertex_array, mesh_vertex_array + mesh_num_vertices, vertices + num_vertices_written);
-            num_vertices_written += mesh_num_vertices;
-            
-            std::copy(mesh_normal_array, mesh_normal_array + mesh_num_normals, normals + num_normals_written);
-            num_normals_written += mesh_num_normals;
-            
-            std::copy(mesh_uv_array, mesh_uv_array + mesh_num_uvs, uvs + num_uvs_written);
-            num_uvs_written += mesh_num_uvs;
-            
-            std::copy(mesh_index_array, mesh_index_array + mesh_num_indices, indices + num_indices_written);
-            num_indices_written += mesh_num_indices;
+        for (auto i = 0u; i < out.shape_list.size(); ++i)
+        {
+            auto const& shape = out.shape_list[i];
+            auto excluded = i >= out.num_meshes && i < num_geometry;
+            shape_materials.emplace_back(shape, excluded ? -1 : GetMaterialIndex(*shape, mat_collector));
+        }
 
-            shapes[num_shapes_written++] = shape;
+        // Release ranges of meshes which are gone or have their geometry changed
+        std::unordered_set<SceneObject::Ptr> live_geometry(geometry.cbegin(), geometry.cend());
+        for (auto iter = out.mesh_allocations.begin(); iter != out.mesh_allocations.end();)
+        {
+            auto mesh = std::static_pointer_cast<Mesh>(iter->first);
+            auto const& allocation = iter->second;
 
-            // Check if mesh has a material and use default if not
-            auto material = mesh->GetMaterial();
-            if (!material)
+            if (live_geometry.find(mesh) != live_geometry.cend() &&
+                allocation.geometry_version == mesh->GetGeometryVersion())
             {
-                material = m_default_material;
+                ++iter;
+                continue;
             }
-            
-            auto matidx = mat_collector.GetItemIndex(material);
-            std::fill(matids + num_matids_written, matids + num_matids_written + mesh_num_indices / 3, matidx);
-            
-            num_matids_written += mesh_num_indices / 3;
-            
-            // Drop dirty flag
-            mesh->SetDirty(false);
+
+            out.vertex_allocator.Free(allocation.vertex_offset, GetVertexRangeSize(allocation.num_vertices));
+            out.index_allocator.Free(allocation.index_offset, allocation.num_indices);
+            iter = out.mesh_allocations.erase(iter);
         }
-        
-        // Excluded shapes are handled in almost the same way
-        // except materials.
-        for (auto& iter : excluded_meshes)
+
+        // Allocate ranges for new geometry.
+        // Layout change requires repacking everything.
+        std::vector<Mesh::Ptr> geometry_uploads;
+        bool geometry_pools_full = out.vertex_layout != m_vertex_layout;
+        for (auto& mesh : geometry)
         {
-            auto mesh = iter;
-            
-            // Get pointers data
-            auto mesh_vertex_array = mesh->GetVertices();
-            auto mesh_num_vertices = mesh->GetNumVertices();
-            
-            auto mesh_normal_array = mesh->GetNormals();
-            auto mesh_num_normals = mesh->GetNumNormals();
-            
-            auto mesh_uv_array = mesh->GetUVs();
-            auto mesh_num_uvs = mesh->GetNumUVs();
-            
-            auto mesh_index_array = mesh->GetIndices();
-            auto mesh_num_indices = mesh->GetNumIndices();
-            
-            // Prepare shape descriptor
-            ClwScene::Shape shape;
-            shape.numprims = static_cast<int>(mesh_num_indices / 3);
-            shape.startvtx = static_cast<int>(num_vertices_written);
-            shape.startidx = static_cast<int>(num_indices_written);
-            shape.start_material_idx = static_cast<int>(num_matids_written);
+            if (out.mesh_allocations.find(mesh) != out.mesh_allocations.cend())
+            {
+                continue;
+            }
 
-            auto transform = mesh->GetTransform();
-            shape.transform.m0 = { transform.m00, transform.m01, transform.m02, transform.m03 };
-            shape.transform.m1 = { transform.m10, transform.m11, transform.m12, transform.m13 };
-            shape.transform.m2 = { transform.m20, transform.m21, transform.m22, transform.m23 };
-            shape.transform.m3 = { transform.m30, transform.m31, transform.m32, transform.m33 };
+            ClwScene::MeshAllocation allocation;
+            allocation.num_vertices = mesh->GetNumVertices();
+            allocation.num_indices = mesh->GetNumIndices();
+            allocation.vertex_offset = out.vertex_allocator.Allocate(GetVertexRangeSize(allocation.num_vertices));
+            allocation.index_offset = out.index_allocator.Allocate(allocation.num_indices);
+            allocation.geometry_version = mesh->GetGeometryVersion();
+            allocation.isect_shape = nullptr;
 
-            shape.linearvelocity = float3(0.0f, 0.f, 0.f);
-            shape.angularvelocity = float3(0.f, 0.f, 0.f, 1.f);
-            
-            shape_data[mesh] = shape;
-            
-            std::copy(mesh_vertex_array, mesh_vertex_array + mesh_num_vertices, vertices + num_vertices_written);
-            num_vertices_written += mesh_num_vertices;
-            
-            std::copy(mesh_normal_array, mesh_normal_array + mesh_num_normals, normals + num_normals_written);
-            num_normals_written += mesh_num_normals;
-            
-            std::copy(mesh_uv_array, mesh_uv_array + mesh_num_uvs, uvs + num_uvs_written);
-            num_uvs_written += mesh_num_uvs;
-            
-            std::copy(mesh_index_array, mesh_index_array + mesh_num_indices, indices + num_indices_written);
-            num_indices_written += mesh_num_indices;
-            
-            shapes[num_shapes_written++] = shape;
-            
-            // We do not need materials for excluded shapes, we never shade them.
-            std::fill(matids + num_matids_written, matids + num_matids_written + mesh_num_indices / 3, -1);
-            
-            num_matids_written += mesh_num_indices / 3;
-            
-            // Drop dirty flag
-            mesh->SetDirty(false);
+            geometry_pools_full = geometry_pools_full ||
+                allocation.vertex_offset == RangeAllocator::kInvalidOffset ||
+                allocation.index_offset == RangeAllocator::kInvalidOffset;
+
+            out.mesh_allocations.emplace(mesh, allocation);
+            geometry_uploads.push_back(mesh);
         }
-        
-        // Handle instances
-        for (auto& iter : instances)
-        {
-            auto instance = iter;
-            auto base_shape = std::static_pointer_cast<Mesh>(instance->GetBaseShape());
-            auto material = instance->GetMaterial();
-            auto transform = instance->GetTransform();
-            auto mesh_num_indices = base_shape->GetNumIndices();
-            
-            // Here shape_data is guaranteed to contain
-            // info for base_shape since we have serialized it
-            // above in a different pass.
-            ClwScene::Shape shape = shape_data[base_shape];
-            // Instance has its own material part.
-            shape.start_material_idx = static_cast<int>(num_matids_written);
-            
-            // Instance has its own transform.
-            shape.transform.m0 = { transform.m00, transform.m01, transform.m02, transform.m03 };
-            shape.transform.m1 = { transform.m10, transform.m11, transform.m12, transform.m13 };
-            shape.transform.m2 = { transform.m20, transform.m21, transform.m22, transform.m23 };
-            shape.transform.m3 = { transform.m30, transform.m31, transform.m32, transform.m33 };
-            
-            shape.linearvelocity = float3(0.0f, 0.f, 0.f);
-            shape.angularvelocity = float3(0.f, 0.f, 0.f, 1.f);
-            
-            shapes[num_shapes_written++] = shape;
-            
-            // If instance do not have a material, use default one.
-            if (!material)
+
+        // If new geometry does not fit, grow the pools and pack everything from scratch
+        if (geometry_pools_full)
+        {
+            std::size_t num_vertices = 0;
+            std::size_t num_indices = 0;
+
+            for (auto& mesh : geometry)
             {
-                material = m_default_material;
+                num_vertices += GetVertexRangeSize(mesh->GetNumVertices());
+                num_indices += mesh->GetNumIndices();
             }
-            
-            auto mat_idx = mat_collector.GetItemIndex(material);
-            std::fill(matids + num_matids_written, matids + num_matids_written + mesh_num_indices / 3, mat_idx);
-            
-            num_matids_written += mesh_num_indices / 3;
-            
-            // Drop dirty flag
-            instance->SetDirty(false);
-        }
 
-        LogInfo("Unmapping buffers...\n");
-        m_context.UnmapBuffer(0, out.vertices, vertices);
-        m_context.UnmapBuffer(0, out.normals, normals);
-        m_context.UnmapBuffer(0, out.uvs, uvs);
-        m_context.UnmapBuffer(0, out.indices, indices);
-        m_context.UnmapBuffer(0, out.materialids, matids);
-        m_context.UnmapBuffer(0, out.shapes, shapes).Wait();
+            auto vertex_capacity = GetVertexRangeSize(GetPoolCapacity(num_vertices));
+            auto index_capacity = GetPoolCapacity(num_indices);
 
-        LogInfo("Updating intersector...\n");
-        UpdateIntersector(scene, out);
+            LogInfo("Creating geometry buffers: ", vertex_capacity, " vertices, ", index_capacity, " indices...\n");
+            out.vertices = m_context.CreateBuffer<float3>(vertex_capacity, CL_MEM_READ_ONLY);
+            out.indices = m_context.CreateBuffer<int>(index_capacity, CL_MEM_READ_ONLY);
 
-        ReloadIntersector(scene, out);
-    }
+            // Compact vertices keep normals in vertices pool (normals pool is still
+            // bound to kernels, so keep it minimal) and pack two uvs per uvs element
+            if (m_vertex_layout == VertexLayout::kCompact)
+            {
+                out.normals = m_context.CreateBuffer<float3>(1, CL_MEM_READ_ONLY);
+                out.uvs = m_context.CreateBuffer<float2>(vertex_capacity / 2, CL_MEM_READ_ONLY);
+            }
+            else
+            {
+                out.normals = m_context.CreateBuffer<float3>(vertex_capacity, CL_MEM_READ_ONLY);
+                out.uvs = m_context.CreateBuffer<float2>(vertex_capacity, CL_MEM_READ_ONLY);
+            }
 
-    void ClwSceneController::UpdateShapeProperties(Scene1 const& scene, Collector& mat_collector, Collector& tex_collector, ClwScene& out) const
-    {
-        std::size_t num_material_ids = 0;
+            out.vertex_layout = m_vertex_layout;
 
-        auto shape_iter = scene.CreateShapeIterator();
+            out.vertex_allocator.Reset(vertex_capacity);
+            out.index_allocator.Reset(index_capacity);
 
-        // Sort shapes into meshes and instances sets.
-        std::set<Mesh::Ptr> meshes;
-        // Excluded meshes are meshes which are not in the scene,
-        // but are references by at least one instance.
-        std::set<Mesh::Ptr> excluded_meshes;
-        std::set<Instance::Ptr> instances;
-        SplitMeshesAndInstances(*shape_iter, meshes, instances, excluded_meshes);
+            for (auto& mesh : geometry)
+            {
+                auto& allocation = out.mesh_allocations.at(mesh);
+                allocation.vertex_offset = out.vertex_allocator.Allocate(GetVertexRangeSize(allocation.num_vertices));
+                allocation.index_offset = out.index_allocator.Allocate(allocation.num_indices);
+            }
 
-        // Calculate GPU array sizes. Do that only for meshes,
-        // since instances do not occupy space in vertex buffers.
-        // However instances still have their own material ids.
-        for (auto& iter : meshes)
-        {
-            auto mesh = iter;
-            num_material_ids += mesh->GetNumIndices() / 3;
+            geometry_uploads = geometry;
         }
 
-        // Excluded meshes still occupy space in vertex buffers.
-        for (auto& iter : excluded_meshes)
+        // Compressed vertices have to stay alive until uploads are finished
+        std::vector<std::vector<CompactVertex>> compact_vertices;
+        std::vector<std::vector<std::uint32_t>> compact_uvs;
+        if (out.vertex_layout == VertexLayout::kCompact)
         {
-            auto mesh = iter;
-            num_material_ids += mesh->GetNumIndices() / 3;
+            compact_vertices.reserve(geometry_uploads.size());
+            compact_uvs.reserve(geometry_uploads.size());
         }
 
-        // Instances only occupy material IDs space.
-        for (auto& iter : instances)
+        // Upload new and changed geometry into its ranges
+        for (auto& mesh : geometry_uploads)
         {
-            auto instance = iter;
-            auto mesh = std::static_pointer_cast<Mesh>(instance->GetBaseShape());
-            num_material_ids += mesh->GetNumIndices() / 3;
-        }
-
-        int* matids = nullptr;
-        ClwScene::Shape* shapes = nullptr;
+            auto const& allocation = out.mesh_allocations.at(mesh);
 
-        // Map arrays and prepare to write data
-        m_context.MapBuffer(0, out.materialids, CL_MAP_READ | CL_MAP_WRITE, &matids);
-        m_context.MapBuffer(0, out.shapes, CL_MAP_READ | CL_MAP_WRITE, &shapes).Wait();
+            // Vertex range is shared by all vertex streams
+            auto num_normals = std::min(mesh->GetNumNormals(), allocation.num_vertices);
+            auto num_uvs = std::min(mesh->GetNumUVs(), allocation.num_vertices);
 
-        auto current_shape = shapes;
-        for (auto& iter : meshes)
-        {
-            auto mesh = iter;
+            if (out.vertex_layout == VertexLayout::kCompact)
+            {
+                if (allocation.num_vertices > 0)
+                {
+                    // Uvs fill whole uvs elements, the range has room for that
+                    auto range_size = GetVertexRangeSize(allocation.num_vertices);
+                    compact_vertices.emplace_back(allocation.num_vertices);
+                    compact_uvs.emplace_back(range_size, 0u);
+                    auto& data = compact_vertices.back();
+                    auto& uvs = compact_uvs.back();
+                    CompressVertices(mesh->GetVertices(), allocation.num_vertices,
+                                     mesh->GetNormals(), num_normals,
+                                     mesh->GetUVs(), num_uvs,
+                                     data.data(), uvs.data());
+                    m_context.WriteBuffer(0, out.vertices, reinterpret_cast<float3 const*>(data.data()), allocation.vertex_offset, allocation.num_vertices);
+                    m_context.WriteBuffer(0, out.uvs, reinterpret_cast<float2 const*>(uvs.data()), allocation.vertex_offset / 2, range_size / 2);
+                }
+            }
+            else
+            {
+                if (allocation.num_vertices > 0)
+                {
+                    m_context.WriteBuffer(0, out.vertices, mesh->GetVertices(), allocation.vertex_offset, allocation.num_vertices);
+                }
 
-            auto mesh_num_indices = mesh->GetNumIndices();
+                if (num_normals > 0)
+                {
+                    m_context.WriteBuffer(0, out.normals, mesh->GetNormals(), allocation.vertex_offset, num_normals);
+                }
 
-            auto transform = mesh->GetTransform();
-            current_shape->transform.m0 = { transform.m00, transform.m01, transform.m02, transform.m03 };
-            current_shape->transform.m1 = { transform.m10, transform.m11, transform.m12, transform.m13 };
-            current_shape->transform.m2 = { transform.m20, transform.m21, transform.m22, transform.m23 };
-            current_shape->transform.m3 = { transform.m30, transform.m31, transform.m32, transform.m33 };
+                if (num_uvs > 0)
+                {
+                    m_context.WriteBuffer(0, out.uvs, mesh->GetUVs(), allocation.vertex_offset, num_uvs);
+                }
+            }
 
-            // Check if mesh has a material and use default if not
-            auto material = mesh->GetMaterial();
-            if (!material)
+            if (allocation.num_indices > 0)
             {
-                material = m_default_material;
+                m_context.WriteBuffer(0, out.indices, reinterpret_cast<int const*>(mesh->GetIndices()), allocation.index_offset, allocation.num_indices);
             }
-
-            auto matidx = mat_collector.GetItemIndex(material);
-            std::fill(matids + current_shape->start_material_idx, 
-                matids + current_shape->start_material_idx + mesh_num_indices / 3, 
-                matidx);
-
-            // Drop dirty flag
-            mesh->SetDirty(false);
-            ++current_shape;
         }
 
-        // Excluded shapes are handled in almost the same way
-        // except materials.
-        for (auto& iter : excluded_meshes)
+        // Release material id ranges of shapes which are gone or have different primitive count
+        std::unordered_set<SceneObject::Ptr> live_shapes;
+        for (auto& item : shape_materials)
         {
-            auto mesh = iter;
-
-            auto mesh_num_indices = mesh->GetNumIndices();
+            live_shapes.emplace(item.first);
+        }
 
-            auto transform = mesh->GetTransform();
-            current_shape->transform.m0 = { transform.m00, transform.m01, transform.m02, transform.m03 };
-            current_shape->transform.m1 = { transform.m10, transform.m11, transform.m12, transform.m13 };
-            current_shape->transform.m2 = { transform.m20, transform.m21, transform.m22, transform.m23 };
-            current_shape->transform.m3 = { transform.m30, transform.m31, transform.m32, transform.m33 };
+        for (auto iter = out.shape_allocations.begin(); iter != out.shape_allocations.end();)
+        {
+            auto const& allocation = iter->second;
 
-            // Check if mesh has a material and use default if not
-            auto material = mesh->GetMaterial();
-            if (!material)
+            if (live_shapes.find(iter->first) != live_shapes.cend() &&
+                allocation.num_matids == GetGeometry(std::static_pointer_cast<Shape>(iter->first))->GetNumIndices() / 3)
             {
-                material = m_default_material;
+                ++iter;
+                continue;
             }
 
-            auto matidx = mat_collector.GetItemIndex(material);
-            std::fill(matids + current_shape->start_material_idx,
-                matids + current_shape->start_material_idx + mesh_num_indices / 3,
-                matidx);
-
-            // Drop dirty flag
-            mesh->SetDirty(false);
-            ++current_shape;
+            out.matid_allocator.Free(allocation.matid_offset, allocation.num_matids);
+            iter = out.shape_allocations.erase(iter);
         }
 
-        // Handle instances
-        for (auto& iter : instances)
+        // Allocate material id ranges for new shapes.
+        // Instances have their own material id ranges.
+        bool matid_pool_full = false;
+        for (auto& item : shape_materials)
         {
-            auto instance = iter;
-            auto base_shape = std::static_pointer_cast<Mesh>(instance->GetBaseShape());
-            auto material = instance->GetMaterial();
-            auto transform = instance->GetTransform();
-            auto mesh_num_indices = base_shape->GetNumIndices();
-
-            current_shape->transform.m0 = { transform.m00, transform.m01, transform.m02, transform.m03 };
-            current_shape->transform.m1 = { transform.m10, transform.m11, transform.m12, transform.m13 };
-            current_shape->transform.m2 = { transform.m20, transform.m21, transform.m22, transform.m23 };
-            current_shape->transform.m3 = { transform.m30, transform.m31, transform.m32, transform.m33 };
-
-            // Check if mesh has a material and use default if not
-            if (!material)
+            if (out.shape_allocations.find(item.first) != out.shape_allocations.cend())
             {
-                material = m_default_material;
+                continue;
             }
 
-            auto matidx = mat_collector.GetItemIndex(material);
-            std::fill(matids + current_shape->start_material_idx,
-                matids + current_shape->start_material_idx + mesh_num_indices / 3,
-                matidx);
+            ClwScene::ShapeAllocation allocation;
+            allocation.num_matids = GetGeometry(item.first)->GetNumIndices() / 3;
+            allocation.matid_offset = out.matid_allocator.Allocate(allocation.num_matids);
+            // Force the range to be filled
+            allocation.material_idx = std::numeric_limits<int>::min();
+
+            matid_pool_full = matid_pool_full ||
+                allocation.matid_offset == RangeAllocator::kInvalidOffset;
+
+            out.shape_allocations.emplace(item.first, allocation);
+        }
+
+        if (matid_pool_full)
+        {
+            std::size_t num_material_ids = 0;
+
+            for (auto& item : shape_materials)
+            {
+                num_material_ids += out.shape_allocations.at(item.first).num_matids;
+            }
+
+            auto matid_capacity = GetPoolCapacity(num_material_ids);
+
+            LogInfo("Creating material id buffer: ", matid_capacity, " primitives...\n");
+            out.materialids = m_context.CreateBuffer<int>(matid_capacity, CL_MEM_READ_ONLY);
+            out.matid_allocator.Reset(matid_capacity);
+
+            for (auto& item : shape_materials)
+            {
+                auto& allocation = out.shape_allocations.at(item.first);
+                allocation.matid_offset = out.matid_allocator.Allocate(allocation.num_matids);
+                allocation.material_idx = std::numeric_limits<int>::min();
+            }
+        }
+
+        // Shape descriptors are small, so rewrite all of them
+        std::vector<ClwScene::Shape> shapes;
+        shapes.reserve(shape_materials.size());
+
+        for (auto& item : shape_materials)
+        {
+            auto const& mesh_allocation = out.mesh_allocations.at(GetGeometry(item.first));
+            auto const& shape_allocation = out.shape_allocations.at(item.first);
+
+            ClwScene::Shape shape;
+            shape.numprims = static_cast<int>(mesh_allocation.num_indices / 3);
+            shape.startvtx = static_cast<int>(mesh_allocation.vertex_offset);
+            shape.startidx = static_cast<int>(mesh_allocation.index_offset);
+            shape.start_material_idx = static_cast<int>(shape_allocation.matid_offset);
+            shape.vertex_layout = static_cast<int>(out.vertex_layout);
+
+            SetShapeTransform(item.first->GetTransform(), shape);
+
+            shape.linearvelocity = float3(0.0f, 0.f, 0.f);
+            shape.angularvelocity = float3(0.f, 0.f, 0.f, 1.f);
+
+            shapes.push_back(shape);
+        }
+
+        if (shapes.size() > out.shapes.GetElementCount())
+        {
+            out.shapes = m_context.CreateBuffer<ClwScene::Shape>(GetPoolCapacity(shapes.size()), CL_MEM_READ_ONLY);
+        }
+
+        if (!shapes.empty())
+        {
+            m_context.WriteBuffer(0, out.shapes, shapes.data(), shapes.size());
+        }
+
+        UpdateMaterialIdRanges(m_context, shape_materials, out);
+
+        // Make sure host data is not referenced anymore
+        m_context.Finish(0);
+
+        LogInfo("Uploaded ", geometry_uploads.size(), " of ", geometry.size(), " meshes\n");
+
+        // Drop dirty flags
+        for (auto& item : shape_materials)
+        {
+            item.first->SetDirty(false);
+        }
+
+        LogInfo("Updating intersector...\n");
+        UpdateIntersector(scene, out);
+
+        ReloadIntersector(scene, out);
+
+        // Device and intersector have their copies now
+        if (!m_geometry_spill_path.empty())
+        {
+            SpillGeometry(geometry_uploads);
+        }
+    }
+
+    void ClwSceneController::SpillGeometry(std::vector<Mesh::Ptr> const& meshes) const
+    {
+        std::size_t num_spilled = 0;
+        std::size_t spilled_size = 0;
+
+        for (auto& mesh : meshes)
+        {
+            // Already referenced from a file or another storage
+            if (mesh->HasExternalGeometry())
+            {
+                continue;
+            }
+
+            auto filename = m_geometry_spill_path + "/baikal_mesh_" +
+                std::to_string(reinterpret_cast<std::uintptr_t>(this)) + "_" +
+                std::to_string(m_num_spill_files++) + ".bin";
+
+            try
+            {
+                mesh->SpillGeometry(filename);
+            }
+            catch (std::runtime_error& e)
+            {
+                // Geometry just stays in memory
+                LogInfo("Failed to spill mesh geometry: ", e.what(), "\n");
+                continue;
+            }
+
+            ++num_spilled;
+            spilled_size += mesh->GetNumIndices() * sizeof(std::uint32_t) +
+                (mesh->GetNumVertices() + mesh->GetNumNormals()) * sizeof(float3) +
+                mesh->GetNumUVs() * sizeof(float2);
+        }
+
+        LogInfo("Spilled ", num_spilled, " meshes, ", spilled_size / (1024 * 1024), " MB\n");
+    }
+
+    void ClwSceneController::UpdateShapeProperties(Scene1 const& scene, Collector& mat_collector, Collector& tex_collector, ClwScene& out) const
+    {
+        auto shape_iter = scene.CreateShapeIterator();
+
+        // Shape list might change without attaching or detaching shapes
+        // (instance base shape replaced), that requires full shape update.
+        std::vector<Shape::Ptr> shape_list;
+        std::size_t num_meshes = 0;
+        std::size_t num_excluded_meshes = 0;
+        BuildShapeList(*shape_iter, shape_list, num_meshes, num_excluded_meshes);
+
+        if (shape_list != out.shape_list || num_meshes != out.num_meshes)
+        {
+            UpdateShapes(scene, mat_collector, tex_collector, out);
+            return;
+        }
+
+        auto num_geometry = out.num_meshes + out.num_excluded_meshes;
+
+        // All shapes in GPU order along with their material indices
+        std::vector<std::pair<Shape::Ptr, int>> shape_materials;
+        shape_materials.reserve(out.shape_list.size());
+
+        for (auto i = 0u; i < out.shape_list.size(); ++i)
+        {
+            auto const& shape = out.shape_list[i];
+            auto excluded = i >= out.num_meshes && i < num_geometry;
+            shape_materials.emplace_back(shape, excluded ? -1 : GetMaterialIndex(*shape, mat_collector));
+        }
+
+        // Geometry edits can not be patched here, so hand those over
+        // to shape update which only re-uploads changed meshes.
+        for (auto& item : shape_materials)
+        {
+            auto mesh = GetGeometry(item.first);
+            auto mesh_allocation = out.mesh_allocations.find(mesh);
+            auto shape_allocation = out.shape_allocations.find(item.first);
+
+            if (mesh_allocation == out.mesh_allocations.cend() ||
+                shape_allocation == out.shape_allocations.cend() ||
+                mesh_allocation->second.geometry_version != mesh->GetGeometryVersion())
+            {
+                UpdateShapes(scene, mat_collector, tex_collector, out);
+                return;
+            }
+        }
+
+        // Transforms might have changed
+        out.world_bounds = scene.GetWorldAABB();
+
+        ClwScene::Shape* shapes = nullptr;
+
+        // Map shapes array and prepare to write data
+        m_context.MapBuffer(0, out.shapes, CL_MAP_READ | CL_MAP_WRITE, &shapes).Wait();
+
+        auto current_shape = shapes;
+        for (auto& item : shape_materials)
+        {
+            SetShapeTransform(item.first->GetTransform(), *current_shape);
 
             // Drop dirty flag
-            instance->SetDirty(false);
+            item.first->SetDirty(false);
             ++current_shape;
         }
 
-        m_context.UnmapBuffer(0, out.materialids, matids);
-        m_context.UnmapBuffer(0, out.shapes, shapes).Wait();
-
+        m_context.UnmapBuffer(0, out.shapes, shapes);
 
+        // Only ranges with changed materials are rewritten
+        UpdateMaterialIdRanges(m_context, shape_materials, out);
     }
     
     void ClwSceneController::UpdateCurrentScene(Scene1 const& scene, ClwScene& out) const
@@ -782,7 +842,6 @@ namespace Baikal
         }
         
         ClwScene::Material* materials = nullptr;
-        std::size_t num_materials_written = 0;
         
         // Map GPU materials buffer
         m_context.MapBuffer(0, out.materials, CL_MAP_WRITE, &materials).Wait();
@@ -795,11 +854,12 @@ namespace Baikal
             // Create material iterator
             auto mat_iter = mat_collector.CreateIterator();
             
-            // Iterate and serialize
+            // Iterate and serialize, collector indices are stable so each
+            // material goes to its own slot (released slots are left as is)
             for (; mat_iter->IsValid(); mat_iter->Next())
             {
-                WriteMaterial(*mat_iter->ItemAs<Material>(), mat_collector, tex_collector, materials + num_materials_written);
-                ++num_materials_written;
+                auto material = mat_iter->ItemAs<Material>();
+                WriteMaterial(*material, mat_collector, tex_collector, materials + mat_collector.GetItemIndex(material));
             }
         }
         
@@ -819,80 +879,216 @@ namespace Baikal
         m_api->Commit();
     }
     
+    // Number of mip levels uploaded for a texture, down to 1x1 level
+    static int GetMipLevelCount(Texture const& texture)
+    {
+        if (!texture.IsMipmapEnabled())
+        {
+            return 1;
+        }
+
+        auto size = texture.GetSize();
+        auto max_size = std::max(size.x, size.y);
+
+        auto num_levels = 1;
+        while (num_levels < ClwScene::kMaxTextureMipLevels && (max_size >> num_levels) > 0)
+        {
+            ++num_levels;
+        }
+
+        return num_levels;
+    }
+
+    static RadeonRays::int2 GetMipLevelSize(Texture const& texture, int level)
+    {
+        auto size = texture.GetSize();
+        return RadeonRays::int2(std::max(size.x >> level, 1), std::max(size.y >> level, 1));
+    }
+
+    // Size of texture data with all mip levels
+    static std::size_t GetTextureDataSize(Texture const& texture)
+    {
+        std::size_t size = 0;
+        for (auto i = 0; i < GetMipLevelCount(texture); ++i)
+        {
+            size += Texture::GetLevelSizeInBytes(texture.GetFormat(), GetMipLevelSize(texture, i));
+        }
+
+        return size;
+    }
+
     void ClwSceneController::UpdateTextures(Scene1 const& scene, Collector& mat_collector, Collector& tex_collector, ClwScene& out) const
     {
         // Get new buffer size
         std::size_t tex_buffer_size = tex_collector.GetNumItems();
-        std::size_t tex_data_buffer_size = 0;
 
         if (tex_buffer_size == 0)
         {
             out.textures = m_context.CreateBuffer<ClwScene::Texture>(1, CL_MEM_READ_ONLY);
             out.texturedata = m_context.CreateBuffer<char>(1, CL_MEM_READ_ONLY);
+            out.texture_allocations.clear();
+            out.texture_allocator.Reset(0);
+            UpdateTileLayout({}, out);
             return;
         }
         
-        // Recreate material buffer if it needs resize
+        // Recreate texture buffer if it needs resize
         if (tex_buffer_size > out.textures.GetElementCount())
         {
-            // Create material buffer
+            // Create texture buffer
             out.textures = m_context.CreateBuffer<ClwScene::Texture>(tex_buffer_size, CL_MEM_READ_ONLY);
         }
         
-        ClwScene::Texture* textures = nullptr;
-        std::size_t num_textures_written = 0;
-        
-        // Map GPU materials buffer
-        m_context.MapBuffer(0, out.textures, CL_MAP_WRITE, &textures).Wait();
-        
-        // Update material bundle first to be able to track differences
+        // Update texture bundle first to be able to track differences
         out.texture_bundle.reset(tex_collector.CreateBundle());
         
-        // Create material iterator
+        // Create texture iterator
         std::unique_ptr<Iterator> tex_iter(tex_collector.CreateIterator());
-        
-        // Iterate and serialize
+
+        // Virtual textures are not kept in texture data pool, their tiles are streamed
+        std::unordered_set<SceneObject::Ptr> live_textures;
+        std::vector<Texture::Ptr> virtual_textures;
+        bool virtual_textures_changed = false;
         for (; tex_iter->IsValid(); tex_iter->Next())
         {
             auto tex = tex_iter->ItemAs<Texture>();
 
-            WriteTexture(*tex, tex_data_buffer_size, textures + num_textures_written);
-
-            ++num_textures_written;
+            if (tex->IsVirtual())
+            {
+                virtual_textures_changed = virtual_textures_changed || tex->IsDirty();
+                virtual_textures.push_back(tex);
+                continue;
+            }
 
-            tex_data_buffer_size += align16(tex->GetSizeInBytes());
+            live_textures.emplace(tex);
         }
 
-        // Unmap material buffer
-        m_context.UnmapBuffer(0, out.textures, textures);
+        if (virtual_textures_changed || virtual_textures != out.virtual_textures)
+        {
+            UpdateTileLayout(virtual_textures, out);
+        }
 
-        // Recreate material buffer if it needs resize
-        if (tex_data_buffer_size > out.texturedata.GetElementCount())
+        // Release ranges of textures which are not used anymore or have been changed
+        for (auto iter = out.texture_allocations.begin(); iter != out.texture_allocations.end();)
         {
-            // Create material buffer
-            out.texturedata = m_context.CreateBuffer<char>(tex_data_buffer_size, CL_MEM_READ_ONLY);
+            auto tex = std::static_pointer_cast<Texture>(iter->first);
+            auto const& allocation = iter->second;
+
+            if (live_textures.find(tex) != live_textures.cend() && !tex->IsDirty() &&
+                allocation.size == align16(GetTextureDataSize(*tex)))
+            {
+                ++iter;
+                continue;
+            }
+
+            out.texture_allocator.Free(allocation.offset, allocation.size);
+            iter = out.texture_allocations.erase(iter);
         }
-        
-        char* data = nullptr;
-        std::size_t num_bytes_written = 0;
-        
-        tex_iter->Reset();
-        
-        // Map GPU materials buffer
-        m_context.MapBuffer(0, out.texturedata, CL_MAP_WRITE, &data).Wait();
-        
-        // Write texture data for all textures
-        for (; tex_iter->IsValid(); tex_iter->Next())
+
+        // Allocate ranges for new textures
+        std::vector<Texture::Ptr> texture_uploads;
+        bool texture_pool_full = false;
+        for (tex_iter->Reset(); tex_iter->IsValid(); tex_iter->Next())
         {
             auto tex = tex_iter->ItemAs<Texture>();
 
-            WriteTextureData(*tex, data + num_bytes_written);
+            if (tex->IsVirtual() || out.texture_allocations.find(tex) != out.texture_allocations.cend())
+            {
+                continue;
+            }
+
+            ClwScene::TextureAllocation allocation;
+            allocation.size = align16(GetTextureDataSize(*tex));
+            allocation.offset = out.texture_allocator.Allocate(allocation.size);
+
+            texture_pool_full = texture_pool_full ||
+                allocation.offset == RangeAllocator::kInvalidOffset;
 
-            num_bytes_written += align16(tex->GetSizeInBytes());
+            out.texture_allocations.emplace(tex, allocation);
+            texture_uploads.push_back(tex);
         }
 
-        // Unmap material buffer
-        m_context.UnmapBuffer(0, out.texturedata, data);
+        if (texture_pool_full)
+        {
+            // Grow the pool and pack all textures from scratch
+            std::size_t tex_data_buffer_size = 0;
+            for (auto& allocation : out.texture_allocations)
+            {
+                tex_data_buffer_size += allocation.second.size;
+            }
+
+            auto capacity = GetPoolCapacity(tex_data_buffer_size);
+
+            LogInfo("Creating texture data buffer: ", capacity, " bytes...\n");
+            out.texturedata = m_context.CreateBuffer<char>(capacity, CL_MEM_READ_ONLY);
+            out.texture_allocator.Reset(capacity);
+
+            char* data = nullptr;
+
+            // Map GPU texture data buffer
+            m_context.MapBuffer(0, out.texturedata, CL_MAP_WRITE, &data).Wait();
+
+            // Write texture data for all textures
+            for (tex_iter->Reset(); tex_iter->IsValid(); tex_iter->Next())
+            {
+                auto tex = tex_iter->ItemAs<Texture>();
+
+                if (tex->IsVirtual())
+                {
+                    continue;
+                }
+
+                auto& allocation = out.texture_allocations.at(tex);
+
+                allocation.offset = out.texture_allocator.Allocate(allocation.size);
+                WriteTextureData(*tex, data + allocation.offset);
+            }
+
+            // Unmap texture data buffer
+            m_context.UnmapBuffer(0, out.texturedata, data);
+        }
+        else
+        {
+            // Patch ranges of new and changed textures only. Mip chains are
+            // staged on the host and have to stay alive until upload is done.
+            std::vector<std::vector<char>> staging(texture_uploads.size());
+
+            for (auto i = 0u; i < texture_uploads.size(); ++i)
+            {
+                auto& tex = texture_uploads[i];
+                auto const& allocation = out.texture_allocations.at(tex);
+                auto data_size = GetTextureDataSize(*tex);
+
+                if (data_size > 0)
+                {
+                    staging[i].resize(data_size);
+                    WriteTextureData(*tex, staging[i].data());
+                    m_context.WriteBuffer(0, out.texturedata, staging[i].data(), allocation.offset, data_size);
+                }
+            }
+
+            m_context.Finish(0);
+        }
+
+        ClwScene::Texture* textures = nullptr;
+
+        // Map GPU textures buffer
+        m_context.MapBuffer(0, out.textures, CL_MAP_WRITE, &textures).Wait();
+
+        // Texture headers are small, so rewrite all of them
+        for (tex_iter->Reset(); tex_iter->IsValid(); tex_iter->Next())
+        {
+            auto tex = tex_iter->ItemAs<Texture>();
+            auto offset = tex->IsVirtual() ? out.page_offsets.at(tex) : out.texture_allocations.at(tex).offset;
+
+            WriteTexture(*tex, offset, textures + tex_collector.GetItemIndex(tex));
+        }
+
+        // Unmap textures buffer
+        m_context.UnmapBuffer(0, out.textures, textures);
+
+        // Make sure host data is not referenced anymore
+        m_context.Finish(0);
     }
     
     // Convert Material:: types to ClwScene:: types
@@ -1350,7 +1546,7 @@ namespace Baikal
         }
     }
     
-    void ClwSceneController::WriteLight(Scene1 const& scene, Light const& light, Collector& tex_collector, void* data) const
+    void ClwSceneController::WriteLight(ClwScene const& out, Light const& light, Collector& tex_collector, void* data) const
     {
         auto clw_light = reinterpret_cast<ClwScene::Light*>(data);
         
@@ -1398,14 +1594,11 @@ namespace Baikal
             
             case ClwScene::kArea:
             {
-                // TODO: optimize this linear search
+                // Shape indices are established by shape update
                 auto shape = static_cast<AreaLight const&>(light).GetShape();
+                auto iter = out.shape_indices.find(shape);
                 
-                auto shape_iter = scene.CreateShapeIterator();
-                
-                auto idx = GetShapeIdx(*shape_iter, shape);
-                
-                clw_light->shapeidx = static_cast<int>(idx);
+                clw_light->shapeidx = iter != out.shape_indices.cend() ? iter->second : -1;
                 clw_light->primidx = static_cast<int>(static_cast<AreaLight const&>(light).GetPrimitiveIdx());
                 break;
             }
@@ -1417,18 +1610,246 @@ namespace Baikal
         }
     }
 
+    // Max resolution of environment light distribution, larger envmaps are averaged down
+    static const int kEnvDistributionMaxWidth = 1024;
+    static const int kEnvDistributionMaxHeight = 512;
+
+    // Size of serialized 1D distribution in ints
+    static std::size_t GetDistribution1DSize(Distribution1D const& distribution)
+    {
+        return 2 + 2 * distribution.m_num_segments;
+    }
+
+    // Serialize 1D distribution: number of segments, CDF and PDF values.
+    // Returns pointer past written data.
+    static int* WriteDistribution1D(Distribution1D const& distribution, int* data)
+    {
+        // Write the number of segments first
+        *data++ = (int)distribution.m_num_segments;
+
+        // Then write num_segments  + 1 CDF values
+        auto values = reinterpret_cast<float*>(data);
+        for (auto i = 0u; i < distribution.m_num_segments + 1; ++i)
+        {
+            values[i] = distribution.m_cdf[i];
+        }
+
+        // Then write num_segments PDF values
+        values += distribution.m_num_segments + 1;
+
+        for (auto i = 0u; i < distribution.m_num_segments; ++i)
+        {
+            values[i] = distribution.m_func_values[i] / distribution.m_func_sum;
+        }
+
+        return data + 2 * distribution.m_num_segments + 1;
+    }
+
+    // Build and serialize envmap luminance distribution over (phi, theta) parametrization,
+    // which is a layout of lat-long envmaps (see Texture_SampleEnvMap).
+    // Layout: width, height, marginal distribution, height conditional distributions.
+    static void WriteEnvLightDistribution(Texture const& texture, std::vector<int>& data)
+    {
+        auto size = texture.GetSize();
+        auto width = std::min(size.x, kEnvDistributionMaxWidth);
+        auto height = std::min(size.y, kEnvDistributionMaxHeight);
+
+        std::vector<float> luminance(width * height);
+        float total = 0.f;
+
+        for (auto y = 0; y < height; ++y)
+        {
+            // Texel block corresponding to distribution cell
+            auto y0 = y * size.y / height;
+            auto y1 = std::max((y + 1) * size.y / height, y0 + 1);
+
+            for (auto x = 0; x < width; ++x)
+            {
+                auto x0 = x * size.x / width;
+                auto x1 = std::max((x + 1) * size.x / width, x0 + 1);
+
+                float value = 0.f;
+                for (auto j = y0; j < y1; ++j)
+                {
+                    for (auto i = x0; i < x1; ++i)
+                    {
+                        auto texel = texture.GetTexel(i, j);
+                        value += 0.2126f * texel.x + 0.7152f * texel.y + 0.0722f * texel.z;
+                    }
+                }
+
+                luminance[y * width + x] = value / ((y1 - y0) * (x1 - x0));
+                total += luminance[y * width + x];
+            }
+        }
+
+        // Keep all the directions reachable: filtering brings
+        // radiance from neighbouring texels into dark cells
+        auto min_luminance = 1e-3f * total / (width * height);
+
+        // Account for solid angle of the cells: rows go from theta = 0 to PI
+        std::vector<float> values(width * height);
+        for (auto y = 0; y < height; ++y)
+        {
+            auto sin_theta = std::sin(PI * (y + 0.5f) / height);
+
+            for (auto x = 0; x < width; ++x)
+            {
+                values[y * width + x] = (luminance[y * width + x] + min_luminance) * sin_theta;
+            }
+        }
+
+        Distribution2D distribution(&values[0], width, height);
+
+        std::size_t distribution_size = 2 + GetDistribution1DSize(distribution.m_marginal);
+        for (auto& conditional : distribution.m_conditional)
+        {
+            distribution_size += GetDistribution1DSize(conditional);
+        }
+
+        data.resize(distribution_size);
+
+        auto current = &data[0];
+        *current++ = width;
+        *current++ = height;
+        current = WriteDistribution1D(distribution.m_marginal, current);
+
+        for (auto& conditional : distribution.m_conditional)
+        {
+            current = WriteDistribution1D(conditional, current);
+        }
+    }
+
+    // Area light of an emissive triangle
+    struct AreaLightRef
+    {
+        int shape_idx;
+        int prim_idx;
+        int light_idx;
+    };
+
+    // Lookup of area lights by emissive triangle (see Scene_GetAreaLightIdx):
+    // table[0] is the number of shapes, table[1 + shape] is the offset of shape
+    // segment or -1, the segment holds the number of primitives followed by
+    // light indices (-1 for primitives without a light)
+    static void WriteAreaLightTable(std::vector<AreaLightRef> const& area_lights, std::vector<int>& table)
+    {
+        int num_shapes = 0;
+        std::map<int, int> num_prims;
+        for (auto const& area_light : area_lights)
+        {
+            num_shapes = std::max(num_shapes, area_light.shape_idx + 1);
+            auto& n = num_prims[area_light.shape_idx];
+            n = std::max(n, area_light.prim_idx + 1);
+        }
+
+        table.assign(1 + num_shapes, -1);
+        table[0] = num_shapes;
+
+        for (auto const& shape : num_prims)
+        {
+            table[1 + shape.first] = static_cast<int>(table.size());
+            table.push_back(shape.second);
+            table.resize(table.size() + shape.second, -1);
+        }
+
+        for (auto const& area_light : area_lights)
+        {
+            table[table[1 + area_light.shape_idx] + 1 + area_light.prim_idx] = area_light.light_idx;
+        }
+    }
+
+    // Describe finite light for light hierarchy, returns false for lights at infinity
+    static bool GetLightBvhPrimitive(Light const& light, LightBvh::Primitive& primitive)
+    {
+        switch (GetLightType(light))
+        {
+            case ClwScene::kPoint:
+            {
+                // Emits in all directions
+                primitive.bounds = bbox(light.GetPosition());
+                primitive.axis = float3(0.f, 0.f, 1.f);
+                primitive.cos_theta_o = -1.f;
+                primitive.cos_theta_e = 0.f;
+                return true;
+            }
+
+            case ClwScene::kSpot:
+            {
+                // Full intensity within inner cone, falls off up to outer one
+                auto cone_shape = static_cast<SpotLight const&>(light).GetConeShape();
+                primitive.bounds = bbox(light.GetPosition());
+                primitive.axis = normalize(light.GetDirection());
+                primitive.cos_theta_o = cone_shape.x;
+                primitive.cos_theta_e = std::cos(std::max(std::acos(cone_shape.y) - std::acos(cone_shape.x), 0.f));
+                return true;
+            }
+
+            case ClwScene::kArea:
+            {
+                auto const& area_light = static_cast<AreaLight const&>(light);
+                auto shape = area_light.GetShape();
+                auto mesh = GetGeometry(shape);
+                auto transform = shape->GetTransform();
+                auto indices = mesh->GetIndices() + 3 * area_light.GetPrimitiveIdx();
+                auto vertices = mesh->GetVertices();
+
+                float3 v[3];
+                for (auto i = 0; i < 3; ++i)
+                {
+                    v[i] = transform_point(vertices[indices[i]], transform);
+                }
+
+                primitive.bounds = bbox(v[0], v[1]);
+                primitive.bounds.grow(v[2]);
+
+                // Triangle emits around interpolated vertex normals (see AreaLight_Sample),
+                // bound them with a cone around their average
+                primitive.axis = normalize(cross(v[1] - v[0], v[2] - v[0]));
+                primitive.cos_theta_o = 1.f;
+                primitive.cos_theta_e = 0.f;
+
+                if (mesh->GetNumNormals() > 0)
+                {
+                    auto normals = mesh->GetNormals();
+
+                    float3 n[3];
+                    for (auto i = 0; i < 3; ++i)
+                    {
+                        n[i] = normalize(transform_vector(normals[indices[i]], transform));
+                    }
+
+                    auto axis = n[0] + n[1] + n[2];
+
+                    if (axis.sqnorm() > 1e-6f)
+                    {
+                        primitive.axis = normalize(axis);
+                        primitive.cos_theta_o = std::min({ dot(primitive.axis, n[0]), dot(primitive.axis, n[1]), dot(primitive.axis, n[2]) });
+                    }
+                    else
+                    {
+                        primitive.cos_theta_o = -1.f;
+                    }
+                }
+
+                return true;
+            }
+
+            default:
+                return false;
+        }
+    }
+
     void ClwSceneController::UpdateLights(Scene1 const& scene, Collector& mat_collector, Collector& tex_collector, ClwScene& out) const
     {
         std::size_t num_lights_written = 0;
         
         auto num_lights = scene.GetNumLights();
-        auto distribution_buffer_size = (1 + 1 + num_lights + num_lights);
 
         // Create light buffer if needed
         if (num_lights > out.lights.GetElementCount())
         {
             out.lights = m_context.CreateBuffer<ClwScene::Light>(num_lights, CL_MEM_READ_ONLY);
-            out.light_distributions = m_context.CreateBuffer<int>(distribution_buffer_size, CL_MEM_READ_ONLY);
         }
 
         ClwScene::Light* lights = nullptr;
@@ -1443,19 +1864,45 @@ namespace Baikal
         std::vector<float> light_power(num_lights);
         std::uint32_t k = 0;
 
+        // Finite lights go to light hierarchy
+        std::vector<LightBvh::Primitive> bvh_primitives;
+        std::vector<std::size_t> bvh_lights;
+        // Emissive hits look their lights up for MIS
+        std::vector<AreaLightRef> area_lights;
+
         // Serialize
         {
             for (; light_iter->IsValid(); light_iter->Next())
             {
                 auto light = light_iter->ItemAs<Light>();
-                WriteLight(scene, *light, tex_collector, lights + num_lights_written);
+                WriteLight(out, *light, tex_collector, lights + num_lights_written);
+
+                LightBvh::Primitive primitive;
+                if (GetLightBvhPrimitive(*light, primitive))
+                {
+                    bvh_primitives.push_back(primitive);
+                    bvh_lights.push_back(num_lights_written);
+                }
+
+                auto const& clw_light = lights[num_lights_written];
+                if (clw_light.type == ClwScene::kArea && clw_light.shapeidx >= 0)
+                {
+                    area_lights.push_back(AreaLightRef{ clw_light.shapeidx, clw_light.primidx, static_cast<int>(num_lights_written) });
+                }
 
-                
                 // Find and update IBL idx
                 auto ibl = std::dynamic_pointer_cast<ImageBasedLight>(light_iter->ItemAs<Light>());
                 if (ibl)
                 {
                     out.envmapidx = static_cast<int>(num_lights_written);
+
+                    // Envmap distribution is expensive, so only rebuild it if envmap changed
+                    auto tex = ibl->GetTexture();
+                    if (tex && (ibl->IsDirty() || tex->IsDirty() || tex != out.env_light_texture))
+                    {
+                        WriteEnvLightDistribution(*tex, out.env_light_distribution);
+                        out.env_light_texture = tex;
+                    }
                 }
 
                 ++num_lights_written;
@@ -1468,40 +1915,290 @@ namespace Baikal
             }
         }
 
-        m_context.UnmapBuffer(0, out.lights, lights);
-
         // Create distribution over light sources based on their power
         Distribution1D light_distribution(&light_power[0], (std::uint32_t)light_power.size());
 
-        // Write distribution data
-        int* distribution_ptr = nullptr;
-        m_context.MapBuffer(0, out.light_distributions, CL_MAP_WRITE, &distribution_ptr).Wait();
-        auto current = distribution_ptr;
+        // Hierarchy is weighted by selection probabilities, so its root holds
+        // the probability of choosing any finite light
+        for (auto i = 0u; i < bvh_primitives.size(); ++i)
+        {
+            auto light_idx = bvh_lights[i];
+            bvh_primitives[i].power = light_distribution.m_cdf[light_idx + 1] - light_distribution.m_cdf[light_idx];
+        }
 
-        // Write the number of segments first
-        *current++ = (int)light_distribution.m_num_segments;
+        LightBvh light_bvh;
+        light_bvh.Build(bvh_primitives);
 
-        // Then write num_segments  + 1 CDF values
-        auto values = reinterpret_cast<float*>(current);
-        for (auto i = 0u; i < light_distribution.m_num_segments + 1; ++i)
+        for (auto i = 0u; i < num_lights_written; ++i)
         {
-            values[i] = light_distribution.m_cdf[i];
+            lights[i].bvh_trail = 0;
+            lights[i].bvh_depth = -1;
         }
 
-        // Then write num_segments PDF values
-        values += light_distribution.m_num_segments + 1;
+        for (auto i = 0u; i < bvh_primitives.size(); ++i)
+        {
+            auto& light = lights[bvh_lights[i]];
+            light.bvh_trail = static_cast<int>(light_bvh.m_paths[i].trail);
+            light.bvh_depth = light_bvh.m_paths[i].depth;
+        }
 
-        for (auto i = 0u; i < light_distribution.m_num_segments; ++i)
+        m_context.UnmapBuffer(0, out.lights, lights);
+
+        // Keep a single empty node if there are no finite lights
+        auto num_nodes = std::max<std::size_t>(light_bvh.m_nodes.size(), 1);
+
+        if (num_nodes > out.light_bvh.GetElementCount())
+        {
+            out.light_bvh = m_context.CreateBuffer<ClwScene::LightBvhNode>(num_nodes, CL_MEM_READ_ONLY);
+        }
+
+        ClwScene::LightBvhNode* nodes = nullptr;
+        m_context.MapBuffer(0, out.light_bvh, CL_MAP_WRITE, &nodes).Wait();
+
+        if (light_bvh.m_nodes.empty())
+        {
+            nodes[0] = ClwScene::LightBvhNode();
+            nodes[0].right = -1;
+            nodes[0].light_idx = -1;
+        }
+
+        for (auto i = 0u; i < light_bvh.m_nodes.size(); ++i)
+        {
+            auto const& node = light_bvh.m_nodes[i];
+            nodes[i].pmin = node.bounds.pmin;
+            nodes[i].pmax = node.bounds.pmax;
+            nodes[i].axis = node.axis;
+            nodes[i].cos_theta_o = node.cos_theta_o;
+            nodes[i].cos_theta_e = node.cos_theta_e;
+            nodes[i].power = node.power;
+            nodes[i].right = node.right;
+            nodes[i].light_idx = node.primitive >= 0 ? static_cast<int>(bvh_lights[node.primitive]) : -1;
+        }
+
+        m_context.UnmapBuffer(0, out.light_bvh, nodes);
+
+        std::vector<int> area_light_table;
+        WriteAreaLightTable(area_lights, area_light_table);
+
+        if (area_light_table.size() > out.area_lights.GetElementCount())
+        {
+            out.area_lights = m_context.CreateBuffer<int>(area_light_table.size(), CL_MEM_READ_ONLY);
+        }
+
+        int* area_light_ptr = nullptr;
+        m_context.MapBuffer(0, out.area_lights, CL_MAP_WRITE, &area_light_ptr).Wait();
+        std::copy(area_light_table.cbegin(), area_light_table.cend(), area_light_ptr);
+        m_context.UnmapBuffer(0, out.area_lights, area_light_ptr);
+
+        // No envmap: empty distribution
+        if (out.envmapidx == -1 || !out.env_light_texture)
+        {
+            out.env_light_distribution.assign(1, 0);
+            out.env_light_texture = nullptr;
+        }
+
+        // Envmap distribution goes right after light selection distribution
+        auto distribution_buffer_size = GetDistribution1DSize(light_distribution) + out.env_light_distribution.size();
+
+        if (distribution_buffer_size > out.light_distributions.GetElementCount())
         {
-            values[i] = light_distribution.m_func_values[i] / light_distribution.m_func_sum;
+            out.light_distributions = m_context.CreateBuffer<int>(distribution_buffer_size, CL_MEM_READ_ONLY);
         }
 
+        // Write distribution data
+        int* distribution_ptr = nullptr;
+        m_context.MapBuffer(0, out.light_distributions, CL_MAP_WRITE, &distribution_ptr).Wait();
+
+        auto current = WriteDistribution1D(light_distribution, distribution_ptr);
+        std::copy(out.env_light_distribution.cbegin(), out.env_light_distribution.cend(), current);
+
         m_context.UnmapBuffer(0, out.light_distributions, distribution_ptr);
 
         out.num_lights = static_cast<int>(num_lights_written);
     }
     
     
+    void ClwSceneController::UpdateTileLayout(std::vector<Texture::Ptr> const& textures, ClwScene& out) const
+    {
+        static_assert(TiledImage::kTileSizeInBytes == ClwScene::kTextureTileSizeInBytes, "Tile size mismatch");
+
+        // Tile sources are about to be released
+        if (out.tile_streamer)
+        {
+            out.tile_streamer->Clear();
+        }
+
+        // Feedback refers to the old layout
+        if (out.pagetable_feedback_pending)
+        {
+            out.pagetable_feedback_event.Wait();
+            out.pagetable_feedback_pending = false;
+        }
+
+        out.virtual_textures = textures;
+        out.page_offsets.clear();
+        out.page_sources.clear();
+
+        // Page table covers all tiles of all virtual textures,
+        // tiles of the coarsest level are always resident
+        std::vector<int> pinned_pages;
+        for (auto const& tex : textures)
+        {
+            auto tiled_image = tex->GetTiledImage();
+            auto page_offset = out.page_sources.size();
+            auto num_levels = std::min<int>(tiled_image->GetNumLevels(), ClwScene::kMaxTextureMipLevels);
+            auto last_level_tiles = tiled_image->GetNumTiles(num_levels - 1);
+            auto last_level_begin = tiled_image->GetFirstTile(num_levels - 1);
+            auto last_level_end = last_level_begin + last_level_tiles.x * last_level_tiles.y;
+
+            for (auto i = 0u; i < last_level_end; ++i)
+            {
+                out.page_sources.push_back(tiled_image->GetTile(i));
+            }
+
+            for (auto i = last_level_begin; i < last_level_end; ++i)
+            {
+                pinned_pages.push_back(static_cast<int>(page_offset + i));
+            }
+
+            out.page_offsets.emplace(tex, page_offset);
+        }
+
+        auto num_pages = out.page_sources.size();
+
+        if (num_pages == 0)
+        {
+            out.tilecache = m_context.CreateBuffer<char>(1, CL_MEM_READ_ONLY);
+            out.pagetable = m_context.CreateBuffer<RadeonRays::int2>(1, CL_MEM_READ_WRITE);
+            out.tile_residency.Reset(0, 0);
+            return;
+        }
+
+        auto num_slots = std::min(m_tile_cache_size / ClwScene::kTextureTileSizeInBytes, num_pages);
+
+        if (num_slots < pinned_pages.size())
+        {
+            throw std::runtime_error("Tile cache is too small to keep coarse levels of virtual textures");
+        }
+
+        LogInfo("Creating tile cache: ", num_slots, " tiles for ", num_pages, " pages...\n");
+        out.tilecache = m_context.CreateBuffer<char>(num_slots * ClwScene::kTextureTileSizeInBytes, CL_MEM_READ_ONLY);
+        out.pagetable = m_context.CreateBuffer<RadeonRays::int2>(num_pages, CL_MEM_READ_WRITE);
+        out.tile_residency.Reset(num_slots, num_pages);
+
+        if (!out.tile_streamer)
+        {
+            out.tile_streamer.reset(new TileStreamer());
+        }
+
+        for (auto page : pinned_pages)
+        {
+            auto slot = out.tile_residency.Pin(page);
+            m_context.WriteBuffer(0, out.tilecache, const_cast<char*>(out.page_sources[page]),
+                                  slot * ClwScene::kTextureTileSizeInBytes, ClwScene::kTextureTileSizeInBytes);
+        }
+
+        std::vector<RadeonRays::int2> pagetable(num_pages);
+        for (auto i = 0u; i < num_pages; ++i)
+        {
+            pagetable[i] = RadeonRays::int2(out.tile_residency.GetSlot(static_cast<int>(i)), 0);
+        }
+
+        m_context.WriteBuffer(0, out.pagetable, pagetable.data(), num_pages);
+        m_context.Finish(0);
+    }
+
+    void ClwSceneController::UpdateStreamedData(Scene1 const& scene, ClwScene& out) const
+    {
+        auto num_pages = out.tile_residency.GetNumPages();
+
+        if (num_pages == 0)
+        {
+            return;
+        }
+
+        // Access flags are read back without waiting and consumed by the next update,
+        // so frames are never synchronized with the host
+        if (!out.pagetable_feedback_pending)
+        {
+            out.pagetable_feedback.resize(num_pages);
+            out.pagetable_feedback_event = m_context.ReadBuffer(0, out.pagetable, out.pagetable_feedback.data(), num_pages);
+            out.pagetable_feedback_pending = true;
+            return;
+        }
+
+        if (out.pagetable_feedback_event.GetCommandExecutionStatus() != CL_COMPLETE)
+        {
+            return;
+        }
+
+        out.pagetable_feedback_pending = false;
+
+        // Pages accessed by kernels before the readback
+        auto& pagetable = out.pagetable_feedback;
+
+        std::vector<int> accessed_pages;
+        for (auto i = 0u; i < num_pages; ++i)
+        {
+            if (pagetable[i].y != 0)
+            {
+                accessed_pages.push_back(static_cast<int>(i));
+            }
+        }
+
+        std::vector<int> misses;
+        out.tile_residency.Update(accessed_pages, misses);
+
+        // Tiles uploaded by the previous update are on the device, the readback went after them
+        out.uploaded_tiles.clear();
+
+        // Upload tiles loaded since the last update, they replace tiles not used by the last frame
+        std::vector<TileStreamer::Tile> tiles;
+        out.tile_streamer->Pop(tiles);
+
+        for (auto& tile : tiles)
+        {
+            auto slot = out.tile_residency.Insert(tile.page);
+
+            // Cache is full of tiles which are in use, the rest is requested again later
+            if (slot < 0)
+            {
+                break;
+            }
+
+            m_context.WriteBuffer(0, out.tilecache, tile.data.data(),
+                                  slot * ClwScene::kTextureTileSizeInBytes, ClwScene::kTextureTileSizeInBytes);
+        }
+
+        // Request missing tiles, rendering uses coarser levels until they arrive
+        std::vector<TileStreamer::Request> requests;
+        for (auto page : misses)
+        {
+            if (requests.size() == kMaxTileRequests)
+            {
+                break;
+            }
+
+            if (out.tile_residency.GetSlot(page) < 0)
+            {
+                requests.push_back(TileStreamer::Request{ page, out.page_sources[page], ClwScene::kTextureTileSizeInBytes });
+            }
+        }
+
+        out.tile_streamer->Push(requests);
+
+        // Refresh residency and reset access flags
+        for (auto i = 0u; i < num_pages; ++i)
+        {
+            pagetable[i] = RadeonRays::int2(out.tile_residency.GetSlot(static_cast<int>(i)), 0);
+        }
+
+        m_context.WriteBuffer(0, out.pagetable, pagetable.data(), num_pages);
+
+        // Tile data is referenced until the next readback completes
+        out.uploaded_tiles = std::move(tiles);
+    }
+
     // Convert texture format into ClwScene:: types
     static ClwScene::TextureFormat GetTextureFormat(Texture const& texture)
     {
@@ -1510,6 +2207,9 @@ namespace Baikal
             case Texture::Format::kRgba8: return ClwScene::TextureFormat::RGBA8;
             case Texture::Format::kRgba16: return ClwScene::TextureFormat::RGBA16;
             case Texture::Format::kRgba32: return ClwScene::TextureFormat::RGBA32;
+            case Texture::Format::kBc1: return ClwScene::TextureFormat::BC1;
+            case Texture::Format::kBc3: return ClwScene::TextureFormat::BC3;
+            case Texture::Format::kBc5: return ClwScene::TextureFormat::BC5;
             default: return ClwScene::TextureFormat::RGBA8;
         }
     }
@@ -1523,7 +2223,33 @@ namespace Baikal
         clw_texture->w = dim.x;
         clw_texture->h = dim.y;
         clw_texture->fmt = GetTextureFormat(texture);
+
+        if (auto tiled_image = texture.GetTiledImage())
+        {
+            // Data offset is the first page in page table for virtual textures
+            clw_texture->dataoffset = 0;
+            clw_texture->tiled = 1;
+            clw_texture->num_levels = std::min<int>(tiled_image->GetNumLevels(), ClwScene::kMaxTextureMipLevels);
+
+            for (auto i = 0; i < clw_texture->num_levels; ++i)
+            {
+                clw_texture->mip_offsets[i] = static_cast<int>(data_offset + tiled_image->GetFirstTile(i));
+            }
+
+            return;
+        }
+
         clw_texture->dataoffset = static_cast<int>(data_offset);
+        clw_texture->tiled = 0;
+        clw_texture->num_levels = GetMipLevelCount(texture);
+
+        // Mip levels are packed one after another
+        std::size_t level_offset = 0;
+        for (auto i = 0; i < clw_texture->num_levels; ++i)
+        {
+            clw_texture->mip_offsets[i] = static_cast<int>(level_offset);
+            level_offset += Texture::GetLevelSizeInBytes(texture.GetFormat(), GetMipLevelSize(texture, i));
+        }
     }
     
     void ClwSceneController::WriteTextureData(Texture const& texture, void* data) const
@@ -1531,5 +2257,34 @@ namespace Baikal
         auto begin = texture.GetData();
         auto end = begin + texture.GetSizeInBytes();
         std::copy(begin, end, static_cast<char*>(data));
+
+        auto num_levels = GetMipLevelCount(texture);
+
+        if (num_levels == 1)
+        {
+            return;
+        }
+
+        // Build mip chain with 2x2 box filter, keeping previous level in floats
+        // to avoid reading back from (potentially mapped) destination memory
+        auto format = texture.GetFormat();
+        auto size = texture.GetSize();
+
+        std::vector<float> level;
+        Texture::ReadTexels(format, begin, size, level);
+
+        auto dst = static_cast<char*>(data) + texture.GetSizeInBytes();
+
+        for (auto l = 1; l < num_levels; ++l)
+        {
+            std::vector<float> next_level;
+            auto next_size = Texture::Downsample(level, size, next_level);
+
+            Texture::WriteTexels(format, next_level, next_size, dst);
+
+            dst += Texture::GetLevelSizeInBytes(format, next_size);
+            level.swap(next_level);
+            size = next_size;
+        }
     }
 }
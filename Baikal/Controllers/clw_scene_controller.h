@@ -43,6 +43,7 @@ namespace Baikal
     class Material;
     class Light;
     class Texture;
+    class Shape;
 
 
     /**
@@ -64,6 +65,17 @@ namespace Baikal
         // Get underlying intersection API.
         RadeonRays::IntersectionApi* GetIntersectionApi() { return  m_api; }
 
+        // Set device memory size for virtual texture tiles
+        // (takes effect when virtual texture set changes)
+        void SetTileCacheSize(std::size_t size_in_bytes) { m_tile_cache_size = size_in_bytes; }
+        // Set layout of vertex data on the device
+        // (takes effect on the next shape update)
+        void SetVertexLayout(VertexLayout layout) { m_vertex_layout = layout; }
+        // Spill host geometry of uploaded meshes into memory mapped files in the
+        // directory, so it is paged back only when read again (empty path keeps
+        // geometry in memory)
+        void SetGeometrySpillPath(std::string const& path) { m_geometry_spill_path = path; }
+
     protected:
         // Clear intersector and load meshes into it.
         void ReloadIntersector(Scene1 const& scene, ClwScene& inout) const;
@@ -85,6 +97,8 @@ namespace Baikal
         Material::Ptr GetDefaultMaterial() const override;
         // If m_current_scene changes
         void UpdateCurrentScene(Scene1 const& scene, ClwScene& out) const override;
+        // Upload streamed virtual texture tiles and request missing ones.
+        void UpdateStreamedData(Scene1 const& scene, ClwScene& out) const override;
         
         // Update intersection API
         void UpdateIntersector(Scene1 const& scene, ClwScene& out) const;
@@ -94,7 +108,7 @@ namespace Baikal
         void WriteMaterial(Material const& material, Collector& mat_collector, Collector& tex_collector, void* data) const;
         // Write out single light at data pointer.
         // Collector is required to convert texture pointers into indices.
-        void WriteLight(Scene1 const& scene, Light const& light, Collector& tex_collector, void* data) const;
+        void WriteLight(ClwScene const& out, Light const& light, Collector& tex_collector, void* data) const;
         // Write out single texture header at data pointer.
         // Header requires texture data offset, so it is passed in.
         void WriteTexture(Texture const& texture, std::size_t data_offset, void* data) const;
@@ -102,11 +116,26 @@ namespace Baikal
         void WriteTextureData(Texture const& texture, void* data) const;
 
     private:
+        // Get material index for a shape (default material is used if none is set)
+        int GetMaterialIndex(Shape const& shape, Collector& mat_collector) const;
+        // Build page table for virtual textures and reset tile cache
+        void UpdateTileLayout(std::vector<Texture::Ptr> const& textures, ClwScene& out) const;
+        // Move host geometry of uploaded meshes into spill files
+        void SpillGeometry(std::vector<Mesh::Ptr> const& meshes) const;
+
         // Context
         CLWContext m_context;
         // Intersection API
         RadeonRays::IntersectionApi* m_api;
         // Default material
         Material::Ptr m_default_material;
+        // Tile cache size in bytes
+        std::size_t m_tile_cache_size;
+        // Vertex layout of geometry pools
+        VertexLayout m_vertex_layout;
+        // Directory for spilled mesh geometry
+        std::string m_geometry_spill_path;
+        // Number of spill files created, used to name them
+        mutable std::size_t m_num_spill_files;
     };
 }
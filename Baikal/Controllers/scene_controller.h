@@ -83,6 +83,8 @@ namespace Baikal
         virtual Material::Ptr GetDefaultMaterial() const = 0;
         // If m_current_scene changes
         virtual void UpdateCurrentScene(Scene1 const& scene, CompiledScene& out) const = 0;
+        // Called on every compile: stream data requested by previously rendered frames
+        virtual void UpdateStreamedData(Scene1 const& scene, CompiledScene& out) const = 0;
         
     private:
         mutable Scene1::Ptr m_current_scene;
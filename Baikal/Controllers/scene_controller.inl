@@ -47,120 +47,132 @@ namespace Baikal
         // As soon as we have this mapping we are analyzing dirty flags and
         // updating necessary parts.
         
-        // We need to make sure collectors are empty before proceeding
-        m_material_collector.Clear();
-        m_texture_collector.Clear();
+        // Collectors keep their state between compiles: objects which are
+        // still referenced keep their indices, the rest is released on commit.
 
-        // Create shape and light iterators
-        auto shape_iter = scene->CreateShapeIterator();
-        auto light_iter = scene->CreateLightIterator();
+        // Dependencies need to be recollected only if the scene structure might have changed:
+        // objects attached or detached, shapes or lights changed (and thus might reference
+        // other materials), material inputs changed. Camera only changes skip this step.
+        auto dirty = scene->GetDirtyFlags();
+        bool should_collect = m_current_scene != scene ||
+            (dirty & (Scene1::kShapes | Scene1::kLights)) != 0 ||
+            scene->HasDirtyShapes() ||
+            scene->HasDirtyLights() ||
+            m_material_collector.HasChanges();
         
-        auto default_material = GetDefaultMaterial();
-        // Collect materials from shapes first
-        m_material_collector.Collect(*shape_iter,
-                              // This function adds all materials to resulting map
-                              // recursively via Material dependency API
-                              [default_material](SceneObject::Ptr item) ->
-                              std::set<SceneObject::Ptr>
-                              {
-                                  // Resulting material set
-                                  std::set<SceneObject::Ptr> mats;
-                                  // Material stack
-                                  std::stack<Material::Ptr> material_stack;
+        if (should_collect)
+        {
+            // Create shape and light iterators
+            auto shape_iter = scene->CreateShapeIterator();
+            auto light_iter = scene->CreateLightIterator();
+        
+            auto default_material = GetDefaultMaterial();
+            // Collect materials from shapes first
+            m_material_collector.Collect(*shape_iter,
+                                  // This function adds all materials to resulting map
+                                  // recursively via Material dependency API
+                                  [default_material](SceneObject::Ptr item) ->
+                                  std::vector<SceneObject::Ptr>
+                                  {
+                                      // Resulting materials (collector skips duplicates)
+                                      std::vector<SceneObject::Ptr> mats;
+                                      // Material stack
+                                      std::stack<Material::Ptr> material_stack;
                                   
-                                  // Get material from current shape
-                                  auto shape = std::static_pointer_cast<Shape>(item);
-                                  auto material = shape->GetMaterial();
+                                      // Get material from current shape
+                                      auto shape = std::static_pointer_cast<Shape>(item);
+                                      auto material = shape->GetMaterial();
                                   
-                                  // If shape does not have a material, use default one
-                                  if (!material)
-                                  {
-                                      material = default_material;
-                                  }
+                                      // If shape does not have a material, use default one
+                                      if (!material)
+                                      {
+                                          material = default_material;
+                                      }
                                   
-                                  // Push to stack as an initializer
-                                  material_stack.push(material);
+                                      // Push to stack as an initializer
+                                      material_stack.push(material);
                                   
-                                  // Drain the stack
-                                  while (!material_stack.empty())
-                                  {
-                                      // Get current material
-                                      auto m = material_stack.top();
-                                      material_stack.pop();
+                                      // Drain the stack
+                                      while (!material_stack.empty())
+                                      {
+                                          // Get current material
+                                          auto m = material_stack.top();
+                                          material_stack.pop();
                                       
-                                      // Emplace into the set
-                                      mats.emplace(m);
+                                          // Emplace into the list
+                                          mats.push_back(m);
                                       
-                                      // Create dependency iterator
-                                      auto mat_iter = m->CreateMaterialIterator();
+                                          // Create dependency iterator
+                                          auto mat_iter = m->CreateMaterialIterator();
                                       
-                                      // Push all dependencies into the stack
-                                      for (; mat_iter->IsValid(); mat_iter->Next())
-                                      {
-                                          material_stack.push(
-                                            mat_iter->ItemAs<Material>()
-                                          );
+                                          // Push all dependencies into the stack
+                                          for (; mat_iter->IsValid(); mat_iter->Next())
+                                          {
+                                              material_stack.push(
+                                                mat_iter->ItemAs<Material>()
+                                              );
+                                          }
                                       }
-                                  }
                                   
-                                  // Return resulting set
-                                  return mats;
-                              });
+                                      // Return resulting list
+                                      return mats;
+                                  });
         
-        // Commit stuff (we can iterate over it after commit has happened)
-        m_material_collector.Commit();
+            // Commit stuff (we can iterate over it after commit has happened)
+            m_material_collector.Commit();
         
-        // Now we need to collect textures from our materials
-        // Create material iterator
-        auto mat_iter = m_material_collector.CreateIterator();
+            // Now we need to collect textures from our materials
+            // Create material iterator
+            auto mat_iter = m_material_collector.CreateIterator();
         
-        // Collect textures from materials
-        m_texture_collector.Collect(*mat_iter,
-                                    [](SceneObject::Ptr item) -> std::set<SceneObject::Ptr>
-                              {
-                                  // Texture set
-                                  std::set<SceneObject::Ptr> textures;
+            // Collect textures from materials
+            m_texture_collector.Collect(*mat_iter,
+                                        [](SceneObject::Ptr item) -> std::vector<SceneObject::Ptr>
+                                  {
+                                      // Texture list
+                                      std::vector<SceneObject::Ptr> textures;
                                   
-                                  auto material = std::static_pointer_cast<Material>(item);
+                                      auto material = std::static_pointer_cast<Material>(item);
                                   
-                                  // Create texture dependency iterator
-                                  auto tex_iter = material->CreateTextureIterator();
+                                      // Create texture dependency iterator
+                                      auto tex_iter = material->CreateTextureIterator();
                                   
-                                  // Emplace all dependent textures
-                                  for (; tex_iter->IsValid(); tex_iter->Next())
-                                  {
-                                      textures.emplace(tex_iter->ItemAs<Texture>());
-                                  }
+                                      // Emplace all dependent textures
+                                      for (; tex_iter->IsValid(); tex_iter->Next())
+                                      {
+                                          textures.push_back(tex_iter->ItemAs<Texture>());
+                                      }
                                   
-                                  // Return resulting set
-                                  return textures;
-                              });
+                                      // Return resulting list
+                                      return textures;
+                                  });
         
         
-        // Collect textures from lights
-        m_texture_collector.Collect(*light_iter,
-                                    [](SceneObject::Ptr item) -> std::set<SceneObject::Ptr>
-                              {
-                                  // Resulting set
-                                  std::set<SceneObject::Ptr> textures;
+            // Collect textures from lights
+            m_texture_collector.Collect(*light_iter,
+                                        [](SceneObject::Ptr item) -> std::vector<SceneObject::Ptr>
+                                  {
+                                      // Resulting list
+                                      std::vector<SceneObject::Ptr> textures;
                                   
-                                  auto light = std::static_pointer_cast<Light>(item);
+                                      auto light = std::static_pointer_cast<Light>(item);
                                   
-                                  // Create texture dependency iterator
-                                  auto tex_iter = light->CreateTextureIterator();
+                                      // Create texture dependency iterator
+                                      auto tex_iter = light->CreateTextureIterator();
                                   
-                                  // Emplace all dependent textures
-                                  for (; tex_iter->IsValid(); tex_iter->Next())
-                                  {
-                                      textures.emplace(tex_iter->ItemAs<Texture>());
-                                  }
+                                      // Emplace all dependent textures
+                                      for (; tex_iter->IsValid(); tex_iter->Next())
+                                      {
+                                          textures.push_back(tex_iter->ItemAs<Texture>());
+                                      }
                                   
-                                  // Return resulting set
-                                  return textures;
-                              });
+                                      // Return resulting list
+                                      return textures;
+                                  });
 
-        // Commit textures
-        m_texture_collector.Commit();
+            // Commit textures
+            m_texture_collector.Commit();
+        }
         
         // Try to find scene in cache first
         auto iter = m_scene_cache.find(scene);
@@ -185,7 +197,14 @@ namespace Baikal
                                        auto material = std::static_pointer_cast<Material>(item);
                                        material->SetDirty(false);
                                    });
-            
+
+            // Drop dirty flags for textures, they have just been uploaded
+            m_texture_collector.Finalize([](SceneObject::Ptr item)
+            {
+                auto tex = std::static_pointer_cast<Texture>(item);
+                tex->SetDirty(false);
+            });
+
             // Return the scene
             return res.first->second;
         }
@@ -193,7 +212,6 @@ namespace Baikal
         {
             // Exctract cached scene entry
             auto& out = iter->second;
-            auto dirty = scene->GetDirtyFlags();
 
             bool should_update_materials = !out.material_bundle ||
                 m_material_collector.NeedsUpdate(out.material_bundle.get(),
@@ -226,70 +244,50 @@ namespace Baikal
                 UpdateCamera(*scene, m_material_collector, m_texture_collector, out);
             }
             
+            // Attached shapes report their changes to the scene
+            bool shapes_changed = scene->HasDirtyShapes();
+
+            // Collectors are shared between cached scenes, so switching scenes
+            // might move material and texture indices. Shape material ids and
+            // lights reference them and need to be rewritten.
+            bool scene_switched = m_current_scene != scene;
+
+            // Shapes go before lights: area lights use shape indices established there
             {
-                // Check if we have lights in the scene
-                auto light_iter = scene->CreateLightIterator();
-                
-                if (!light_iter->IsValid())
+                // Check if we have shapes in the scene
+                if (scene->GetNumShapes() == 0)
                 {
-                    throw std::runtime_error("No lights in the scene");
+                    throw std::runtime_error("No shapes in the scene");
                 }
-                
-                
-                // Check if light parameters have been changed
-                bool lights_changed = false;
-                
-                for (; light_iter->IsValid(); light_iter->Next())
+
+                // Update shapes if needed
+                if (dirty & Scene1::kShapes)
                 {
-                    auto light = light_iter->ItemAs<Light>();
-                    
-                    if (light->IsDirty())
-                    {
-                        lights_changed = true;
-                        break;
-                    }
+                    UpdateShapes(*scene, m_material_collector, m_texture_collector, out);
                 }
-                
-                
-                // Update lights if needed
-                if (dirty & Scene1::kLights || lights_changed || 
-                    should_update_textures || should_update_materials)
+                else if (shapes_changed || scene_switched)
                 {
-                    UpdateLights(*scene, m_material_collector, m_texture_collector, out);
+                    UpdateShapeProperties(*scene, m_material_collector, m_texture_collector, out);
                 }
             }
             
             {
-                // Check if we have shapes in the scene
-                auto shape_iter = scene->CreateShapeIterator();
-                
-                if (!shape_iter->IsValid())
+                // Check if we have lights in the scene
+                if (scene->GetNumLights() == 0)
                 {
-                    throw std::runtime_error("No shapes in the scene");
+                    throw std::runtime_error("No lights in the scene");
                 }
                 
-                // Check if shape parameters have been changed
-                bool shapes_changed = false;
+                // Attached lights report their changes to the scene
+                bool lights_changed = scene->HasDirtyLights();
                 
-                for (; shape_iter->IsValid(); shape_iter->Next())
+                // Update lights if needed. Area lights reference shapes
+                // by index and are bounded in world space for light hierarchy,
+                // so shape changes require light update too.
+                if (dirty & Scene1::kLights || dirty & Scene1::kShapes || lights_changed || shapes_changed ||
+                    should_update_textures || should_update_materials || scene_switched)
                 {
-                    auto shape = shape_iter->ItemAs<Shape>();
-
-                    if (shape->IsDirty())
-                    {
-                        shapes_changed = true;
-                        break;
-                    }
-                }
-
-                // Update shapes if needed
-                if (dirty & Scene1::kShapes)
-                {
-                    UpdateShapes(*scene, m_material_collector, m_texture_collector, out);
-                }
-                else if (shapes_changed)
-                {
-                    UpdateShapeProperties(*scene, m_material_collector, m_texture_collector, out);
+                    UpdateLights(*scene, m_material_collector, m_texture_collector, out);
                 }
             }
             
@@ -306,8 +304,11 @@ namespace Baikal
                 UpdateTextures(*scene, m_material_collector, m_texture_collector, out);
             }
 
+            // Virtual texture tiles are streamed in between frames
+            UpdateStreamedData(*scene, out);
+
             // Set current scene
-            if (m_current_scene != scene)
+            if (scene_switched)
             {
                 m_current_scene = scene;
 
@@ -341,10 +342,10 @@ namespace Baikal
     {
         UpdateCamera(scene, m_material_collector, m_texture_collector, out);
         
-        UpdateLights(scene, m_material_collector, m_texture_collector, out);
-        
         UpdateShapes(scene, m_material_collector, m_texture_collector, out);
         
+        UpdateLights(scene, m_material_collector, m_texture_collector, out);
+        
         UpdateMaterials(scene, m_material_collector, m_texture_collector, out);
         
         UpdateTextures(scene, m_material_collector, m_texture_collector, out);
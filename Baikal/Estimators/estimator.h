@@ -29,6 +29,7 @@ THE SOFTWARE.
 
 #include <array>
 #include <memory>
+#include <vector>
 
 namespace Baikal
 {
@@ -67,11 +68,18 @@ namespace Baikal
             float primary_throughput;
             float secondary_throughput;
             float shadow_throughput;
+            // Secondary rays throughput after sorting and the time
+            // it takes to sort them (ms)
+            float sorted_secondary_throughput;
+            float ray_sort_time;
         };
 
         Estimator(std::shared_ptr<RadeonRays::IntersectionApi> api)
             : m_intersector(api)
             , m_max_bounces(5u)
+            , m_compacted_launch(false)
+            , m_material_sorting(false)
+            , m_ray_sorting_bounces(0u)
         {
         }
 
@@ -90,6 +98,14 @@ namespace Baikal
         */
         virtual std::size_t GetWorkBufferSize() const = 0;
 
+        /**
+        \brief Returns device memory size taken by a single work buffer entry in bytes.
+
+        Clients use it to derive work buffer size from memory budget. Memory
+        allocated by the intersector internally is not included.
+        */
+        virtual std::size_t GetWorkBufferItemSize() const = 0;
+
         /**
         \brief Set random seed value for the renderer. Renders
         with the same random seed are guaranteed to be the same.
@@ -266,12 +282,104 @@ namespace Baikal
             return m_max_bounces;
         }
 
+        /**
+        \brief Size kernel launches by the number of active rays.
+
+        By default kernels are launched over the whole ray buffer and threads of
+        terminated paths exit early. In compacted mode the number of rays left after
+        stream compaction is read back at every bounce and used as a launch size.
+        This costs a synchronization per bounce, but saves most of the launches
+        in deep bounces.
+
+        \param enable
+        */
+        void SetCompactedLaunch(bool enable) {
+            m_compacted_launch = enable;
+        }
+
+        /**
+        \brief Check whether kernel launches are sized by the number of active rays.
+        */
+        bool GetCompactedLaunch() const {
+            return m_compacted_launch;
+        }
+
+        /**
+        \brief Shade hits in the order of their materials.
+
+        Hits are sorted by BxDF type and material after compaction, so that threads
+        of a wavefront run the same shading code. Sorting has a cost of its own and
+        only pays off for scenes with many different materials.
+
+        \param enable
+        */
+        void SetMaterialSorting(bool enable) {
+            m_material_sorting = enable;
+        }
+
+        /**
+        \brief Check whether hits are shaded in the order of their materials.
+        */
+        bool GetMaterialSorting() const {
+            return m_material_sorting;
+        }
+
+        /**
+        \brief Sort rays of a bounce before intersecting them.
+
+        Rays are sorted by direction octant and Morton code of their origin, which
+        makes intersector memory access more coherent. Primary rays are coherent
+        already, so this only applies to bounces starting from 1.
+
+        \param bounce Bounce index (1 - first secondary bounce)
+        \param enable
+        */
+        void SetRaySorting(std::uint32_t bounce, bool enable) {
+            if (bounce >= 32)
+            {
+                return;
+            }
+
+            if (enable)
+            {
+                m_ray_sorting_bounces |= (1u << bounce);
+            }
+            else
+            {
+                m_ray_sorting_bounces &= ~(1u << bounce);
+            }
+        }
+
+        /**
+        \brief Check whether rays of a bounce are sorted.
+        */
+        bool GetRaySorting(std::uint32_t bounce) const {
+            return bounce > 0 && bounce < 32 && (m_ray_sorting_bounces & (1u << bounce)) != 0;
+        }
+
+        /**
+        \brief Get number of active rays at each bounce of the last estimate.
+
+        Counts are gathered in compacted launch mode only.
+        */
+        std::vector<std::uint32_t> const& GetActiveRayCounts() const {
+            return m_active_ray_counts;
+        }
+
         Estimator(Estimator const&) = delete;
         Estimator& operator = (Estimator const&) = delete;
 
+    protected:
+        // Active rays per bounce of the last estimate
+        std::vector<std::uint32_t> m_active_ray_counts;
+
     private:
         std::shared_ptr<RadeonRays::IntersectionApi> m_intersector;
         std::uint32_t m_max_bounces;
+        bool m_compacted_launch;
+        bool m_material_sorting;
+        // Bit i is set if rays of bounce i are sorted
+        std::uint32_t m_ray_sorting_bounces;
         std::array<CLWBuffer<float3>, 
             static_cast<size_t>(IntermediateValue::kMax)> m_intermediate_value;
     };
@@ -7,6 +7,7 @@
 #include <cstdint>
 #include <random>
 #include <algorithm>
+#include <limits>
 
 #include "Utils/sobol.h"
 
@@ -16,60 +17,6 @@
 
 namespace Baikal
 {
-    struct PathTracingEstimator::PathState
-    {
-        float4 throughput;
-        int volume;
-        int flags;
-        int extra0;
-        int extra1;
-    };
-
-    struct PathTracingEstimator::RenderData
-    {
-        // OpenCL stuff
-        CLWBuffer<ray> rays[2];
-        CLWBuffer<int> hits;
-
-        CLWBuffer<ray> shadowrays;
-        CLWBuffer<int> shadowhits;
-
-        CLWBuffer<Intersection> intersections;
-        CLWBuffer<int> compacted_indices;
-        CLWBuffer<int> pixelindices[2];
-        CLWBuffer<int> output_indices;
-        CLWBuffer<int> iota;
-
-        CLWBuffer<float3> lightsamples;
-        CLWBuffer<PathState> paths;
-        CLWBuffer<std::uint32_t> random;
-        CLWBuffer<std::uint32_t> sobolmat;
-        CLWBuffer<int> hitcount;
-        CLWParallelPrimitives pp;
-
-        // RadeonRays stuff
-        Buffer* fr_rays[2];
-        Buffer* fr_shadowrays;
-        Buffer* fr_shadowhits;
-        Buffer* fr_hits;
-        Buffer* fr_intersections;
-        Buffer* fr_hitcount;
-
-        Collector mat_collector;
-        Collector tex_collector;
-
-        RenderData()
-            : fr_shadowrays(nullptr)
-            , fr_shadowhits(nullptr)
-            , fr_hits(nullptr)
-            , fr_intersections(nullptr)
-            , fr_hitcount(nullptr)
-        {
-            fr_rays[0] = nullptr;
-            fr_rays[1] = nullptr;
-        }
-    };
-
     PathTracingEstimator::PathTracingEstimator(
         CLWContext context,
         std::shared_ptr<RadeonRays::IntersectionApi> api,
@@ -102,6 +49,15 @@ namespace Baikal
         return m_render_data->rays[0].GetElementCount();
     }
 
+    std::size_t PathTracingEstimator::GetWorkBufferItemSize() const
+    {
+        // Rays (2 indirect and shadow), intersections, light samples, paths, random seeds
+        // and integer buffers: hits, shadow hits, compacted indices, sort keys (2), sort order,
+        // pixel indices (2), output indices and iota
+        return 3 * sizeof(ray) + sizeof(Intersection) + sizeof(float3) + sizeof(PathState) +
+            sizeof(std::uint32_t) + 10 * sizeof(int);
+    }
+
     void PathTracingEstimator::SetWorkBufferSize(std::size_t size)
     {
         m_render_data->rays[0] = GetContext().CreateBuffer<ray>(size, CL_MEM_READ_WRITE);
@@ -123,6 +79,9 @@ namespace Baikal
 
         m_render_data->iota = GetContext().CreateBuffer<int>(size, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, &initdata[0]);
         m_render_data->compacted_indices = GetContext().CreateBuffer<int>(size, CL_MEM_READ_WRITE);
+        m_render_data->sort_keys[0] = GetContext().CreateBuffer<int>(size, CL_MEM_READ_WRITE);
+        m_render_data->sort_keys[1] = GetContext().CreateBuffer<int>(size, CL_MEM_READ_WRITE);
+        m_render_data->sort_order = GetContext().CreateBuffer<int>(size, CL_MEM_READ_WRITE);
         m_render_data->pixelindices[0] = GetContext().CreateBuffer<int>(size, CL_MEM_READ_WRITE);
         m_render_data->pixelindices[1] = GetContext().CreateBuffer<int>(size, CL_MEM_READ_WRITE);
         m_render_data->output_indices = GetContext().CreateBuffer<int>(size, CL_MEM_READ_WRITE);
@@ -171,10 +130,8 @@ namespace Baikal
         bool atomic_update
     )
     {
-        if (atomic_update)
-        {
-            SetDefaultBuildOptions(" -D BAIKAL_ATOMIC_RESOLVE ");
-        }
+        // Programs are cached per build options, so switching back and forth is cheap
+        SetDefaultBuildOptions(atomic_update ? " -D BAIKAL_ATOMIC_RESOLVE " : "");
 
         auto has_visibility_buffer = HasIntermediateValueBuffer(IntermediateValue::kVisibility);
         auto visibility_buffer = GetIntermediateValueBuffer(IntermediateValue::kVisibility);
@@ -184,6 +141,13 @@ namespace Baikal
         GetContext().CopyBuffer(0u, m_render_data->iota, m_render_data->pixelindices[0], 0, 0, num_estimates); 
         GetContext().CopyBuffer(0u, m_render_data->iota, m_render_data->pixelindices[1], 0, 0, num_estimates);
 
+        auto compacted_launch = GetCompactedLaunch();
+        m_active_ray_counts.clear();
+
+        // Rays in the current bounce, this is an upper bound unless
+        // the count is read back after compaction
+        auto num_rays = num_estimates;
+
         // Initialize first pass
         for (auto pass = 0u; pass < GetMaxBounces(); ++pass)
         {
@@ -198,22 +162,22 @@ namespace Baikal
             // Intersect ray batch
             GetIntersector()->QueryIntersection(
                 m_render_data->fr_rays[pass & 0x1], 
-                m_render_data->fr_hitcount, (std::uint32_t)num_estimates, 
+                m_render_data->fr_hitcount, (std::uint32_t)num_rays, 
                 m_render_data->fr_intersections, 
                 nullptr, 
                 nullptr
             );
 
             // Apply scattering
-            EvaluateVolume(scene, pass, num_estimates, output, use_output_indices);
+            EvaluateVolume(scene, pass, num_rays, output, use_output_indices);
 
             if (pass > 0 && scene.envmapidx > -1)
             {
-                ShadeMiss(scene, pass, num_estimates, output, use_output_indices);
+                ShadeMiss(scene, pass, num_rays, output, use_output_indices);
             }
 
             // Convert intersections to predicates
-            FilterPathStream(pass, num_estimates);
+            FilterPathStream(pass, num_rays);
 
             // Compact batch
             m_render_data->pp.Compact(
@@ -221,40 +185,66 @@ namespace Baikal
                 m_render_data->hits,
                 m_render_data->iota, 
                 m_render_data->compacted_indices, 
-                (std::uint32_t)num_estimates,
+                (std::uint32_t)num_rays,
                 m_render_data->hitcount
             );
 
+            // Shade missing rays (this goes over all primary rays, not only active ones)
+            if (pass == 0)
+                ShadeBackground(scene, pass, num_estimates, output, use_output_indices);
+
+            if (compacted_launch)
+            {
+                // Size the rest of the bounce and the next bounce by active rays
+                int num_active = 0;
+                GetContext().ReadBuffer(0, m_render_data->hitcount, &num_active, 1).Wait();
+                m_active_ray_counts.push_back(static_cast<std::uint32_t>(num_active));
+                num_rays = static_cast<std::size_t>(num_active);
+
+                // All paths have terminated
+                if (num_rays == 0)
+                {
+                    break;
+                }
+            }
+
             // Advance indices to keep pixel indices up to date
-            RestorePixelIndices(pass, num_estimates);
+            RestorePixelIndices(pass, num_rays);
 
-            // Shade hits
-            ShadeVolume(scene, pass, num_estimates, output, use_output_indices);
+            if (GetMaterialSorting())
+            {
+                SortHitsByMaterial(scene, num_rays);
+            }
 
             // Shade hits
-            ShadeSurface(scene, pass, num_estimates, output, use_output_indices);
+            ShadeVolume(scene, pass, num_rays, output, use_output_indices);
 
-            // Shade missing rays
-            if (pass == 0)
-                ShadeBackground(scene, pass, num_estimates, output, use_output_indices);
+            // Shade hits
+            ShadeSurface(scene, pass, num_rays, output, use_output_indices);
 
             // Intersect shadow rays
             GetIntersector()->QueryOcclusion(
                 m_render_data->fr_shadowrays, 
                 m_render_data->fr_hitcount, 
-                (std::uint32_t)num_estimates,
+                (std::uint32_t)num_rays,
                 m_render_data->fr_shadowhits, 
                 nullptr, 
                 nullptr
             );
 
             // Gather light samples and account for visibility
-            GatherLightSamples(scene, pass, num_estimates, output, use_output_indices);
+            GatherLightSamples(scene, pass, num_rays, output, use_output_indices);
 
             if (pass == 0 && has_visibility_buffer)
             {
                 // Run visibility resolve kernel
-                GatherVisibility(scene, pass, num_estimates, visibility_buffer, use_output_indices);
+                GatherVisibility(scene, pass, num_rays, visibility_buffer, use_output_indices);
+            }
+
+            // Make next bounce rays coherent for the intersector
+            if (pass + 1 < GetMaxBounces() && GetRaySorting(pass + 1))
+            {
+                SortRays(scene, pass, num_rays);
             }
 
             GetContext().Flush(0);
@@ -290,6 +280,7 @@ namespace Baikal
         auto shadekernel = GetKernel("ShadeSurface");
 
         auto output_indices = use_output_indices ? m_render_data->output_indices : m_render_data->iota;
+        auto shading_order = GetMaterialSorting() ? m_render_data->sort_order : m_render_data->iota;
 
         // Set kernel parameters
         int argc = 0;
@@ -299,6 +290,7 @@ namespace Baikal
         shadekernel.SetArg(argc++, m_render_data->pixelindices[pass & 0x1]);
         shadekernel.SetArg(argc++, output_indices);
         shadekernel.SetArg(argc++, m_render_data->hitcount);
+        shadekernel.SetArg(argc++, shading_order);
         shadekernel.SetArg(argc++, scene.vertices);
         shadekernel.SetArg(argc++, scene.normals);
         shadekernel.SetArg(argc++, scene.uvs);
@@ -308,9 +300,13 @@ namespace Baikal
         shadekernel.SetArg(argc++, scene.materials);
         shadekernel.SetArg(argc++, scene.textures);
         shadekernel.SetArg(argc++, scene.texturedata);
+        shadekernel.SetArg(argc++, scene.tilecache);
+        shadekernel.SetArg(argc++, scene.pagetable);
         shadekernel.SetArg(argc++, scene.envmapidx);
         shadekernel.SetArg(argc++, scene.lights);
         shadekernel.SetArg(argc++, scene.light_distributions);
+        shadekernel.SetArg(argc++, scene.light_bvh);
+        shadekernel.SetArg(argc++, scene.area_lights);
         shadekernel.SetArg(argc++, scene.num_lights);
         shadekernel.SetArg(argc++, rand_uint());
         shadekernel.SetArg(argc++, m_render_data->random);
@@ -360,9 +356,13 @@ namespace Baikal
         shadekernel.SetArg(argc++, scene.materials);
         shadekernel.SetArg(argc++, scene.textures);
         shadekernel.SetArg(argc++, scene.texturedata);
+        shadekernel.SetArg(argc++, scene.tilecache);
+        shadekernel.SetArg(argc++, scene.pagetable);
         shadekernel.SetArg(argc++, scene.envmapidx);
         shadekernel.SetArg(argc++, scene.lights);
         shadekernel.SetArg(argc++, scene.light_distributions);
+        shadekernel.SetArg(argc++, scene.light_bvh);
+        shadekernel.SetArg(argc++, scene.area_lights);
         shadekernel.SetArg(argc++, scene.num_lights);
         shadekernel.SetArg(argc++, rand_uint());
         shadekernel.SetArg(argc++, m_render_data->random);
@@ -404,6 +404,8 @@ namespace Baikal
         evalkernel.SetArg(argc++, scene.volumes);
         evalkernel.SetArg(argc++, scene.textures);
         evalkernel.SetArg(argc++, scene.texturedata);
+        evalkernel.SetArg(argc++, scene.tilecache);
+        evalkernel.SetArg(argc++, scene.pagetable);
         evalkernel.SetArg(argc++, rand_uint());
         evalkernel.SetArg(argc++, m_render_data->random);
         evalkernel.SetArg(argc++, m_render_data->sobolmat);
@@ -443,6 +445,8 @@ namespace Baikal
         misskernel.SetArg(argc++, scene.envmapidx);
         misskernel.SetArg(argc++, scene.textures);
         misskernel.SetArg(argc++, scene.texturedata);
+        misskernel.SetArg(argc++, scene.tilecache);
+        misskernel.SetArg(argc++, scene.pagetable);
         misskernel.SetArg(argc++, m_render_data->paths);
         misskernel.SetArg(argc++, scene.volumes);
         misskernel.SetArg(argc++, output);
@@ -543,6 +547,94 @@ namespace Baikal
         }
     }
 
+    void PathTracingEstimator::SortHitsByMaterial(ClwScene const& scene, std::size_t size)
+    {
+        // Inactive slots go last
+        GetContext().FillBuffer(0, m_render_data->sort_keys[0], std::numeric_limits<int>::max(), size);
+
+        auto keykernel = GetKernel("GenerateShadingKeys");
+
+        int argc = 0;
+        keykernel.SetArg(argc++, m_render_data->intersections);
+        keykernel.SetArg(argc++, m_render_data->compacted_indices);
+        keykernel.SetArg(argc++, m_render_data->hitcount);
+        keykernel.SetArg(argc++, scene.shapes);
+        keykernel.SetArg(argc++, scene.materialids);
+        keykernel.SetArg(argc++, scene.materials);
+        keykernel.SetArg(argc++, m_render_data->sort_keys[0]);
+
+        {
+            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, keykernel);
+        }
+
+        // Slots sorted by their keys give shading order
+        m_render_data->pp.SortRadix(
+            0,
+            m_render_data->sort_keys[0],
+            m_render_data->sort_keys[1],
+            m_render_data->iota,
+            m_render_data->sort_order,
+            (std::uint32_t)size
+        );
+    }
+
+    void PathTracingEstimator::SortRays(ClwScene const& scene, int pass, std::size_t size)
+    {
+        auto& rays = m_render_data->rays[(pass + 1) & 0x1];
+        auto& pixel_indices = m_render_data->pixelindices[pass & 0x1];
+
+        // Unused slots go last
+        GetContext().FillBuffer(0, m_render_data->sort_keys[0], std::numeric_limits<int>::max(), size);
+
+        auto keykernel = GetKernel("GenerateRayKeys");
+
+        int argc = 0;
+        keykernel.SetArg(argc++, rays);
+        keykernel.SetArg(argc++, m_render_data->hitcount);
+        keykernel.SetArg(argc++, scene.world_bounds.pmin.x);
+        keykernel.SetArg(argc++, scene.world_bounds.pmin.y);
+        keykernel.SetArg(argc++, scene.world_bounds.pmin.z);
+        keykernel.SetArg(argc++, scene.world_bounds.pmax.x);
+        keykernel.SetArg(argc++, scene.world_bounds.pmax.y);
+        keykernel.SetArg(argc++, scene.world_bounds.pmax.z);
+        keykernel.SetArg(argc++, m_render_data->sort_keys[0]);
+
+        {
+            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, keykernel);
+        }
+
+        m_render_data->pp.SortRadix(
+            0,
+            m_render_data->sort_keys[0],
+            m_render_data->sort_keys[1],
+            m_render_data->iota,
+            m_render_data->sort_order,
+            (std::uint32_t)size
+        );
+
+        // Current rays and next pixel indices are not used anymore in this bounce,
+        // gather sorted data there and copy it back
+        auto& sorted_rays = m_render_data->rays[pass & 0x1];
+        auto& sorted_pixel_indices = m_render_data->pixelindices[(pass + 1) & 0x1];
+
+        auto reorderkernel = GetKernel("ReorderRays");
+
+        argc = 0;
+        reorderkernel.SetArg(argc++, m_render_data->sort_order);
+        reorderkernel.SetArg(argc++, m_render_data->hitcount);
+        reorderkernel.SetArg(argc++, rays);
+        reorderkernel.SetArg(argc++, pixel_indices);
+        reorderkernel.SetArg(argc++, sorted_rays);
+        reorderkernel.SetArg(argc++, sorted_pixel_indices);
+
+        {
+            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, reorderkernel);
+        }
+
+        GetContext().CopyBuffer(0, sorted_rays, rays, 0, 0, size);
+        GetContext().CopyBuffer(0, sorted_pixel_indices, pixel_indices, 0, 0, size);
+    }
+
     void PathTracingEstimator::ShadeMiss(
         ClwScene const& scene,
         int pass,
@@ -563,10 +655,14 @@ namespace Baikal
         misskernel.SetArg(argc++, m_render_data->hitcount);
         misskernel.SetArg(argc++, scene.lights);
         misskernel.SetArg(argc++, scene.light_distributions);
+        misskernel.SetArg(argc++, scene.light_bvh);
+        misskernel.SetArg(argc++, scene.area_lights);
         misskernel.SetArg(argc++, scene.num_lights);
         misskernel.SetArg(argc++, scene.envmapidx);
         misskernel.SetArg(argc++, scene.textures);
         misskernel.SetArg(argc++, scene.texturedata);
+        misskernel.SetArg(argc++, scene.tilecache);
+        misskernel.SetArg(argc++, scene.pagetable);
         misskernel.SetArg(argc++, m_render_data->paths);
         misskernel.SetArg(argc++, scene.volumes);
         misskernel.SetArg(argc++, output);
@@ -678,6 +774,11 @@ namespace Baikal
         // Advance indices to keep pixel indices up to date
         RestorePixelIndices(0, num_estimates);
 
+        if (GetMaterialSorting())
+        {
+            SortHitsByMaterial(scene, num_estimates);
+        }
+
         // Shade hits
         ShadeSurface(scene, 0, num_estimates, temporary, false);
 
@@ -739,6 +840,48 @@ namespace Baikal
             num_estimates / (((float)std::chrono::duration_cast<std::chrono::milliseconds>(delta).count()
                 / num_passes)
                 / 1000.f);
+
+        // Sort secondary rays (sorting sorted rays costs the same)
+        start = std::chrono::high_resolution_clock::now();
+
+        for (auto i = 0U; i < num_passes; ++i)
+        {
+            SortRays(scene, 0, num_estimates);
+        }
+
+        GetContext().Finish(0);
+
+        delta = std::chrono::high_resolution_clock::now() - start;
+
+        stats.ray_sort_time =
+            ((float)std::chrono::duration_cast<std::chrono::microseconds>(delta).count() / num_passes) / 1000.f;
+
+        // Clear ray hits buffer
+        GetContext().FillBuffer(0, m_render_data->hits, 0, m_render_data->hits.GetElementCount());
+
+        // Intersect sorted ray batch
+        start = std::chrono::high_resolution_clock::now();
+
+        for (auto i = 0U; i < num_passes; ++i)
+        {
+            GetIntersector()->QueryIntersection(
+                m_render_data->fr_rays[1],
+                m_render_data->fr_hitcount,
+                (std::uint32_t)num_estimates,
+                m_render_data->fr_intersections,
+                nullptr,
+                nullptr
+            );
+        }
+
+        GetContext().Finish(0);
+
+        delta = std::chrono::high_resolution_clock::now() - start;
+
+        stats.sorted_secondary_throughput =
+            num_estimates / (((float)std::chrono::duration_cast<std::chrono::milliseconds>(delta).count()
+                / num_passes)
+                / 1000.f);
     }
 
     bool PathTracingEstimator::SupportsIntermediateValue(IntermediateValue value) const
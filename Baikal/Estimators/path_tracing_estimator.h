@@ -59,6 +59,11 @@ namespace Baikal
         */
         std::size_t GetWorkBufferSize() const override;
 
+        /**
+        \brief Returns device memory size taken by a single work buffer entry in bytes.
+        */
+        std::size_t GetWorkBufferItemSize() const override;
+
         /**
         \brief Set random seed value for the estimator. Renders
         with the same random seed are guaranteed to be the same.
@@ -183,7 +188,7 @@ namespace Baikal
         */
         bool SupportsIntermediateValue(IntermediateValue value) const override;
 
-    private:
+    protected:
         void InitPathData(std::size_t size);
 
         void ShadeSurface(
@@ -248,8 +253,69 @@ namespace Baikal
         // Convert intersection info to compaction predicate
         void FilterPathStream(int pass, std::size_t size);
 
-        struct PathState;
-        struct RenderData;
+        // Sort compacted hits by material to reduce shading divergence
+        void SortHitsByMaterial(ClwScene const& scene, std::size_t size);
+
+        // Sort rays of the next bounce by direction and origin
+        void SortRays(ClwScene const& scene, int pass, std::size_t size);
+
+        struct PathState
+        {
+            float4 throughput;
+            int volume;
+            int flags;
+            int extra0;
+            float cone_width;
+            float cone_spread;
+            int padding[3];
+        };
+
+        struct RenderData
+        {
+            // OpenCL stuff
+            CLWBuffer<ray> rays[2];
+            CLWBuffer<int> hits;
+
+            CLWBuffer<ray> shadowrays;
+            CLWBuffer<int> shadowhits;
+
+            CLWBuffer<Intersection> intersections;
+            CLWBuffer<int> compacted_indices;
+            CLWBuffer<int> sort_keys[2];
+            CLWBuffer<int> sort_order;
+            CLWBuffer<int> pixelindices[2];
+            CLWBuffer<int> output_indices;
+            CLWBuffer<int> iota;
+
+            CLWBuffer<float3> lightsamples;
+            CLWBuffer<PathState> paths;
+            CLWBuffer<std::uint32_t> random;
+            CLWBuffer<std::uint32_t> sobolmat;
+            CLWBuffer<int> hitcount;
+            CLWParallelPrimitives pp;
+
+            // RadeonRays stuff
+            Buffer* fr_rays[2];
+            Buffer* fr_shadowrays;
+            Buffer* fr_shadowhits;
+            Buffer* fr_hits;
+            Buffer* fr_intersections;
+            Buffer* fr_hitcount;
+
+            Collector mat_collector;
+            Collector tex_collector;
+
+            RenderData()
+                : fr_shadowrays(nullptr)
+                , fr_shadowhits(nullptr)
+                , fr_hits(nullptr)
+                , fr_intersections(nullptr)
+                , fr_hitcount(nullptr)
+            {
+                fr_rays[0] = nullptr;
+                fr_rays[1] = nullptr;
+            }
+        };
 
         std::unique_ptr<RenderData> m_render_data;
         mutable std::uint32_t m_sample_counter;
@@ -0,0 +1,153 @@
+#include "persistent_path_tracing_estimator.h"
+
+#include <algorithm>
+
+namespace Baikal
+{
+    // Persistent threads are launched in groups of kPersistentGroupSize items,
+    // kPersistentGroupsPerComputeUnit groups per compute unit to hide latency
+    std::size_t constexpr kPersistentGroupSize = 64u;
+    std::size_t constexpr kPersistentGroupsPerComputeUnit = 4u;
+
+    PersistentPathTracingEstimator::PersistentPathTracingEstimator(
+        CLWContext context,
+        std::shared_ptr<RadeonRays::IntersectionApi> api,
+        std::string const& cache_path
+    ) : PathTracingEstimator(context, api, cache_path)
+    {
+        m_work_counter = context.CreateBuffer<int>(1, CL_MEM_READ_WRITE);
+    }
+
+    void PersistentPathTracingEstimator::Estimate(
+        ClwScene const& scene,
+        std::size_t num_estimates,
+        QualityLevel quality,
+        CLWBuffer<RadeonRays::float3> output,
+        bool use_output_indices,
+        bool atomic_update
+    )
+    {
+        // Programs are cached per build options, so switching back and forth is cheap
+        SetDefaultBuildOptions(atomic_update ? " -D BAIKAL_ATOMIC_RESOLVE " : "");
+
+        auto has_visibility_buffer = HasIntermediateValueBuffer(IntermediateValue::kVisibility);
+        auto visibility_buffer = GetIntermediateValueBuffer(IntermediateValue::kVisibility);
+
+        InitPathData(num_estimates);
+
+        // Paths are never compacted, slot i holds path i for all the bounces
+        GetContext().CopyBuffer(0u, m_render_data->iota, m_render_data->pixelindices[0], 0, 0, num_estimates);
+        GetContext().CopyBuffer(0u, m_render_data->iota, m_render_data->pixelindices[1], 0, 0, num_estimates);
+
+        m_active_ray_counts.clear();
+
+        auto num_bounces = GetMaxBounces();
+
+        for (auto pass = 0u; pass < num_bounces; ++pass)
+        {
+            // Intersect ray batch, terminated paths have their rays deactivated
+            GetIntersector()->QueryIntersection(
+                m_render_data->fr_rays[pass & 0x1],
+                m_render_data->fr_hitcount, (std::uint32_t)num_estimates,
+                m_render_data->fr_intersections,
+                nullptr,
+                nullptr
+            );
+
+            // Shade misses and hits and gather previous bounce light samples
+            ShadePaths(scene, pass, num_estimates, output, use_output_indices);
+
+            // Intersect shadow rays
+            GetIntersector()->QueryOcclusion(
+                m_render_data->fr_shadowrays,
+                m_render_data->fr_hitcount,
+                (std::uint32_t)num_estimates,
+                m_render_data->fr_shadowhits,
+                nullptr,
+                nullptr
+            );
+
+            if (pass == 0 && has_visibility_buffer)
+            {
+                // Run visibility resolve kernel
+                GatherVisibility(scene, pass, num_estimates, visibility_buffer, use_output_indices);
+            }
+
+            GetContext().Flush(0);
+        }
+
+        // Light samples of the last bounce are not picked up by the shading kernel
+        if (num_bounces > 0)
+        {
+            GatherLightSamples(scene, num_bounces - 1, num_estimates, output, use_output_indices);
+        }
+
+        ++m_sample_counter;
+    }
+
+    void PersistentPathTracingEstimator::ShadePaths(
+        ClwScene const& scene,
+        int pass,
+        std::size_t size,
+        CLWBuffer<RadeonRays::float3> output,
+        bool use_output_indices
+    )
+    {
+        // Fetch kernel
+        auto shadekernel = GetKernel("ShadePathsPersistent");
+
+        auto output_indices = use_output_indices ? m_render_data->output_indices : m_render_data->iota;
+
+        // Reset work queue
+        GetContext().FillBuffer(0, m_work_counter, 0, 1);
+
+        // Set kernel parameters
+        int argc = 0;
+        shadekernel.SetArg(argc++, m_render_data->rays[pass & 0x1]);
+        shadekernel.SetArg(argc++, m_render_data->intersections);
+        shadekernel.SetArg(argc++, output_indices);
+        shadekernel.SetArg(argc++, m_render_data->hitcount);
+        shadekernel.SetArg(argc++, m_work_counter);
+        shadekernel.SetArg(argc++, scene.vertices);
+        shadekernel.SetArg(argc++, scene.normals);
+        shadekernel.SetArg(argc++, scene.uvs);
+        shadekernel.SetArg(argc++, scene.indices);
+        shadekernel.SetArg(argc++, scene.shapes);
+        shadekernel.SetArg(argc++, scene.materialids);
+        shadekernel.SetArg(argc++, scene.materials);
+        shadekernel.SetArg(argc++, scene.textures);
+        shadekernel.SetArg(argc++, scene.texturedata);
+        shadekernel.SetArg(argc++, scene.tilecache);
+        shadekernel.SetArg(argc++, scene.pagetable);
+        shadekernel.SetArg(argc++, scene.envmapidx);
+        shadekernel.SetArg(argc++, scene.lights);
+        shadekernel.SetArg(argc++, scene.light_distributions);
+        shadekernel.SetArg(argc++, scene.light_bvh);
+        shadekernel.SetArg(argc++, scene.area_lights);
+        shadekernel.SetArg(argc++, scene.num_lights);
+        shadekernel.SetArg(argc++, rand_uint());
+        shadekernel.SetArg(argc++, m_render_data->random);
+        shadekernel.SetArg(argc++, m_render_data->sobolmat);
+        shadekernel.SetArg(argc++, pass);
+        shadekernel.SetArg(argc++, m_sample_counter);
+        shadekernel.SetArg(argc++, scene.volumes);
+        shadekernel.SetArg(argc++, m_render_data->shadowhits);
+        shadekernel.SetArg(argc++, m_render_data->shadowrays);
+        shadekernel.SetArg(argc++, m_render_data->lightsamples);
+        shadekernel.SetArg(argc++, m_render_data->paths);
+        shadekernel.SetArg(argc++, m_render_data->rays[(pass + 1) & 0x1]);
+        shadekernel.SetArg(argc++, output);
+
+        // Just enough groups to fill the device, small batches get one group per chunk
+        auto num_compute_units = static_cast<std::size_t>(GetContext().GetDevice(0).GetMaxComputeUnits());
+        auto num_groups = std::min(
+            std::max(num_compute_units, std::size_t(1)) * kPersistentGroupsPerComputeUnit,
+            (size + kPersistentGroupSize - 1) / kPersistentGroupSize
+        );
+
+        // Run shading kernel
+        {
+            GetContext().Launch1D(0, std::max(num_groups, std::size_t(1)) * kPersistentGroupSize, kPersistentGroupSize, shadekernel);
+        }
+    }
+}
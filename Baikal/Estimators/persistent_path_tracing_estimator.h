@@ -0,0 +1,83 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "path_tracing_estimator.h"
+
+namespace Baikal
+{
+    /**
+    \brief Path tracing estimator running shading with persistent threads.
+
+    Wavefront estimator launches about a dozen kernels per bounce and compacts the
+    ray stream between them, which is dominated by launch overhead for small ray
+    batches (small tiles, low resolution, interactive previews). This estimator
+    keeps all the paths in place and runs a single persistent-threads kernel per
+    bounce which handles misses, terminated paths, surface shading and resolves
+    light samples of the previous bounce. Intersection and occlusion queries are
+    still issued to the intersector.
+
+    Compacted launch, material and ray sorting settings are ignored.
+    */
+    class PersistentPathTracingEstimator : public PathTracingEstimator
+    {
+    public:
+        PersistentPathTracingEstimator(
+            CLWContext context,
+            std::shared_ptr<RadeonRays::IntersectionApi> api,
+            std::string const& cache_path=""
+        );
+
+        /**
+        \brief Evaluate single sample radiance estimate for a given direction.
+
+        \param scene Scene description.
+        \param num_estimates Number of items in ray buffer.
+        \param quality Quality of the estimate.
+        \param output Output buffer.
+        \param use_output_indices Scatter results via output index buffer.
+        \param atomic_update Tells an estimator that indices might contain duplicate elements and
+        hence atomic update is required while updating output buffer.
+        */
+        void Estimate(
+            ClwScene const& scene,
+            std::size_t num_estimates,
+            QualityLevel quality,
+            CLWBuffer<RadeonRays::float3> output,
+            bool use_output_indices = true,
+            bool atomic_update = false
+        ) override;
+
+    private:
+        // Run persistent shading kernel over the whole batch
+        void ShadePaths(
+            ClwScene const& scene,
+            int pass,
+            std::size_t size,
+            CLWBuffer<RadeonRays::float3> output,
+            bool use_output_indices
+        );
+
+        // Work queue head for persistent threads
+        CLWBuffer<int> m_work_counter;
+    };
+}
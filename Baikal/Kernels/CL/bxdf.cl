@@ -164,8 +164,8 @@ float3 MicrofacetBeckmann_Evaluate(
     TEXTURE_ARG_LIST
     )
 {
-    const float3 ks = Texture_GetValue3f(dg->mat.simple.kx.xyz, dg->uv, TEXTURE_ARGS_IDX(dg->mat.simple.kxmapidx));
-    const float roughness = Texture_GetValue1f(dg->mat.simple.ns, dg->uv, TEXTURE_ARGS_IDX(dg->mat.simple.nsmapidx));
+    const float3 ks = Texture_GetValue3f(dg->mat.simple.kx.xyz, dg->uv, dg->lod, TEXTURE_ARGS_IDX(dg->mat.simple.kxmapidx));
+    const float roughness = Texture_GetValue1f(dg->mat.simple.ns, dg->uv, dg->lod, TEXTURE_ARGS_IDX(dg->mat.simple.nsmapidx));
     const float eta = dg->mat.simple.ni;
 
     // Incident and reflected zenith angles
@@ -195,7 +195,7 @@ float MicrofacetBeckmann_GetPdf(
     TEXTURE_ARG_LIST
     )
 {
-    const float roughness = Texture_GetValue1f(dg->mat.simple.ns, dg->uv, TEXTURE_ARGS_IDX(dg->mat.simple.nsmapidx));
+    const float roughness = Texture_GetValue1f(dg->mat.simple.ns, dg->uv, dg->lod, TEXTURE_ARGS_IDX(dg->mat.simple.nsmapidx));
     return MicrofacetDistribution_Beckmann_GetPdf(roughness, dg, wi, wo, TEXTURE_ARGS);
 }
 
@@ -214,7 +214,7 @@ float3 MicrofacetBeckmann_Sample(
     float* pdf
     )
 {
-    const float roughness = Texture_GetValue1f(dg->mat.simple.ns, dg->uv, TEXTURE_ARGS_IDX(dg->mat.simple.nsmapidx));
+    const float roughness = Texture_GetValue1f(dg->mat.simple.ns, dg->uv, dg->lod, TEXTURE_ARGS_IDX(dg->mat.simple.nsmapidx));
 
     float3 wh;
     MicrofacetDistribution_Beckmann_SampleNormal(roughness, dg, TEXTURE_ARGS, sample, &wh);
@@ -324,8 +324,8 @@ float3 MicrofacetGGX_Evaluate(
     TEXTURE_ARG_LIST
     )
 {
-    const float3 ks = Texture_GetValue3f(dg->mat.simple.kx.xyz, dg->uv, TEXTURE_ARGS_IDX(dg->mat.simple.kxmapidx));
-    const float roughness = Texture_GetValue1f(dg->mat.simple.ns, dg->uv, TEXTURE_ARGS_IDX(dg->mat.simple.nsmapidx));
+    const float3 ks = Texture_GetValue3f(dg->mat.simple.kx.xyz, dg->uv, dg->lod, TEXTURE_ARGS_IDX(dg->mat.simple.kxmapidx));
+    const float roughness = Texture_GetValue1f(dg->mat.simple.ns, dg->uv, dg->lod, TEXTURE_ARGS_IDX(dg->mat.simple.nsmapidx));
 
     // Incident and reflected zenith angles
     float costhetao = fabs(wo.y);
@@ -353,7 +353,7 @@ float MicrofacetGGX_GetPdf(
     TEXTURE_ARG_LIST
     )
 {
-    const float roughness = Texture_GetValue1f(dg->mat.simple.ns, dg->uv, TEXTURE_ARGS_IDX(dg->mat.simple.nsmapidx));
+    const float roughness = Texture_GetValue1f(dg->mat.simple.ns, dg->uv, dg->lod, TEXTURE_ARGS_IDX(dg->mat.simple.nsmapidx));
 
     float3 wh = normalize(wo + wi);
 
@@ -375,7 +375,7 @@ float3 MicrofacetGGX_Sample(
     float* pdf
     )
 {
-    const float roughness = Texture_GetValue1f(dg->mat.simple.ns, dg->uv, TEXTURE_ARGS_IDX(dg->mat.simple.nsmapidx));
+    const float roughness = Texture_GetValue1f(dg->mat.simple.ns, dg->uv, dg->lod, TEXTURE_ARGS_IDX(dg->mat.simple.nsmapidx));
 
     float3 wh;
     MicrofacetDistribution_GGX_SampleNormal(roughness, dg, TEXTURE_ARGS, sample, &wh);
@@ -403,7 +403,7 @@ float3 Lambert_Evaluate(
     TEXTURE_ARG_LIST
     )
 {
-    const float3 kd = Texture_GetValue3f(dg->mat.simple.kx.xyz, dg->uv, TEXTURE_ARGS_IDX(dg->mat.simple.kxmapidx));
+    const float3 kd = Texture_GetValue3f(dg->mat.simple.kx.xyz, dg->uv, dg->lod, TEXTURE_ARGS_IDX(dg->mat.simple.kxmapidx));
 
     float F = dg->mat.simple.fresnel;
 
@@ -441,7 +441,7 @@ float3 Lambert_Sample(
     float* pdf
     )
 {
-    const float3 kd = Texture_GetValue3f(dg->mat.simple.kx.xyz, dg->uv, TEXTURE_ARGS_IDX(dg->mat.simple.kxmapidx));
+    const float3 kd = Texture_GetValue3f(dg->mat.simple.kx.xyz, dg->uv, dg->lod, TEXTURE_ARGS_IDX(dg->mat.simple.kxmapidx));
 
     *wo = Sample_MapToHemisphere(sample, make_float3(0.f, 1.f, 0.f) , 1.f);
 
@@ -485,7 +485,7 @@ float3 Translucent_Sample(
     float* pdf
     )
 {
-    const float3 kd = Texture_GetValue3f(dg->mat.simple.kx.xyz, dg->uv, TEXTURE_ARGS_IDX(dg->mat.simple.kxmapidx));
+    const float3 kd = Texture_GetValue3f(dg->mat.simple.kx.xyz, dg->uv, dg->lod, TEXTURE_ARGS_IDX(dg->mat.simple.kxmapidx));
 
     float ndotwi = wi.y;
 
@@ -510,7 +510,7 @@ float3 Translucent_Evaluate(
     TEXTURE_ARG_LIST
     )
 {
-    const float3 kd = Texture_GetValue3f(dg->mat.simple.kx.xyz, dg->uv, TEXTURE_ARGS_IDX(dg->mat.simple.kxmapidx));
+    const float3 kd = Texture_GetValue3f(dg->mat.simple.kx.xyz, dg->uv, dg->lod, TEXTURE_ARGS_IDX(dg->mat.simple.kxmapidx));
 
     float ndotwi = wi.y;
     float ndotwo = wo.y;
@@ -571,7 +571,7 @@ float3 IdealReflect_Sample(
     float* pdf
     )
 {
-    const float3 ks = Texture_GetValue3f(dg->mat.simple.kx.xyz, dg->uv, TEXTURE_ARGS_IDX(dg->mat.simple.kxmapidx));
+    const float3 ks = Texture_GetValue3f(dg->mat.simple.kx.xyz, dg->uv, dg->lod, TEXTURE_ARGS_IDX(dg->mat.simple.kxmapidx));
     const float eta = dg->mat.simple.ni;
 
     // Mirror reflect wi
@@ -636,7 +636,7 @@ float3 IdealRefract_Sample(
     float* pdf
     )
 {
-    const float3 ks = Texture_GetValue3f(dg->mat.simple.kx.xyz, dg->uv, TEXTURE_ARGS_IDX(dg->mat.simple.kxmapidx));
+    const float3 ks = Texture_GetValue3f(dg->mat.simple.kx.xyz, dg->uv, dg->lod, TEXTURE_ARGS_IDX(dg->mat.simple.kxmapidx));
 
     float etai = 1.f;
     float etat = dg->mat.simple.ni;
@@ -686,8 +686,8 @@ float3 MicrofacetRefractionGGX_Evaluate(
     TEXTURE_ARG_LIST
     )
 {
-    const float3 ks = Texture_GetValue3f(dg->mat.simple.kx.xyz, dg->uv, TEXTURE_ARGS_IDX(dg->mat.simple.kxmapidx));
-    const float roughness = max(Texture_GetValue1f(dg->mat.simple.ns, dg->uv, TEXTURE_ARGS_IDX(dg->mat.simple.nsmapidx)), ROUGHNESS_EPS);
+    const float3 ks = Texture_GetValue3f(dg->mat.simple.kx.xyz, dg->uv, dg->lod, TEXTURE_ARGS_IDX(dg->mat.simple.kxmapidx));
+    const float roughness = max(Texture_GetValue1f(dg->mat.simple.ns, dg->uv, dg->lod, TEXTURE_ARGS_IDX(dg->mat.simple.nsmapidx)), ROUGHNESS_EPS);
 
     float ndotwi = wi.y;
     float ndotwo = wo.y;
@@ -737,7 +737,7 @@ float MicrofacetRefractionGGX_GetPdf(
     TEXTURE_ARG_LIST
     )
 {
-    const float roughness = max(Texture_GetValue1f(dg->mat.simple.ns, dg->uv, TEXTURE_ARGS_IDX(dg->mat.simple.nsmapidx)), ROUGHNESS_EPS);
+    const float roughness = max(Texture_GetValue1f(dg->mat.simple.ns, dg->uv, dg->lod, TEXTURE_ARGS_IDX(dg->mat.simple.nsmapidx)), ROUGHNESS_EPS);
     float ndotwi = wi.y;
     float ndotwo = wo.y;
 
@@ -788,8 +788,8 @@ float3 MicrofacetRefractionGGX_Sample(
     float* pdf
     )
 {
-    const float3 ks = Texture_GetValue3f(dg->mat.simple.kx.xyz, dg->uv, TEXTURE_ARGS_IDX(dg->mat.simple.kxmapidx));
-    const float roughness = max(Texture_GetValue1f(dg->mat.simple.ns, dg->uv, TEXTURE_ARGS_IDX(dg->mat.simple.nsmapidx)), ROUGHNESS_EPS);
+    const float3 ks = Texture_GetValue3f(dg->mat.simple.kx.xyz, dg->uv, dg->lod, TEXTURE_ARGS_IDX(dg->mat.simple.kxmapidx));
+    const float roughness = max(Texture_GetValue1f(dg->mat.simple.ns, dg->uv, dg->lod, TEXTURE_ARGS_IDX(dg->mat.simple.nsmapidx)), ROUGHNESS_EPS);
 
     float ndotwi = wi.y;
 
@@ -844,8 +844,8 @@ float3 MicrofacetRefractionBeckmann_Evaluate(
     TEXTURE_ARG_LIST
     )
 {
-    const float3 ks = Texture_GetValue3f(dg->mat.simple.kx.xyz, dg->uv, TEXTURE_ARGS_IDX(dg->mat.simple.kxmapidx));
-    const float roughness = max(Texture_GetValue1f(dg->mat.simple.ns, dg->uv, TEXTURE_ARGS_IDX(dg->mat.simple.nsmapidx)), ROUGHNESS_EPS);
+    const float3 ks = Texture_GetValue3f(dg->mat.simple.kx.xyz, dg->uv, dg->lod, TEXTURE_ARGS_IDX(dg->mat.simple.kxmapidx));
+    const float roughness = max(Texture_GetValue1f(dg->mat.simple.ns, dg->uv, dg->lod, TEXTURE_ARGS_IDX(dg->mat.simple.nsmapidx)), ROUGHNESS_EPS);
 
     float ndotwi = wi.y;
     float ndotwo = wo.y;
@@ -890,7 +890,7 @@ float MicrofacetRefractionBeckmann_GetPdf(
     TEXTURE_ARG_LIST
     )
 {
-    const float roughness = Texture_GetValue1f(dg->mat.simple.ns, dg->uv, TEXTURE_ARGS_IDX(dg->mat.simple.nsmapidx));
+    const float roughness = Texture_GetValue1f(dg->mat.simple.ns, dg->uv, dg->lod, TEXTURE_ARGS_IDX(dg->mat.simple.nsmapidx));
     float ndotwi = wi.y;
     float ndotwo = wo.y;
 
@@ -936,8 +936,8 @@ float3 MicrofacetRefractionBeckmann_Sample(
     float* pdf
     )
 {
-    const float3 ks = Texture_GetValue3f(dg->mat.simple.kx.xyz, dg->uv, TEXTURE_ARGS_IDX(dg->mat.simple.kxmapidx));
-    const float roughness = Texture_GetValue1f(dg->mat.simple.ns, dg->uv, TEXTURE_ARGS_IDX(dg->mat.simple.nsmapidx));
+    const float3 ks = Texture_GetValue3f(dg->mat.simple.kx.xyz, dg->uv, dg->lod, TEXTURE_ARGS_IDX(dg->mat.simple.kxmapidx));
+    const float roughness = Texture_GetValue1f(dg->mat.simple.ns, dg->uv, dg->lod, TEXTURE_ARGS_IDX(dg->mat.simple.nsmapidx));
 
     float ndotwi = wi.y;
 
@@ -1168,7 +1168,7 @@ float3 Emissive_GetLe(
     // Texture args
     TEXTURE_ARG_LIST)
 {
-    const float3 kd = Texture_GetValue3f(dg->mat.simple.kx.xyz, dg->uv, TEXTURE_ARGS_IDX(dg->mat.simple.kxmapidx));
+    const float3 kd = Texture_GetValue3f(dg->mat.simple.kx.xyz, dg->uv, dg->lod, TEXTURE_ARGS_IDX(dg->mat.simple.kxmapidx));
     return kd;
 }
 
@@ -40,6 +40,8 @@ THE SOFTWARE.
 #define CRAZY_LOW_DISTANCE 0.001f
 #define REASONABLE_RADIANCE(x) (clamp((x), 0.f, CRAZY_HIGH_RADIANCE))
 #define NON_BLACK(x) (length(x) > 0.f)
+#define ONE_MINUS_EPSILON 0x1.fffffep-1f
+#define TEXTURE_BASE_LOD (-FLT_MAX)
 
 #define MULTISCATTER
 
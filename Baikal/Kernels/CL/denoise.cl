@@ -23,6 +23,7 @@ THE SOFTWARE.
 #define DENOISE_CL
 
 #include <../Baikal/Kernels/CL/common.cl>
+#include <../Baikal/Kernels/CL/utils.cl>
 
 // Similarity function
 inline float C(float3 x1, float3 x2, float sigma)
@@ -39,10 +40,13 @@ void BilateralDenoise_main(
     GLOBAL float4 const* restrict colors,
     // Normal data
     GLOBAL float4 const* restrict normals,
+    int normal_format,
     // Positional data
     GLOBAL float4 const* restrict positions,
+    int position_format,
     // Albedo data
     GLOBAL float4 const* restrict albedos,
+    int albedo_format,
     // Image resolution
     int width,
     int height,
@@ -67,9 +71,9 @@ void BilateralDenoise_main(
         int idx = global_id.y * width + global_id.x;
 
         float3 color = colors[idx].w > 1 ? (colors[idx].xyz / colors[idx].w) : colors[idx].xyz;
-        float3 normal = normals[idx].w > 1 ? (normals[idx].xyz / normals[idx].w) : normals[idx].xyz;
-        float3 position = positions[idx].w > 1 ? (positions[idx].xyz / positions[idx].w) : positions[idx].xyz;
-        float3 albedo = albedos[idx].w > 1 ? (albedos[idx].xyz / albedos[idx].w) : albedos[idx].xyz;
+        float3 normal = Output_ReadAverage(normals, normal_format, idx);
+        float3 position = Output_ReadAverage(positions, position_format, idx);
+        float3 albedo = Output_ReadAverage(albedos, albedo_format, idx);
 
         float3 filtered_color = 0.f;
         float sum = 0.f;
@@ -84,9 +88,9 @@ void BilateralDenoise_main(
                     int ci = cy * width + cx;
 
                     float3 c = colors[ci].xyz / colors[ci].w;
-                    float3 n = normals[ci].xyz / normals[ci].w;
-                    float3 p = positions[ci].xyz / positions[ci].w;
-                    float3 a = albedos[ci].xyz / albedos[ci].w;
+                    float3 n = Output_ReadAverage(normals, normal_format, ci);
+                    float3 p = Output_ReadAverage(positions, position_format, ci);
+                    float3 a = Output_ReadAverage(albedos, albedo_format, ci);
 
                     if (length(p) > 0.f)
                     {
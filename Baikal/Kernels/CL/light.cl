@@ -75,6 +75,15 @@ float3 EnvironmentLight_GetLe(// Light
     return light->multiplier * Texture_SampleEnvMap(normalize(*wo), TEXTURE_ARGS_IDX(light->tex));
 }
 
+/// Get environment light distribution (luminance based), nullptr if not available.
+/// It is stored right after light selection distribution.
+GLOBAL int const* EnvironmentLight_GetDistribution(Scene const* scene)
+{
+    GLOBAL int const* data = scene->light_distribution;
+    data += Distribution1D_GetSize(data);
+    return data[0] > 0 ? data : 0;
+}
+
 /// Sample direction to the light
 float3 EnvironmentLight_Sample(// Light
                                Light const* light,
@@ -92,14 +101,34 @@ float3 EnvironmentLight_Sample(// Light
                                float* pdf
                               )
 {
-    float3 d = Sample_MapToHemisphere(sample, dg->n, 0.f);
+    GLOBAL int const* distribution = EnvironmentLight_GetDistribution(scene);
+    float3 d;
+
+    if (distribution)
+    {
+        // Sample envmap texel proportionally to its luminance
+        float uv_pdf = 0.f;
+        float2 uv = Distribution2D_Sample(sample, distribution, &uv_pdf);
+
+        // Map to spherical coordinates (see Texture_SampleEnvMap)
+        float phi = uv.x * 2.f * PI;
+        float theta = uv.y * PI;
+        float sin_theta = sin(theta);
+
+        d = make_float3(sin_theta * sin(phi), cos(theta), sin_theta * cos(phi));
+
+        // Convert to solid angle measure
+        *pdf = sin_theta > 0.f ? uv_pdf / (2.f * PI * PI * sin_theta) : 0.f;
+    }
+    else
+    {
+        d = Sample_MapToHemisphere(sample, dg->n, 0.f);
+        *pdf = 1.f / (2.f * PI);
+    }
 
     // Generate direction
     *wo = 100000.f * d;
 
-    // Envmap PDF
-    *pdf = 1.f / (2.f * PI);
-
     // Sample envmap
     return light->multiplier * Texture_SampleEnvMap(d, TEXTURE_ARGS_IDX(light->tex));
 }
@@ -118,7 +147,25 @@ float EnvironmentLight_GetPdf(
                               TEXTURE_ARG_LIST
                               )
 {
-    return 1.f / (2.f * PI);
+    GLOBAL int const* distribution = EnvironmentLight_GetDistribution(scene);
+
+    if (!distribution)
+    {
+        return 1.f / (2.f * PI);
+    }
+
+    float r, phi, theta;
+    CartesianToSpherical(wo, &r, &phi, &theta);
+
+    float sin_theta = sin(theta);
+
+    if (sin_theta <= 0.f)
+    {
+        return 0.f;
+    }
+
+    float2 uv = make_float2(phi / (2.f * PI), theta / PI);
+    return Distribution2D_GetPdf(uv, distribution) / (2.f * PI * PI * sin_theta);
 }
 
 
@@ -163,7 +210,7 @@ float3 AreaLight_GetLe(// Emissive object
         int mat_idx = Scene_GetMaterialIndex(scene, shapeidx, primidx);
         Material mat = scene->materials[mat_idx];
 
-        const float3 ke = Texture_GetValue3f(mat.simple.kx.xyz, tx, TEXTURE_ARGS_IDX(mat.simple.kxmapidx));
+        const float3 ke = Texture_GetValue3f(mat.simple.kx.xyz, tx, TEXTURE_BASE_LOD, TEXTURE_ARGS_IDX(mat.simple.kxmapidx));
         return ke;
     }
     else
@@ -211,7 +258,7 @@ float3 AreaLight_Sample(// Emissive object
     int mat_idx = Scene_GetMaterialIndex(scene, shapeidx, primidx);
     Material mat = scene->materials[mat_idx];
 
-    const float3 ke = Texture_GetValue3f(mat.simple.kx.xyz, tx, TEXTURE_ARGS_IDX(mat.simple.kxmapidx));
+    const float3 ke = Texture_GetValue3f(mat.simple.kx.xyz, tx, TEXTURE_BASE_LOD, TEXTURE_ARGS_IDX(mat.simple.kxmapidx));
 
     float3 v = -normalize(*wo);
 
@@ -312,7 +359,7 @@ float3 AreaLight_SampleVertex(
     int mat_idx = Scene_GetMaterialIndex(scene, shapeidx, primidx);
     Material mat = scene->materials[mat_idx];
 
-    const float3 ke = Texture_GetValue3f(mat.simple.kx.xyz, tx, TEXTURE_ARGS_IDX(mat.simple.kxmapidx));
+    const float3 ke = Texture_GetValue3f(mat.simple.kx.xyz, tx, TEXTURE_BASE_LOD, TEXTURE_ARGS_IDX(mat.simple.kxmapidx));
 
     *wo = Sample_MapToHemisphere(sample1, *n, 1.f);
     *pdf = (1.f / area) * fabs(dot(*n, *wo)) / PI;
@@ -55,6 +55,8 @@ void PerspectiveCamera_GeneratePaths(
     uint rng_seed,
     // Current frame
     uint frame,
+    // Number of samples per pixel in the domain
+    int num_samples,
     // Rays to generate
     GLOBAL ray* restrict rays,
     // RNG data
@@ -71,27 +73,31 @@ void PerspectiveCamera_GeneratePaths(
         int y = idx / output_width;
         int x = idx % output_width;
 
+        // Samples of a pixel go one domain copy after another and get consecutive frames
+        uint sample_frame = frame + global_id / (*num_pixels / num_samples);
+
         // Get pointer to ray & path handles
         GLOBAL ray* my_ray = rays + global_id;
 
-        // Initialize sampler
+        // Initialize sampler, seeds are stored per ray as work buffers
+        // might be smaller than the output
         Sampler sampler;
 #if SAMPLER == SOBOL
-        uint scramble = random[x + output_width * y] * 0x1fe3434f;
+        uint scramble = random[global_id] * 0x1fe3434f;
 
-        if (frame & 0xF)
+        if (sample_frame & 0xF)
         {
-            random[x + output_width * y] = WangHash(scramble);
+            random[global_id] = WangHash(scramble);
         }
 
-        Sampler_Init(&sampler, frame, SAMPLE_DIM_CAMERA_OFFSET, scramble);
+        Sampler_Init(&sampler, sample_frame, SAMPLE_DIM_CAMERA_OFFSET, scramble);
 #elif SAMPLER == RANDOM
         uint scramble = x + output_width * y * rng_seed;
         Sampler_Init(&sampler, scramble);
 #elif SAMPLER == CMJ
-        uint rnd = random[x + output_width * y];
-        uint scramble = rnd * 0x1fe3434f * ((frame + 133 * rnd) / (CMJ_DIM * CMJ_DIM));
-        Sampler_Init(&sampler, frame % (CMJ_DIM * CMJ_DIM), SAMPLE_DIM_CAMERA_OFFSET, scramble);
+        uint rnd = random[global_id];
+        uint scramble = rnd * 0x1fe3434f * ((sample_frame + 133 * rnd) / (CMJ_DIM * CMJ_DIM));
+        Sampler_Init(&sampler, sample_frame % (CMJ_DIM * CMJ_DIM), SAMPLE_DIM_CAMERA_OFFSET, scramble);
 #endif
 
         // Generate sample
@@ -122,7 +128,8 @@ void PerspectiveCamera_GeneratePaths(
         // Set ray max
         my_ray->extra.x = 0xFFFFFFFF;
         my_ray->extra.y = 0xFFFFFFFF;
-        Ray_SetExtra(my_ray, 1.f);
+        // Pixel angular size is a spread angle of a ray cone
+        Ray_SetExtra(my_ray, make_float2(1.f, camera->dim.y / (camera->focal_length * output_height)));
         Ray_SetMask(my_ray, VISIBILITY_MASK_PRIMARY);
     }
 }
@@ -143,6 +150,8 @@ KERNEL void PerspectiveCameraDof_GeneratePaths(
     uint rng_seed,
     // Current frame
     uint frame,
+    // Number of samples per pixel in the domain
+    int num_samples,
     // Rays to generate
     GLOBAL ray* restrict rays,
     // RNG data
@@ -159,27 +168,31 @@ KERNEL void PerspectiveCameraDof_GeneratePaths(
         int y = idx / output_width;
         int x = idx % output_width;
 
+        // Samples of a pixel go one domain copy after another and get consecutive frames
+        uint sample_frame = frame + global_id / (*num_pixels / num_samples);
+
         // Get pointer to ray & path handles
         GLOBAL ray* my_ray = rays + global_id;
 
-        // Initialize sampler
+        // Initialize sampler, seeds are stored per ray as work buffers
+        // might be smaller than the output
         Sampler sampler;
 #if SAMPLER == SOBOL
-        uint scramble = random[x + output_width * y] * 0x1fe3434f;
+        uint scramble = random[global_id] * 0x1fe3434f;
 
-        if (frame & 0xF)
+        if (sample_frame & 0xF)
         {
-            random[x + output_width * y] = WangHash(scramble);
+            random[global_id] = WangHash(scramble);
         }
 
-        Sampler_Init(&sampler, frame, SAMPLE_DIM_CAMERA_OFFSET, scramble);
+        Sampler_Init(&sampler, sample_frame, SAMPLE_DIM_CAMERA_OFFSET, scramble);
 #elif SAMPLER == RANDOM
         uint scramble = x + output_width * y * rng_seed;
         Sampler_Init(&sampler, scramble);
 #elif SAMPLER == CMJ
-        uint rnd = random[x + output_width * y];
-        uint scramble = rnd * 0x1fe3434f * ((frame + 133 * rnd) / (CMJ_DIM * CMJ_DIM));
-        Sampler_Init(&sampler, frame % (CMJ_DIM * CMJ_DIM), SAMPLE_DIM_CAMERA_OFFSET, scramble);
+        uint rnd = random[global_id];
+        uint scramble = rnd * 0x1fe3434f * ((sample_frame + 133 * rnd) / (CMJ_DIM * CMJ_DIM));
+        Sampler_Init(&sampler, sample_frame % (CMJ_DIM * CMJ_DIM), SAMPLE_DIM_CAMERA_OFFSET, scramble);
 #endif
 
         // Generate pixel and lens samples
@@ -218,7 +231,8 @@ KERNEL void PerspectiveCameraDof_GeneratePaths(
         // Set ray max
         my_ray->extra.x = 0xFFFFFFFF;
         my_ray->extra.y = 0xFFFFFFFF;
-        Ray_SetExtra(my_ray, 1.f);
+        // Pixel angular size is a spread angle of a ray cone
+        Ray_SetExtra(my_ray, make_float2(1.f, camera->dim.y / (camera->focal_length * output_height)));
         Ray_SetMask(my_ray, VISIBILITY_MASK_PRIMARY);
     }
 }
@@ -481,6 +495,8 @@ KERNEL void GenerateTileDomain(
     int offset_y,
     int width,
     int height,
+    // Number of samples per pixel
+    int num_samples,
     uint rng_seed,
     uint frame,
     GLOBAL uint* restrict random,
@@ -516,12 +532,16 @@ KERNEL void GenerateTileDomain(
             (group_id.y * tile_size.y + local_id.y) * output_width +
             (group_id.x * tile_size.x + local_id.x);
 
-        indices[global_id.y * width + global_id.x] = idx;
+        // Domain is repeated for each sample
+        for (int i = 0; i < num_samples; ++i)
+        {
+            indices[(i * height + global_id.y) * width + global_id.x] = idx;
+        }
     }
 
     if (global_id.x == 0 && global_id.y == 0)
     {
-        *count = width * height;
+        *count = width * height * num_samples;
     }
 }
 
@@ -585,8 +605,9 @@ KERNEL void GenerateTileDomain_Adaptive(
     float pdf;
     int tile = Distribution1D_SampleDiscrete(sample.x, tile_distribution, &pdf);
 
-    int num_tiles_x = output_width / tile_size.x;
-    int num_tiles_y = output_height / tile_size.y;
+    // Distribution covers partial tiles on the image border too
+    int num_tiles_x = (output_width + tile_size.x - 1) / tile_size.x;
+    int num_tiles_y = (output_height + tile_size.y - 1) / tile_size.y;
 
     int tile_y = clamp(tile / num_tiles_x , 0, num_tiles_y - 1);
     int tile_x = clamp(tile % num_tiles_x, 0, num_tiles_x - 1);
@@ -596,8 +617,8 @@ KERNEL void GenerateTileDomain_Adaptive(
     if (global_id.x < width && global_id.y < height)
     {
         int idx = start_idx +
-            (tile_y * tile_size.y + local_id.y) * output_width +
-            (tile_x * tile_size.x + local_id.x);
+            min(tile_y * tile_size.y + local_id.y, output_height - 1) * output_width +
+            min(tile_x * tile_size.x + local_id.x, output_width - 1);
 
         indices[global_id.y * width + global_id.x] = idx;
     }
@@ -652,51 +673,75 @@ KERNEL void FillAOVs(
     // Frame
     int frame,
     // World position flag
-    int world_position_enabled, 
+    int world_position_enabled,
+    int world_position_format,
+    GLOBAL int* restrict world_position_count,
     // World position AOV
     GLOBAL float4* restrict aov_world_position,
     // World normal flag
     int world_shading_normal_enabled,
+    int world_shading_normal_format,
+    GLOBAL int* restrict world_shading_normal_count,
     // World normal AOV
     GLOBAL float4* restrict aov_world_shading_normal,
     // View normal flag
     int view_shading_normal_enabled,
+    int view_shading_normal_format,
+    GLOBAL int* restrict view_shading_normal_count,
     // View normal AOV
     GLOBAL float4* restrict aov_view_shading_normal,
     // World true normal flag
     int world_geometric_normal_enabled,
+    int world_geometric_normal_format,
+    GLOBAL int* restrict world_geometric_normal_count,
     // World true normal AOV
     GLOBAL float4* restrict aov_world_geometric_normal,
     // UV flag
     int uv_enabled,
+    int uv_format,
+    GLOBAL int* restrict uv_count,
     // UV AOV
     GLOBAL float4* restrict aov_uv,
     // Wireframe flag
     int wireframe_enabled,
+    int wireframe_format,
+    GLOBAL int* restrict wireframe_count,
     // Wireframe AOV
     GLOBAL float4* restrict aov_wireframe,
     // Albedo flag
     int albedo_enabled,
+    int albedo_format,
+    GLOBAL int* restrict albedo_count,
     // Wireframe AOV
     GLOBAL float4* restrict aov_albedo,
     // World tangent flag
     int world_tangent_enabled,
+    int world_tangent_format,
+    GLOBAL int* restrict world_tangent_count,
     // World tangent AOV
     GLOBAL float4* restrict aov_world_tangent,
     // World bitangent flag
     int world_bitangent_enabled,
+    int world_bitangent_format,
+    GLOBAL int* restrict world_bitangent_count,
     // World bitangent AOV
     GLOBAL float4* restrict aov_world_bitangent,
     // Gloss enabled flag
     int gloss_enabled,
+    int gloss_format,
+    GLOBAL int* restrict gloss_count,
     // Specularity map
     GLOBAL float4* restrict aov_gloss,
     // Depth enabled flag
     int depth_enabled,
+    int depth_format,
+    GLOBAL int* restrict depth_count,
     // Depth map
     GLOBAL float4* restrict aov_depth,
     // NOTE: following are fake parameters, handled outside
     int visibility_enabled,
+    int visibility_format,
+    GLOBAL int* restrict visibility_count,
     GLOBAL float4* restrict aov_visibility
 )
 {
@@ -746,8 +791,7 @@ KERNEL void FillAOVs(
 
             if (world_position_enabled)
             {
-                aov_world_position[idx].xyz += diffgeo.p;
-                aov_world_position[idx].w += 1.f;
+                Output_Accumulate(aov_world_position, world_position_format, world_position_count, idx, diffgeo.p);
             }
 
             if (world_shading_normal_enabled)
@@ -773,8 +817,7 @@ KERNEL void FillAOVs(
                 DifferentialGeometry_ApplyBumpNormalMap(&diffgeo, TEXTURE_ARGS);
                 DifferentialGeometry_CalculateTangentTransforms(&diffgeo);
 
-                aov_world_shading_normal[idx].xyz += diffgeo.n;
-                aov_world_shading_normal[idx].w += 1.f;
+                Output_Accumulate(aov_world_shading_normal, world_shading_normal_format, world_shading_normal_count, idx, diffgeo.n);
             }
 
             if (view_shading_normal_enabled)
@@ -805,28 +848,24 @@ KERNEL void FillAOVs(
                                         dot(camera->forward, diffgeo.n));
                 res = normalize(res);
 
-                aov_view_shading_normal[idx].xyz += res;
-                aov_view_shading_normal[idx].w += 1.f;
+                Output_Accumulate(aov_view_shading_normal, view_shading_normal_format, view_shading_normal_count, idx, res);
             }
 
             if (world_geometric_normal_enabled)
             {
-                aov_world_geometric_normal[idx].xyz += diffgeo.ng;
-                aov_world_geometric_normal[idx].w += 1.f;
+                Output_Accumulate(aov_world_geometric_normal, world_geometric_normal_format, world_geometric_normal_count, idx, diffgeo.ng);
             }
 
             if (wireframe_enabled)
             {
                 bool hit = (isect.uvwt.x < 1e-3) || (isect.uvwt.y < 1e-3) || (1.f - isect.uvwt.x - isect.uvwt.y < 1e-3);
                 float3 value = hit ? make_float3(1.f, 1.f, 1.f) : make_float3(0.f, 0.f, 0.f);
-                aov_wireframe[idx].xyz += value;
-                aov_wireframe[idx].w += 1.f;
+                Output_Accumulate(aov_wireframe, wireframe_format, wireframe_count, idx, value);
             }
 
             if (uv_enabled)
             {
-                aov_uv[idx].xy += diffgeo.uv.xy;
-                aov_uv[idx].w += 1.f;
+                Output_Accumulate(aov_uv, uv_format, uv_count, idx, make_float3(diffgeo.uv.x, diffgeo.uv.y, 0.f));
             }
 
             if (albedo_enabled)
@@ -837,10 +876,9 @@ KERNEL void FillAOVs(
                 // Select BxDF
                 Material_Select(&scene, wi, &sampler, TEXTURE_ARGS, SAMPLER_ARGS, &diffgeo);
 
-                const float3 kd = Texture_GetValue3f(diffgeo.mat.simple.kx.xyz, diffgeo.uv, TEXTURE_ARGS_IDX(diffgeo.mat.simple.kxmapidx));
+                const float3 kd = Texture_GetValue3f(diffgeo.mat.simple.kx.xyz, diffgeo.uv, diffgeo.lod, TEXTURE_ARGS_IDX(diffgeo.mat.simple.kxmapidx));
 
-                aov_albedo[idx].xyz += kd;
-                aov_albedo[idx].w += 1.f;
+                Output_Accumulate(aov_albedo, albedo_format, albedo_count, idx, kd);
             }
 
             if (world_tangent_enabled)
@@ -866,8 +904,7 @@ KERNEL void FillAOVs(
                 DifferentialGeometry_ApplyBumpNormalMap(&diffgeo, TEXTURE_ARGS);
                 DifferentialGeometry_CalculateTangentTransforms(&diffgeo);
 
-                aov_world_tangent[idx].xyz += diffgeo.dpdu;
-                aov_world_tangent[idx].w += 1.f;
+                Output_Accumulate(aov_world_tangent, world_tangent_format, world_tangent_count, idx, diffgeo.dpdu);
             }
 
             if (world_bitangent_enabled)
@@ -893,8 +930,7 @@ KERNEL void FillAOVs(
                 DifferentialGeometry_ApplyBumpNormalMap(&diffgeo, TEXTURE_ARGS);
                 DifferentialGeometry_CalculateTangentTransforms(&diffgeo);
 
-                aov_world_bitangent[idx].xyz += diffgeo.dpdv;
-                aov_world_bitangent[idx].w += 1.f;
+                Output_Accumulate(aov_world_bitangent, world_bitangent_format, world_bitangent_count, idx, diffgeo.dpdv);
             }
 
             if (gloss_enabled)
@@ -915,26 +951,23 @@ KERNEL void FillAOVs(
                 else if (type == kMicrofacetGGX || type == kMicrofacetBeckmann ||
                     type == kMicrofacetRefractionGGX || type == kMicrofacetRefractionBeckmann)
                 {
-                    gloss = 1.f - Texture_GetValue1f(diffgeo.mat.simple.ns, diffgeo.uv, TEXTURE_ARGS_IDX(diffgeo.mat.simple.nsmapidx));
+                    gloss = 1.f - Texture_GetValue1f(diffgeo.mat.simple.ns, diffgeo.uv, diffgeo.lod, TEXTURE_ARGS_IDX(diffgeo.mat.simple.nsmapidx));
                 }
 
 
-                aov_gloss[idx].xyz += gloss;
-                aov_gloss[idx].w += 1.f;
+                Output_Accumulate(aov_gloss, gloss_format, gloss_count, idx, (float3)(gloss));
             }
 
             if (depth_enabled)
             {
-                float w = aov_depth[idx].w;
-                if (w == 0.f)
+                if (depth_format == OUTPUT_FORMAT_RGBA32F && aov_depth[idx].w == 0.f)
                 {
                     aov_depth[idx].xyz = isect.uvwt.w;
                     aov_depth[idx].w = 1.f;
                 }
                 else
                 {
-                    aov_depth[idx].xyz += isect.uvwt.w;
-                    aov_depth[idx].w += 1.f;
+                    Output_Accumulate(aov_depth, depth_format, depth_count, idx, (float3)(isect.uvwt.w));
                 }
             }
         }
@@ -990,6 +1023,8 @@ KERNEL void ApplyGammaAndCopyData(
 KERNEL void AccumulateSingleSample(
     GLOBAL float4 const* restrict src_sample_data,
     GLOBAL float4* restrict dst_accumulation_data,
+    // Per pixel moments of sample luminance: count, sum, sum of squares
+    GLOBAL float4* restrict moments,
     GLOBAL int* restrict scatter_indices,
     int num_elements
 )
@@ -998,10 +1033,14 @@ KERNEL void AccumulateSingleSample(
 
     if (global_id < num_elements)
     {
+        // Adaptive domain might send several samples to the same pixel
         int idx = scatter_indices[global_id];
         float4 sample = src_sample_data[global_id];
-        dst_accumulation_data[idx].xyz += sample.xyz;
-        dst_accumulation_data[idx].w += 1.f;
+        atomic_add_float4(dst_accumulation_data + idx, (float4)(sample.xyz, 1.f));
+
+        // Plain sums, unlike running mean they can be updated atomically
+        float value = luminance(sample.xyz);
+        atomic_add_float3((GLOBAL float3*)(moments + idx), make_float3(1.f, value, value * value));
     }
 }
 
@@ -1043,8 +1082,13 @@ INLINE void group_reduce_max(__local float* lds, int size, int lid)
 }
 
 
+// Relative error is normalized by mean luminance offset by this value,
+// so that dark pixels do not dominate
+#define TILE_ERROR_LUMINANCE_OFFSET 0.1f
+
+// Estimate per tile error as an average relative standard error of pixel means
 KERNEL void EstimateVariance(
-    GLOBAL float4 const* restrict image_buffer,
+    GLOBAL float4 const* restrict moments,
     GLOBAL float* restrict variance_buffer,
     int width,
     int height
@@ -1066,48 +1110,112 @@ KERNEL void EstimateVariance(
     float value = 0.f;
     if (x < width && y < height)
     {
-        float4 rw = image_buffer[y * width + x]; rw /= rw.w;
-        value = 4*luminance(clamp(rw.xyz, 0.f, 1.f));
-        rw = y + 1 < height ? image_buffer[(y + 1) * width + x] : image_buffer[y * width + x]; rw /= rw.w;
-        value -= luminance(clamp(rw.xyz, 0.f, 1.f));
-        rw = y - 1 >= 0 ? image_buffer[(y - 1) * width + x] : image_buffer[y * width + x]; rw /= rw.w;
-        value -= luminance(clamp(rw.xyz, 0.f, 1.f));
-        rw = x + 1 < width ? image_buffer[y * width + x + 1] : image_buffer[y * width + x]; rw /= rw.w;
-        value -= luminance(clamp(rw.xyz, 0.f, 1.f));
-        rw = x - 1 >= 0 ? image_buffer[y * width + x - 1] : image_buffer[y * width + x]; rw /= rw.w;
-        value -= luminance(clamp(rw.xyz, 0.f, 1.f));
-        //rw = y + 1 < height && x + 1 < width ? image_buffer[(y + 1) * width + x + 1] : image_buffer[y * width + x]; rw /= rw.w;
-        //value -= luminance(clamp(rw.xyz, 0.f, 1.f));
-        //rw = y - 1 >= 0 && x - 1 >= 0 ? image_buffer[(y - 1) * width + x - 1] : image_buffer[y * width + x]; rw /= rw.w;
-        //value -= luminance(clamp(rw.xyz, 0.f, 1.f));
-        //rw = y + 1 < height && x - 1 >= 0 ? image_buffer[(y + 1) * width + x - 1] : image_buffer[y * width + x]; rw /= rw.w;
-        //value -= luminance(clamp(rw.xyz, 0.f, 1.f));
-        //rw = y - 1 >= 0 && x + 1 < width ? image_buffer[(y - 1) * width + x + 1] : image_buffer[y * width + x]; rw /= rw.w;
-        //value -= luminance(clamp(rw.xyz, 0.f, 1.f));
+        float4 m = moments[y * width + x];
+
+        // Variance of the mean is sample variance over sample count
+        if (m.x > 1.f)
+        {
+            float mean = m.y / m.x;
+            float variance = max(m.z - m.y * mean, 0.f) / (m.x - 1.f);
+            value = native_sqrt(variance / m.x) / (mean + TILE_ERROR_LUMINANCE_OFFSET);
+        }
     }
 
-    value = fabs(value);
     lds[lid] = value;
     barrier(CLK_LOCAL_MEM_FENCE);
 
     group_reduce_add(lds, 256, lid);
 
-    float mean = lds[0] / (wx * wy);
-    barrier(CLK_LOCAL_MEM_FENCE);
-
-    /*lds[lid] = (mean - value) * (mean - value);
-    barrier(CLK_LOCAL_MEM_FENCE);
-
-    group_reduce_add(lds, 256, lid);*/
+    // Border tiles average over pixels inside the image only
+    int num_pixels = (min(width, (gx + 1) * wx) - gx * wx) * (min(height, (gy + 1) * wy) - gy * wy);
 
     if (x < width && y < height)
     {
         if (lx == 0 && ly == 0)
         {
-            //float dev = lds[0] / (wx * wy - 1);
-            variance_buffer[gy * num_tiles + gx] = mean;
+            variance_buffer[gy * num_tiles + gx] = lds[0] / num_pixels;
         }
     }
 }
 
+// Build tile sampling distribution from tile errors in place, single work group.
+// Tiles with error below the threshold are marked converged and get zero probability.
+// Output layout matches Distribution1D: num_segments, num_segments + 1 CDF values, num_segments PDF values.
+KERNEL void BuildTileDistribution(
+    GLOBAL float const* restrict tile_error,
+    GLOBAL int* restrict converged,
+    float threshold,
+    int num_tiles,
+    GLOBAL int* restrict distribution,
+    GLOBAL int* restrict num_active_tiles
+)
+{
+    __local float lds[256];
+    __local int lds_count[256];
+    __local float lds_total;
+
+    int lid = get_local_id(0);
+    int group_size = get_local_size(0);
+
+    GLOBAL float* cdf = (GLOBAL float*)&distribution[1];
+    GLOBAL float* pdf = cdf + num_tiles + 1;
+
+    // Each work item handles a contiguous range of tiles
+    int num_tiles_per_item = (num_tiles + group_size - 1) / group_size;
+    int begin = min(lid * num_tiles_per_item, num_tiles);
+    int end = min(begin + num_tiles_per_item, num_tiles);
+
+    float sum = 0.f;
+    int count = 0;
+    for (int i = begin; i < end; ++i)
+    {
+        if (threshold > 0.f && tile_error[i] < threshold)
+        {
+            converged[i] = 1;
+        }
+
+        // Converged tiles do not receive samples anymore
+        float value = converged[i] ? 0.f : tile_error[i];
+        pdf[i] = value;
+        sum += value;
+        count += converged[i] ? 0 : 1;
+    }
+
+    lds[lid] = sum;
+    lds_count[lid] = count;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Exclusive scan of range sums, the number of ranges is small
+    if (lid == 0)
+    {
+        float total = 0.f;
+        int total_count = 0;
+        for (int i = 0; i < group_size; ++i)
+        {
+            float value = lds[i];
+            lds[i] = total;
+            total += value;
+            total_count += lds_count[i];
+        }
+
+        lds_total = total;
+        distribution[0] = num_tiles;
+        cdf[num_tiles] = 1.f;
+        *num_active_tiles = total_count;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    float total = lds_total;
+
+    // Fall back to uniform distribution if everything has converged
+    bool uniform = total <= 0.f;
+    float running = lds[lid];
+    for (int i = begin; i < end; ++i)
+    {
+        cdf[i] = uniform ? (float)i / num_tiles : running / total;
+        running += pdf[i];
+        pdf[i] = uniform ? 1.f : pdf[i] * num_tiles / total;
+    }
+}
+
 #endif // MONTE_CARLO_RENDERER_CL
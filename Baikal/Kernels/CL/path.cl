@@ -30,7 +30,10 @@ typedef struct _Path
     int volume;
     int flags;
     int active;
-    int extra1;
+    // Ray cone (see Path_PropagateRayCone)
+    float cone_width;
+    float cone_spread;
+    int padding[3];
 } Path;
 
 typedef enum _PathFlags
@@ -103,6 +106,13 @@ void Path_Kill(__global Path* path)
     path->flags |= kKilled;
 }
 
+// Propagate ray cone along the path segment, returns cone width at its end
+float Path_PropagateRayCone(__global Path* path, float distance)
+{
+    path->cone_width += path->cone_spread * distance;
+    return path->cone_width;
+}
+
 void Path_AddContribution(__global Path* path, __global float3* output, int idx, float3 val)
 {
     output[idx] += Path_GetThroughput(path) * val;
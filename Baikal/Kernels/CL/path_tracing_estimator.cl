@@ -57,6 +57,8 @@ void InitPathData(
         my_path->volume = INVALID_IDX;
         my_path->flags = 0;
         my_path->active = 0xFF;
+        my_path->cone_width = 0.f;
+        my_path->cone_spread = 0.f;
     }
 }
 
@@ -98,6 +100,10 @@ KERNEL void ShadeVolume(
     GLOBAL Light const* restrict lights,
     // Light distribution
     GLOBAL int const* restrict light_distribution,
+    // Light hierarchy
+    GLOBAL LightBvhNode const* restrict light_bvh,
+    // Area lights of emissive triangles
+    GLOBAL int const* restrict area_lights,
     // Number of emissive objects
     int num_lights,
     // RNG seed
@@ -138,7 +144,9 @@ KERNEL void ShadeVolume(
         lights,
         env_light_idx,
         num_lights,
-        light_distribution
+        light_distribution,
+        light_bvh,
+        area_lights
     };
 
     if (global_id < *num_hits)
@@ -181,17 +189,27 @@ KERNEL void ShadeVolume(
         // Sample light source
         float pdf = 0.f;
         float selection_pdf = 0.f;
-        float3 wo;
-
-        int light_idx = Scene_SampleLight(&scene, Sampler_Sample1D(&sampler, SAMPLER_ARGS), &selection_pdf);
+        float3 wo = 0.f;
 
         // Here we need fake differential geometry for light sampling procedure
         DifferentialGeometry dg;
         // put scattering position in there (it is along the current ray at isect.distance
         // since EvaluateVolume has put it there
         dg.p = o + wi * Intersection_GetDistance(isects + hit_idx);
-        // Get light sample intencity
-        float3 le = Light_Sample(light_idx, &scene, &dg, TEXTURE_ARGS, Sampler_Sample2D(&sampler, SAMPLER_ARGS), &wo, &pdf);
+
+        // Keep ray cone going through scattering events
+        if (bounce == 0)
+        {
+            path->cone_spread = Ray_GetExtra(&rays[hit_idx]).y;
+        }
+
+        Path_PropagateRayCone(path, Intersection_GetDistance(isects + hit_idx));
+
+        int light_idx = Scene_SampleLight(&scene, dg.p, Sampler_Sample1D(&sampler, SAMPLER_ARGS), &selection_pdf);
+
+        // Get light sample intencity (none of the lights might contribute to the point)
+        float2 light_sample = Sampler_Sample2D(&sampler, SAMPLER_ARGS);
+        float3 le = light_idx > -1 ? Light_Sample(light_idx, &scene, &dg, TEXTURE_ARGS, light_sample, &wo, &pdf) : 0.f;
 
         // Generate shadow ray
         float shadow_ray_length = length(wo);
@@ -244,6 +262,287 @@ KERNEL void ShadeVolume(
     }
 }
 
+///< Calculate material sort keys for hits, keys of inactive slots should be cleared beforehand
+KERNEL void GenerateShadingKeys(
+    // Intersection data
+    GLOBAL Intersection const* restrict isects,
+    // Hit indices
+    GLOBAL int const* restrict hit_indices,
+    // Number of rays
+    GLOBAL int const* restrict num_hits,
+    // Shapes
+    GLOBAL Shape const* restrict shapes,
+    // Material IDs
+    GLOBAL int const* restrict material_ids,
+    // Materials
+    GLOBAL Material const* restrict materials,
+    // Sort keys
+    GLOBAL int* restrict keys
+)
+{
+    int global_id = get_global_id(0);
+
+    if (global_id < *num_hits)
+    {
+        Intersection isect = isects[hit_indices[global_id]];
+        Shape shape = shapes[isect.shapeid - 1];
+        int material_idx = material_ids[shape.start_material_idx + isect.primid];
+
+        // Group by BxDF type first to reduce divergence, then by material to keep texture access coherent
+        keys[global_id] = (materials[material_idx].type << 24) | (material_idx & 0xffffff);
+    }
+}
+
+// Shade single surface hit: account for emission or sample direct lighting
+// and generate path continuation. Shadow ray, light sample and indirect ray
+// go to the slot global_id. This is only applied to non-scattered paths.
+INLINE void ShadeSurface_Hit(
+    // Scene
+    Scene const* scene,
+    // Ray that produced the hit
+    GLOBAL ray const* restrict hit_ray,
+    // Intersection data
+    Intersection isect,
+    // Pixel index
+    int pixel_idx,
+    // Output index
+    int output_index,
+    // Slot for generated rays
+    int global_id,
+    // Textures
+    TEXTURE_ARG_LIST,
+    // RNG seed
+    uint rng_seed,
+    // Sampler states
+    GLOBAL uint* restrict random,
+    // Sobol matrices
+    GLOBAL uint const* restrict sobol_mat,
+    // Current bounce
+    int bounce,
+    // Frame
+    int frame,
+    // Volume data
+    GLOBAL Volume const* restrict volumes,
+    // Shadow rays
+    GLOBAL ray* restrict shadow_rays,
+    // Light samples
+    GLOBAL float3* restrict light_samples,
+    // Path
+    GLOBAL Path* restrict path,
+    // Indirect rays
+    GLOBAL ray* restrict indirect_rays,
+    // Radiance
+    GLOBAL float3* restrict output
+)
+{
+    // Early exit for scattered paths
+    if (Path_IsScattered(path))
+    {
+        return;
+    }
+
+    // Fetch incoming ray direction
+    float3 wi = -normalize(hit_ray->d.xyz);
+
+    Sampler sampler;
+#if SAMPLER == SOBOL 
+    uint scramble = random[pixel_idx] * 0x1fe3434f;
+    Sampler_Init(&sampler, frame, SAMPLE_DIM_SURFACE_OFFSET + bounce * SAMPLE_DIMS_PER_BOUNCE, scramble);
+#elif SAMPLER == RANDOM
+    uint scramble = pixel_idx * rng_seed;
+    Sampler_Init(&sampler, scramble);
+#elif SAMPLER == CMJ
+    uint rnd = random[pixel_idx];
+    uint scramble = rnd * 0x1fe3434f * ((frame + 331 * rnd) / (CMJ_DIM * CMJ_DIM));
+    Sampler_Init(&sampler, frame % (CMJ_DIM * CMJ_DIM), SAMPLE_DIM_SURFACE_OFFSET + bounce * SAMPLE_DIMS_PER_BOUNCE, scramble);
+#endif
+
+    // Fill surface data
+    DifferentialGeometry diffgeo;
+    Scene_FillDifferentialGeometry(scene, &isect, &diffgeo); 
+
+    // Camera rays carry ray cone spread angle, its width at the hit gives texture LOD
+    if (bounce == 0)
+    {
+        path->cone_spread = Ray_GetExtra(hit_ray).y;
+    }
+
+    DifferentialGeometry_SetRayConeLod(&diffgeo, wi, Path_PropagateRayCone(path, isect.uvwt.w));
+
+    // Check if we are hitting from the inside
+    float ngdotwi = dot(diffgeo.ng, wi);
+    bool backfacing = ngdotwi < 0.f;
+
+    // Select BxDF 
+    Material_Select(scene, wi, &sampler, TEXTURE_ARGS, SAMPLER_ARGS, &diffgeo);
+
+    // Terminate if emissive
+    if (Bxdf_IsEmissive(&diffgeo))
+    {
+        if (!backfacing)
+        {
+            float weight = 1.f;
+
+            if (bounce > 0 && !Path_IsSpecular(path))
+            {
+                float2 extra = Ray_GetExtra(hit_ray);
+                float ld = isect.uvwt.w;
+                float denom = fabs(dot(diffgeo.n, wi)) * diffgeo.area;
+                // Light sampling picks the triangle with the same pdf from the previous vertex,
+                // emissive triangles without a light can't be sampled
+                int light_idx = Scene_GetAreaLightIdx(scene, isect.shapeid - 1, isect.primid);
+                float selection_pdf = light_idx >= 0 ? Scene_GetLightPdf(scene, light_idx, hit_ray->o.xyz) : 0.f;
+                float bxdf_light_pdf = denom > 0.f ? (ld * ld / denom * selection_pdf) : 0.f;
+                weight = extra.x > 0.f ? BalanceHeuristic(1, extra.x, 1, bxdf_light_pdf) : 1.f;
+            }
+
+            // In this case we hit after an application of MIS process at previous step.
+            // That means BRDF weight has been already applied.
+            float3 v = Path_GetThroughput(path) * Emissive_GetLe(&diffgeo, TEXTURE_ARGS) * weight;
+            ADD_FLOAT3(&output[output_index], v);
+        }
+
+        Path_Kill(path);
+        Ray_SetInactive(shadow_rays + global_id);
+        Ray_SetInactive(indirect_rays + global_id);
+
+        light_samples[global_id] = 0.f;
+        return;
+    }
+
+
+    float s = Bxdf_IsBtdf(&diffgeo) ? (-sign(ngdotwi)) : 1.f;
+    if (backfacing && !Bxdf_IsBtdf(&diffgeo))
+    {
+        //Reverse normal and tangents in this case
+        //but not for BTDFs, since BTDFs rely
+        //on normal direction in order to arrange   
+        //indices of refraction
+        diffgeo.n = -diffgeo.n;
+        diffgeo.dpdu = -diffgeo.dpdu;
+        diffgeo.dpdv = -diffgeo.dpdv;
+        s = -s;
+    }
+
+
+    DifferentialGeometry_ApplyBumpNormalMap(&diffgeo, TEXTURE_ARGS);
+    DifferentialGeometry_CalculateTangentTransforms(&diffgeo);
+
+    float ndotwi = fabs(dot(diffgeo.n, wi));
+
+    float light_pdf = 0.f;
+    float bxdf_light_pdf = 0.f;
+    float bxdf_pdf = 0.f;
+    float light_bxdf_pdf = 0.f;
+    float selection_pdf = 0.f;
+    float3 radiance = 0.f;
+    float3 lightwo;
+    float3 bxdfwo;
+    float3 wo;
+    float bxdf_weight = 1.f;
+    float light_weight = 1.f;
+
+    int light_idx = Scene_SampleLight(scene, diffgeo.p, Sampler_Sample1D(&sampler, SAMPLER_ARGS), &selection_pdf);
+
+    float3 throughput = Path_GetThroughput(path);
+
+    // Sample bxdf
+    float3 bxdf = Bxdf_Sample(&diffgeo, wi, TEXTURE_ARGS, Sampler_Sample2D(&sampler, SAMPLER_ARGS), &bxdfwo, &bxdf_pdf);
+
+    // If we have light to sample we can hopefully do mis 
+    if (light_idx > -1) 
+    {
+        // Sample light
+        float3 le = Light_Sample(light_idx, scene, &diffgeo, TEXTURE_ARGS, Sampler_Sample2D(&sampler, SAMPLER_ARGS), &lightwo, &light_pdf);
+        light_bxdf_pdf = Bxdf_GetPdf(&diffgeo, wi, normalize(lightwo), TEXTURE_ARGS);
+        light_weight = Light_IsSingular(&scene->lights[light_idx]) ? 1.f : BalanceHeuristic(1, light_pdf * selection_pdf, 1, light_bxdf_pdf); 
+
+        // Apply MIS to account for both
+        if (NON_BLACK(le) && light_pdf > 0.0f && !Bxdf_IsSingular(&diffgeo))
+        {
+            wo = lightwo;
+            float ndotwo = fabs(dot(diffgeo.n, normalize(wo)));
+            radiance = le * ndotwo * Bxdf_Evaluate(&diffgeo, wi, normalize(wo), TEXTURE_ARGS) * throughput * light_weight / light_pdf / selection_pdf;
+        }
+    }
+
+    // If we have some light here generate a shadow ray
+    if (NON_BLACK(radiance))
+    {
+        // Generate shadow ray
+        float3 shadow_ray_o = diffgeo.p + CRAZY_LOW_DISTANCE * s * diffgeo.ng;
+        float3 temp = diffgeo.p + wo - shadow_ray_o;
+        float3 shadow_ray_dir = normalize(temp);
+        float shadow_ray_length = length(temp);
+        int shadow_ray_mask = VISIBILITY_MASK_BOUNCE_SHADOW(bounce);
+
+        Ray_Init(shadow_rays + global_id, shadow_ray_o, shadow_ray_dir, shadow_ray_length, 0.f, shadow_ray_mask);
+
+        // Apply the volume to shadow ray if needed
+        int volume_idx = Path_GetVolumeIdx(path);
+        if (volume_idx != -1)
+        {
+            radiance *= Volume_Transmittance(&volumes[volume_idx], &shadow_rays[global_id], shadow_ray_length);
+            radiance += Volume_Emission(&volumes[volume_idx], &shadow_rays[global_id], shadow_ray_length) * throughput;
+        }
+
+        // And write the light sample 
+        light_samples[global_id] = REASONABLE_RADIANCE(radiance);
+    }
+    else
+    {
+        // Otherwise save some intersector cycles
+        Ray_SetInactive(shadow_rays + global_id);
+        light_samples[global_id] = 0;
+    }
+
+    // Apply Russian roulette
+    float q = max(min(0.5f,
+        // Luminance
+        0.2126f * throughput.x + 0.7152f * throughput.y + 0.0722f * throughput.z), 0.01f);
+    // Only if it is 3+ bounce
+    bool rr_apply = bounce > 3;
+    bool rr_stop = Sampler_Sample1D(&sampler, SAMPLER_ARGS) > q && rr_apply;
+
+    if (rr_apply)
+    {
+        Path_MulThroughput(path, 1.f / q);
+    }
+
+    if (Bxdf_IsSingular(&diffgeo))
+    {
+        Path_SetSpecularFlag(path);
+    }
+    else
+    {
+        Path_ClearSpecularFlag(path);
+    }
+
+    bxdfwo = normalize(bxdfwo);
+    float3 t = bxdf * fabs(dot(diffgeo.n, bxdfwo));
+
+    // Only continue if we have non-zero throughput & pdf
+    if (NON_BLACK(t) && bxdf_pdf > 0.f && !rr_stop)
+    {
+        // Update the throughput
+        Path_MulThroughput(path, t / bxdf_pdf);
+
+        // Generate ray
+        float3 indirect_ray_dir = bxdfwo;
+        float3 indirect_ray_o = diffgeo.p + CRAZY_LOW_DISTANCE * s * diffgeo.ng;
+        int indirect_ray_mask = VISIBILITY_MASK_BOUNCE(bounce + 1);
+
+        Ray_Init(indirect_rays + global_id, indirect_ray_o, indirect_ray_dir, CRAZY_HIGH_DISTANCE, 0.f, indirect_ray_mask);
+        Ray_SetExtra(indirect_rays + global_id, make_float2(Bxdf_IsSingular(&diffgeo) ? 0.f : bxdf_pdf, 0.f));
+    }
+    else
+    {
+        // Otherwise kill the path
+        Path_Kill(path);
+        Ray_SetInactive(indirect_rays + global_id);
+    }
+}
+
 // Handle ray-surface interaction possibly generating path continuation. 
 // This is only applied to non-scattered paths.
 KERNEL void ShadeSurface(
@@ -259,6 +558,8 @@ KERNEL void ShadeSurface(
     GLOBAL int const*  restrict output_indices,
     // Number of rays
     GLOBAL int const* restrict num_hits,
+    // Order of hits to shade
+    GLOBAL int const* restrict shading_order,
     // Vertices
     GLOBAL float3 const* restrict vertices,
     // Normals
@@ -281,6 +582,10 @@ KERNEL void ShadeSurface(
     GLOBAL Light const* restrict lights,
     // Light distribution
     GLOBAL int const* restrict light_distribution,
+    // Light hierarchy
+    GLOBAL LightBvhNode const* restrict light_bvh,
+    // Area lights of emissive triangles
+    GLOBAL int const* restrict area_lights,
     // Number of emissive objects
     int num_lights,
     // RNG seed
@@ -321,215 +626,25 @@ KERNEL void ShadeSurface(
         lights,
         env_light_idx,
         num_lights,
-        light_distribution
+        light_distribution,
+        light_bvh,
+        area_lights
     };
 
     // Only applied to active rays after compaction
     if (global_id < *num_hits)
     {
+        // Hits might be shaded out of order, results stay in place
+        global_id = shading_order[global_id];
+
         // Fetch index
         int hit_idx = hit_indices[global_id];
         int pixel_idx = pixel_indices[global_id];
         Intersection isect = isects[hit_idx];
 
-        GLOBAL Path* path = paths + pixel_idx;
-
-        // Early exit for scattered paths
-        if (Path_IsScattered(path))
-        {
-            return;
-        }
-
-        // Fetch incoming ray direction
-        float3 wi = -normalize(rays[hit_idx].d.xyz);
-
-        Sampler sampler;
-#if SAMPLER == SOBOL 
-        uint scramble = random[pixel_idx] * 0x1fe3434f;
-        Sampler_Init(&sampler, frame, SAMPLE_DIM_SURFACE_OFFSET + bounce * SAMPLE_DIMS_PER_BOUNCE, scramble);
-#elif SAMPLER == RANDOM
-        uint scramble = pixel_idx * rng_seed;
-        Sampler_Init(&sampler, scramble);
-#elif SAMPLER == CMJ
-        uint rnd = random[pixel_idx];
-        uint scramble = rnd * 0x1fe3434f * ((frame + 331 * rnd) / (CMJ_DIM * CMJ_DIM));
-        Sampler_Init(&sampler, frame % (CMJ_DIM * CMJ_DIM), SAMPLE_DIM_SURFACE_OFFSET + bounce * SAMPLE_DIMS_PER_BOUNCE, scramble);
-#endif
-
-        // Fill surface data
-        DifferentialGeometry diffgeo;
-        Scene_FillDifferentialGeometry(&scene, &isect, &diffgeo); 
-
-        // Check if we are hitting from the inside
-        float ngdotwi = dot(diffgeo.ng, wi);
-        bool backfacing = ngdotwi < 0.f;
-
-        // Select BxDF 
-        Material_Select(&scene, wi, &sampler, TEXTURE_ARGS, SAMPLER_ARGS, &diffgeo);
-
-        // Terminate if emissive
-        if (Bxdf_IsEmissive(&diffgeo))
-        {
-            if (!backfacing)
-            {
-                float weight = 1.f;
-
-                if (bounce > 0 && !Path_IsSpecular(path))
-                {
-                    float2 extra = Ray_GetExtra(&rays[hit_idx]);
-                    float ld = isect.uvwt.w;
-                    float denom = fabs(dot(diffgeo.n, wi)) * diffgeo.area;
-                    // TODO: num_lights should be num_emissies instead, presence of analytical lights breaks this code
-                    float bxdf_light_pdf = denom > 0.f ? (ld * ld / denom / num_lights) : 0.f;
-                    weight = extra.x > 0.f ? BalanceHeuristic(1, extra.x, 1, bxdf_light_pdf) : 1.f;
-                }
-
-                // In this case we hit after an application of MIS process at previous step.
-                // That means BRDF weight has been already applied.
-                float3 v = Path_GetThroughput(path) * Emissive_GetLe(&diffgeo, TEXTURE_ARGS) * weight;
-                int output_index = output_indices[pixel_idx];
-                ADD_FLOAT3(&output[output_index], v);
-            }
-
-            Path_Kill(path);
-            Ray_SetInactive(shadow_rays + global_id);
-            Ray_SetInactive(indirect_rays + global_id);
-
-            light_samples[global_id] = 0.f;
-            return;
-        }
-
-
-        float s = Bxdf_IsBtdf(&diffgeo) ? (-sign(ngdotwi)) : 1.f;
-        if (backfacing && !Bxdf_IsBtdf(&diffgeo))
-        {
-            //Reverse normal and tangents in this case
-            //but not for BTDFs, since BTDFs rely
-            //on normal direction in order to arrange   
-            //indices of refraction
-            diffgeo.n = -diffgeo.n;
-            diffgeo.dpdu = -diffgeo.dpdu;
-            diffgeo.dpdv = -diffgeo.dpdv;
-            s = -s;
-        }
-
-
-        DifferentialGeometry_ApplyBumpNormalMap(&diffgeo, TEXTURE_ARGS);
-        DifferentialGeometry_CalculateTangentTransforms(&diffgeo);
-
-        float ndotwi = fabs(dot(diffgeo.n, wi));
-
-        float light_pdf = 0.f;
-        float bxdf_light_pdf = 0.f;
-        float bxdf_pdf = 0.f;
-        float light_bxdf_pdf = 0.f;
-        float selection_pdf = 0.f;
-        float3 radiance = 0.f;
-        float3 lightwo;
-        float3 bxdfwo;
-        float3 wo;
-        float bxdf_weight = 1.f;
-        float light_weight = 1.f;
-
-        int light_idx = Scene_SampleLight(&scene, Sampler_Sample1D(&sampler, SAMPLER_ARGS), &selection_pdf);
-
-        float3 throughput = Path_GetThroughput(path);
-
-        // Sample bxdf
-        float3 bxdf = Bxdf_Sample(&diffgeo, wi, TEXTURE_ARGS, Sampler_Sample2D(&sampler, SAMPLER_ARGS), &bxdfwo, &bxdf_pdf);
-
-        // If we have light to sample we can hopefully do mis 
-        if (light_idx > -1) 
-        {
-            // Sample light
-            float3 le = Light_Sample(light_idx, &scene, &diffgeo, TEXTURE_ARGS, Sampler_Sample2D(&sampler, SAMPLER_ARGS), &lightwo, &light_pdf);
-            light_bxdf_pdf = Bxdf_GetPdf(&diffgeo, wi, normalize(lightwo), TEXTURE_ARGS);
-            light_weight = Light_IsSingular(&scene.lights[light_idx]) ? 1.f : BalanceHeuristic(1, light_pdf * selection_pdf, 1, light_bxdf_pdf); 
-
-            // Apply MIS to account for both
-            if (NON_BLACK(le) && light_pdf > 0.0f && !Bxdf_IsSingular(&diffgeo))
-            {
-                wo = lightwo;
-                float ndotwo = fabs(dot(diffgeo.n, normalize(wo)));
-                radiance = le * ndotwo * Bxdf_Evaluate(&diffgeo, wi, normalize(wo), TEXTURE_ARGS) * throughput * light_weight / light_pdf / selection_pdf;
-            }
-        }
-
-        // If we have some light here generate a shadow ray
-        if (NON_BLACK(radiance))
-        {
-            // Generate shadow ray
-            float3 shadow_ray_o = diffgeo.p + CRAZY_LOW_DISTANCE * s * diffgeo.ng;
-            float3 temp = diffgeo.p + wo - shadow_ray_o;
-            float3 shadow_ray_dir = normalize(temp);
-            float shadow_ray_length = length(temp);
-            int shadow_ray_mask = VISIBILITY_MASK_BOUNCE_SHADOW(bounce);
-
-            Ray_Init(shadow_rays + global_id, shadow_ray_o, shadow_ray_dir, shadow_ray_length, 0.f, shadow_ray_mask);
-
-            // Apply the volume to shadow ray if needed
-            int volume_idx = Path_GetVolumeIdx(path);
-            if (volume_idx != -1)
-            {
-                radiance *= Volume_Transmittance(&volumes[volume_idx], &shadow_rays[global_id], shadow_ray_length);
-                radiance += Volume_Emission(&volumes[volume_idx], &shadow_rays[global_id], shadow_ray_length) * throughput;
-            }
-
-            // And write the light sample 
-            light_samples[global_id] = REASONABLE_RADIANCE(radiance);
-        }
-        else
-        {
-            // Otherwise save some intersector cycles
-            Ray_SetInactive(shadow_rays + global_id);
-            light_samples[global_id] = 0;
-        }
-
-        // Apply Russian roulette
-        float q = max(min(0.5f,
-            // Luminance
-            0.2126f * throughput.x + 0.7152f * throughput.y + 0.0722f * throughput.z), 0.01f);
-        // Only if it is 3+ bounce
-        bool rr_apply = bounce > 3;
-        bool rr_stop = Sampler_Sample1D(&sampler, SAMPLER_ARGS) > q && rr_apply;
-
-        if (rr_apply)
-        {
-            Path_MulThroughput(path, 1.f / q);
-        }
-
-        if (Bxdf_IsSingular(&diffgeo))
-        {
-            Path_SetSpecularFlag(path);
-        }
-        else
-        {
-            Path_ClearSpecularFlag(path);
-        }
-
-        bxdfwo = normalize(bxdfwo);
-        float3 t = bxdf * fabs(dot(diffgeo.n, bxdfwo));
-
-        // Only continue if we have non-zero throughput & pdf
-        if (NON_BLACK(t) && bxdf_pdf > 0.f && !rr_stop)
-        {
-            // Update the throughput
-            Path_MulThroughput(path, t / bxdf_pdf);
-
-            // Generate ray
-            float3 indirect_ray_dir = bxdfwo;
-            float3 indirect_ray_o = diffgeo.p + CRAZY_LOW_DISTANCE * s * diffgeo.ng;
-            int indirect_ray_mask = VISIBILITY_MASK_BOUNCE(bounce + 1);
-
-            Ray_Init(indirect_rays + global_id, indirect_ray_o, indirect_ray_dir, CRAZY_HIGH_DISTANCE, 0.f, indirect_ray_mask);
-            Ray_SetExtra(indirect_rays + global_id, make_float2(Bxdf_IsSingular(&diffgeo) ? 0.f : bxdf_pdf, 0.f));
-        }
-        else
-        {
-            // Otherwise kill the path
-            Path_Kill(path);
-            Ray_SetInactive(indirect_rays + global_id);
-        }
+        ShadeSurface_Hit(&scene, rays + hit_idx, isect, pixel_idx, output_indices[pixel_idx], global_id,
+            TEXTURE_ARGS, rng_seed, random, sobol_mat, bounce, frame, volumes,
+            shadow_rays, light_samples, paths + pixel_idx, indirect_rays, output);
     }
 }
 
@@ -738,6 +853,87 @@ KERNEL void FilterPathStream(
     }
 }
 
+// Spread lower 10 bits of a value to every third bit
+INLINE uint MortonExpandBits(uint v)
+{
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+///< Calculate ray sort keys: direction octant first, then Morton code of ray origin within scene bounds
+KERNEL void GenerateRayKeys(
+    // Ray batch
+    GLOBAL ray const* restrict rays,
+    // Number of rays
+    GLOBAL int const* restrict num_rays,
+    // Scene bounds
+    float scene_min_x,
+    float scene_min_y,
+    float scene_min_z,
+    float scene_max_x,
+    float scene_max_y,
+    float scene_max_z,
+    // Sort keys
+    GLOBAL int* restrict keys
+)
+{
+    int global_id = get_global_id(0);
+
+    if (global_id < *num_rays)
+    {
+        ray r = rays[global_id];
+
+        // Inactive rays go last, but before unused slots (INT_MAX)
+        if (r.extra.y == 0)
+        {
+            keys[global_id] = INT_MAX - 1;
+            return;
+        }
+
+        float3 scene_min = make_float3(scene_min_x, scene_min_y, scene_min_z);
+        float3 scene_extents = max(make_float3(scene_max_x, scene_max_y, scene_max_z) - scene_min, 1e-5f);
+        float3 p = clamp((r.o.xyz - scene_min) / scene_extents, 0.f, 1.f) * 511.f;
+
+        uint morton = (MortonExpandBits((uint)p.x) << 2) |
+            (MortonExpandBits((uint)p.y) << 1) |
+            MortonExpandBits((uint)p.z);
+
+        uint octant = (r.d.x < 0.f ? 4u : 0u) | (r.d.y < 0.f ? 2u : 0u) | (r.d.z < 0.f ? 1u : 0u);
+
+        // 3 bits of octant and 27 bits of Morton code
+        keys[global_id] = (int)((octant << 27) | morton);
+    }
+}
+
+///< Gather rays and their pixel indices in sorted order
+KERNEL void ReorderRays(
+    // Sorted order
+    GLOBAL int const* restrict order,
+    // Number of rays
+    GLOBAL int const* restrict num_rays,
+    // Rays to reorder
+    GLOBAL ray const* restrict src_rays,
+    // Pixel indices to reorder
+    GLOBAL int const* restrict src_pixel_indices,
+    // Reordered rays
+    GLOBAL ray* restrict dst_rays,
+    // Reordered pixel indices
+    GLOBAL int* restrict dst_pixel_indices
+)
+{
+    int global_id = get_global_id(0);
+
+    if (global_id < *num_rays)
+    {
+        int idx = order[global_id];
+        dst_rays[global_id] = src_rays[idx];
+        dst_pixel_indices[global_id] = src_pixel_indices[idx];
+    }
+}
+
 ///< Illuminate missing rays
 KERNEL void ShadeMiss(
     // Ray batch
@@ -753,6 +949,10 @@ KERNEL void ShadeMiss(
     GLOBAL Light const* restrict lights,
     // Light distribution
     GLOBAL int const* restrict light_distribution,
+    // Light hierarchy
+    GLOBAL LightBvhNode const* restrict light_bvh,
+    // Area lights of emissive triangles
+    GLOBAL int const* restrict area_lights,
     // Number of emissive objects
     int num_lights,
     int env_light_idx,
@@ -778,9 +978,21 @@ KERNEL void ShadeMiss(
         {
             Light light = lights[env_light_idx];
 
+            // Only lights are needed for envmap PDF
+            Scene scene =
+            {
+                0, 0, 0, 0, 0, 0, 0,
+                lights,
+                env_light_idx,
+                num_lights,
+                light_distribution,
+                light_bvh,
+                area_lights
+            };
+
             // Apply MIS
-            float selection_pdf = Distribution1D_GetPdfDiscreet(env_light_idx, light_distribution);
-            float light_pdf = EnvironmentLight_GetPdf(&light, 0, 0, rays[global_id].d.xyz, TEXTURE_ARGS);
+            float selection_pdf = Scene_GetLightPdf(&scene, env_light_idx, rays[global_id].o.xyz);
+            float light_pdf = EnvironmentLight_GetPdf(&light, &scene, 0, rays[global_id].d.xyz, TEXTURE_ARGS);
             float2 extra = Ray_GetExtra(&rays[global_id]);
             float weight = extra.x > 0.f ? BalanceHeuristic(1, extra.x, 1, light_pdf * selection_pdf) : 1.f;
 
@@ -792,3 +1004,186 @@ KERNEL void ShadeMiss(
     }
 }
 
+// Persistent threads variant of a bounce. A fixed number of work groups
+// (just enough to fill the device) fetch chunks of path slots from a global
+// counter until the batch is drained. Slots are not compacted: slot i holds
+// path i for all bounces, misses and terminated paths are handled in place.
+// Light samples of the previous bounce are resolved here as well.
+KERNEL void ShadePathsPersistent(
+    // Ray batch
+    GLOBAL ray const* restrict rays,
+    // Intersection data
+    GLOBAL Intersection const* restrict isects,
+    // Output indices
+    GLOBAL int const*  restrict output_indices,
+    // Number of rays
+    GLOBAL int const* restrict num_rays,
+    // Work queue head, zero at launch
+    GLOBAL int* restrict work_counter,
+    // Vertices
+    GLOBAL float3 const* restrict vertices,
+    // Normals
+    GLOBAL float3 const* restrict normals,
+    // UVs
+    GLOBAL float2 const* restrict uvs,
+    // Indices
+    GLOBAL int const* restrict indices,
+    // Shapes
+    GLOBAL Shape const* restrict shapes,
+    // Material IDs
+    GLOBAL int const* restrict material_ids,
+    // Materials
+    GLOBAL Material const* restrict materials,
+    // Textures
+    TEXTURE_ARG_LIST,
+    // Environment texture index
+    int env_light_idx,
+    // Emissives
+    GLOBAL Light const* restrict lights,
+    // Light distribution
+    GLOBAL int const* restrict light_distribution,
+    // Light hierarchy
+    GLOBAL LightBvhNode const* restrict light_bvh,
+    // Area lights of emissive triangles
+    GLOBAL int const* restrict area_lights,
+    // Number of emissive objects
+    int num_lights,
+    // RNG seed
+    uint rng_seed,
+    // Sampler states
+    GLOBAL uint* restrict random,
+    // Sobol matrices
+    GLOBAL uint const* restrict sobol_mat,
+    // Current bounce
+    int bounce,
+    // Frame
+    int frame,
+    // Volume data
+    GLOBAL Volume const* restrict volumes,
+    // Shadow rays hits of the previous bounce
+    GLOBAL int const* restrict shadow_hits,
+    // Shadow rays
+    GLOBAL ray* restrict shadow_rays,
+    // Light samples
+    GLOBAL float3* restrict light_samples,
+    // Path throughput
+    GLOBAL Path* restrict paths,
+    // Indirect rays
+    GLOBAL ray* restrict indirect_rays,
+    // Radiance
+    GLOBAL float3* restrict output
+)
+{
+    Scene scene =
+    {
+        vertices,
+        normals,
+        uvs,
+        indices,
+        shapes,
+        material_ids,
+        materials,
+        lights,
+        env_light_idx,
+        num_lights,
+        light_distribution,
+        light_bvh,
+        area_lights
+    };
+
+    __local int chunk_start;
+
+    int num_items = *num_rays;
+
+    while (true)
+    {
+        // Fetch next chunk for the whole group
+        if (get_local_id(0) == 0)
+        {
+            chunk_start = atomic_add(work_counter, (int)get_local_size(0));
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+        int first_id = chunk_start;
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        // The queue is drained, the whole group leaves together
+        if (first_id >= num_items)
+        {
+            break;
+        }
+
+        int global_id = first_id + get_local_id(0);
+
+        if (global_id < num_items)
+        {
+            int output_index = output_indices[global_id];
+            GLOBAL Path* path = paths + global_id;
+
+            // Light sample of the previous bounce has reached the light
+            if (bounce > 0 && shadow_hits[global_id] == -1)
+            {
+                ADD_FLOAT3(&output[output_index], light_samples[global_id]);
+            }
+
+            Intersection isect = isects[global_id];
+
+            // Camera rays add background and account for the sample itself
+            if (bounce == 0)
+            {
+                float4 v = make_float4(0.f, 0.f, 0.f, 1.f);
+
+                if (isect.shapeid < 0 && env_light_idx != -1)
+                {
+                    Light light = lights[env_light_idx];
+                    v.xyz = light.multiplier * Texture_SampleEnvMap(rays[global_id].d.xyz, TEXTURE_ARGS_IDX(light.tex));
+                }
+
+                ADD_FLOAT4((GLOBAL float4*)(output + output_index), v);
+            }
+
+            bool shade = Path_IsAlive(path);
+
+            // Missed rays pick up environment light with MIS and terminate
+            if (shade && isect.shapeid < 0)
+            {
+                if (bounce > 0 && env_light_idx != -1)
+                {
+                    Light light = lights[env_light_idx];
+
+                    float selection_pdf = Scene_GetLightPdf(&scene, env_light_idx, rays[global_id].o.xyz);
+                    float light_pdf = EnvironmentLight_GetPdf(&light, &scene, 0, rays[global_id].d.xyz, TEXTURE_ARGS);
+                    float2 extra = Ray_GetExtra(&rays[global_id]);
+                    float weight = extra.x > 0.f ? BalanceHeuristic(1, extra.x, 1, light_pdf * selection_pdf) : 1.f;
+
+                    float3 t = Path_GetThroughput(path);
+                    float3 v = REASONABLE_RADIANCE(weight * light.multiplier * Texture_SampleEnvMap(rays[global_id].d.xyz, TEXTURE_ARGS_IDX(light.tex)) * t);
+                    ADD_FLOAT3(&output[output_index], v);
+                }
+
+                Path_Kill(path);
+                shade = false;
+            }
+
+            if (shade && length(Path_GetThroughput(path)) < CRAZY_LOW_THROUGHPUT)
+            {
+                Path_Kill(path);
+                shade = false;
+            }
+
+            if (shade)
+            {
+                ShadeSurface_Hit(&scene, rays + global_id, isect, global_id, output_index, global_id,
+                    TEXTURE_ARGS, rng_seed, random, sobol_mat, bounce, frame, volumes,
+                    shadow_rays, light_samples, path, indirect_rays, output);
+            }
+            else
+            {
+                // Terminated paths do not produce any rays
+                Ray_SetInactive(shadow_rays + global_id);
+                Ray_SetInactive(indirect_rays + global_id);
+                light_samples[global_id] = 0.f;
+            }
+        }
+    }
+}
@@ -64,6 +64,9 @@ typedef struct
     int startvtx;
     // Start material idx
     int start_material_idx;
+    // Layout of vertex data (VERTEX_LAYOUT_*)
+    int vertex_layout;
+    int padding[3];
     // Linear motion vector
     float3 linearvelocity;
     // Angular velocity
@@ -199,9 +202,33 @@ typedef struct
     float3 d;
     float3 intensity;
     int type;
-    int padding[3];
+    // Path to the light in light hierarchy (see LightBvhNode),
+    // depth is -1 for lights outside of the hierarchy
+    int bvh_trail;
+    int bvh_depth;
+    int padding;
 } Light;
 
+// Light hierarchy node, nodes are stored depth first
+typedef struct
+{
+    // Bounds of light sources
+    float3 pmin;
+    float3 pmax;
+    // Emission cone axis
+    float3 axis;
+    // Emission normals spread and emission angle past the normals
+    float cos_theta_o;
+    float cos_theta_e;
+    // Fraction of total lights power emitted by the subtree
+    float power;
+    // Right child (left child goes right after the node), -1 for leaves
+    int right;
+    // Light index for leaves, -1 for interior nodes
+    int light_idx;
+    int padding[3];
+} LightBvhNode;
+
 typedef enum
     {
         kEmpty,
@@ -241,7 +268,23 @@ enum TextureFormat
     UNKNOWN,
     RGBA8,
     RGBA16,
-    RGBA32
+    RGBA32,
+    // Block compressed, 4x4 texel blocks
+    BC1,
+    BC3,
+    BC5
+};
+
+// Max number of mip levels (enough for 32k textures)
+enum
+{
+    kMaxTextureMipLevels = 16
+};
+
+// Virtual texture tile size: 64x64 RGBA8, 64x32 RGBA16 or 32x32 RGBA32 texels
+enum
+{
+    kTextureTileSizeInBytes = 16384
 };
 
 /// Texture description
@@ -257,6 +300,13 @@ typedef
         // Format
         int fmt;
         int extra;
+        // Number of mip levels, level i is half the size of level i - 1
+        int num_levels;
+        // Virtual texture: tiles are streamed into tile cache
+        // and mip_offsets are offsets of levels in page table
+        int tiled;
+        // Offsets of mip levels relative to dataoffset
+        int mip_offsets[kMaxTextureMipLevels];
     } Texture;
 
 
@@ -275,6 +325,10 @@ typedef struct _DifferentialGeometry
     float3 dpdu;
     float3 dpdv;
     float  area;
+    // Half of log2 of triangle area ratio in UV and world spaces
+    float  uv_lod_bias;
+    // Texture level of detail: log2 of footprint width in UV space
+    float  lod;
 
     matrix4x4 world_to_tangent;
     matrix4x4 tangent_to_world;
@@ -416,10 +416,11 @@ float Distribution1D_GetPdf(float s, GLOBAL int const* data)
     GLOBAL float const* cdf_data = (GLOBAL float const*)&data[1];
     GLOBAL float const* pdf_data = cdf_data + num_segments + 1;
 
-    int segment_idx = max(lower_bound(cdf_data, num_segments + 1, s), 1);
+    // s is a value in [0,1] range, so segment is found directly
+    int segment_idx = clamp((int)(s * num_segments), 0, num_segments - 1);
 
     // Calc pdf
-    return pdf_data[segment_idx - 1];
+    return pdf_data[segment_idx];
 }
 
 /// PDF of  1D distribution
@@ -433,6 +434,48 @@ float Distribution1D_GetPdfDiscreet(int d, GLOBAL int const* data)
     return pdf_data[d] / num_segments;
 }
 
+/// Size of 1D distribution data in ints
+int Distribution1D_GetSize(GLOBAL int const* data)
+{
+    return 2 * data[0] + 2;
+}
+
+/// 2D distribution is stored as width, height, marginal distribution over rows
+/// and then conditional distributions for each of the rows
+GLOBAL int const* Distribution2D_GetConditional(int row, GLOBAL int const* data)
+{
+    int width = data[0];
+    int height = data[1];
+    return data + 2 + (2 * height + 2) + row * (2 * width + 2);
+}
+
+/// Sample 2D distribution, returns point in [0,1]x[0,1]
+float2 Distribution2D_Sample(float2 s, GLOBAL int const* data, float* pdf)
+{
+    GLOBAL int const* marginal = data + 2;
+
+    // Pick row first
+    float marginal_pdf = 0.f;
+    float v = Distribution1D_Sample(s.y, marginal, &marginal_pdf);
+    int row = clamp((int)(v * data[1]), 0, data[1] - 1);
+
+    // Then pick the point within the row
+    float conditional_pdf = 0.f;
+    float u = Distribution1D_Sample(s.x, Distribution2D_GetConditional(row, data), &conditional_pdf);
+
+    *pdf = marginal_pdf * conditional_pdf;
+
+    return make_float2(u, v);
+}
+
+/// PDF of 2D distribution
+float Distribution2D_GetPdf(float2 uv, GLOBAL int const* data)
+{
+    int row = clamp((int)(uv.y * data[1]), 0, data[1] - 1);
+    return Distribution1D_GetPdf(uv.y, data + 2) *
+        Distribution1D_GetPdf(uv.x, Distribution2D_GetConditional(row, data));
+}
+
 
 
 #endif // SAMPLING_CL
@@ -50,8 +50,54 @@ typedef struct
     int num_lights;
     // Light distribution 
     GLOBAL int const* restrict light_distribution;
+    // Light hierarchy over finite lights
+    GLOBAL LightBvhNode const* restrict light_bvh;
+    // Area light indices of emissive triangles (see Scene_GetAreaLightIdx)
+    GLOBAL int const* restrict area_lights;
 } Scene;
 
+// Vertex layouts, should match Baikal::VertexLayout
+#define VERTEX_LAYOUT_FULL 0
+// Full precision position with octahedral normal in w in vertices,
+// half2 uvs packed two per uvs element (normals are unused)
+#define VERTEX_LAYOUT_COMPACT 1
+
+// Fetch object space vertex position
+INLINE float3 Scene_GetVertexPosition(Scene const* scene, Shape const* shape, int idx)
+{
+    float3 p = scene->vertices[shape->startvtx + idx];
+
+    // w holds packed normal in compact layout
+    if (shape->vertex_layout == VERTEX_LAYOUT_COMPACT)
+    {
+        p.w = 0.f;
+    }
+
+    return p;
+}
+
+// Fetch object space vertex normal
+INLINE float3 Scene_GetVertexNormal(Scene const* scene, Shape const* shape, int idx)
+{
+    if (shape->vertex_layout == VERTEX_LAYOUT_COMPACT)
+    {
+        return Output_UnpackOctNormal(as_uint(scene->vertices[shape->startvtx + idx].w));
+    }
+
+    return scene->normals[shape->startvtx + idx];
+}
+
+// Fetch vertex uv
+INLINE float2 Scene_GetVertexUV(Scene const* scene, Shape const* shape, int idx)
+{
+    if (shape->vertex_layout == VERTEX_LAYOUT_COMPACT)
+    {
+        return vload_half2(shape->startvtx + idx, (GLOBAL half const*)scene->uvs);
+    }
+
+    return scene->uvs[shape->startvtx + idx];
+}
+
 // Get triangle vertices given scene, shape index and prim index
 INLINE void Scene_GetTriangleVertices(Scene const* scene, int shape_idx, int prim_idx, float3* v0, float3* v1, float3* v2)
 {
@@ -64,9 +110,9 @@ INLINE void Scene_GetTriangleVertices(Scene const* scene, int shape_idx, int pri
     int i2 = scene->indices[shape.startidx + 3 * prim_idx + 2];
 
     // Fetch positions and transform to world space
-    *v0 = matrix_mul_point3(shape.transform, scene->vertices[shape.startvtx + i0]);
-    *v1 = matrix_mul_point3(shape.transform, scene->vertices[shape.startvtx + i1]);
-    *v2 = matrix_mul_point3(shape.transform, scene->vertices[shape.startvtx + i2]);
+    *v0 = matrix_mul_point3(shape.transform, Scene_GetVertexPosition(scene, &shape, i0));
+    *v1 = matrix_mul_point3(shape.transform, Scene_GetVertexPosition(scene, &shape, i1));
+    *v2 = matrix_mul_point3(shape.transform, Scene_GetVertexPosition(scene, &shape, i2));
 }
 
 // Get triangle uvs given scene, shape index and prim index
@@ -81,9 +127,9 @@ INLINE void Scene_GetTriangleUVs(Scene const* scene, int shape_idx, int prim_idx
     int i2 = scene->indices[shape.startidx + 3 * prim_idx + 2];
 
     // Fetch positions and transform to world space
-    *uv0 = scene->uvs[shape.startvtx + i0];
-    *uv1 = scene->uvs[shape.startvtx + i1];
-    *uv2 = scene->uvs[shape.startvtx + i2];
+    *uv0 = Scene_GetVertexUV(scene, &shape, i0);
+    *uv1 = Scene_GetVertexUV(scene, &shape, i1);
+    *uv2 = Scene_GetVertexUV(scene, &shape, i2);
 }
 
 
@@ -99,19 +145,19 @@ INLINE void Scene_InterpolateAttributes(Scene const* scene, int shape_idx, int p
     int i2 = scene->indices[shape.startidx + 3 * prim_idx + 2];
 
     // Fetch normals
-    float3 n0 = scene->normals[shape.startvtx + i0];
-    float3 n1 = scene->normals[shape.startvtx + i1];
-    float3 n2 = scene->normals[shape.startvtx + i2];
+    float3 n0 = Scene_GetVertexNormal(scene, &shape, i0);
+    float3 n1 = Scene_GetVertexNormal(scene, &shape, i1);
+    float3 n2 = Scene_GetVertexNormal(scene, &shape, i2);
 
     // Fetch positions and transform to world space
-    float3 v0 = matrix_mul_point3(shape.transform, scene->vertices[shape.startvtx + i0]);
-    float3 v1 = matrix_mul_point3(shape.transform, scene->vertices[shape.startvtx + i1]);
-    float3 v2 = matrix_mul_point3(shape.transform, scene->vertices[shape.startvtx + i2]);
+    float3 v0 = matrix_mul_point3(shape.transform, Scene_GetVertexPosition(scene, &shape, i0));
+    float3 v1 = matrix_mul_point3(shape.transform, Scene_GetVertexPosition(scene, &shape, i1));
+    float3 v2 = matrix_mul_point3(shape.transform, Scene_GetVertexPosition(scene, &shape, i2));
 
     // Fetch UVs
-    float2 uv0 = scene->uvs[shape.startvtx + i0];
-    float2 uv1 = scene->uvs[shape.startvtx + i1];
-    float2 uv2 = scene->uvs[shape.startvtx + i2];
+    float2 uv0 = Scene_GetVertexUV(scene, &shape, i0);
+    float2 uv1 = Scene_GetVertexUV(scene, &shape, i1);
+    float2 uv2 = Scene_GetVertexUV(scene, &shape, i2);
 
     // Calculate barycentric position and normal
     *p = (1.f - barycentrics.x - barycentrics.y) * v0 + barycentrics.x * v1 + barycentrics.y * v2;
@@ -209,9 +255,21 @@ void Scene_FillDifferentialGeometry(// Scene
         diffgeo->dpdv = normalize(cross(diffgeo->n, diffgeo->dpdu));
     }
 
+    // Texture footprint is unknown here, so base level is sampled
+    // unless it is set (see DifferentialGeometry_SetRayConeLod)
+    diffgeo->uv_lod_bias = (area > 0.f && det != 0.f) ? 0.5f * log2(0.5f * fabs(det) / area) : 0.f;
+    diffgeo->lod = TEXTURE_BASE_LOD;
+
     diffgeo->material_index = material_idx;
 }
 
+// Set texture level of detail from ray cone width at the shading point
+INLINE void DifferentialGeometry_SetRayConeLod(DifferentialGeometry* diffgeo, float3 wi, float cone_width)
+{
+    float cos_theta = fabs(dot(diffgeo->ng, wi));
+    diffgeo->lod = (cone_width > 0.f && cos_theta > 0.f) ? diffgeo->uv_lod_bias + log2(cone_width / cos_theta) : TEXTURE_BASE_LOD;
+}
+
 
 // Calculate tangent transform matrices inside differential geometry
 INLINE void DifferentialGeometry_CalculateTangentTransforms(DifferentialGeometry* diffgeo)
@@ -232,8 +290,115 @@ INLINE void DifferentialGeometry_CalculateTangentTransforms(DifferentialGeometry
 
 #define POWER_SAMPLING
 
-// Sample light index
-INLINE int Scene_SampleLight(Scene const* scene, float sample, float* pdf)
+// Check if light source is at infinity and thus is not in light hierarchy
+INLINE bool Scene_IsInfiniteLight(Scene const* scene, int light_idx)
+{
+    int type = scene->lights[light_idx].type;
+    return type == kIbl || type == kDirectional;
+}
+
+// Estimate contribution of light hierarchy node to a point
+INLINE float LightBvh_GetImportance(GLOBAL LightBvhNode const* node, float3 p)
+{
+    float3 center = 0.5f * (node->pmin + node->pmax);
+    float3 extent = node->pmax - node->pmin;
+    float3 d = p - center;
+    float d2 = dot(d, d);
+    float r2 = 0.25f * dot(extent, extent);
+
+    // Angle between cone axis and direction to the point
+    float cos_theta_w = d2 > 0.f ? clamp(dot(node->axis, d) * native_rsqrt(d2), -1.f, 1.f) : 1.f;
+    // Angle bounds subtend from the point, whole sphere if the point is inside
+    float cos_theta_b = d2 > r2 ? native_sqrt(1.f - r2 / d2) : -1.f;
+
+    // Minimum angle between emission directions and direction to the point
+    float theta = max(acos(cos_theta_w) - acos(node->cos_theta_o) - acos(cos_theta_b), 0.f);
+
+    if (theta > acos(node->cos_theta_e))
+    {
+        return 0.f;
+    }
+
+    return node->power * cos(theta) / max(max(d2, r2), 1e-8f);
+}
+
+// Probability of choosing left child of an interior node
+INLINE float LightBvh_GetLeftProbability(GLOBAL LightBvhNode const* nodes, int idx, float3 p)
+{
+    float left = LightBvh_GetImportance(&nodes[idx + 1], p);
+    float right = LightBvh_GetImportance(&nodes[nodes[idx].right], p);
+    return left + right > 0.f ? left / (left + right) : -1.f;
+}
+
+// Stochastically traverse light hierarchy picking children by their importance
+INLINE int LightBvh_Sample(GLOBAL LightBvhNode const* nodes, float3 p, float sample, float* pdf)
+{
+    int idx = 0;
+    *pdf = 1.f;
+
+    while (nodes[idx].light_idx < 0)
+    {
+        // Empty hierarchy or no contribution
+        float left = nodes[idx].right < 0 ? -1.f : LightBvh_GetLeftProbability(nodes, idx, p);
+
+        if (left < 0.f)
+        {
+            *pdf = 0.f;
+            return -1;
+        }
+
+        // Reuse the sample for the next level
+        if (sample < left)
+        {
+            sample = sample / left;
+            *pdf *= left;
+            idx = idx + 1;
+        }
+        else
+        {
+            sample = (sample - left) / (1.f - left);
+            *pdf *= 1.f - left;
+            idx = nodes[idx].right;
+        }
+
+        sample = min(sample, ONE_MINUS_EPSILON);
+    }
+
+    return nodes[idx].light_idx;
+}
+
+// Probability of picking a light by LightBvh_Sample, walks the path stored in the light
+INLINE float LightBvh_GetPdf(GLOBAL LightBvhNode const* nodes, Light const* light, float3 p)
+{
+    int idx = 0;
+    float pdf = 1.f;
+
+    for (int i = 0; i < light->bvh_depth; ++i)
+    {
+        float left = LightBvh_GetLeftProbability(nodes, idx, p);
+
+        if (left < 0.f)
+        {
+            return 0.f;
+        }
+
+        if ((light->bvh_trail >> i) & 0x1)
+        {
+            pdf *= 1.f - left;
+            idx = nodes[idx].right;
+        }
+        else
+        {
+            pdf *= left;
+            idx = idx + 1;
+        }
+    }
+
+    return pdf;
+}
+
+// Sample light index for a point p
+INLINE int Scene_SampleLight(Scene const* scene, float3 p, float sample, float* pdf)
 {
 #ifndef POWER_SAMPLING
     int num_lights = scene->num_lights;
@@ -241,10 +406,55 @@ INLINE int Scene_SampleLight(Scene const* scene, float sample, float* pdf)
     *pdf = 1.f / num_lights;
     return light_idx;
 #else
-    int num_lights = scene->num_lights;
     int light_idx = Distribution1D_SampleDiscrete(sample, scene->light_distribution, pdf);
+
+    // Power distribution decides between light hierarchy and infinite lights,
+    // finite light is then chosen by its estimated contribution to p
+    if (scene->light_bvh && !Scene_IsInfiniteLight(scene, light_idx))
+    {
+        GLOBAL float const* cdf = (GLOBAL float const*)&scene->light_distribution[1];
+        float s = (sample - cdf[light_idx]) / (cdf[light_idx + 1] - cdf[light_idx]);
+
+        // Hierarchy root keeps the probability of choosing any finite light
+        float bvh_pdf = 0.f;
+        light_idx = LightBvh_Sample(scene->light_bvh, p, clamp(s, 0.f, ONE_MINUS_EPSILON), &bvh_pdf);
+        *pdf = scene->light_bvh[0].power * bvh_pdf;
+    }
+
     return light_idx;
 #endif
 }
 
+// Area light of emissive triangle, -1 if the triangle has no light. The table holds
+// number of shapes, then per shape offsets of segments (-1 for shapes without lights),
+// each segment is the number of primitives followed by their light indices.
+INLINE int Scene_GetAreaLightIdx(Scene const* scene, int shape_idx, int prim_idx)
+{
+    GLOBAL int const* table = scene->area_lights;
+
+    if (!table || shape_idx < 0 || shape_idx >= table[0])
+    {
+        return -1;
+    }
+
+    int offset = table[1 + shape_idx];
+    return offset >= 0 && prim_idx < table[offset] ? table[offset + 1 + prim_idx] : -1;
+}
+
+// Probability of sampling a light by Scene_SampleLight for a point p
+INLINE float Scene_GetLightPdf(Scene const* scene, int light_idx, float3 p)
+{
+#ifndef POWER_SAMPLING
+    return 1.f / scene->num_lights;
+#else
+    if (scene->light_bvh && !Scene_IsInfiniteLight(scene, light_idx))
+    {
+        Light light = scene->lights[light_idx];
+        return scene->light_bvh[0].power * LightBvh_GetPdf(scene->light_bvh, &light, p);
+    }
+
+    return Distribution1D_GetPdfDiscreet(light_idx, scene->light_distribution);
+#endif
+}
+
 #endif
@@ -28,30 +28,184 @@ THE SOFTWARE.
 
 
 /// To simplify a bit
-#define TEXTURE_ARG_LIST __global Texture const* textures, __global char const* texturedata
-#define TEXTURE_ARG_LIST_IDX(x) int x, __global Texture const* textures, __global char const* texturedata
-#define TEXTURE_ARGS textures, texturedata
-#define TEXTURE_ARGS_IDX(x) x, textures, texturedata
+#define TEXTURE_ARG_LIST __global Texture const* textures, __global char const* texturedata, __global char const* tilecache, __global int2* pagetable
+#define TEXTURE_ARG_LIST_IDX(x) int x, __global Texture const* textures, __global char const* texturedata, __global char const* tilecache, __global int2* pagetable
+#define TEXTURE_ARGS textures, texturedata, tilecache, pagetable
+#define TEXTURE_ARGS_IDX(x) x, textures, texturedata, tilecache, pagetable
 
-/// Sample 2D texture
+/// Decode color endpoint block (BC1 or color part of BC3), texel is in [0, 16) range.
+/// BC1 blocks with c0 <= c1 have 3 colors and transparent black.
 inline
-float4 Texture_Sample2D(float2 uv, TEXTURE_ARG_LIST_IDX(texidx))
+float4 TextureData_DecodeColorBlock(uint2 block, int texel, bool bc1)
 {
-    // Get width and height
-    int width = textures[texidx].w;
-    int height = textures[texidx].h;
+    uint c0 = block.x & 0xffff;
+    uint c1 = block.x >> 16;
+    uint idx = (block.y >> (2 * texel)) & 0x3;
 
-    // Find the origin of the data in the pool
-    __global char const* mydata = texturedata + textures[texidx].dataoffset;
+    float4 col0 = make_float4((float)((c0 >> 11) & 0x1f) / 31.f, (float)((c0 >> 5) & 0x3f) / 63.f, (float)(c0 & 0x1f) / 31.f, 1.f);
+    float4 col1 = make_float4((float)((c1 >> 11) & 0x1f) / 31.f, (float)((c1 >> 5) & 0x3f) / 63.f, (float)(c1 & 0x1f) / 31.f, 1.f);
 
-    // Handle UV wrap
-    // TODO: need UV mode support
-    uv -= floor(uv);
+    if (!bc1 || c0 > c1)
+    {
+        switch (idx)
+        {
+            case 0: return col0;
+            case 1: return col1;
+            case 2: return lerp(col0, col1, 1.f / 3.f);
+            default: return lerp(col0, col1, 2.f / 3.f);
+        }
+    }
+    else
+    {
+        switch (idx)
+        {
+            case 0: return col0;
+            case 1: return col1;
+            case 2: return lerp(col0, col1, 0.5f);
+            default: return make_float4(0.f, 0.f, 0.f, 0.f);
+        }
+    }
+}
 
-    // Reverse Y:
-    // it is needed as textures are loaded with Y axis going top to down
-    // and our axis goes from down to top
-    uv.y = 1.f - uv.y;
+/// Decode single channel block (alpha of BC3, channels of BC5)
+inline
+float TextureData_DecodeAlphaBlock(uint2 block, int texel)
+{
+    float a0 = (float)(block.x & 0xff) / 255.f;
+    float a1 = (float)((block.x >> 8) & 0xff) / 255.f;
+
+    // 48 bits of 3-bit indices follow the endpoints
+    ulong bits = ((ulong)block.y << 16) | (ulong)(block.x >> 16);
+    uint idx = (uint)(bits >> (3 * texel)) & 0x7;
+
+    if (idx < 2)
+    {
+        return idx == 0 ? a0 : a1;
+    }
+
+    if (a0 > a1)
+    {
+        return mix(a0, a1, (float)(idx - 1) / 7.f);
+    }
+
+    return idx == 6 ? 0.f : (idx == 7 ? 1.f : mix(a0, a1, (float)(idx - 1) / 5.f));
+}
+
+/// Fetch texel from 4x4 block compressed data
+inline
+float4 TextureData_FetchBlockTexel(__global char const* data, int fmt, int width, int x, int y)
+{
+    int num_blocks_x = (width + 3) >> 2;
+    int block_idx = (y >> 2) * num_blocks_x + (x >> 2);
+    int texel = ((y & 3) << 2) | (x & 3);
+
+    __global uint const* blocks = (__global uint const*)data;
+
+    switch (fmt)
+    {
+        case BC1:
+        {
+            return TextureData_DecodeColorBlock(vload2(block_idx, blocks), texel, true);
+        }
+
+        case BC3:
+        {
+            uint4 block = vload4(block_idx, blocks);
+            float4 val = TextureData_DecodeColorBlock(block.zw, texel, false);
+            val.w = TextureData_DecodeAlphaBlock(block.xy, texel);
+            return val;
+        }
+
+        case BC5:
+        {
+            uint4 block = vload4(block_idx, blocks);
+            return make_float4(TextureData_DecodeAlphaBlock(block.xy, texel), TextureData_DecodeAlphaBlock(block.zw, texel), 0.f, 1.f);
+        }
+
+        default:
+        {
+            return make_float4(0.f, 0.f, 0.f, 0.f);
+        }
+    }
+}
+
+/// Tile dimensions of virtual texture (tiles have the same size in bytes)
+inline
+int2 Texture_GetTileSize(int fmt)
+{
+    switch (fmt)
+    {
+        case RGBA32: return make_int2(32, 32);
+        case RGBA16: return make_int2(64, 32);
+        default: return make_int2(64, 64);
+    }
+}
+
+/// Fetch texel of virtual texture. Access is reported to the host through page table,
+/// if the tile is not resident coarser levels are used (the last level is always resident).
+inline
+float4 Texture_FetchTiledTexel(int level, int x, int y, TEXTURE_ARG_LIST_IDX(texidx))
+{
+    int fmt = textures[texidx].fmt;
+    int2 tile_size = Texture_GetTileSize(fmt);
+    int max_level = textures[texidx].num_levels - 1;
+
+    for (int l = level; l <= max_level; ++l)
+    {
+        int width = max(textures[texidx].w >> l, 1);
+        int num_tiles_x = (width + tile_size.x - 1) / tile_size.x;
+        int page = textures[texidx].mip_offsets[l] + (y / tile_size.y) * num_tiles_x + x / tile_size.x;
+
+        int2 entry = pagetable[page];
+
+        // Only the requested level is streamed in
+        if (l == level && entry.y == 0)
+        {
+            pagetable[page].y = 1;
+        }
+
+        if (entry.x >= 0 || l == max_level)
+        {
+            __global char const* tile = tilecache + (size_t)max(entry.x, 0) * kTextureTileSizeInBytes;
+            int idx = (y % tile_size.y) * tile_size.x + x % tile_size.x;
+
+            switch (fmt)
+            {
+                case RGBA32:
+                {
+                    return *((__global float4 const*)tile + idx);
+                }
+
+                case RGBA16:
+                {
+                    return vload_half4(idx, (__global half const*)tile);
+                }
+
+                default:
+                {
+                    uchar4 val = *((__global uchar4 const*)tile + idx);
+                    return make_float4((float)val.x / 255.f, (float)val.y / 255.f, (float)val.z / 255.f, (float)val.w / 255.f);
+                }
+            }
+        }
+
+        x >>= 1;
+        y >>= 1;
+    }
+
+    return make_float4(0.f, 0.f, 0.f, 0.f);
+}
+
+/// Bilinear sample of a single mip level
+inline
+float4 Texture_SampleLevel(float2 uv, int level, TEXTURE_ARG_LIST_IDX(texidx))
+{
+    // Get width and height of the level
+    int width = max(textures[texidx].w >> level, 1);
+    int height = max(textures[texidx].h >> level, 1);
+
+    // Find the origin of the data in the pool
+    __global char const* mydata = texturedata + textures[texidx].dataoffset + textures[texidx].mip_offsets[level];
 
     // Calculate integer coordinates
     int x0 = clamp((int)floor(uv.x * width), 0, width - 1);
@@ -65,6 +219,18 @@ float4 Texture_Sample2D(float2 uv, TEXTURE_ARG_LIST_IDX(texidx))
     float wx = uv.x * width - floor(uv.x * width);
     float wy = uv.y * height - floor(uv.y * height);
 
+    if (textures[texidx].tiled)
+    {
+        // Get 4 values from tile cache
+        float4 val00 = Texture_FetchTiledTexel(level, x0, y0, TEXTURE_ARGS_IDX(texidx));
+        float4 val01 = Texture_FetchTiledTexel(level, x1, y0, TEXTURE_ARGS_IDX(texidx));
+        float4 val10 = Texture_FetchTiledTexel(level, x0, y1, TEXTURE_ARGS_IDX(texidx));
+        float4 val11 = Texture_FetchTiledTexel(level, x1, y1, TEXTURE_ARGS_IDX(texidx));
+
+        // Filter and return the result
+        return lerp(lerp(val00, val01, wx), lerp(val10, val11, wx), wy);
+    }
+
     switch (textures[texidx].fmt)
     {
         case RGBA32:
@@ -114,6 +280,22 @@ float4 Texture_Sample2D(float2 uv, TEXTURE_ARG_LIST_IDX(texidx))
             return lerp(lerp(val00, val01, wx), lerp(val10, val11, wx), wy);
         }
 
+        case BC1:
+        case BC3:
+        case BC5:
+        {
+            int fmt = textures[texidx].fmt;
+
+            // Get 4 values, neighbours mostly share the block
+            float4 val00 = TextureData_FetchBlockTexel(mydata, fmt, width, x0, y0);
+            float4 val01 = TextureData_FetchBlockTexel(mydata, fmt, width, x1, y0);
+            float4 val10 = TextureData_FetchBlockTexel(mydata, fmt, width, x0, y1);
+            float4 val11 = TextureData_FetchBlockTexel(mydata, fmt, width, x1, y1);
+
+            // Filter and return the result
+            return lerp(lerp(val00, val01, wx), lerp(val10, val11, wx), wy);
+        }
+
         default:
         {
             return make_float4(0.f, 0.f, 0.f, 0.f);
@@ -121,6 +303,38 @@ float4 Texture_Sample2D(float2 uv, TEXTURE_ARG_LIST_IDX(texidx))
     }
 }
 
+/// Sample 2D texture
+/// lod is log2 of footprint width in UV space (TEXTURE_BASE_LOD to sample base level only)
+inline
+float4 Texture_Sample2D(float2 uv, float lod, TEXTURE_ARG_LIST_IDX(texidx))
+{
+    // Handle UV wrap
+    // TODO: need UV mode support
+    uv -= floor(uv);
+
+    // Reverse Y:
+    // it is needed as textures are loaded with Y axis going top to down
+    // and our axis goes from down to top
+    uv.y = 1.f - uv.y;
+
+    // Footprint in texels of base level gives the level (ray cones, Akenine-Moller et al.)
+    int max_level = textures[texidx].num_levels - 1;
+    float level = clamp(lod + 0.5f * log2((float)(textures[texidx].w * textures[texidx].h)), 0.f, (float)max_level);
+
+    // Trilinear filtering between two closest levels
+    int level0 = (int)level;
+    float w = level - level0;
+
+    float4 val = Texture_SampleLevel(uv, level0, TEXTURE_ARGS_IDX(texidx));
+
+    if (w > 0.f && level0 < max_level)
+    {
+        val = lerp(val, Texture_SampleLevel(uv, level0 + 1, TEXTURE_ARGS_IDX(texidx)), w);
+    }
+
+    return val;
+}
+
 /// Sample lattitue-longitude environment map using 3d vector
 inline
 float3 Texture_SampleEnvMap(float3 d, TEXTURE_ARG_LIST_IDX(texidx))
@@ -135,7 +349,7 @@ float3 Texture_SampleEnvMap(float3 d, TEXTURE_ARG_LIST_IDX(texidx))
     uv.y = 1.f - theta / PI;
 
     // Sample the texture
-    return Texture_Sample2D(uv, TEXTURE_ARGS_IDX(texidx)).xyz;
+    return Texture_Sample2D(uv, TEXTURE_BASE_LOD, TEXTURE_ARGS_IDX(texidx)).xyz;
 }
 
 /// Get data from parameter value or texture
@@ -145,6 +359,8 @@ float3 Texture_GetValue3f(
                 float3 v,
                 // Texture coordinate
                 float2 uv,
+                // Texture level of detail
+                float lod,
                 // Texture args
                 TEXTURE_ARG_LIST_IDX(texidx)
                 )
@@ -153,7 +369,7 @@ float3 Texture_GetValue3f(
     if (texidx != -1)
     {
         // Sample texture
-        return native_powr(Texture_Sample2D(uv, TEXTURE_ARGS_IDX(texidx)).xyz, 2.2f);
+        return native_powr(Texture_Sample2D(uv, lod, TEXTURE_ARGS_IDX(texidx)).xyz, 2.2f);
     }
 
     // Return fixed color otherwise
@@ -167,6 +383,8 @@ float4 Texture_GetValue4f(
                 float4 v,
                 // Texture coordinate
                 float2 uv,
+                // Texture level of detail
+                float lod,
                 // Texture args
                 TEXTURE_ARG_LIST_IDX(texidx)
                 )
@@ -175,7 +393,7 @@ float4 Texture_GetValue4f(
     if (texidx != -1)
     {
         // Sample texture
-        return native_powr(Texture_Sample2D(uv, TEXTURE_ARGS_IDX(texidx)), 2.2f);
+        return native_powr(Texture_Sample2D(uv, lod, TEXTURE_ARGS_IDX(texidx)), 2.2f);
     }
 
     // Return fixed color otherwise
@@ -189,6 +407,8 @@ float Texture_GetValue1f(
                         float v,
                         // Texture coordinate
                         float2 uv,
+                        // Texture level of detail
+                        float lod,
                         // Texture args
                         TEXTURE_ARG_LIST_IDX(texidx)
                         )
@@ -197,7 +417,7 @@ float Texture_GetValue1f(
     if (texidx != -1)
     {
         // Sample texture
-        return Texture_Sample2D(uv, TEXTURE_ARGS_IDX(texidx)).x;
+        return Texture_Sample2D(uv, lod, TEXTURE_ARGS_IDX(texidx)).x;
     }
 
     // Return fixed color otherwise
@@ -290,6 +510,56 @@ inline float3 TextureData_SampleNormalFromBump_float4(__global float4 const* myd
 	return n;
 }
 
+inline float3 TextureData_SampleNormalFromBump_block(__global char const* mydata, int fmt, int width, int height, int t0, int s0)
+{
+	int t0minus = clamp(t0 - 1, 0, height - 1);
+	int t0plus = clamp(t0 + 1, 0, height - 1);
+	int s0minus = clamp(s0 - 1, 0, width - 1);
+	int s0plus = clamp(s0 + 1, 0, width - 1);
+
+	const float tex00 = TextureData_FetchBlockTexel(mydata, fmt, width, s0minus, t0minus).x;
+	const float tex10 = TextureData_FetchBlockTexel(mydata, fmt, width, s0, t0minus).x;
+	const float tex20 = TextureData_FetchBlockTexel(mydata, fmt, width, s0plus, t0minus).x;
+
+	const float tex01 = TextureData_FetchBlockTexel(mydata, fmt, width, s0minus, t0).x;
+	const float tex21 = TextureData_FetchBlockTexel(mydata, fmt, width, s0plus, t0).x;
+
+	const float tex02 = TextureData_FetchBlockTexel(mydata, fmt, width, s0minus, t0plus).x;
+	const float tex12 = TextureData_FetchBlockTexel(mydata, fmt, width, s0, t0plus).x;
+	const float tex22 = TextureData_FetchBlockTexel(mydata, fmt, width, s0plus, t0plus).x;
+
+	const float Gx = tex00 - tex20 + 2.0f * tex01 - 2.0f * tex21 + tex02 - tex22;
+	const float Gy = tex00 + 2.0f * tex10 + tex20 - tex02 - 2.0f * tex12 - tex22;
+	const float3 n = make_float3(Gx, Gy, 1.f);
+
+	return n;
+}
+
+inline float3 TextureData_SampleNormalFromBump_tiled(int width, int height, int t0, int s0, TEXTURE_ARG_LIST_IDX(texidx))
+{
+	int t0minus = clamp(t0 - 1, 0, height - 1);
+	int t0plus = clamp(t0 + 1, 0, height - 1);
+	int s0minus = clamp(s0 - 1, 0, width - 1);
+	int s0plus = clamp(s0 + 1, 0, width - 1);
+
+	const float tex00 = Texture_FetchTiledTexel(0, s0minus, t0minus, TEXTURE_ARGS_IDX(texidx)).x;
+	const float tex10 = Texture_FetchTiledTexel(0, s0, t0minus, TEXTURE_ARGS_IDX(texidx)).x;
+	const float tex20 = Texture_FetchTiledTexel(0, s0plus, t0minus, TEXTURE_ARGS_IDX(texidx)).x;
+
+	const float tex01 = Texture_FetchTiledTexel(0, s0minus, t0, TEXTURE_ARGS_IDX(texidx)).x;
+	const float tex21 = Texture_FetchTiledTexel(0, s0plus, t0, TEXTURE_ARGS_IDX(texidx)).x;
+
+	const float tex02 = Texture_FetchTiledTexel(0, s0minus, t0plus, TEXTURE_ARGS_IDX(texidx)).x;
+	const float tex12 = Texture_FetchTiledTexel(0, s0, t0plus, TEXTURE_ARGS_IDX(texidx)).x;
+	const float tex22 = Texture_FetchTiledTexel(0, s0plus, t0plus, TEXTURE_ARGS_IDX(texidx)).x;
+
+	const float Gx = tex00 - tex20 + 2.0f * tex01 - 2.0f * tex21 + tex02 - tex22;
+	const float Gy = tex00 + 2.0f * tex10 + tex20 - tex02 - 2.0f * tex12 - tex22;
+	const float3 n = make_float3(Gx, Gy, 1.f);
+
+	return n;
+}
+
 /// Sample 2D texture
 inline
 float3 Texture_SampleBump(float2 uv, TEXTURE_ARG_LIST_IDX(texidx))
@@ -321,6 +591,18 @@ float3 Texture_SampleBump(float2 uv, TEXTURE_ARG_LIST_IDX(texidx))
 	float wx = uv.x * width - floor(uv.x * width);
 	float wy = uv.y * height - floor(uv.y * height);
 
+    if (textures[texidx].tiled)
+    {
+		float3 n00 = TextureData_SampleNormalFromBump_tiled(width, height, t0, s0, TEXTURE_ARGS_IDX(texidx));
+		float3 n01 = TextureData_SampleNormalFromBump_tiled(width, height, t0, s1, TEXTURE_ARGS_IDX(texidx));
+		float3 n10 = TextureData_SampleNormalFromBump_tiled(width, height, t1, s0, TEXTURE_ARGS_IDX(texidx));
+		float3 n11 = TextureData_SampleNormalFromBump_tiled(width, height, t1, s1, TEXTURE_ARGS_IDX(texidx));
+
+		float3 n = lerp3(lerp3(n00, n01, wx), lerp3(n10, n11, wx), wy);
+
+		return 0.5f * normalize(n) + make_float3(0.5f, 0.5f, 0.5f);
+    }
+
     switch (textures[texidx].fmt)
     {
     case RGBA32:
@@ -365,6 +647,22 @@ float3 Texture_SampleBump(float2 uv, TEXTURE_ARG_LIST_IDX(texidx))
 		return 0.5f * normalize(n) + make_float3(0.5f, 0.5f, 0.5f);
     }
 
+    case BC1:
+    case BC3:
+    case BC5:
+    {
+        int fmt = textures[texidx].fmt;
+
+		float3 n00 = TextureData_SampleNormalFromBump_block(mydata, fmt, width, height, t0, s0);
+		float3 n01 = TextureData_SampleNormalFromBump_block(mydata, fmt, width, height, t0, s1);
+		float3 n10 = TextureData_SampleNormalFromBump_block(mydata, fmt, width, height, t1, s0);
+		float3 n11 = TextureData_SampleNormalFromBump_block(mydata, fmt, width, height, t1, s1);
+
+		float3 n = lerp3(lerp3(n00, n01, wx), lerp3(n10, n11, wx), wy);
+
+		return 0.5f * normalize(n) + make_float3(0.5f, 0.5f, 0.5f);
+    }
+
     default:
     {
         return make_float3(0.f, 0.f, 0.f);
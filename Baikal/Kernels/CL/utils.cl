@@ -237,5 +237,120 @@ void add_float4(__global float4* ptr, float4 value)
     *ptr += value;
 }
 
+// Output storage formats, should match Baikal::OutputFormat
+#define OUTPUT_FORMAT_RGBA32F 0
+#define OUTPUT_FORMAT_RGBA16F 1
+#define OUTPUT_FORMAT_R32F 2
+#define OUTPUT_FORMAT_OCT_NORMAL 3
+#define OUTPUT_FORMAT_RGBA8 4
+
+// Octahedral normal encoding, two 16 bit snorm values
+INLINE uint Output_PackOctNormal(float3 n)
+{
+    n /= (fabs(n.x) + fabs(n.y) + fabs(n.z) + 1e-8f);
+    float2 v = n.xy;
+
+    if (n.z < 0.f)
+    {
+        v.x = (1.f - fabs(n.y)) * (n.x >= 0.f ? 1.f : -1.f);
+        v.y = (1.f - fabs(n.x)) * (n.y >= 0.f ? 1.f : -1.f);
+    }
+
+    int x = (int)round(clamp(v.x, -1.f, 1.f) * 32767.f);
+    int y = (int)round(clamp(v.y, -1.f, 1.f) * 32767.f);
+    return ((uint)x & 0xFFFF) | ((uint)y << 16);
+}
+
+INLINE float3 Output_UnpackOctNormal(uint value)
+{
+    // Sign extend 16 bit values
+    float x = (float)((int)(value << 16) >> 16) / 32767.f;
+    float y = (float)((int)value >> 16) / 32767.f;
+    float3 n = make_float3(x, y, 1.f - fabs(x) - fabs(y));
+
+    if (n.z < 0.f)
+    {
+        n.x = (1.f - fabs(y)) * (x >= 0.f ? 1.f : -1.f);
+        n.y = (1.f - fabs(x)) * (y >= 0.f ? 1.f : -1.f);
+    }
+
+    return normalize(n);
+}
+
+// Read output pixel, the result is accumulated sum in xyz and sample count in w.
+// Compact formats keep averaged values, so count is always 1 for them.
+INLINE float4 Output_Read(GLOBAL void const* data, int format, int idx)
+{
+    switch (format)
+    {
+    case OUTPUT_FORMAT_RGBA16F:
+        return (float4)(vload_half4(idx, (GLOBAL half const*)data).xyz, 1.f);
+    case OUTPUT_FORMAT_R32F:
+    {
+        float value = ((GLOBAL float const*)data)[idx];
+        return (float4)(value, value, value, 1.f);
+    }
+    case OUTPUT_FORMAT_OCT_NORMAL:
+        return (float4)(Output_UnpackOctNormal(((GLOBAL uint const*)data)[idx]), 1.f);
+    case OUTPUT_FORMAT_RGBA8:
+    {
+        uint value = ((GLOBAL uint const*)data)[idx];
+        return (float4)((float)(value & 0xFF) / 255.f, (float)((value >> 8) & 0xFF) / 255.f, (float)((value >> 16) & 0xFF) / 255.f, 1.f);
+    }
+    default:
+        return ((GLOBAL float4 const*)data)[idx];
+    }
+}
+
+// Read averaged output pixel value
+INLINE float3 Output_ReadAverage(GLOBAL void const* data, int format, int idx)
+{
+    float4 value = Output_Read(data, format, idx);
+    return value.xyz / max(value.w, 1.f);
+}
+
+// Add a sample to output pixel. Full precision format accumulates sums,
+// compact ones keep running average and count samples in sample_count.
+// Packed values can't be updated atomically, so a pixel has to be
+// written by a single work item per launch.
+INLINE void Output_Accumulate(GLOBAL void* data, int format, GLOBAL int* sample_count, int idx, float3 value)
+{
+    if (format == OUTPUT_FORMAT_RGBA32F)
+    {
+        GLOBAL float4* pixel = (GLOBAL float4*)data + idx;
+        pixel->xyz += value;
+        pixel->w += 1.f;
+        return;
+    }
+
+    int num_samples = sample_count[idx];
+    sample_count[idx] = num_samples + 1;
+
+    float3 average = value;
+    if (num_samples > 0)
+    {
+        float3 old = Output_Read(data, format, idx).xyz;
+        average = old + (value - old) / (float)(num_samples + 1);
+    }
+
+    switch (format)
+    {
+    case OUTPUT_FORMAT_RGBA16F:
+        vstore_half4((float4)(average, 1.f), idx, (GLOBAL half*)data);
+        break;
+    case OUTPUT_FORMAT_R32F:
+        ((GLOBAL float*)data)[idx] = average.x;
+        break;
+    case OUTPUT_FORMAT_OCT_NORMAL:
+        ((GLOBAL uint*)data)[idx] = Output_PackOctNormal(average);
+        break;
+    case OUTPUT_FORMAT_RGBA8:
+    {
+        uint4 v = convert_uint4_sat_rte((float4)(clamp(average, 0.f, 1.f), 1.f) * 255.f);
+        ((GLOBAL uint*)data)[idx] = v.x | (v.y << 8) | (v.z << 16) | (v.w << 24);
+        break;
+    }
+    }
+}
 
 #endif // UTILS_CL
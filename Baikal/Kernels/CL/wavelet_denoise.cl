@@ -282,7 +282,9 @@ void CopyBuffers_main(
     // Input buffers
     GLOBAL float4 const* restrict colors,
     GLOBAL float4 const* restrict positions,
+    int position_format,
     GLOBAL float4 const* restrict normals,
+    int normal_format,
     // Image resolution
     int width,
     int height,
@@ -302,8 +304,8 @@ void CopyBuffers_main(
         const int idx = global_id.y * width + global_id.x;
 
         out_colors[idx] = (float4)(colors[idx].xyz / max(colors[idx].w,  1.f), 1.f);
-        out_positions[idx] = (float4)(positions[idx].xyz / max(positions[idx].w,  1.f), 1.f);
-        out_normals[idx] = (float4)(normals[idx].xyz / max(normals[idx].w,  1.f), 1.f);
+        out_positions[idx] = (float4)(Output_ReadAverage(positions, position_format, idx), 1.f);
+        out_normals[idx] = (float4)(Output_ReadAverage(normals, normal_format, idx), 1.f);
     }
 }
 
@@ -3,32 +3,160 @@
 #include "output.h"
 #include "CLW.h"
 
+#include <stdexcept>
+#include <vector>
+
 namespace Baikal
 {
     class ClwOutput : public Output
     {
     public:
-        ClwOutput(CLWContext context, std::uint32_t w, std::uint32_t h)
-        : Output(w, h)
+        ClwOutput(CLWContext context, std::uint32_t w, std::uint32_t h, OutputFormat format = OutputFormat::kRGBA32F)
+        : Output(w, h, format)
         , m_context(context)
-        , m_data(context.CreateBuffer<RadeonRays::float3>(w*h, CL_MEM_READ_WRITE))
+        , m_data(context.CreateBuffer<RadeonRays::float3>(GetStorageSize(w * h, format), CL_MEM_READ_WRITE))
+        // Full precision format keeps sample count in w
+        , m_sample_count(context.CreateBuffer<int>(format == OutputFormat::kRGBA32F ? 1 : w * h, CL_MEM_READ_WRITE))
+        , m_readback_pending(false)
+        , m_front(-1)
+        {
+        }
+
+        ~ClwOutput()
         {
+            for (auto i = 0; i < 2; ++i)
+            {
+                if (m_mapped[i])
+                {
+                    m_context.UnmapBuffer(0, m_staging[i], m_mapped[i]).Wait();
+                }
+            }
         }
 
         void GetData(RadeonRays::float3* data) const
         {
-            m_context.ReadBuffer(0, m_data, data, m_data.GetElementCount()).Wait();
+            if (format() == OutputFormat::kRGBA32F)
+            {
+                m_context.ReadBuffer(0, m_data, data, m_data.GetElementCount()).Wait();
+                return;
+            }
+
+            std::vector<RadeonRays::float3> packed(m_data.GetElementCount());
+            m_context.ReadBuffer(0, m_data, &packed[0], packed.size()).Wait();
+            DecodeOutputData(format(), &packed[0], width() * height(), data);
+        }
+
+        // The copy is queued after the work already submitted, so it captures a whole frame.
+        // Staging is mapped right after the copy, so completed data is read without queue calls.
+        void RequestData() const override
+        {
+            if (m_readback_pending && !CompleteReadback(false))
+            {
+                return;
+            }
+
+            // Pinned staging is allocated on first request, device copies into it
+            // without a host round trip and mapping it afterwards is cheap
+            auto back = m_front == 0 ? 1 : 0;
+            if (!m_staging[back])
+            {
+                m_staging[back] = m_context.CreateBuffer<RadeonRays::float3>(m_data.GetElementCount(), CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR);
+            }
+            else if (m_mapped[back])
+            {
+                m_context.UnmapBuffer(0, m_staging[back], m_mapped[back]);
+                m_mapped[back] = nullptr;
+            }
+
+            m_context.CopyBuffer(0, m_data, m_staging[back], 0, 0, m_data.GetElementCount());
+            m_readback_event = m_context.MapBuffer(0, m_staging[back], CL_MAP_READ, &m_mapped[back]);
+            m_readback_pending = true;
+            m_context.Flush(0);
+        }
+
+        bool IsDataReady() const override
+        {
+            if (m_readback_pending && !CompleteReadback(false))
+            {
+                return false;
+            }
+
+            return m_front >= 0;
+        }
+
+        void GetRequestedData(RadeonRays::float3* data) const override
+        {
+            if (m_readback_pending)
+            {
+                CompleteReadback(m_front < 0);
+            }
+
+            if (m_front < 0)
+            {
+                throw std::runtime_error("ClwOutput: no data has been requested");
+            }
+
+            DecodeOutputData(format(), m_mapped[m_front], width() * height(), data);
         }
 
+        // Compact formats are always cleared to zero
         void Clear(RadeonRays::float3 const& val)
         {
-            m_context.FillBuffer(0, m_data, val, m_data.GetElementCount()).Wait();
+            auto value = format() == OutputFormat::kRGBA32F ? val : RadeonRays::float3();
+            m_context.FillBuffer(0, m_data, value, m_data.GetElementCount());
+            m_context.FillBuffer(0, m_sample_count, 0, m_sample_count.GetElementCount()).Wait();
+
+            // Drop copies of the data before clear
+            if (m_readback_pending)
+            {
+                m_readback_event.Wait();
+                m_readback_pending = false;
+            }
+
+            m_front = -1;
         }
 
+        // Device storage, compact formats are packed and should be
+        // interpreted according to format() by kernels
         CLWBuffer<RadeonRays::float3> data() const { return m_data; }
+        // Per pixel number of samples averaged by compact formats
+        CLWBuffer<int> sample_count() const { return m_sample_count; }
 
     private:
+        // Number of float4 elements needed to store pixels in a given format
+        static std::size_t GetStorageSize(std::size_t num_pixels, OutputFormat format)
+        {
+            auto size_in_bytes = num_pixels * GetOutputFormatSize(format);
+            return (size_in_bytes + sizeof(RadeonRays::float3) - 1) / sizeof(RadeonRays::float3);
+        }
+
+        // Swap staging buffers if pending readback has completed
+        bool CompleteReadback(bool wait) const
+        {
+            if (wait)
+            {
+                m_readback_event.Wait();
+            }
+            else if (m_readback_event.GetCommandExecutionStatus() != CL_COMPLETE)
+            {
+                return false;
+            }
+
+            m_front = m_front == 0 ? 1 : 0;
+            m_readback_pending = false;
+            return true;
+        }
+
         CLWBuffer<RadeonRays::float3> m_data;
+        CLWBuffer<int> m_sample_count;
         CLWContext m_context;
+        // Pinned staging buffers, one is being written while the other holds the last completed copy
+        mutable CLWBuffer<RadeonRays::float3> m_staging[2];
+        // Host pointers of mapped staging buffers, valid once the readback event has completed
+        mutable RadeonRays::float3* m_mapped[2] = { nullptr, nullptr };
+        mutable CLWEvent m_readback_event;
+        mutable bool m_readback_pending;
+        // Staging buffer with the last completed copy, -1 if none
+        mutable int m_front;
     };
 }
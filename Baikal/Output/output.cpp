@@ -0,0 +1,85 @@
+#include "output.h"
+
+#include "Utils/half.h"
+#include "Utils/vertex_compression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace Baikal
+{
+    using namespace RadeonRays;
+
+    std::size_t GetOutputFormatSize(OutputFormat format)
+    {
+        switch (format)
+        {
+        case OutputFormat::kRGBA32F:
+            return 4 * sizeof(float);
+        case OutputFormat::kRGBA16F:
+            return 4 * sizeof(std::uint16_t);
+        case OutputFormat::kR32F:
+        case OutputFormat::kOctNormal:
+        case OutputFormat::kRGBA8:
+            return sizeof(std::uint32_t);
+        default:
+            throw std::runtime_error("Unsupported output format");
+        }
+    }
+
+    void DecodeOutputData(OutputFormat format, void const* data, std::size_t num_pixels, float3* out)
+    {
+        auto bytes = static_cast<char const*>(data);
+        auto pixel_size = GetOutputFormatSize(format);
+
+        for (auto i = 0u; i < num_pixels; ++i)
+        {
+            auto pixel = bytes + i * pixel_size;
+
+            switch (format)
+            {
+            case OutputFormat::kRGBA32F:
+                std::memcpy(&out[i], pixel, pixel_size);
+                break;
+            case OutputFormat::kRGBA16F:
+            {
+                std::uint16_t values[4];
+                std::memcpy(values, pixel, pixel_size);
+
+                half h[3];
+                for (auto c = 0; c < 3; ++c)
+                {
+                    h[c].setBits(values[c]);
+                }
+
+                out[i] = float3(h[0], h[1], h[2], 1.f);
+                break;
+            }
+            case OutputFormat::kR32F:
+            {
+                float value;
+                std::memcpy(&value, pixel, sizeof(value));
+                out[i] = float3(value, value, value, 1.f);
+                break;
+            }
+            case OutputFormat::kOctNormal:
+            {
+                std::uint32_t value;
+                std::memcpy(&value, pixel, sizeof(value));
+                out[i] = UnpackOctNormal(value);
+                out[i].w = 1.f;
+                break;
+            }
+            case OutputFormat::kRGBA8:
+            {
+                std::uint32_t value;
+                std::memcpy(&value, pixel, sizeof(value));
+                out[i] = float3((value & 0xFF) / 255.f, ((value >> 8) & 0xFF) / 255.f, ((value >> 16) & 0xFF) / 255.f, 1.f);
+                break;
+            }
+            }
+        }
+    }
+}
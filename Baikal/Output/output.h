@@ -31,11 +31,37 @@
 
 #include "math/float3.h"
 
+#include <cstddef>
 #include <cstdint>
 
 namespace Baikal
 {
-    
+    /**
+     \brief Storage format of output surface.
+
+     Full precision format accumulates sample sums and sample count in w.
+     Compact formats keep running average of samples, they are intended for AOVs.
+     */
+    enum class OutputFormat
+    {
+        // 4 x 32 bit float
+        kRGBA32F,
+        // 4 x 16 bit float
+        kRGBA16F,
+        // Single 32 bit float, depth
+        kR32F,
+        // Octahedral encoded unit vector, 2 x 16 bit snorm, normals
+        kOctNormal,
+        // 4 x 8 bit unorm, albedo
+        kRGBA8
+    };
+
+    // Size of a pixel in bytes
+    std::size_t GetOutputFormatSize(OutputFormat format);
+
+    // Decode pixels of a given format into xyz values and sample count in w
+    void DecodeOutputData(OutputFormat format, void const* data, std::size_t num_pixels, RadeonRays::float3* out);
+
     /**
      \brief Interface for rendering output surface.
      
@@ -49,10 +75,12 @@ namespace Baikal
          
          \param w Output surface width
          \param h Output surface height
+         \param format Storage format
          */
-        Output(std::uint32_t w, std::uint32_t h)
+        Output(std::uint32_t w, std::uint32_t h, OutputFormat format = OutputFormat::kRGBA32F)
         : m_width(w)
         , m_height(h)
+        , m_format(format)
         {
         }
 
@@ -65,18 +93,44 @@ namespace Baikal
          */
         virtual void GetData(RadeonRays::float3* data) const = 0;
 
+        /**
+         \brief Start asynchronous copy of surface data to host memory.
+
+         Rendering might continue while the copy is in flight. If previous
+         request has not completed yet, the call does nothing.
+         */
+        virtual void RequestData() const = 0;
+
+        /**
+         \brief Check if the last requested copy has completed.
+         */
+        virtual bool IsDataReady() const = 0;
+
+        /**
+         \brief Get the most recent completed copy of surface data.
+
+         Blocks only if nothing has completed yet, in this case waits
+         for the pending request. Throws if no data has been requested.
+         */
+        virtual void GetRequestedData(RadeonRays::float3* data) const = 0;
+
         // Get surface width
         std::uint32_t width() const;
         // Get surface height
         std::uint32_t height() const;
+        // Get storage format
+        OutputFormat format() const;
 
     private:
         // Surface width
         std::uint32_t m_width;
         // Surface height
         std::uint32_t m_height;
+        // Storage format
+        OutputFormat m_format;
     };
     
     inline std::uint32_t Output::width() const { return m_width; }
     inline std::uint32_t Output::height() const { return m_height; }
+    inline OutputFormat Output::format() const { return m_format; }
 }
@@ -98,8 +98,11 @@ namespace Baikal
         int argc = 0;
         denoise_kernel.SetArg(argc++, color->data());
         denoise_kernel.SetArg(argc++, normal->data());
+        denoise_kernel.SetArg(argc++, static_cast<int>(normal->format()));
         denoise_kernel.SetArg(argc++, position->data());
+        denoise_kernel.SetArg(argc++, static_cast<int>(position->format()));
         denoise_kernel.SetArg(argc++, albedo->data());
+        denoise_kernel.SetArg(argc++, static_cast<int>(albedo->format()));
         denoise_kernel.SetArg(argc++, color->width());
         denoise_kernel.SetArg(argc++, color->height());
         denoise_kernel.SetArg(argc++, radius);
@@ -208,7 +208,9 @@ namespace Baikal
             // Set kernel parameters
             copy_buffers_kernel.SetArg(argc++, color->data());
             copy_buffers_kernel.SetArg(argc++, position->data());
+            copy_buffers_kernel.SetArg(argc++, static_cast<int>(position->format()));
             copy_buffers_kernel.SetArg(argc++, normal->data());
+            copy_buffers_kernel.SetArg(argc++, static_cast<int>(normal->format()));
             copy_buffers_kernel.SetArg(argc++, color->width());
             copy_buffers_kernel.SetArg(argc++, color->height());
             copy_buffers_kernel.SetArg(argc++, m_colors[m_current_buffer_index]->data());
@@ -4,6 +4,7 @@
 #include "Renderers/monte_carlo_renderer.h"
 #include "Renderers/adaptive_renderer.h"
 #include "Estimators/path_tracing_estimator.h"
+#include "Estimators/persistent_path_tracing_estimator.h"
 #include "PostEffects/bilateral_denoiser.h"
 #include "PostEffects/wavelet_denoiser.h"
 
@@ -38,16 +39,31 @@ namespace Baikal
                         std::make_unique<PathTracingEstimator>(m_context, m_intersector, m_cache_path),
                         m_cache_path
                         ));
+            case RendererType::kAdaptive:
+                return std::unique_ptr<Renderer>(
+                    new AdaptiveRenderer(
+                        m_context,
+                        std::make_unique<PathTracingEstimator>(m_context, m_intersector, m_cache_path),
+                        m_cache_path
+                        ));
+            case RendererType::kPersistentPathTracer:
+                return std::unique_ptr<Renderer>(
+                    new MonteCarloRenderer(
+                        m_context,
+                        std::make_unique<PersistentPathTracingEstimator>(m_context, m_intersector, m_cache_path),
+                        m_cache_path
+                        ));
             default:
                 throw std::runtime_error("Renderer not supported");
         }
     }
 
     std::unique_ptr<Output> ClwRenderFactory::CreateOutput(std::uint32_t w,
-                                                           std::uint32_t h)
+                                                           std::uint32_t h,
+                                                           OutputFormat format)
                                                            const
     {
-        return std::unique_ptr<Output>(new ClwOutput(m_context, w, h));
+        return std::unique_ptr<Output>(new ClwOutput(m_context, w, h, format));
     }
 
     std::unique_ptr<PostEffect> ClwRenderFactory::CreatePostEffect(
@@ -68,6 +84,8 @@ namespace Baikal
 
     std::unique_ptr<SceneController<ClwScene>> ClwRenderFactory::CreateSceneController() const
     {
-        return std::make_unique<ClwSceneController>(m_context, m_intersector.get());
+        auto controller = std::make_unique<ClwSceneController>(m_context, m_intersector.get());
+        controller->SetGeometrySpillPath(m_geometry_spill_path);
+        return controller;
     }
 }
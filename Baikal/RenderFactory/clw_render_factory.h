@@ -51,7 +51,8 @@ namespace Baikal
             CreateRenderer(RendererType type) const override;
         // Create an output of specified type
         std::unique_ptr<Output> 
-            CreateOutput(std::uint32_t w, std::uint32_t h) const override;
+            CreateOutput(std::uint32_t w, std::uint32_t h,
+                         OutputFormat format = OutputFormat::kRGBA32F) const override;
         // Create post effect of specified type
         std::unique_ptr<PostEffect> 
             CreatePostEffect(PostEffectType type) const override;
@@ -59,9 +60,14 @@ namespace Baikal
         std::unique_ptr<SceneController<ClwScene>>
             CreateSceneController() const override;
 
+        // Directory for spilled mesh geometry of scene controllers created
+        // afterwards (empty path keeps geometry in memory)
+        void SetGeometrySpillPath(std::string const& path) { m_geometry_spill_path = path; }
+
     private:
         CLWContext m_context;
         std::string m_cache_path;
+        std::string m_geometry_spill_path;
 
         using RadeonRaysInstanceDelete = decltype(RadeonRays::IntersectionApi::Delete);
 
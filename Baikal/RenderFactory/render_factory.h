@@ -25,11 +25,11 @@
 
 #include "CLW.h"
 #include "Controllers/scene_controller.h"
+#include "Output/output.h"
 
 namespace Baikal
 {
     class Renderer;
-    class Output;
     class PostEffect;
     
     /**
@@ -45,7 +45,11 @@ namespace Baikal
     public:
         enum class RendererType
         {
-            kUnidirectionalPathTracer
+            kUnidirectionalPathTracer,
+            // Path tracer distributing samples by per-tile error estimate
+            kAdaptive,
+            // Path tracer shading with persistent threads, for small ray batches
+            kPersistentPathTracer
         };
         
         enum class PostEffectType
@@ -61,7 +65,8 @@ namespace Baikal
         std::unique_ptr<Renderer> CreateRenderer(RendererType type) const = 0;
 
         virtual 
-        std::unique_ptr<Output> CreateOutput(std::uint32_t w, std::uint32_t h) const = 0;
+        std::unique_ptr<Output> CreateOutput(std::uint32_t w, std::uint32_t h,
+                                             OutputFormat format = OutputFormat::kRGBA32F) const = 0;
 
         virtual 
         std::unique_ptr<PostEffect> CreatePostEffect(PostEffectType type) const = 0;
@@ -3,13 +3,20 @@
 
 namespace Baikal
 {
+    // Variance is estimated and tile distribution updated every kVarianceEstimationPeriod samples
+    std::uint32_t constexpr kVarianceEstimationPeriod = 32u;
+
     AdaptiveRenderer::AdaptiveRenderer(
         CLWContext context,
-        std::unique_ptr<Estimator> estimator
-    ) : MonteCarloRenderer(context, std::move(estimator))
+        std::unique_ptr<Estimator> estimator,
+        std::string const& cache_path
+    ) : MonteCarloRenderer(context, std::move(estimator), cache_path)
+        , m_convergence_threshold(0.f)
+        , m_active_tiles_pending(false)
+        , m_num_active_tiles(0)
+        , m_converged(false)
     {
-        auto samples_buffer_size = GetEstimator().GetWorkBufferSize();
-        m_sample_buffer = GetContext().CreateBuffer<float3>(samples_buffer_size, CL_MEM_READ_WRITE);
+        m_active_tiles_buffer = GetContext().CreateBuffer<int>(1, CL_MEM_READ_WRITE);
     }
 
     void AdaptiveRenderer::Clear(RadeonRays::float3 const& val,
@@ -17,7 +24,29 @@ namespace Baikal
     {
         MonteCarloRenderer::Clear(val, output);
 
-        GetContext().FillBuffer(0u, m_variance_buffer, 0.f, m_variance_buffer.GetElementCount()).Wait();
+        GetContext().FillBuffer(0u, m_variance_buffer, 0.f, m_variance_buffer.GetElementCount());
+        GetContext().FillBuffer(0u, m_moments_buffer, float3(), m_moments_buffer.GetElementCount());
+        GetContext().FillBuffer(0u, m_converged_buffer, 0, m_converged_buffer.GetElementCount()).Wait();
+
+        // Drop results of pending readback
+        if (m_active_tiles_pending)
+        {
+            m_active_tiles_event.Wait();
+            m_active_tiles_pending = false;
+        }
+
+        m_converged = false;
+    }
+
+    bool AdaptiveRenderer::IsConverged() const
+    {
+        if (m_active_tiles_pending && m_active_tiles_event.GetCommandExecutionStatus() == CL_COMPLETE)
+        {
+            m_active_tiles_pending = false;
+            m_converged = m_num_active_tiles == 0;
+        }
+
+        return m_converged;
     }
 
     // Render single tile
@@ -25,19 +54,27 @@ namespace Baikal
         RadeonRays::int2 const& tile_origin,
         RadeonRays::int2 const& tile_size)
     {
+        ReserveWorkBuffer(tile_size);
+
         // Number of rays to generate
         auto output = static_cast<ClwOutput*>(GetOutput(OutputType::kColor));
-        auto width = output->width();
-        auto height = output->height();
-
-        GetContext().FillBuffer(0u, m_sample_buffer, float3(), m_sample_buffer.GetElementCount()).Wait();
 
-        if (output)
+        // Whole image has converged, do not waste samples
+        if (output && !IsConverged())
         {
+            // Work buffer size follows output size
+            auto samples_buffer_size = GetEstimator().GetWorkBufferSize();
+            if (m_sample_buffer.GetElementCount() != samples_buffer_size)
+            {
+                m_sample_buffer = GetContext().CreateBuffer<float3>(samples_buffer_size, CL_MEM_READ_WRITE);
+            }
+
+            GetContext().FillBuffer(0u, m_sample_buffer, float3(), m_sample_buffer.GetElementCount()).Wait();
+
             auto num_rays = tile_size.x * tile_size.y;
-            auto output_size = int2(width, height);
+            auto output_size = int2(output->width(), output->height());
 
-            if (m_sample_counter < 32)
+            if (m_sample_counter < kVarianceEstimationPeriod)
             {
                 MonteCarloRenderer::GenerateTileDomain(output_size, tile_origin, tile_size);
             }
@@ -59,18 +96,10 @@ namespace Baikal
 
             AccumulateSamples(m_sample_buffer, output->data(), num_rays);
 
-            if (m_sample_counter > 0 && m_sample_counter % 32 == 0)
+            if (m_sample_counter > 0 && m_sample_counter % kVarianceEstimationPeriod == 0)
             {
-                auto variance_buffer_size = m_variance_buffer.GetElementCount();
-                EstimateVariance(output->data(), output->width(), output->height());
-
-                std::vector<float> probabilities(variance_buffer_size);
-                GetContext().ReadBuffer(0u, m_variance_buffer, &probabilities[0], variance_buffer_size).Wait();
-
-                m_tile_distribution.Set(&probabilities[0],
-                                        (std::uint32_t)variance_buffer_size);
-
-                UpdateTileDistribution();
+                EstimateVariance(m_moments_buffer, output->width(), output->height());
+                UpdateTileDistribution(m_convergence_threshold);
             }
 
         }
@@ -84,6 +113,14 @@ namespace Baikal
         }
     }
 
+    void AdaptiveRenderer::SetSamplesPerIteration(std::uint32_t num_samples)
+    {
+        if (num_samples != 1)
+        {
+            throw std::runtime_error("AdaptiveRenderer: only one sample per iteration is supported");
+        }
+    }
+
     void AdaptiveRenderer::AccumulateSamples(
         CLWBuffer<float3> sample_buffer,
         CLWBuffer<float3> accumulation_buffer,
@@ -95,6 +132,7 @@ namespace Baikal
         int argc = 0;
         accumulate_kernel.SetArg(argc++, sample_buffer);
         accumulate_kernel.SetArg(argc++, accumulation_buffer);
+        accumulate_kernel.SetArg(argc++, m_moments_buffer);
         accumulate_kernel.SetArg(argc++, m_estimator->GetOutputIndexBuffer());
         accumulate_kernel.SetArg(argc++, num_elements);
 
@@ -104,7 +142,7 @@ namespace Baikal
     }
 
     void AdaptiveRenderer::EstimateVariance(
-        CLWBuffer<float3> accumulation_buffer,
+        CLWBuffer<float3> moments_buffer,
         std::uint32_t width,
         std::uint32_t height
     )
@@ -112,14 +150,14 @@ namespace Baikal
         auto estimate_kernel = GetKernel("EstimateVariance");
 
         int argc = 0;
-        estimate_kernel.SetArg(argc++, accumulation_buffer);
+        estimate_kernel.SetArg(argc++, moments_buffer);
         estimate_kernel.SetArg(argc++, m_variance_buffer);
         estimate_kernel.SetArg(argc++, width);
         estimate_kernel.SetArg(argc++, height);
 
         // Run shading kernel
         {
-            size_t gs[] = { static_cast<size_t>((width + 15) / 16 * 16), static_cast<size_t>((width + 15) / 16 * 16) };
+            size_t gs[] = { static_cast<size_t>((width + 15) / 16 * 16), static_cast<size_t>((height + 15) / 16 * 16) };
             size_t ls[] = { 16, 16 };
 
             GetContext().Launch2D(0, gs, ls, estimate_kernel);
@@ -138,47 +176,60 @@ namespace Baikal
 
             auto variance_buffer_size = ((width + 15) / 16) * ((height + 15) / 16);
             m_variance_buffer = GetContext().CreateBuffer<float>(variance_buffer_size, CL_MEM_READ_WRITE);
+            m_converged_buffer = GetContext().CreateBuffer<int>(variance_buffer_size, CL_MEM_READ_WRITE);
+            m_moments_buffer = GetContext().CreateBuffer<float3>(width * height, CL_MEM_READ_WRITE);
+            GetContext().FillBuffer(0u, m_moments_buffer, float3(), width * height);
+            // Number of segments, CDF and PDF values
+            m_tile_distribution_buffer = GetContext().CreateBuffer<int>(2 + 2 * variance_buffer_size, CL_MEM_READ_WRITE);
 
-            std::vector<float> probabilities(variance_buffer_size, 1.f);
-            m_tile_distribution.Set(&probabilities[0], variance_buffer_size);
+            // Start with uniform distribution
+            GetContext().FillBuffer(0u, m_variance_buffer, 1.f, variance_buffer_size);
+            GetContext().FillBuffer(0u, m_converged_buffer, 0, variance_buffer_size);
 
-            UpdateTileDistribution();
+            if (m_active_tiles_pending)
+            {
+                m_active_tiles_event.Wait();
+                m_active_tiles_pending = false;
+            }
+
+            m_converged = false;
+
+            UpdateTileDistribution(0.f);
         }
     }
 
-    void AdaptiveRenderer::UpdateTileDistribution()
+    void AdaptiveRenderer::UpdateTileDistribution(float threshold)
     {
-        // Write distribution data
-        int* distribution_ptr = nullptr;
-        auto num_tiles = m_variance_buffer.GetElementCount();
-        auto required_size = (1 + 1 + num_tiles + num_tiles);
-        if (m_tile_distribution_buffer.GetElementCount() < required_size)
+        auto build_kernel = GetKernel("BuildTileDistribution");
+        auto num_tiles = static_cast<int>(m_variance_buffer.GetElementCount());
+
+        int argc = 0;
+        build_kernel.SetArg(argc++, m_variance_buffer);
+        build_kernel.SetArg(argc++, m_converged_buffer);
+        build_kernel.SetArg(argc++, threshold);
+        build_kernel.SetArg(argc++, num_tiles);
+        build_kernel.SetArg(argc++, m_tile_distribution_buffer);
+        build_kernel.SetArg(argc++, m_active_tiles_buffer);
+
+        // Single group builds the whole distribution
+        GetContext().Launch1D(0, 256, 256, build_kernel);
+
+        // Previous readback has to finish before the host value is overwritten
+        if (m_active_tiles_pending)
         {
-            m_tile_distribution_buffer = GetContext().CreateBuffer<int>(required_size, CL_MEM_READ_ONLY);
+            m_active_tiles_event.Wait();
         }
 
-        GetContext().MapBuffer(0, m_tile_distribution_buffer, CL_MAP_WRITE, &distribution_ptr).Wait();
-        auto current = distribution_ptr;
-
-        // Write the number of segments first
-        *current++ = (int)m_tile_distribution.m_num_segments;
-
-        // Then write num_segments  + 1 CDF values
-        auto values = reinterpret_cast<float*>(current);
-        for (auto i = 0u; i < m_tile_distribution.m_num_segments + 1; ++i)
+        // Converged state is polled later, no need to wait here
+        if (threshold > 0.f)
         {
-            values[i] = m_tile_distribution.m_cdf[i];
+            m_active_tiles_event = GetContext().ReadBuffer(0u, m_active_tiles_buffer, &m_num_active_tiles, 1);
+            m_active_tiles_pending = true;
         }
-
-        // Then write num_segments PDF values
-        values += m_tile_distribution.m_num_segments + 1;
-
-        for (auto i = 0u; i < m_tile_distribution.m_num_segments; ++i)
+        else
         {
-            values[i] = m_tile_distribution.m_func_values[i] / m_tile_distribution.m_func_sum;
+            m_active_tiles_pending = false;
         }
-
-        GetContext().UnmapBuffer(0, m_tile_distribution_buffer, distribution_ptr);
     }
 
     void AdaptiveRenderer::GenerateTileDomain(
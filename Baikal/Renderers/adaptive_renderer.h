@@ -24,7 +24,6 @@ THE SOFTWARE.
 #include "math/int2.h"
 #include "monte_carlo_renderer.h"
 #include "CLW.h"
-#include "Utils/distribution1d.h"
 
 #include <memory>
 
@@ -41,7 +40,8 @@ namespace Baikal
     public:
         AdaptiveRenderer(
             CLWContext context, 
-            std::unique_ptr<Estimator> estimator
+            std::unique_ptr<Estimator> estimator,
+            std::string const& cache_path = ""
         );
 
         ~AdaptiveRenderer() = default;
@@ -58,9 +58,28 @@ namespace Baikal
         // Set output
         void SetOutput(OutputType type, Output* output) override;
 
+        // Variance estimation relies on one sample per iteration
+        void SetSamplesPerIteration(std::uint32_t num_samples) override;
+
+        // Tiles with error estimate below the threshold stop receiving samples, 0 disables convergence
+        void SetConvergenceThreshold(float threshold) override { m_convergence_threshold = threshold; }
+        float GetConvergenceThreshold() const { return m_convergence_threshold; }
+
+        // Check if all tiles have converged. Tile state is read back asynchronously,
+        // so the result might lag behind by one variance estimation period.
+        bool IsConverged() const override;
+
         // DEBUG STUFF
         CLWBuffer<float> GetVarianceBuffer() const { return m_variance_buffer; }
-    protected:
+        CLWBuffer<int> GetTileDistributionBuffer() const { return m_tile_distribution_buffer; }
+        CLWBuffer<int> GetConvergedBuffer() const { return m_converged_buffer; }
+        CLWBuffer<float3> GetMomentsBuffer() const { return m_moments_buffer; }
+
+        // Rebuild tile distribution and converged mask on the device from variance estimates
+        void UpdateTileDistribution(float threshold);
+
+        // Add samples scattered by estimator output indices to accumulation and moments,
+        // several samples might go to the same pixel
         void AccumulateSamples(
             CLWBuffer<float3> sample_buffer,
             CLWBuffer<float3> accumulation_buffer,
@@ -68,24 +87,34 @@ namespace Baikal
         );
 
         void EstimateVariance(
-            CLWBuffer<float3> accumulation_buffer,
+            CLWBuffer<float3> moments_buffer,
             std::uint32_t width,
             std::uint32_t height
         );
 
+    protected:
         void GenerateTileDomain(
             int2 const& output_size,
             int2 const& tile_origin,
             int2 const& tile_size
         ) override;
 
-        void UpdateTileDistribution();
-
     private:
         mutable CLWBuffer<float> m_variance_buffer;
+        // Per pixel sample count, sum and sum of squares of sample luminance
+        mutable CLWBuffer<float3> m_moments_buffer;
         mutable CLWBuffer<float3> m_sample_buffer;
         CLWBuffer<int> m_tile_distribution_buffer;
-        Distribution1D m_tile_distribution;
+        // Per tile converged flags
+        mutable CLWBuffer<int> m_converged_buffer;
+        // Number of tiles which have not converged yet
+        CLWBuffer<int> m_active_tiles_buffer;
+        float m_convergence_threshold;
+        // Readback of the number of active tiles
+        mutable CLWEvent m_active_tiles_event;
+        mutable bool m_active_tiles_pending;
+        mutable int m_num_active_tiles;
+        mutable bool m_converged;
     };
 
 }
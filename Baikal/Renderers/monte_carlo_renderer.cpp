@@ -42,8 +42,10 @@ namespace Baikal
 {
     using namespace RadeonRays;
 
-    int constexpr kTileSizeX = 1920;
-    int constexpr kTileSizeY = 1080;
+    // Work buffers are not made smaller than this
+    std::size_t constexpr kMinWorkBufferSize = 64 * 64;
+    // Default work buffer budget is a fraction of device memory
+    std::size_t constexpr kDefaultWorkBufferBudgetFraction = 4;
 
     // Constructor
     MonteCarloRenderer::MonteCarloRenderer(
@@ -54,8 +56,55 @@ namespace Baikal
         : Baikal::ClwClass(context, "../Baikal/Kernels/CL/monte_carlo_renderer.cl", "", cache_path)
         , m_estimator(std::move(estimator))
         , m_sample_counter(0u)
+        , m_work_buffer_budget(static_cast<std::size_t>(context.GetDevice(0).GetGlobalMemSize() / kDefaultWorkBufferBudgetFraction))
+        , m_tile_size(0, 0)
+        , m_samples_per_iteration(1u)
     {
-        m_estimator->SetWorkBufferSize(kTileSizeX * kTileSizeY);
+        // Work buffers are allocated on first render when output size is known
+    }
+
+    void MonteCarloRenderer::SetWorkBufferBudget(std::size_t budget)
+    {
+        m_work_buffer_budget = budget;
+    }
+
+    void MonteCarloRenderer::SetSamplesPerIteration(std::uint32_t num_samples)
+    {
+        if (num_samples == 0)
+        {
+            throw std::runtime_error("MonteCarloRenderer: number of samples per iteration should be positive");
+        }
+
+        m_samples_per_iteration = num_samples;
+    }
+
+    void MonteCarloRenderer::UpdateWorkBuffer(int2 const& output_size)
+    {
+        // Nothing to render into
+        if (output_size.x <= 0 || output_size.y <= 0)
+        {
+            m_tile_size = int2(0, 0);
+            return;
+        }
+
+        auto max_items = std::max(m_work_buffer_budget / m_estimator->GetWorkBufferItemSize(), kMinWorkBufferSize);
+
+        // Keep whole rows in a tile if possible
+        auto tile_size_x = std::min(static_cast<std::size_t>(output_size.x), max_items);
+        auto tile_size_y = std::min(static_cast<std::size_t>(output_size.y), max_items / tile_size_x);
+
+        m_tile_size = int2(static_cast<int>(tile_size_x), static_cast<int>(tile_size_y));
+
+        // Pack as many samples per pixel as the budget allows
+        auto tile_items = tile_size_x * tile_size_y;
+        auto required_size = std::max(std::min(tile_items * m_samples_per_iteration, std::max(max_items, tile_items)), kMinWorkBufferSize);
+        auto current_size = m_estimator->GetWorkBufferSize();
+
+        // Grow to fit a tile, shrink if most of the buffers are unused
+        if (current_size < required_size || current_size > 2 * required_size)
+        {
+            m_estimator->SetWorkBufferSize(required_size);
+        }
     }
 
     void MonteCarloRenderer::Clear(RadeonRays::float3 const& val, Output& output) const
@@ -82,17 +131,25 @@ namespace Baikal
 
         auto output_size = int2(output->width(), output->height());
 
-        if (output_size.x > kTileSizeX || output_size.y > kTileSizeY)
+        if (output_size.x <= 0 || output_size.y <= 0)
+        {
+            return;
+        }
+
+        UpdateWorkBuffer(output_size);
+
+        // Tiles are queued one after another without waiting
+        if (output_size.x > m_tile_size.x || output_size.y > m_tile_size.y)
         {
-            auto num_tiles_x = (output_size.x + kTileSizeX - 1) / kTileSizeX;
-            auto num_tiles_y = (output_size.y + kTileSizeY - 1) / kTileSizeY;
+            auto num_tiles_x = (output_size.x + m_tile_size.x - 1) / m_tile_size.x;
+            auto num_tiles_y = (output_size.y + m_tile_size.y - 1) / m_tile_size.y;
 
             for (auto x = 0; x < num_tiles_x; ++x)
                 for (auto y = 0; y < num_tiles_y; ++y)
                 {
-                    auto tile_offset = int2(x * kTileSizeX, y * kTileSizeY);
-                    auto tile_size = int2(std::min(kTileSizeX, output_size.x - tile_offset.x),
-                        std::min(kTileSizeY, output_size.y - tile_offset.y));
+                    auto tile_offset = int2(x * m_tile_size.x, y * m_tile_size.y);
+                    auto tile_size = int2(std::min(m_tile_size.x, output_size.x - tile_offset.x),
+                        std::min(m_tile_size.y, output_size.y - tile_offset.y));
 
                     RenderTile(scene, tile_offset, tile_size);
                 }
@@ -102,28 +159,53 @@ namespace Baikal
             RenderTile(scene, int2(), output_size);
         }
 
-        ++m_sample_counter;
+        m_sample_counter += m_samples_per_iteration;
+    }
+
+    void MonteCarloRenderer::ReserveWorkBuffer(int2 const& tile_size)
+    {
+        auto required_size = static_cast<std::size_t>(tile_size.x * tile_size.y);
+
+        if (m_estimator->GetWorkBufferSize() < required_size)
+        {
+            m_estimator->SetWorkBufferSize(std::max(required_size, kMinWorkBufferSize));
+        }
     }
 
     // Render the scene into the output
     void MonteCarloRenderer::RenderTile(ClwScene const& scene, int2 const& tile_origin, int2 const& tile_size)
     {
+        ReserveWorkBuffer(tile_size);
+
         // Number of rays to generate
         auto output = static_cast<ClwOutput*>(GetOutput(OutputType::kColor));
 
         if (output)
         {
-            auto num_rays = tile_size.x * tile_size.y;
+            auto num_pixels = static_cast<std::uint32_t>(tile_size.x * tile_size.y);
             auto output_size = int2(output->width(), output->height());
 
-            GenerateTileDomain(output_size, tile_origin, tile_size);
-            GeneratePrimaryRays(scene, *output, tile_size);
+            // Samples of a pixel are packed into a single launch while they fit into work buffers,
+            // they accumulate into the same output pixel, so atomic resolve is needed then
+            auto max_samples = std::max(static_cast<std::uint32_t>(m_estimator->GetWorkBufferSize() / num_pixels), 1u);
 
-            m_estimator->Estimate(
-                scene,
-                num_rays,
-                Estimator::QualityLevel::kStandard,
-                output->data());
+            for (auto sample = 0u; sample < m_samples_per_iteration;)
+            {
+                auto num_samples = std::min(max_samples, m_samples_per_iteration - sample);
+
+                GenerateMultiSampleTileDomain(output_size, tile_origin, tile_size, num_samples);
+                GeneratePrimaryRays(scene, *output, tile_size, false, num_samples, sample);
+
+                m_estimator->Estimate(
+                    scene,
+                    num_pixels * num_samples,
+                    Estimator::QualityLevel::kStandard,
+                    output->data(),
+                    true,
+                    num_samples > 1);
+
+                sample += num_samples;
+            }
         }
 
         // Check if we have other outputs, than color
@@ -140,6 +222,16 @@ namespace Baikal
         int2 const& tile_origin,
         int2 const& tile_size
     )
+    {
+        GenerateMultiSampleTileDomain(output_size, tile_origin, tile_size, 1u);
+    }
+
+    void MonteCarloRenderer::GenerateMultiSampleTileDomain(
+        int2 const& output_size,
+        int2 const& tile_origin,
+        int2 const& tile_size,
+        std::uint32_t num_samples
+    )
     {
         // Fetch kernel
         CLWKernel generate_kernel = GetKernel("GenerateTileDomain");
@@ -152,6 +244,7 @@ namespace Baikal
         generate_kernel.SetArg(argc++, tile_origin.y);
         generate_kernel.SetArg(argc++, tile_size.x);
         generate_kernel.SetArg(argc++, tile_size.y);
+        generate_kernel.SetArg(argc++, static_cast<int>(num_samples));
         generate_kernel.SetArg(argc++, rand_uint());
         generate_kernel.SetArg(argc++, m_sample_counter);
         generate_kernel.SetArg(argc++, m_estimator->GetRandomBuffer(Estimator::RandomBufferType::kRandomSeed));
@@ -190,6 +283,13 @@ namespace Baikal
 
     void MonteCarloRenderer::SetOutput(OutputType type, Output* output)
     {
+        // Estimator accumulates radiance and visibility with full precision
+        if ((type == OutputType::kColor || type == OutputType::kVisibility) &&
+            output && output->format() != OutputFormat::kRGBA32F)
+        {
+            throw std::runtime_error("Color and visibility outputs require RGBA32F format");
+        }
+
         if (type == OutputType::kVisibility)
         {
             if (!m_estimator->SupportsIntermediateValue(Estimator::IntermediateValue::kVisibility))
@@ -212,8 +312,9 @@ namespace Baikal
         auto output = FindFirstNonZeroOutput();
         auto output_size = int2(output->width(), output->height());
 
-        // Generate tile domain
-        GenerateTileDomain(output_size, tile_origin, tile_size);
+        // AOVs are updated without atomics, so each pixel gets exactly one
+        // work item (adaptive renderers override GenerateTileDomain)
+        MonteCarloRenderer::GenerateTileDomain(output_size, tile_origin, tile_size);
 
         // Generate primary
         GeneratePrimaryRays(scene, *output, tile_size, true);
@@ -239,6 +340,8 @@ namespace Baikal
         fill_kernel.SetArg(argc++, scene.materials);
         fill_kernel.SetArg(argc++, scene.textures);
         fill_kernel.SetArg(argc++, scene.texturedata);
+        fill_kernel.SetArg(argc++, scene.tilecache);
+        fill_kernel.SetArg(argc++, scene.pagetable);
         fill_kernel.SetArg(argc++, scene.envmapidx);
         fill_kernel.SetArg(argc++, scene.lights);
         fill_kernel.SetArg(argc++, scene.num_lights);
@@ -252,12 +355,16 @@ namespace Baikal
             if (auto aov = static_cast<ClwOutput*>(GetOutput(static_cast<Renderer::OutputType>(i))))
             {
                 fill_kernel.SetArg(argc++, 1);
+                fill_kernel.SetArg(argc++, static_cast<int>(aov->format()));
+                fill_kernel.SetArg(argc++, aov->sample_count());
                 fill_kernel.SetArg(argc++, aov->data());
             }
             else
             {
                 fill_kernel.SetArg(argc++, 0);
-                // This is simply a dummy buffer
+                fill_kernel.SetArg(argc++, 0);
+                // These are simply dummy buffers
+                fill_kernel.SetArg(argc++, m_estimator->GetRayCountBuffer());
                 fill_kernel.SetArg(argc++, m_estimator->GetRayCountBuffer());
             }
         }
@@ -274,7 +381,9 @@ namespace Baikal
         ClwScene const& scene, 
         Output const& output, 
         int2 const& tile_size,
-        bool generate_at_pixel_center
+        bool generate_at_pixel_center,
+        std::uint32_t num_samples,
+        std::uint32_t first_sample
     )
     {
         // Fetch kernel
@@ -290,13 +399,14 @@ namespace Baikal
         genkernel.SetArg(argc++, m_estimator->GetOutputIndexBuffer());
         genkernel.SetArg(argc++, m_estimator->GetRayCountBuffer());
         genkernel.SetArg(argc++, (int)rand_uint());
-        genkernel.SetArg(argc++, m_sample_counter);
+        genkernel.SetArg(argc++, m_sample_counter + first_sample);
+        genkernel.SetArg(argc++, static_cast<int>(num_samples));
         genkernel.SetArg(argc++, m_estimator->GetRayBuffer());
         genkernel.SetArg(argc++, m_estimator->GetRandomBuffer(Estimator::RandomBufferType::kRandomSeed));
         genkernel.SetArg(argc++, m_estimator->GetRandomBuffer(Estimator::RandomBufferType::kSobolLUT));
 
         {
-            int globalsize = tile_size.x * tile_size.y;
+            int globalsize = tile_size.x * tile_size.y * static_cast<int>(num_samples);
             GetContext().Launch1D(0, ((globalsize + 63) / 64) * 64, 64, genkernel);
         }
     }
@@ -320,10 +430,15 @@ namespace Baikal
     {
         auto output = static_cast<ClwOutput*>(GetOutput(OutputType::kColor));
 
-        int num_rays = output->width() * output->height();
-        int2 tile_size = int2(output->width(), output->height());
+        auto output_size = int2(output->width(), output->height());
+
+        UpdateWorkBuffer(output_size);
+
+        // Benchmark the first tile only
+        int2 tile_size = int2(std::min(m_tile_size.x, output_size.x), std::min(m_tile_size.y, output_size.y));
+        int num_rays = tile_size.x * tile_size.y;
 
-        GenerateTileDomain(tile_size, int2(), tile_size);
+        GenerateTileDomain(output_size, int2(), tile_size);
         GeneratePrimaryRays(scene, *output, tile_size);
 
         m_estimator->Benchmark(scene, num_rays, stats);
@@ -333,4 +448,24 @@ namespace Baikal
     {
         m_estimator->SetMaxBounces(max_bounces);
     }
+
+    void MonteCarloRenderer::SetCompactedLaunch(bool enable)
+    {
+        m_estimator->SetCompactedLaunch(enable);
+    }
+
+    void MonteCarloRenderer::SetMaterialSorting(bool enable)
+    {
+        m_estimator->SetMaterialSorting(enable);
+    }
+
+    void MonteCarloRenderer::SetRaySorting(std::uint32_t bounce, bool enable)
+    {
+        m_estimator->SetRaySorting(bounce, enable);
+    }
+
+    std::vector<std::uint32_t> const& MonteCarloRenderer::GetActiveRayCounts() const
+    {
+        return m_estimator->GetActiveRayCounts();
+    }
 }
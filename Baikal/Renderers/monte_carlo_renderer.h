@@ -79,12 +79,33 @@ namespace Baikal
         // Set max number of light bounces
         void SetMaxBounces(std::uint32_t max_bounces);
 
+        // Set device memory budget for estimator work buffers in bytes.
+        // Outputs which do not fit are rendered in several tiles.
+        void SetWorkBufferBudget(std::size_t budget);
+        std::size_t GetWorkBufferBudget() const { return m_work_buffer_budget; }
+
+        // Set number of samples per pixel taken by a single Render() call.
+        // Samples are packed into one launch as long as they fit into work buffers.
+        virtual void SetSamplesPerIteration(std::uint32_t num_samples);
+        std::uint32_t GetSamplesPerIteration() const { return m_samples_per_iteration; }
+
+        // Size estimator launches by the number of active rays
+        void SetCompactedLaunch(bool enable);
+        // Shade hits in the order of their materials
+        void SetMaterialSorting(bool enable);
+        // Sort rays of a bounce before intersecting them
+        void SetRaySorting(std::uint32_t bounce, bool enable);
+        // Active rays per bounce of the last estimate (compacted launches only)
+        std::vector<std::uint32_t> const& GetActiveRayCounts() const;
+
     protected:
         void GeneratePrimaryRays(
             ClwScene const& scene,
             Output const& output,
             int2 const& tile_size,
-            bool generate_at_pixel_center = false
+            bool generate_at_pixel_center = false,
+            std::uint32_t num_samples = 1,
+            std::uint32_t first_sample = 0
         );
 
         void FillAOVs(
@@ -99,14 +120,33 @@ namespace Baikal
             int2 const& tile_size
         );
 
+        // Generate tile domain repeated for num_samples samples per pixel
+        void GenerateMultiSampleTileDomain(
+            int2 const& output_size,
+            int2 const& tile_origin,
+            int2 const& tile_size,
+            std::uint32_t num_samples
+        );
+
         Estimator& GetEstimator() { return *m_estimator;  }
 
+        // Derive tile size from output size and memory budget, resize work buffers if needed
+        void UpdateWorkBuffer(int2 const& output_size);
+        // Make sure work buffers fit a tile, tiles requested by clients directly might exceed the budget
+        void ReserveWorkBuffer(int2 const& tile_size);
+
         // Find non-zero AOV
         Output* FindFirstNonZeroOutput(bool include_color = true) const;
 
     public:
         std::unique_ptr<Estimator> m_estimator;
         mutable std::uint32_t m_sample_counter;
+        // Work buffer budget in bytes
+        std::size_t m_work_buffer_budget;
+        // Max tile fitting into work buffers
+        int2 m_tile_size;
+        // Samples per pixel per Render() call
+        std::uint32_t m_samples_per_iteration;
     };
 
 }
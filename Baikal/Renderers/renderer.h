@@ -119,6 +119,22 @@ namespace Baikal
         */
         virtual void SetRandomSeed(std::uint32_t seed) = 0;
 
+        /**
+        \brief Set error threshold below which adaptive renderers stop
+        sampling image regions, 0 disables convergence. Renderers
+        taking samples uniformly ignore it.
+
+        \param threshold Relative error threshold
+        */
+        virtual void SetConvergenceThreshold(float threshold) {}
+
+        /**
+        \brief Check if the image has converged and further Render()
+        calls do not take samples. Always false for renderers taking
+        samples uniformly.
+        */
+        virtual bool IsConverged() const { return false; }
+
         /**
             Disallow copies and moves.
          */
@@ -2,30 +2,161 @@
 #include "SceneGraph/clwscene.h"
 #include "SceneGraph/iterator.h"
 #include <vector>
+#include <unordered_map>
+#include <queue>
+#include <functional>
 #include <cassert>
 
 namespace Baikal
 {
-    using ItemMap = std::map<SceneObject::Ptr, int>;
-    using ItemSet = std::set<SceneObject::Ptr>;
-    
+    // Collector state is a slot array: item index is a slot index
+    struct CollectorSlot
+    {
+        SceneObject::Ptr item;
+        // Commit epoch item was last collected in
+        std::uint32_t epoch;
+        // Item is in a change list
+        bool changed;
+    };
+
+    using SlotArray = std::vector<CollectorSlot>;
+
     class BundleImpl : public Bundle
     {
     public:
-        BundleImpl(ItemMap const& map, ItemSet const& set)
-        : m_map(map)
-        , m_set(set)
+        BundleImpl(std::uint32_t layout_generation)
+        : m_layout_generation(layout_generation)
         {
         }
-        
-        ItemMap m_map;
-        ItemSet m_set;
+
+        // Bundle is valid as long as collector layout has not changed
+        std::uint32_t m_layout_generation;
     };
-    
-    struct Collector::CollectorImpl
+
+    // Iterates over occupied slots only
+    class SlotIterator : public Iterator
     {
-        ItemMap m_map;
-        ItemSet m_set;
+    public:
+        SlotIterator(SlotArray const& slots)
+        : m_slots(slots)
+        , m_cur(0)
+        {
+            Reset();
+        }
+
+        bool IsValid() const override
+        {
+            return m_cur < m_slots.size();
+        }
+
+        void Next() override
+        {
+            for (++m_cur; m_cur < m_slots.size() && !m_slots[m_cur].item; ++m_cur);
+        }
+
+        SceneObject::Ptr Item() const override
+        {
+            return m_slots[m_cur].item;
+        }
+
+        void Reset() override
+        {
+            for (m_cur = 0; m_cur < m_slots.size() && !m_slots[m_cur].item; ++m_cur);
+        }
+
+    private:
+        SlotArray const& m_slots;
+        std::size_t m_cur;
+    };
+
+    struct Collector::CollectorImpl : public SceneObject::DirtyJournal
+    {
+        // Item to slot mapping
+        std::unordered_map<SceneObject const*, std::uint32_t> m_map;
+        // Slots, empty ones are in the free list
+        SlotArray m_slots;
+        // Lowest free slot goes first to keep layouts reproducible
+        std::priority_queue<std::uint32_t, std::vector<std::uint32_t>, std::greater<std::uint32_t>> m_free;
+        // Slots of items added or changed since last finalization
+        std::vector<std::uint32_t> m_changed;
+        // Current commit epoch
+        std::uint32_t m_epoch = 0;
+        // Number of items collected during current epoch
+        std::size_t m_num_collected = 0;
+        // Layout generation, incremented each time items are added or released
+        std::uint32_t m_layout_generation = 0;
+
+        ~CollectorImpl()
+        {
+            for (auto& slot : m_slots)
+            {
+                if (slot.item)
+                {
+                    slot.item->RemoveDirtyJournal(this);
+                }
+            }
+        }
+
+        // Collected items report their changes here
+        void OnDirty(SceneObject const& object) override
+        {
+            auto iter = m_map.find(&object);
+
+            if (iter != m_map.cend())
+            {
+                MarkChanged(iter->second);
+            }
+        }
+
+        void MarkChanged(std::uint32_t idx)
+        {
+            if (!m_slots[idx].changed)
+            {
+                m_slots[idx].changed = true;
+                m_changed.push_back(idx);
+            }
+        }
+
+        void Add(SceneObject::Ptr item)
+        {
+            auto iter = m_map.find(item.get());
+
+            if (iter != m_map.cend())
+            {
+                auto& slot = m_slots[iter->second];
+
+                if (slot.epoch != m_epoch)
+                {
+                    slot.epoch = m_epoch;
+                    ++m_num_collected;
+                }
+
+                return;
+            }
+
+            std::uint32_t idx = 0;
+
+            if (!m_free.empty())
+            {
+                idx = m_free.top();
+                m_free.pop();
+            }
+            else
+            {
+                idx = static_cast<std::uint32_t>(m_slots.size());
+                m_slots.push_back(CollectorSlot{ nullptr, 0, false });
+            }
+
+            m_slots[idx].item = item;
+            m_slots[idx].epoch = m_epoch;
+            m_map.emplace(item.get(), idx);
+            item->AddDirtyJournal(this);
+
+            ++m_num_collected;
+            ++m_layout_generation;
+
+            MarkChanged(idx);
+        }
     };
     
     Collector::Collector()
@@ -37,15 +168,15 @@ namespace Baikal
     
     void Collector::Clear()
     {
-        m_impl->m_map.clear();
-        m_impl->m_set.clear();
+        auto layout_generation = m_impl->m_layout_generation;
+        m_impl.reset(new CollectorImpl);
+        // Make sure bundles created before are invalidated
+        m_impl->m_layout_generation = layout_generation + 1;
     }
     
     std::unique_ptr<Iterator> Collector::CreateIterator() const
     {
-        return std::unique_ptr<Iterator>(
-            new IteratorImpl<ItemSet::const_iterator>(m_impl->m_set.cbegin(),
-                                                      m_impl->m_set.cend()));
+        return std::unique_ptr<Iterator>(new SlotIterator(m_impl->m_slots));
     }
     
     void Collector::Collect(Iterator& iter, ExpandFunc expand_func)
@@ -56,78 +187,100 @@ namespace Baikal
             auto cur_items = expand_func(iter.Item());
             
             // Insert items
-            m_impl->m_set.insert(cur_items.cbegin(), cur_items.cend());
+            for (auto& item : cur_items)
+            {
+                m_impl->Add(item);
+            }
         }
     }
     
     void Collector::Commit()
     {
-        m_impl->m_map.clear();
-        
-        int idx = 0;
-        for (auto& i : m_impl->m_set)
+        auto& impl = *m_impl;
+
+        // Release items which have not been collected during this epoch.
+        // If all the items have been collected there is nothing to scan for.
+        if (impl.m_num_collected != impl.m_map.size())
         {
-            m_impl->m_map[i] = idx++;
+            for (auto i = 0u; i < impl.m_slots.size(); ++i)
+            {
+                auto& slot = impl.m_slots[i];
+
+                if (slot.item && slot.epoch != impl.m_epoch)
+                {
+                    slot.item->RemoveDirtyJournal(&impl);
+                    impl.m_map.erase(slot.item.get());
+                    slot.item = nullptr;
+                    impl.m_free.push(i);
+                }
+            }
+
+            ++impl.m_layout_generation;
         }
+
+        ++impl.m_epoch;
+        impl.m_num_collected = 0;
     }
     
     void Collector::Finalize(FinalizeFunc finalize_func)
     {
-        for (auto& i : m_impl->m_set)
+        for (auto idx : m_impl->m_changed)
         {
-            finalize_func(i);
+            auto& slot = m_impl->m_slots[idx];
+
+            if (slot.item)
+            {
+                finalize_func(slot.item);
+            }
+
+            slot.changed = false;
         }
+
+        m_impl->m_changed.clear();
     }
     
     bool Collector::NeedsUpdate(Bundle const* bundle, ChangedFunc changed_func) const
     {
         auto bundle_impl = static_cast<BundleImpl const*>(bundle);
         
-        // Check if:
-        // 0) bundle and our map sizes match.
-        // 1) All the objects collector has are in the bundle.
-        // 2) They have not changed.
-        if (bundle_impl->m_set.size() != m_impl->m_set.size())
+        // Objects have been added or removed since bundle creation
+        if (bundle_impl->m_layout_generation != m_impl->m_layout_generation)
         {
             return true;
         }
         
-        for (auto& i : m_impl->m_set)
+        // Only objects which were seen changed might need an update
+        for (auto idx : m_impl->m_changed)
         {
-            if (changed_func(i))
-            {
-                // Case 2: we have the object which is changed.
-                return true;
-            }
-            
-            auto iter = bundle_impl->m_set.find(i);
-            
-            if (iter == bundle_impl->m_set.cend())
+            auto& slot = m_impl->m_slots[idx];
+
+            if (slot.item && changed_func(slot.item))
             {
-                // Case 1: we have an object which is not serialized as a part of bundle.
                 return true;
             }
-
-            // Here we know that bundle_impl->m_map[i] == m_impl->m_map[i]
-            // since it is defined by set traversal order.
         }
         
         return false;
     }
     
+    bool Collector::HasChanges() const
+    {
+        return !m_impl->m_changed.empty();
+    }
+
     std::size_t Collector::GetNumItems() const
     {
-        return m_impl->m_set.size();
+        return m_impl->m_slots.size();
     }
     
     Bundle* Collector::CreateBundle() const
     {
-        return new BundleImpl { m_impl->m_map, m_impl->m_set };
+        return new BundleImpl(m_impl->m_layout_generation);
     }
     
     std::uint32_t Collector::GetItemIndex(SceneObject::Ptr item) const
     {
-        auto iter = m_impl->m_map.find(item);
+        auto iter = m_impl->m_map.find(item.get());
         
         if (iter == m_impl->m_map.cend())
         {
@@ -136,6 +289,4 @@ namespace Baikal
         
         return iter->second;
     }
-    
-    
 }
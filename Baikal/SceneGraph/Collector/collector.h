@@ -28,8 +28,7 @@
  */
 #pragma once
 #include <memory>
-#include <map>
-#include <set>
+#include <vector>
 #include <functional>
 
 #include "../scene_object.h"
@@ -56,11 +55,16 @@ namespace Baikal
      
      Collector iterates over collection of objects collecting objects and their dependecies into random access bundle.
      The engine uses collectors in order to resolve material-texture or shape-material dependecies for GPU serialization.
+     
+     Collector keeps its state between collections: objects keep their indices as long as they are collected,
+     objects which were not collected since last commit are released and their indices are reused
+     (lowest first). This way indices are stable across frames and reproducible between runs,
+     given expansion functions return objects in deterministic order.
      */
     class Collector
     {
     public:
-        using ExpandFunc = std::function<std::set<SceneObject::Ptr>(SceneObject::Ptr)>;
+        using ExpandFunc = std::function<std::vector<SceneObject::Ptr>(SceneObject::Ptr)>;
         using ChangedFunc = std::function<bool(SceneObject::Ptr)>;
         using FinalizeFunc = std::function<void(SceneObject::Ptr)>;
         
@@ -71,21 +75,23 @@ namespace Baikal
         
         // Clear collector state (CreateIterator returns invalid iterator if the collector is empty)
         void Clear();
-        // Create an iterator of objects
+        // Create an iterator of objects (in index order)
         std::unique_ptr<Iterator> CreateIterator() const;
         // Collect objects and their dependencies
         void Collect(Iterator& iter, ExpandFunc expand_func);
-        // Commit collected objects
+        // Commit collected objects: objects not collected since previous commit are released
         void Commit();
         // Given a budnle check if all collected objects are in the bundle and do not require update
         bool NeedsUpdate(Bundle const* bundle, ChangedFunc cahnged_func) const;
-        // Get number of objects in the collection
+        // Check if objects have been added or changed since last finalization
+        bool HasChanges() const;
+        // Get index range of the collection (might include released indices)
         std::size_t GetNumItems() const;
         // Create serialised bundle (randomly accessible dump of objects)
         Bundle* CreateBundle() const;
         // Get item index within a collection
         std::uint32_t GetItemIndex(SceneObject::Ptr item) const;
-        // Finalization function
+        // Finalization function (called for objects added or changed since previous finalization)
         void Finalize(FinalizeFunc finalize_func);
     
         // Disallow copies and moves
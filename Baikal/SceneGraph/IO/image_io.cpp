@@ -1,8 +1,15 @@
 #include "image_io.h"
+#include "tiled_image.h"
 #include "../texture.h"
 
 #include "OpenImageIO/imageio.h"
 
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
 namespace Baikal
 {
     class Oiio : public ImageIo
@@ -36,9 +43,120 @@ namespace Baikal
             return TypeDesc::FLOAT;
     }
     
+    static std::uint32_t MakeFourCC(char a, char b, char c, char d)
+    {
+        return static_cast<std::uint32_t>(a) | (static_cast<std::uint32_t>(b) << 8) |
+            (static_cast<std::uint32_t>(c) << 16) | (static_cast<std::uint32_t>(d) << 24);
+    }
+
+    // Load block compressed DDS image as is (base level only, mips are generated on upload).
+    // Returns nullptr for DDS formats other than BC1/BC3/BC5, those are decoded by OIIO.
+    static Texture::Ptr LoadDds(std::string const& filename)
+    {
+        // Header layout: magic, DDS_HEADER (124 bytes), optional DDS_HEADER_DXT10 (20 bytes)
+        static const std::size_t kHeaderSize = 128;
+        static const std::size_t kDx10HeaderSize = 20;
+        static const std::size_t kHeightOffset = 12;
+        static const std::size_t kWidthOffset = 16;
+        static const std::size_t kFourCCOffset = 84;
+
+        std::ifstream in(filename, std::ios::binary);
+
+        if (!in)
+        {
+            throw std::runtime_error("Can't load " + filename + " image");
+        }
+
+        std::uint8_t header[kHeaderSize + kDx10HeaderSize];
+        if (!in.read(reinterpret_cast<char*>(header), kHeaderSize) ||
+            std::memcmp(header, "DDS ", 4) != 0)
+        {
+            throw std::runtime_error("Invalid DDS file " + filename);
+        }
+
+        auto read_uint32 = [&header](std::size_t offset)
+        {
+            std::uint32_t value;
+            std::memcpy(&value, header + offset, sizeof(value));
+            return value;
+        };
+
+        auto height = static_cast<int>(read_uint32(kHeightOffset));
+        auto width = static_cast<int>(read_uint32(kWidthOffset));
+        auto fourcc = read_uint32(kFourCCOffset);
+
+        Texture::Format format;
+        if (fourcc == MakeFourCC('D', 'X', 'T', '1'))
+        {
+            format = Texture::Format::kBc1;
+        }
+        else if (fourcc == MakeFourCC('D', 'X', 'T', '5'))
+        {
+            format = Texture::Format::kBc3;
+        }
+        else if (fourcc == MakeFourCC('A', 'T', 'I', '2') || fourcc == MakeFourCC('B', 'C', '5', 'U'))
+        {
+            format = Texture::Format::kBc5;
+        }
+        else if (fourcc == MakeFourCC('D', 'X', '1', '0'))
+        {
+            if (!in.read(reinterpret_cast<char*>(header + kHeaderSize), kDx10HeaderSize))
+            {
+                throw std::runtime_error("Invalid DDS file " + filename);
+            }
+
+            // DXGI_FORMAT values of UNORM (and SRGB) variants
+            switch (read_uint32(kHeaderSize))
+            {
+                case 71: case 72: format = Texture::Format::kBc1; break;
+                case 77: case 78: format = Texture::Format::kBc3; break;
+                case 83: format = Texture::Format::kBc5; break;
+                default: return nullptr;
+            }
+        }
+        else
+        {
+            return nullptr;
+        }
+
+        if (width <= 0 || height <= 0)
+        {
+            throw std::runtime_error("Invalid DDS file " + filename);
+        }
+
+        auto size = GetBlockCompressedSize(Texture::GetBlockFormat(format), width, height);
+        std::unique_ptr<char[]> texturedata(new char[size]);
+
+        if (!in.read(texturedata.get(), size))
+        {
+            throw std::runtime_error("Invalid DDS file " + filename);
+        }
+
+        return Texture::Create(texturedata.release(), RadeonRays::int2(width, height), format);
+    }
+
     Texture::Ptr Oiio::LoadImage(const std::string &filename) const
     {
         OIIO_NAMESPACE_USING
+
+        auto dot = filename.find_last_of('.');
+        auto ext = dot != std::string::npos ? filename.substr(dot) : std::string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return static_cast<char>(std::tolower(c)); });
+
+        // Tile files become virtual textures streamed on demand
+        if (ext == ".tiles")
+        {
+            return Texture::Create(TiledImage::Open(filename));
+        }
+
+        // Keep pre-compressed images compressed
+        if (ext == ".dds")
+        {
+            if (auto texture = LoadDds(filename))
+            {
+                return texture;
+            }
+        }
         
         std::unique_ptr<ImageInput> input{ImageInput::open(filename)};
         
@@ -99,6 +217,11 @@ namespace Baikal
     {
         OIIO_NAMESPACE_USING;
 
+        if (Texture::IsBlockCompressed(texture->GetFormat()) || texture->IsVirtual())
+        {
+            throw std::runtime_error("Can't save block compressed or virtual image " + filename);
+        }
+
         std::unique_ptr<ImageOutput> out{ImageOutput::create(filename)};
         
         if (!out)
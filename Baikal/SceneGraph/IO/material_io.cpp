@@ -445,10 +445,10 @@ namespace Baikal
         mat_collector.Collect(*shape_iter,
             // This function adds all materials to resulting map
             // recursively via Material dependency API
-        [](SceneObject::Ptr item) -> std::set<SceneObject::Ptr>
+        [](SceneObject::Ptr item) -> std::vector<SceneObject::Ptr>
         {
-            // Resulting material set
-            std::set<SceneObject::Ptr> mats;
+            // Resulting materials (collector skips duplicates)
+            std::vector<SceneObject::Ptr> mats;
             // Material stack
             std::stack<Material::Ptr> material_stack;
 
@@ -469,8 +469,8 @@ namespace Baikal
                 auto m = material_stack.top();
                 material_stack.pop();
 
-                // Emplace into the set
-                mats.emplace(m);
+                // Emplace into the list
+                mats.push_back(m);
 
                 // Create dependency iterator
                 std::unique_ptr<Iterator> mat_iter = m->CreateMaterialIterator();
@@ -482,7 +482,7 @@ namespace Baikal
                 }
             }
 
-            // Return resulting set
+            // Return resulting list
             return mats;
         });
 
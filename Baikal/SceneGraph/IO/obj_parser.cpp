@@ -0,0 +1,696 @@
+#include "obj_parser.h"
+#include "Utils/mapped_file.h"
+#include "Utils/thread_pool.h"
+#include "Utils/log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <future>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace Baikal
+{
+    // Chunks smaller than this are not worth a separate task
+    static const std::size_t kMinChunkSize = 1 << 20;
+    // More chunks than threads balance the load between threads
+    static const std::size_t kChunksPerThread = 4;
+    // Missing texcoord or normal index in face statement
+    static const int kNoIndex = std::numeric_limits<int>::min();
+
+    namespace
+    {
+        // Face vertex. Negative OBJ indices are relative to the end of the
+        // arrays, they are resolved once chunk base offsets are known.
+        struct ObjIndex
+        {
+            int v;
+            int vt;
+            int vn;
+            // Mask of relative indices: 1 - v, 2 - vt, 4 - vn
+            int relative;
+        };
+
+        inline bool operator == (ObjIndex const& a, ObjIndex const& b)
+        {
+            return a.v == b.v && a.vt == b.vt && a.vn == b.vn;
+        }
+
+        struct ObjIndexHash
+        {
+            std::size_t operator()(ObjIndex const& index) const
+            {
+                auto h = static_cast<std::size_t>(static_cast<std::uint32_t>(index.v));
+                h = h * 31 + static_cast<std::uint32_t>(index.vt);
+                h = h * 31 + static_cast<std::uint32_t>(index.vn);
+                return h;
+            }
+        };
+
+        enum class ObjEventType
+        {
+            kMaterialLibrary,
+            kUseMaterial,
+            kShape
+        };
+
+        // Statement affecting faces which follow it (mtllib, usemtl, g, o)
+        struct ObjEvent
+        {
+            ObjEventType type;
+            std::string name;
+            // Number of faces in the chunk before the statement
+            std::size_t face;
+        };
+
+        struct ObjChunk
+        {
+            char const* begin;
+            char const* end;
+            std::vector<float> positions;
+            std::vector<float> normals;
+            std::vector<float> texcoords;
+            std::vector<ObjIndex> indices;
+            // Start of each face in indices, the last one is the end of indices
+            std::vector<std::size_t> faces;
+            std::vector<ObjEvent> events;
+            // Offsets of chunk arrays in the whole file
+            std::size_t base_position;
+            std::size_t base_normal;
+            std::size_t base_texcoord;
+        };
+
+        // Range of chunk faces
+        struct FaceRun
+        {
+            std::size_t chunk;
+            std::size_t first_face;
+            std::size_t end_face;
+        };
+
+        // Faces sharing vertices
+        struct FaceGroup
+        {
+            int material;
+            std::vector<FaceRun> runs;
+        };
+
+        struct ShapeDesc
+        {
+            std::string name;
+            std::vector<FaceGroup> groups;
+        };
+
+        inline bool IsSpace(char c)
+        {
+            return c == ' ' || c == '\t';
+        }
+
+        inline bool IsDigit(char c)
+        {
+            return static_cast<unsigned>(c - '0') < 10u;
+        }
+
+        inline void SkipSpaces(char const*& p, char const* end)
+        {
+            while (p < end && IsSpace(*p))
+            {
+                ++p;
+            }
+        }
+
+        inline void SkipToken(char const*& p, char const* end)
+        {
+            while (p < end && !IsSpace(*p))
+            {
+                ++p;
+            }
+        }
+
+        // Check if line starts with keyword followed by a space
+        inline bool IsKeyword(char const* p, char const* end, char const* keyword, std::size_t length)
+        {
+            return static_cast<std::size_t>(end - p) > length &&
+                std::memcmp(p, keyword, length) == 0 &&
+                IsSpace(p[length]);
+        }
+
+        // Locale independent float parsing
+        float ParseFloat(char const*& p, char const* end)
+        {
+            SkipSpaces(p, end);
+
+            auto negative = false;
+            if (p < end && (*p == '+' || *p == '-'))
+            {
+                negative = *p++ == '-';
+            }
+
+            double mantissa = 0.0;
+            auto exponent = 0;
+
+            while (p < end && IsDigit(*p))
+            {
+                mantissa = mantissa * 10.0 + (*p++ - '0');
+            }
+
+            if (p < end && *p == '.')
+            {
+                ++p;
+                while (p < end && IsDigit(*p))
+                {
+                    mantissa = mantissa * 10.0 + (*p++ - '0');
+                    --exponent;
+                }
+            }
+
+            if (p < end && (*p == 'e' || *p == 'E'))
+            {
+                ++p;
+
+                auto negative_exponent = false;
+                if (p < end && (*p == '+' || *p == '-'))
+                {
+                    negative_exponent = *p++ == '-';
+                }
+
+                auto value = 0;
+                while (p < end && IsDigit(*p))
+                {
+                    value = std::min(value * 10 + (*p++ - '0'), 1000);
+                }
+
+                exponent += negative_exponent ? -value : value;
+            }
+
+            SkipToken(p, end);
+
+            auto value = exponent != 0 ? mantissa * std::pow(10.0, exponent) : mantissa;
+            return static_cast<float>(negative ? -value : value);
+        }
+
+        inline int ParseInt(char const*& p, char const* end)
+        {
+            auto negative = false;
+            if (p < end && (*p == '+' || *p == '-'))
+            {
+                negative = *p++ == '-';
+            }
+
+            auto value = 0;
+            while (p < end && IsDigit(*p))
+            {
+                value = value * 10 + (*p++ - '0');
+            }
+
+            return negative ? -value : value;
+        }
+
+        inline std::string ParseName(char const*& p, char const* end)
+        {
+            SkipSpaces(p, end);
+
+            auto begin = p;
+            SkipToken(p, end);
+
+            return std::string(begin, p);
+        }
+
+        // Make index zero based, negative indices are relative to the current end of the array
+        inline int MakeIndex(int idx, std::size_t count, int flag, int& relative)
+        {
+            if (idx > 0)
+            {
+                return idx - 1;
+            }
+
+            if (idx == 0)
+            {
+                return 0;
+            }
+
+            relative |= flag;
+            return static_cast<int>(count) + idx;
+        }
+
+        // Parse v, v/vt, v//vn or v/vt/vn
+        ObjIndex ParseFaceVertex(char const*& p, char const* end, ObjChunk const& chunk)
+        {
+            ObjIndex index = { 0, kNoIndex, kNoIndex, 0 };
+
+            index.v = MakeIndex(ParseInt(p, end), chunk.positions.size() / 3, 1, index.relative);
+
+            if (p < end && *p == '/')
+            {
+                ++p;
+
+                if (p < end && *p != '/' && !IsSpace(*p))
+                {
+                    index.vt = MakeIndex(ParseInt(p, end), chunk.texcoords.size() / 2, 2, index.relative);
+                }
+
+                if (p < end && *p == '/')
+                {
+                    ++p;
+                    index.vn = MakeIndex(ParseInt(p, end), chunk.normals.size() / 3, 4, index.relative);
+                }
+            }
+
+            SkipToken(p, end);
+            return index;
+        }
+
+        void ParseLine(ObjChunk& chunk, char const* p, char const* end)
+        {
+            SkipSpaces(p, end);
+
+            if (p == end || *p == '#')
+            {
+                return;
+            }
+
+            if (IsKeyword(p, end, "v", 1))
+            {
+                p += 2;
+                chunk.positions.push_back(ParseFloat(p, end));
+                chunk.positions.push_back(ParseFloat(p, end));
+                chunk.positions.push_back(ParseFloat(p, end));
+            }
+            else if (IsKeyword(p, end, "vn", 2))
+            {
+                p += 3;
+                chunk.normals.push_back(ParseFloat(p, end));
+                chunk.normals.push_back(ParseFloat(p, end));
+                chunk.normals.push_back(ParseFloat(p, end));
+            }
+            else if (IsKeyword(p, end, "vt", 2))
+            {
+                p += 3;
+                chunk.texcoords.push_back(ParseFloat(p, end));
+                chunk.texcoords.push_back(ParseFloat(p, end));
+            }
+            else if (IsKeyword(p, end, "f", 1))
+            {
+                p += 2;
+
+                auto first = chunk.indices.size();
+
+                SkipSpaces(p, end);
+                while (p < end)
+                {
+                    chunk.indices.push_back(ParseFaceVertex(p, end, chunk));
+                    SkipSpaces(p, end);
+                }
+
+                // Points and lines are skipped
+                if (chunk.indices.size() - first >= 3)
+                {
+                    chunk.faces.push_back(first);
+                }
+                else
+                {
+                    chunk.indices.resize(first);
+                }
+            }
+            else if (IsKeyword(p, end, "usemtl", 6))
+            {
+                p += 7;
+                chunk.events.push_back({ ObjEventType::kUseMaterial, ParseName(p, end), chunk.faces.size() });
+            }
+            else if (IsKeyword(p, end, "mtllib", 6))
+            {
+                p += 7;
+                chunk.events.push_back({ ObjEventType::kMaterialLibrary, ParseName(p, end), chunk.faces.size() });
+            }
+            else if (IsKeyword(p, end, "g", 1) || IsKeyword(p, end, "o", 1))
+            {
+                p += 2;
+                chunk.events.push_back({ ObjEventType::kShape, ParseName(p, end), chunk.faces.size() });
+            }
+
+            // Other statements are ignored
+        }
+
+        void ParseChunk(ObjChunk& chunk)
+        {
+            auto p = chunk.begin;
+
+            while (p < chunk.end)
+            {
+                auto line_end = static_cast<char const*>(std::memchr(p, '\n', chunk.end - p));
+                auto next = line_end ? line_end + 1 : chunk.end;
+                auto end = line_end ? line_end : chunk.end;
+
+                if (end > p && end[-1] == '\r')
+                {
+                    --end;
+                }
+
+                ParseLine(chunk, p, end);
+                p = next;
+            }
+
+            chunk.faces.push_back(chunk.indices.size());
+        }
+
+        // Copy chunk arrays into the whole file arrays and make indices absolute
+        void StitchChunk(ObjChunk& chunk,
+                         std::vector<RadeonRays::float3>& positions,
+                         std::vector<RadeonRays::float3>& normals,
+                         std::vector<RadeonRays::float2>& texcoords)
+        {
+            for (auto i = 0u; i < chunk.positions.size() / 3; ++i)
+            {
+                positions[chunk.base_position + i] = RadeonRays::float3(chunk.positions[3 * i], chunk.positions[3 * i + 1], chunk.positions[3 * i + 2], 1.f);
+            }
+
+            for (auto i = 0u; i < chunk.normals.size() / 3; ++i)
+            {
+                normals[chunk.base_normal + i] = RadeonRays::float3(chunk.normals[3 * i], chunk.normals[3 * i + 1], chunk.normals[3 * i + 2], 0.f);
+            }
+
+            for (auto i = 0u; i < chunk.texcoords.size() / 2; ++i)
+            {
+                texcoords[chunk.base_texcoord + i] = RadeonRays::float2(chunk.texcoords[2 * i], chunk.texcoords[2 * i + 1]);
+            }
+
+            for (auto& index : chunk.indices)
+            {
+                if (index.relative & 1)
+                {
+                    index.v += static_cast<int>(chunk.base_position);
+                }
+
+                if (index.vt == kNoIndex)
+                {
+                    index.vt = -1;
+                }
+                else if (index.relative & 2)
+                {
+                    index.vt += static_cast<int>(chunk.base_texcoord);
+                }
+
+                if (index.vn == kNoIndex)
+                {
+                    index.vn = -1;
+                }
+                else if (index.relative & 4)
+                {
+                    index.vn += static_cast<int>(chunk.base_normal);
+                }
+
+                index.relative = 0;
+            }
+
+            // Chunk arrays are not needed anymore
+            std::vector<float>().swap(chunk.positions);
+            std::vector<float>().swap(chunk.normals);
+            std::vector<float>().swap(chunk.texcoords);
+        }
+
+        void BuildShape(ShapeDesc const& desc,
+                        std::vector<ObjChunk> const& chunks,
+                        std::vector<RadeonRays::float3> const& positions,
+                        std::vector<RadeonRays::float3> const& normals,
+                        std::vector<RadeonRays::float2> const& texcoords,
+                        ObjParser::Shape& shape)
+        {
+            shape.name = desc.name;
+
+            for (auto const& group : desc.groups)
+            {
+                // Vertices are shared within the group only (as in tinyobj)
+                std::unordered_map<ObjIndex, std::uint32_t, ObjIndexHash> cache;
+
+                auto add_vertex = [&](ObjIndex const& index) -> std::uint32_t
+                {
+                    auto iter = cache.find(index);
+
+                    if (iter != cache.cend())
+                    {
+                        return iter->second;
+                    }
+
+                    if (index.v < 0 || index.v >= static_cast<int>(positions.size()))
+                    {
+                        throw std::runtime_error("OBJ face references missing vertex");
+                    }
+
+                    shape.positions.push_back(positions[index.v]);
+
+                    if (index.vn >= 0 && index.vn < static_cast<int>(normals.size()))
+                    {
+                        shape.normals.push_back(normals[index.vn]);
+                    }
+
+                    if (index.vt >= 0 && index.vt < static_cast<int>(texcoords.size()))
+                    {
+                        shape.uvs.push_back(texcoords[index.vt]);
+                    }
+
+                    auto idx = static_cast<std::uint32_t>(shape.positions.size() - 1);
+                    cache.emplace(index, idx);
+                    return idx;
+                };
+
+                for (auto const& run : group.runs)
+                {
+                    auto const& chunk = chunks[run.chunk];
+
+                    for (auto f = run.first_face; f < run.end_face; ++f)
+                    {
+                        auto first = chunk.faces[f];
+                        auto last = chunk.faces[f + 1];
+
+                        // Polygon -> triangle fan conversion
+                        for (auto k = first + 2; k < last; ++k)
+                        {
+                            shape.indices.push_back(add_vertex(chunk.indices[first]));
+                            shape.indices.push_back(add_vertex(chunk.indices[k - 1]));
+                            shape.indices.push_back(add_vertex(chunk.indices[k]));
+                            shape.material_ids.push_back(group.material);
+                        }
+                    }
+                }
+            }
+        }
+
+        // Wait for all the tasks (they reference local data), then rethrow the first failure
+        void WaitForTasks(std::vector<std::future<void>>& tasks)
+        {
+            for (auto& task : tasks)
+            {
+                task.wait();
+            }
+
+            for (auto& task : tasks)
+            {
+                task.get();
+            }
+        }
+
+        double GetElapsedMs(std::chrono::high_resolution_clock::time_point start)
+        {
+            auto elapsed = std::chrono::high_resolution_clock::now() - start;
+            return std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(elapsed).count();
+        }
+    }
+
+    void ObjParser::Parse(std::string const& filename,
+                          ThreadPool& pool,
+                          MaterialLibraryCallback const& on_material_library,
+                          std::vector<Shape>& shapes,
+                          std::vector<std::string>& material_names)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        MappedFile file(filename);
+        auto data = file.GetData();
+        auto file_end = data + file.GetSize();
+
+        shapes.clear();
+        material_names.clear();
+
+        // Split the file into chunks at line boundaries
+        auto num_chunks = std::max<std::size_t>(1, std::min(pool.GetNumThreads() * kChunksPerThread, file.GetSize() / kMinChunkSize));
+
+        std::vector<ObjChunk> chunks;
+        chunks.reserve(num_chunks);
+
+        auto chunk_begin = data;
+        for (auto i = 0u; i < num_chunks && chunk_begin < file_end; ++i)
+        {
+            auto chunk_end = std::max(chunk_begin, data + file.GetSize() * (i + 1) / num_chunks);
+            auto line_end = chunk_end < file_end ?
+                static_cast<char const*>(std::memchr(chunk_end, '\n', file_end - chunk_end)) : nullptr;
+
+            chunks.emplace_back();
+            chunks.back().begin = chunk_begin;
+            chunks.back().end = line_end ? line_end + 1 : file_end;
+            chunk_begin = chunks.back().end;
+        }
+
+        std::vector<std::future<void>> tasks;
+        for (auto& chunk : chunks)
+        {
+            tasks.push_back(pool.Submit([&chunk]() { ParseChunk(chunk); }));
+        }
+
+        // Report material libraries in file order as soon as their chunks are ready
+        try
+        {
+            for (auto i = 0u; i < chunks.size(); ++i)
+            {
+                tasks[i].get();
+
+                for (auto const& event : chunks[i].events)
+                {
+                    if (event.type == ObjEventType::kMaterialLibrary && on_material_library)
+                    {
+                        on_material_library(event.name);
+                    }
+                }
+            }
+        }
+        catch (...)
+        {
+            for (auto& task : tasks)
+            {
+                if (task.valid())
+                {
+                    task.wait();
+                }
+            }
+
+            throw;
+        }
+
+        LogInfo("OBJ: parsed ", chunks.size(), " chunks in ", GetElapsedMs(start), " ms\n");
+        start = std::chrono::high_resolution_clock::now();
+
+        // Place chunk arrays one after another
+        std::size_t num_positions = 0;
+        std::size_t num_normals = 0;
+        std::size_t num_texcoords = 0;
+        for (auto& chunk : chunks)
+        {
+            chunk.base_position = num_positions;
+            chunk.base_normal = num_normals;
+            chunk.base_texcoord = num_texcoords;
+            num_positions += chunk.positions.size() / 3;
+            num_normals += chunk.normals.size() / 3;
+            num_texcoords += chunk.texcoords.size() / 2;
+        }
+
+        if (num_positions > static_cast<std::size_t>(std::numeric_limits<int>::max()))
+        {
+            throw std::runtime_error("OBJ file has too many vertices");
+        }
+
+        std::vector<RadeonRays::float3> positions(num_positions);
+        std::vector<RadeonRays::float3> normals(num_normals);
+        std::vector<RadeonRays::float2> texcoords(num_texcoords);
+
+        tasks.clear();
+        for (auto& chunk : chunks)
+        {
+            tasks.push_back(pool.Submit([&]() { StitchChunk(chunk, positions, normals, texcoords); }));
+        }
+
+        WaitForTasks(tasks);
+
+        // Split faces into shapes (g, o) and vertex sharing groups (usemtl)
+        std::unordered_map<std::string, int> material_ids;
+        std::vector<ShapeDesc> descs;
+        ShapeDesc desc;
+        FaceGroup group;
+        group.material = -1;
+        auto material = -1;
+
+        auto flush_group = [&]()
+        {
+            if (!group.runs.empty())
+            {
+                desc.groups.push_back(std::move(group));
+            }
+
+            group = FaceGroup();
+            group.material = material;
+        };
+
+        auto add_faces = [&group](std::size_t chunk, std::size_t first, std::size_t end)
+        {
+            if (first < end)
+            {
+                group.runs.push_back({ chunk, first, end });
+            }
+        };
+
+        for (auto i = 0u; i < chunks.size(); ++i)
+        {
+            std::size_t face = 0;
+
+            for (auto const& event : chunks[i].events)
+            {
+                add_faces(i, face, event.face);
+                face = event.face;
+
+                if (event.type == ObjEventType::kUseMaterial)
+                {
+                    auto iter = material_ids.find(event.name);
+
+                    if (iter == material_ids.cend())
+                    {
+                        iter = material_ids.emplace(event.name, static_cast<int>(material_names.size())).first;
+                        material_names.push_back(event.name);
+                    }
+
+                    if (iter->second != material)
+                    {
+                        material = iter->second;
+                        flush_group();
+                    }
+                }
+                else if (event.type == ObjEventType::kShape)
+                {
+                    flush_group();
+
+                    if (!desc.groups.empty())
+                    {
+                        descs.push_back(std::move(desc));
+                    }
+
+                    desc = ShapeDesc();
+                    desc.name = event.name;
+                }
+            }
+
+            add_faces(i, face, chunks[i].faces.size() - 1);
+        }
+
+        flush_group();
+
+        if (!desc.groups.empty())
+        {
+            descs.push_back(std::move(desc));
+        }
+
+        LogInfo("OBJ: stitched ", num_positions, " vertices in ", GetElapsedMs(start), " ms\n");
+        start = std::chrono::high_resolution_clock::now();
+
+        shapes.resize(descs.size());
+
+        tasks.clear();
+        for (auto i = 0u; i < descs.size(); ++i)
+        {
+            tasks.push_back(pool.Submit([&, i]() { BuildShape(descs[i], chunks, positions, normals, texcoords, shapes[i]); }));
+        }
+
+        WaitForTasks(tasks);
+
+        LogInfo("OBJ: built ", shapes.size(), " shapes in ", GetElapsedMs(start), " ms\n");
+    }
+}
@@ -0,0 +1,70 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "math/float2.h"
+#include "math/float3.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace Baikal
+{
+    class ThreadPool;
+
+    ///< Parallel OBJ geometry parser. The file is memory mapped and split into
+    ///< chunks at line boundaries, chunks are parsed concurrently, stitched
+    ///< together and then shapes are built concurrently. Follows tinyobj rules:
+    ///< shapes are split by g/o statements, polygons are triangulated as fans
+    ///< and vertices are shared within a run of faces with the same material.
+    ///<
+    class ObjParser
+    {
+    public:
+        struct Shape
+        {
+            std::string name;
+            std::vector<RadeonRays::float3> positions;
+            std::vector<RadeonRays::float3> normals;
+            std::vector<RadeonRays::float2> uvs;
+            std::vector<std::uint32_t> indices;
+            // Per triangle index into material names, -1 if not set
+            std::vector<int> material_ids;
+        };
+
+        // Called for each mtllib statement in file order as soon as
+        // the chunk containing it is parsed, so materials can be loaded
+        // while the rest of the file is being parsed
+        using MaterialLibraryCallback = std::function<void(std::string const& name)>;
+
+        // Parse the file using the pool, material names are the ones used in usemtl
+        // statements. Throws std::runtime_error if the file can't be read or
+        // references missing vertices.
+        static void Parse(std::string const& filename,
+                          ThreadPool& pool,
+                          MaterialLibraryCallback const& on_material_library,
+                          std::vector<Shape>& shapes,
+                          std::vector<std::string>& material_names);
+    };
+}
@@ -4,257 +4,939 @@
 #include "SceneGraph/shape.h"
 #include "SceneGraph/material.h"
 #include "SceneGraph/light.h"
+#include "SceneGraph/camera.h"
 #include "SceneGraph/texture.h"
 #include "SceneGraph/IO/image_io.h"
-#include "math/mathutils.h"
+#include "Utils/mapped_file.h"
 #include "Utils/log.h"
 
+#include <cstring>
 #include <fstream>
+#include <functional>
+#include <map>
 
 namespace Baikal
 {
-    std::unique_ptr<SceneIo> SceneIo::CreateSceneIoBinary()
+    // File layout: header, mesh arrays, sections, table of contents.
+    // Every block starts at 64 bytes aligned offset, data is stored in
+    // host (little endian) byte order so it can be referenced in place.
+    static const std::size_t kSceneAlignment = 64;
+    static const char kSceneMagic[4] = { 'B', 'X', 'S', 'C' };
+    static const std::uint32_t kSceneVersion = 1;
+
+    struct SceneFileHeader
     {
-        return std::unique_ptr<SceneIo>(new SceneBinaryIo());
+        char magic[4];
+        std::uint32_t version;
+        std::uint32_t num_sections;
+        std::uint32_t padding;
+        std::uint64_t toc_offset;
+        std::uint64_t file_size;
+        std::uint8_t reserved[32];
+    };
+
+    static_assert(sizeof(SceneFileHeader) == kSceneAlignment, "Scene file header should be 64 bytes");
+
+    enum class SceneSection : std::uint32_t
+    {
+        kStrings,
+        kTextures,
+        kMaterials,
+        kMaterialInputs,
+        kMeshes,
+        kInstances,
+        kLights,
+        kCamera
+    };
+
+    // Table of contents entry
+    struct SceneSectionEntry
+    {
+        std::uint32_t type;
+        std::uint32_t count;
+        std::uint64_t offset;
+        std::uint64_t size;
+    };
+
+    // Reference into string pool
+    struct SceneString
+    {
+        std::uint32_t offset;
+        std::uint32_t size;
+    };
+
+    // Textures are stored by reference (name relative to basepath)
+    struct SceneTextureRecord
+    {
+        SceneString name;
+    };
+
+    enum class SceneMaterialKind : std::uint32_t
+    {
+        kSingleBxdf,
+        kMultiBxdf,
+        kDisneyBxdf
+    };
+
+    struct SceneMaterialRecord
+    {
+        SceneString name;
+        std::uint32_t kind;
+        // SingleBxdf::BxdfType or MultiBxdf::Type
+        std::uint32_t type;
+        std::uint32_t thin;
+        // Range in material inputs section
+        std::uint32_t first_input;
+        std::uint32_t num_inputs;
+    };
+
+    struct SceneMaterialInputRecord
+    {
+        SceneString name;
+        std::uint32_t type;
+        // Texture or material index, -1 if not set
+        std::int32_t index;
+        float value[4];
+    };
+
+    struct SceneMeshRecord
+    {
+        SceneString name;
+        std::uint64_t indices_offset;
+        std::uint64_t vertices_offset;
+        std::uint64_t normals_offset;
+        std::uint64_t uvs_offset;
+        std::uint32_t num_indices;
+        std::uint32_t num_vertices;
+        std::uint32_t num_normals;
+        std::uint32_t num_uvs;
+        std::int32_t material;
+        std::uint32_t visibility_mask;
+        // Meshes only used as instance base are not attached to the scene
+        std::uint32_t attached;
+        float transform[16];
+    };
+
+    struct SceneInstanceRecord
+    {
+        SceneString name;
+        std::int32_t base_mesh;
+        std::int32_t material;
+        std::uint32_t visibility_mask;
+        float transform[16];
+    };
+
+    enum class SceneLightType : std::uint32_t
+    {
+        kPoint,
+        kDirectional,
+        kSpot,
+        kImageBased,
+        kArea
+    };
+
+    struct SceneLightRecord
+    {
+        SceneString name;
+        std::uint32_t type;
+        // Texture index of image based light
+        std::int32_t texture;
+        // Area light shape (meshes go first, then instances) and primitive
+        std::int32_t shape;
+        std::uint32_t prim_idx;
+        float position[3];
+        float direction[3];
+        float radiance[3];
+        float cone_shape[2];
+        float multiplier;
+    };
+
+    struct SceneCameraRecord
+    {
+        float position[3];
+        float forward[3];
+        float up[3];
+        float sensor_size[2];
+        float depth_range[2];
+        float focus_distance;
+        float focal_length;
+        float aperture;
+    };
+
+    static void StoreFloat3(RadeonRays::float3 const& v, float* out)
+    {
+        out[0] = v.x;
+        out[1] = v.y;
+        out[2] = v.z;
     }
 
-    Scene1::Ptr SceneBinaryIo::LoadScene(std::string const& filename, std::string const& basepath) const
+    static RadeonRays::float3 LoadFloat3(float const* v)
     {
-        auto scene = Scene1::Create();
-        auto image_io(ImageIo::CreateImageIo());
+        return RadeonRays::float3(v[0], v[1], v[2]);
+    }
+
+    static void StoreMatrix(RadeonRays::matrix const& m, float* out)
+    {
+        for (auto i = 0; i < 4; ++i)
+            for (auto j = 0; j < 4; ++j)
+                out[i * 4 + j] = m.m[i][j];
+    }
 
-        std::map<std::string, Material*> mats;
+    static RadeonRays::matrix LoadMatrix(float const* v)
+    {
+        RadeonRays::matrix m;
+        for (auto i = 0; i < 4; ++i)
+            for (auto j = 0; j < 4; ++j)
+                m.m[i][j] = v[i * 4 + j];
+        return m;
+    }
 
-        struct less
+    namespace
+    {
+        class SceneFileWriter
         {
-            bool operator ()(RadeonRays::float3 const& v1, RadeonRays::float3 const& v2) const {
-                return v1.x < v2.x;
+        public:
+            explicit SceneFileWriter(std::string const& filename)
+                : m_out(filename, std::ios::binary)
+            {
+                if (!m_out)
+                {
+                    throw std::runtime_error("Can't create " + filename);
+                }
+
+                // Header is filled in when the file is complete
+                SceneFileHeader header = {};
+                m_out.write(reinterpret_cast<char const*>(&header), sizeof(header));
             }
-        };
 
-        std::map<RadeonRays::float3, Material::Ptr, less> c2mats;
+            // Write block at the next aligned offset, returns the offset
+            std::uint64_t Write(void const* data, std::size_t size)
+            {
+                Align();
 
-        std::string full_path = filename;
+                auto offset = static_cast<std::uint64_t>(m_out.tellp());
 
-        std::ifstream in(full_path, std::ios::binary | std::ios::in);
+                if (size > 0)
+                {
+                    m_out.write(static_cast<char const*>(data), size);
+                }
 
-        if (!in)
-        {
-            throw std::runtime_error("Cannot open file for reading");
-        }
+                return offset;
+            }
 
-        std::uint32_t num_meshes = 0;
-        in.read((char*)&num_meshes, sizeof(std::uint32_t));
+            template <typename T>
+            void WriteSection(SceneSection type, std::vector<T> const& records)
+            {
+                SceneSectionEntry entry;
+                entry.type = static_cast<std::uint32_t>(type);
+                entry.count = static_cast<std::uint32_t>(records.size());
+                entry.size = records.size() * sizeof(T);
+                entry.offset = Write(records.data(), entry.size);
+                m_toc.push_back(entry);
+            }
+
+            SceneString AddString(std::string const& str)
+            {
+                SceneString res;
+                res.offset = static_cast<std::uint32_t>(m_strings.size());
+                res.size = static_cast<std::uint32_t>(str.size());
+                m_strings.insert(m_strings.end(), str.cbegin(), str.cend());
+                return res;
+            }
+
+            void Finish()
+            {
+                WriteSection(SceneSection::kStrings, m_strings);
+
+                SceneFileHeader header = {};
+                std::memcpy(header.magic, kSceneMagic, sizeof(kSceneMagic));
+                header.version = kSceneVersion;
+                header.num_sections = static_cast<std::uint32_t>(m_toc.size());
+                header.toc_offset = Write(m_toc.data(), m_toc.size() * sizeof(SceneSectionEntry));
+                Align();
+                header.file_size = static_cast<std::uint64_t>(m_out.tellp());
 
-        LogInfo("Number of objects: ", num_meshes, "\n");
+                m_out.seekp(0);
+                m_out.write(reinterpret_cast<char const*>(&header), sizeof(header));
 
-        for (auto i = 0U; i < num_meshes; ++i)
+                if (!m_out)
+                {
+                    throw std::runtime_error("Failed to write scene file");
+                }
+            }
+
+        private:
+            void Align()
+            {
+                static const char zeros[kSceneAlignment] = {};
+
+                auto pos = static_cast<std::size_t>(m_out.tellp());
+                auto padding = (kSceneAlignment - pos % kSceneAlignment) % kSceneAlignment;
+
+                m_out.write(zeros, padding);
+            }
+
+            std::ofstream m_out;
+            std::vector<SceneSectionEntry> m_toc;
+            std::vector<char> m_strings;
+        };
+
+        class SceneFileReader
         {
-            auto mesh = Mesh::Create();
+        public:
+            explicit SceneFileReader(MappedFile const& file)
+                : m_data(file.GetData())
+                , m_size(file.GetSize())
+            {
+                if (m_size < sizeof(SceneFileHeader))
+                {
+                    throw std::runtime_error("Not a scene file");
+                }
 
-            std::uint32_t num_indices = 0;
-            in.read((char*)&num_indices, sizeof(std::uint32_t));
+                SceneFileHeader header;
+                std::memcpy(&header, m_data, sizeof(header));
 
-            std::uint32_t num_vertices = 0;
-            in.read((char*)&num_vertices, sizeof(std::uint32_t));
+                if (std::memcmp(header.magic, kSceneMagic, sizeof(kSceneMagic)) != 0)
+                {
+                    throw std::runtime_error("Not a scene file");
+                }
 
+                if (header.version != kSceneVersion)
+                {
+                    throw std::runtime_error("Unsupported scene file version " + std::to_string(header.version));
+                }
 
-            std::uint32_t num_normals = 0;
-            in.read((char*)&num_normals, sizeof(std::uint32_t));
+                if (header.file_size != m_size)
+                {
+                    throw std::runtime_error("Scene file is truncated");
+                }
 
+                m_toc = GetArray<SceneSectionEntry>(header.toc_offset, header.num_sections);
+                m_num_sections = header.num_sections;
 
-            std::uint32_t num_uvs = 0;
-            in.read((char*)&num_uvs, sizeof(std::uint32_t));
+                m_strings = GetSection<char>(SceneSection::kStrings, m_num_strings);
+            }
 
+            // Get section records, returns nullptr if the section is missing
+            template <typename T>
+            T const* GetSection(SceneSection type, std::uint32_t& count) const
             {
-                std::vector<std::uint32_t> indices(num_indices);
-                in.read((char*)&indices[0], num_indices * sizeof(std::uint32_t));
+                for (auto i = 0u; i < m_num_sections; ++i)
+                {
+                    auto const& entry = m_toc[i];
 
-                mesh->SetIndices(&indices[0], num_indices);
+                    if (entry.type == static_cast<std::uint32_t>(type))
+                    {
+                        if (entry.size != std::uint64_t(entry.count) * sizeof(T))
+                        {
+                            throw std::runtime_error("Scene file is corrupted");
+                        }
+
+                        count = entry.count;
+                        return GetArray<T>(entry.offset, entry.count);
+                    }
+                }
+
+                count = 0;
+                return nullptr;
             }
 
+            // Get array stored in place, checks bounds and alignment
+            template <typename T>
+            T const* GetArray(std::uint64_t offset, std::uint32_t count) const
             {
-                std::vector<RadeonRays::float3> vertices(num_vertices);
-                in.read((char*)&vertices[0], num_vertices * sizeof(RadeonRays::float3));
+                auto size = std::uint64_t(count) * sizeof(T);
+
+                if (offset % kSceneAlignment != 0 || offset > m_size || size > m_size - offset)
+                {
+                    throw std::runtime_error("Scene file is corrupted");
+                }
 
-                mesh->SetVertices(&vertices[0], num_vertices);
+                return count > 0 ? reinterpret_cast<T const*>(m_data + offset) : nullptr;
             }
 
+            std::string GetString(SceneString str) const
             {
-                std::vector<RadeonRays::float3> normals(num_normals);
-                in.read((char*)&normals[0], num_normals * sizeof(RadeonRays::float3));
+                if (str.offset > m_num_strings || str.size > m_num_strings - str.offset)
+                {
+                    throw std::runtime_error("Scene file is corrupted");
+                }
 
-                mesh->SetNormals(&normals[0], num_normals);
+                return str.size > 0 ? std::string(m_strings + str.offset, str.size) : std::string();
             }
 
+        private:
+            char const* m_data;
+            std::size_t m_size;
+            SceneSectionEntry const* m_toc;
+            std::uint32_t m_num_sections;
+            char const* m_strings;
+            std::uint32_t m_num_strings;
+        };
+    }
+
+    std::unique_ptr<SceneIo> SceneIo::CreateSceneIoBinary()
+    {
+        return std::unique_ptr<SceneIo>(new SceneBinaryIo());
+    }
+
+    Scene1::Ptr SceneBinaryIo::LoadScene(std::string const& filename, std::string const& basepath) const
+    {
+        // Loaded meshes keep the mapping alive while they reference it
+        auto file = std::make_shared<MappedFile>(filename);
+        SceneFileReader reader(*file);
+
+        auto scene = Scene1::Create();
+        auto image_io(ImageIo::CreateImageIo());
+
+        std::uint32_t num_textures = 0;
+        auto texture_records = reader.GetSection<SceneTextureRecord>(SceneSection::kTextures, num_textures);
+
+        std::vector<Texture::Ptr> textures(num_textures);
+        for (auto i = 0u; i < num_textures; ++i)
+        {
+            auto name = reader.GetString(texture_records[i].name);
+
+            if (name.empty())
             {
-                std::vector<RadeonRays::float2> uvs(num_uvs);
-                in.read((char*)&uvs[0], num_uvs * sizeof(RadeonRays::float2));
+                LogInfo("Skipping unnamed texture ", i, "\n");
+                continue;
+            }
+
+            textures[i] = LoadTexture(*image_io, *scene, basepath, name);
+        }
+
+        std::uint32_t num_materials = 0;
+        auto material_records = reader.GetSection<SceneMaterialRecord>(SceneSection::kMaterials, num_materials);
+
+        // Materials reference each other, so create them first and set inputs after
+        std::vector<Material::Ptr> materials(num_materials);
+        for (auto i = 0u; i < num_materials; ++i)
+        {
+            auto const& record = material_records[i];
 
-                mesh->SetUVs(&uvs[0], num_uvs);
+            switch (static_cast<SceneMaterialKind>(record.kind))
+            {
+                case SceneMaterialKind::kSingleBxdf:
+                    materials[i] = SingleBxdf::Create(static_cast<SingleBxdf::BxdfType>(record.type));
+                    break;
+                case SceneMaterialKind::kMultiBxdf:
+                    materials[i] = MultiBxdf::Create(static_cast<MultiBxdf::Type>(record.type));
+                    break;
+                case SceneMaterialKind::kDisneyBxdf:
+                    materials[i] = DisneyBxdf::Create();
+                    break;
+                default:
+                    throw std::runtime_error("Scene file is corrupted");
             }
 
+            materials[i]->SetName(reader.GetString(record.name));
+            materials[i]->SetThin(record.thin != 0);
+        }
 
+        auto get_material = [&materials](std::int32_t idx) -> Material::Ptr
+        {
+            if (idx >= static_cast<std::int32_t>(materials.size()))
             {
-                std::uint32_t flag = 0;
-                in.read(reinterpret_cast<char*>(&flag), sizeof(flag));
+                throw std::runtime_error("Scene file is corrupted");
+            }
 
-                if (!flag)
-                {
-                    RadeonRays::float3 albedo;
-                    in.read(reinterpret_cast<char*>(&albedo.x), sizeof(RadeonRays::float3));
+            return idx >= 0 ? materials[idx] : nullptr;
+        };
 
-                    /*auto iter = c2mats.find(albedo);
+        std::uint32_t num_inputs = 0;
+        auto input_records = reader.GetSection<SceneMaterialInputRecord>(SceneSection::kMaterialInputs, num_inputs);
 
-                    if (iter != c2mats.cend())
-                    {
-                        material = iter->second;
-                    }
-                    else
-                    {
-                        material = new SingleBxdf(SingleBxdf::BxdfType::kLambert);
-                        material->SetInputValue("albedo", albedo);
-                        c2mats[albedo] = material;
-                        scene->AttachAutoreleaseObject(material);
-                    }*/
-                }
-                else
+        for (auto i = 0u; i < num_materials; ++i)
+        {
+            auto const& record = material_records[i];
+
+            if (record.first_input > num_inputs || record.num_inputs > num_inputs - record.first_input)
+            {
+                throw std::runtime_error("Scene file is corrupted");
+            }
+
+            for (auto j = record.first_input; j < record.first_input + record.num_inputs; ++j)
+            {
+                auto const& input = input_records[j];
+                auto name = reader.GetString(input.name);
+
+                switch (static_cast<Material::InputType>(input.type))
                 {
-                    std::uint32_t size = 0;
-                    in.read(reinterpret_cast<char*>(&size), sizeof(size));
-
-                    std::vector<char> buff(size);
-                    in.read(&buff[0], sizeof(char) * size);
-
-                    //std::string name(buff.cbegin(), buff.cend());
-
-                    //auto iter = mats.find(name);
-
-                    //if (iter != mats.cend())
-                    //{
-                    //    material = iter->second;
-                    //}
-                    //else
-                    //{
-                    //    LogInfo("Loading texture ", name, "\n");
-                    //    auto texture = image_io->LoadImage(basepath + name);
-                    //    //material = new SingleBxdf(SingleBxdf::BxdfType::kLambert);
-                    //    //material->SetInputValue("albedo", texture);
-                    //    //mats[name] = material;
-                    //    //scene->AttachAutoreleaseObject(texture);
-                    //    //scene->AttachAutoreleaseObject(material);
-                    //}
+                    case Material::InputType::kFloat4:
+                        materials[i]->SetInputValue(name, RadeonRays::float4(input.value[0], input.value[1], input.value[2], input.value[3]));
+                        break;
+                    case Material::InputType::kTexture:
+                        if (input.index >= static_cast<std::int32_t>(num_textures))
+                        {
+                            throw std::runtime_error("Scene file is corrupted");
+                        }
+                        // Keep default value if texture is missing
+                        if (input.index >= 0 && textures[input.index])
+                        {
+                            materials[i]->SetInputValue(name, textures[input.index]);
+                        }
+                        break;
+                    case Material::InputType::kMaterial:
+                        materials[i]->SetInputValue(name, get_material(input.index));
+                        break;
+                    default:
+                        throw std::runtime_error("Scene file is corrupted");
+                }
+            }
+        }
+
+        std::uint32_t num_meshes = 0;
+        auto mesh_records = reader.GetSection<SceneMeshRecord>(SceneSection::kMeshes, num_meshes);
 
+        std::uint32_t num_instances = 0;
+        auto instance_records = reader.GetSection<SceneInstanceRecord>(SceneSection::kInstances, num_instances);
+
+        LogInfo("Number of objects: ", num_meshes + num_instances, "\n");
+
+        // Meshes go first, then instances
+        std::vector<Shape::Ptr> shapes;
+        shapes.reserve(num_meshes + num_instances);
+
+        for (auto i = 0u; i < num_meshes; ++i)
+        {
+            auto const& record = mesh_records[i];
+
+            // Indices are used without copying, so make sure they stay within vertex data
+            auto indices = reader.GetArray<std::uint32_t>(record.indices_offset, record.num_indices);
+            for (auto j = 0u; j < record.num_indices; ++j)
+            {
+                if (indices[j] >= record.num_vertices)
+                {
+                    throw std::runtime_error("Scene file is corrupted");
                 }
+            }
+
+            auto mesh = Mesh::Create();
+            mesh->SetExternalGeometry(file,
+                indices, record.num_indices,
+                reader.GetArray<RadeonRays::float3>(record.vertices_offset, record.num_vertices), record.num_vertices,
+                reader.GetArray<RadeonRays::float3>(record.normals_offset, record.num_normals), record.num_normals,
+                reader.GetArray<RadeonRays::float2>(record.uvs_offset, record.num_uvs), record.num_uvs);
+
+            mesh->SetName(reader.GetString(record.name));
+            mesh->SetMaterial(get_material(record.material));
+            mesh->SetVisibilityMask(record.visibility_mask);
+            mesh->SetTransform(LoadMatrix(record.transform));
+
+            if (record.attached)
+            {
+                scene->AttachShape(mesh);
+            }
+
+            shapes.push_back(mesh);
+        }
+
+        for (auto i = 0u; i < num_instances; ++i)
+        {
+            auto const& record = instance_records[i];
 
-                mesh->SetMaterial(nullptr);
+            if (record.base_mesh < 0 || record.base_mesh >= static_cast<std::int32_t>(num_meshes))
+            {
+                throw std::runtime_error("Scene file is corrupted");
             }
 
-            scene->AttachShape(mesh);
+            auto instance = Instance::Create(shapes[record.base_mesh]);
+            instance->SetName(reader.GetString(record.name));
+            instance->SetMaterial(get_material(record.material));
+            instance->SetVisibilityMask(record.visibility_mask);
+            instance->SetTransform(LoadMatrix(record.transform));
+
+            scene->AttachShape(instance);
+            shapes.push_back(instance);
         }
 
+        std::uint32_t num_lights = 0;
+        auto light_records = reader.GetSection<SceneLightRecord>(SceneSection::kLights, num_lights);
 
+        for (auto i = 0u; i < num_lights; ++i)
+        {
+            auto const& record = light_records[i];
 
-        auto  ibl_texture = image_io->LoadImage("../Resources/Textures/Canopus_Ground_4k.exr");
+            Light::Ptr light;
+            switch (static_cast<SceneLightType>(record.type))
+            {
+                case SceneLightType::kPoint:
+                    light = PointLight::Create();
+                    break;
+                case SceneLightType::kDirectional:
+                    light = DirectionalLight::Create();
+                    break;
+                case SceneLightType::kSpot:
+                {
+                    auto spot = SpotLight::Create();
+                    spot->SetConeShape(RadeonRays::float2(record.cone_shape[0], record.cone_shape[1]));
+                    light = spot;
+                    break;
+                }
+                case SceneLightType::kImageBased:
+                {
+                    if (record.texture >= static_cast<std::int32_t>(num_textures))
+                    {
+                        throw std::runtime_error("Scene file is corrupted");
+                    }
 
-        auto ibl = ImageBasedLight::Create();
-        ibl->SetTexture(ibl_texture);
-        ibl->SetMultiplier(1.f);
+                    auto ibl = ImageBasedLight::Create();
+                    ibl->SetTexture(record.texture >= 0 ? textures[record.texture] : nullptr);
+                    ibl->SetMultiplier(record.multiplier);
+                    light = ibl;
+                    break;
+                }
+                case SceneLightType::kArea:
+                {
+                    if (record.shape < 0 || record.shape >= static_cast<std::int32_t>(shapes.size()))
+                    {
+                        throw std::runtime_error("Scene file is corrupted");
+                    }
 
-        // TODO: temporary code to add directional light
-        auto light = DirectionalLight::Create();
-        light->SetDirection(RadeonRays::normalize(RadeonRays::float3(-1.1f, -0.6f, -0.4f)));
-        light->SetEmittedRadiance(7.f * RadeonRays::float3(1.f, 0.95f, 0.92f));
+                    light = AreaLight::Create(shapes[record.shape], record.prim_idx);
+                    break;
+                }
+                default:
+                    throw std::runtime_error("Scene file is corrupted");
+            }
 
-        auto light1 = DirectionalLight::Create();
-        light1->SetDirection(RadeonRays::float3(0.3f, -1.f, -0.5f));
-        light1->SetEmittedRadiance(RadeonRays::float3(1.f, 0.8f, 0.65f));
+            light->SetName(reader.GetString(record.name));
+            light->SetPosition(LoadFloat3(record.position));
+            light->SetDirection(LoadFloat3(record.direction));
+            light->SetEmittedRadiance(LoadFloat3(record.radiance));
 
-        scene->AttachLight(light);
-        //scene->AttachLight(light1);
-        scene->AttachLight(ibl);
+            scene->AttachLight(light);
+        }
+
+        std::uint32_t num_cameras = 0;
+        auto camera_record = reader.GetSection<SceneCameraRecord>(SceneSection::kCamera, num_cameras);
+
+        if (num_cameras > 0)
+        {
+            auto position = LoadFloat3(camera_record->position);
+            auto camera = PerspectiveCamera::Create(position,
+                                                    position + LoadFloat3(camera_record->forward),
+                                                    LoadFloat3(camera_record->up));
+
+            camera->SetSensorSize(RadeonRays::float2(camera_record->sensor_size[0], camera_record->sensor_size[1]));
+            camera->SetDepthRange(RadeonRays::float2(camera_record->depth_range[0], camera_record->depth_range[1]));
+            camera->SetFocusDistance(camera_record->focus_distance);
+            camera->SetFocalLength(camera_record->focal_length);
+            camera->SetAperture(camera_record->aperture);
+
+            scene->SetCamera(camera);
+        }
 
         return scene;
     }
 
     void SceneBinaryIo::SaveScene(Scene1 const& scene, std::string const& filename, std::string const& basepath) const
     {
-        std::string full_path = filename;
+        // Collect meshes: attached ones first, then instance base meshes
+        std::vector<Mesh::Ptr> meshes;
+        std::vector<std::uint32_t> attached;
+        std::vector<Instance::Ptr> instances;
+        std::map<Shape const*, std::int32_t> shape_indices;
 
-        std::ofstream out(full_path, std::ios::binary | std::ios::out);
-
-        if (!out)
+        auto shape_iter = scene.CreateShapeIterator();
+        for (; shape_iter->IsValid(); shape_iter->Next())
         {
-            throw std::runtime_error("Cannot open file for writing");
+            auto shape = shape_iter->ItemAs<Shape>();
+
+            if (auto mesh = std::dynamic_pointer_cast<Mesh>(shape))
+            {
+                shape_indices[mesh.get()] = static_cast<std::int32_t>(meshes.size());
+                meshes.push_back(mesh);
+                attached.push_back(1u);
+            }
+            else if (auto instance = std::dynamic_pointer_cast<Instance>(shape))
+            {
+                instances.push_back(instance);
+            }
+            else
+            {
+                throw std::runtime_error("Shape type not supported");
+            }
         }
 
-        auto default_material = SingleBxdf::Create(SingleBxdf::BxdfType::kLambert);
+        for (auto const& instance : instances)
+        {
+            auto base = std::dynamic_pointer_cast<Mesh>(instance->GetBaseShape());
 
-        auto num_shapes = (std::uint32_t)scene.GetNumShapes();
-        out.write((char*)&num_shapes, sizeof(std::uint32_t));
+            if (!base)
+            {
+                throw std::runtime_error("Only mesh instances are supported");
+            }
 
-        auto shape_iter = scene.CreateShapeIterator();
+            if (shape_indices.find(base.get()) == shape_indices.cend())
+            {
+                shape_indices[base.get()] = static_cast<std::int32_t>(meshes.size());
+                meshes.push_back(base);
+                attached.push_back(0u);
+            }
+        }
 
-        for (; shape_iter->IsValid(); shape_iter->Next())
+        for (auto i = 0u; i < instances.size(); ++i)
         {
-            auto mesh = shape_iter->ItemAs<Mesh>();
-            auto num_indices = (std::uint32_t)mesh->GetNumIndices();
-            out.write((char*)&num_indices, sizeof(std::uint32_t));
+            shape_indices[instances[i].get()] = static_cast<std::int32_t>(meshes.size() + i);
+        }
 
-            auto num_vertices = (std::uint32_t)mesh->GetNumVertices();
-            out.write((char*)&num_vertices, sizeof(std::uint32_t));
+        // Collect textures and materials (recursively through inputs)
+        std::vector<Texture::Ptr> textures;
+        std::map<Texture const*, std::int32_t> texture_indices;
+        std::vector<Material::Ptr> materials;
+        std::map<Material const*, std::int32_t> material_indices;
 
-            auto num_normals = (std::uint32_t)mesh->GetNumNormals();
-            out.write((char*)&num_normals, sizeof(std::uint32_t));
+        auto add_texture = [&textures, &texture_indices](Texture::Ptr texture) -> std::int32_t
+        {
+            if (!texture)
+            {
+                return -1;
+            }
 
-            auto num_uvs = (std::uint32_t)mesh->GetNumUVs();
-            out.write((char*)&num_uvs, sizeof(std::uint32_t));
+            auto iter = texture_indices.find(texture.get());
 
-            out.write((char const*)mesh->GetIndices(), mesh->GetNumIndices() * sizeof(std::uint32_t));
-            out.write((char const*)mesh->GetVertices(), mesh->GetNumVertices() * sizeof(RadeonRays::float3));
-            out.write((char const*)mesh->GetNormals(), mesh->GetNumNormals() * sizeof(RadeonRays::float3));
-            out.write((char const*)mesh->GetUVs(), mesh->GetNumUVs() * sizeof(RadeonRays::float2));
+            if (iter != texture_indices.cend())
+            {
+                return iter->second;
+            }
 
-            auto material = mesh->GetMaterial();
+            auto idx = static_cast<std::int32_t>(textures.size());
+            texture_indices[texture.get()] = idx;
+            textures.push_back(texture);
+            return idx;
+        };
 
+        std::function<std::int32_t(Material::Ptr)> add_material = [&](Material::Ptr material) -> std::int32_t
+        {
             if (!material)
             {
-                material = default_material;
+                return -1;
             }
 
-            auto diffuse = std::dynamic_pointer_cast<SingleBxdf>(material);
+            auto iter = material_indices.find(material.get());
 
-            if (!diffuse)
+            if (iter != material_indices.cend())
             {
-                diffuse = std::dynamic_pointer_cast<SingleBxdf>(material->GetInputValue("base_material").mat_value);
+                return iter->second;
             }
 
-            if (!diffuse)
+            auto idx = static_cast<std::int32_t>(materials.size());
+            material_indices[material.get()] = idx;
+            materials.push_back(material);
+
+            for (auto const& name : material->GetInputNames())
             {
-                throw std::runtime_error("Material not supported");
+                auto value = material->GetInputValue(name);
+
+                if (value.type == Material::InputType::kTexture)
+                {
+                    add_texture(value.tex_value);
+                }
+                else if (value.type == Material::InputType::kMaterial)
+                {
+                    add_material(value.mat_value);
+                }
             }
 
-            auto albedo = diffuse->GetInputValue("albedo");
+            return idx;
+        };
+
+        SceneFileWriter writer(filename);
+
+        std::vector<SceneMeshRecord> mesh_records(meshes.size());
+        for (auto i = 0u; i < meshes.size(); ++i)
+        {
+            auto const& mesh = meshes[i];
+            auto& record = mesh_records[i];
+
+            record.name = writer.AddString(mesh->GetName());
+            record.num_indices = static_cast<std::uint32_t>(mesh->GetNumIndices());
+            record.num_vertices = static_cast<std::uint32_t>(mesh->GetNumVertices());
+            record.num_normals = static_cast<std::uint32_t>(mesh->GetNumNormals());
+            record.num_uvs = static_cast<std::uint32_t>(mesh->GetNumUVs());
+            record.indices_offset = writer.Write(mesh->GetIndices(), record.num_indices * sizeof(std::uint32_t));
+            record.vertices_offset = writer.Write(mesh->GetVertices(), record.num_vertices * sizeof(RadeonRays::float3));
+            record.normals_offset = writer.Write(mesh->GetNormals(), record.num_normals * sizeof(RadeonRays::float3));
+            record.uvs_offset = writer.Write(mesh->GetUVs(), record.num_uvs * sizeof(RadeonRays::float2));
+            record.material = add_material(mesh->GetMaterial());
+            record.visibility_mask = mesh->GetVisibilityMask();
+            record.attached = attached[i];
+            StoreMatrix(mesh->GetTransform(), record.transform);
+        }
+
+        std::vector<SceneInstanceRecord> instance_records(instances.size());
+        for (auto i = 0u; i < instances.size(); ++i)
+        {
+            auto const& instance = instances[i];
+            auto& record = instance_records[i];
+
+            record.name = writer.AddString(instance->GetName());
+            record.base_mesh = shape_indices[instance->GetBaseShape().get()];
+            record.material = add_material(instance->GetMaterial());
+            record.visibility_mask = instance->GetVisibilityMask();
+            StoreMatrix(instance->GetTransform(), record.transform);
+        }
+
+        std::vector<SceneLightRecord> light_records;
+        auto light_iter = scene.CreateLightIterator();
+        for (; light_iter->IsValid(); light_iter->Next())
+        {
+            auto light = light_iter->ItemAs<Light>();
+
+            SceneLightRecord record = {};
+            record.name = writer.AddString(light->GetName());
+            record.texture = -1;
+            record.shape = -1;
+            StoreFloat3(light->GetPosition(), record.position);
+            StoreFloat3(light->GetDirection(), record.direction);
+            StoreFloat3(light->GetEmittedRadiance(), record.radiance);
 
-            if (albedo.type == Material::InputType::kFloat4)
+            if (std::dynamic_pointer_cast<PointLight>(light))
+            {
+                record.type = static_cast<std::uint32_t>(SceneLightType::kPoint);
+            }
+            else if (std::dynamic_pointer_cast<DirectionalLight>(light))
+            {
+                record.type = static_cast<std::uint32_t>(SceneLightType::kDirectional);
+            }
+            else if (auto spot = std::dynamic_pointer_cast<SpotLight>(light))
+            {
+                record.type = static_cast<std::uint32_t>(SceneLightType::kSpot);
+                record.cone_shape[0] = spot->GetConeShape().x;
+                record.cone_shape[1] = spot->GetConeShape().y;
+            }
+            else if (auto ibl = std::dynamic_pointer_cast<ImageBasedLight>(light))
+            {
+                record.type = static_cast<std::uint32_t>(SceneLightType::kImageBased);
+                record.texture = add_texture(ibl->GetTexture());
+                record.multiplier = ibl->GetMultiplier();
+            }
+            else if (auto area = std::dynamic_pointer_cast<AreaLight>(light))
             {
-                std::uint32_t flag = 0;
-                out.write(reinterpret_cast<char const*>(&flag), sizeof(flag));
-                out.write(reinterpret_cast<char const*>(&albedo.float_value.x), sizeof(RadeonRays::float3));
+                auto iter = shape_indices.find(area->GetShape().get());
+
+                if (iter == shape_indices.cend())
+                {
+                    throw std::runtime_error("Area light shape is not in the scene");
+                }
+
+                record.type = static_cast<std::uint32_t>(SceneLightType::kArea);
+                record.shape = iter->second;
+                record.prim_idx = static_cast<std::uint32_t>(area->GetPrimitiveIdx());
             }
             else
             {
-                std::uint32_t flag = 1;
+                throw std::runtime_error("Light type not supported");
+            }
 
-                auto name = albedo.tex_value->GetName();
-                //LogInfo("Saving texture ", name, "\n");
-                auto size = name.size();
+            light_records.push_back(record);
+        }
 
-                out.write(reinterpret_cast<char const*>(&flag), sizeof(flag));
-                out.write(reinterpret_cast<char const*>(&size), sizeof(size));
-                out.write(name.c_str(), sizeof(char) * size);
+        // All the materials are collected at this point
+        std::vector<SceneMaterialRecord> material_records(materials.size());
+        std::vector<SceneMaterialInputRecord> input_records;
+        for (auto i = 0u; i < materials.size(); ++i)
+        {
+            auto const& material = materials[i];
+            auto& record = material_records[i];
+
+            record.name = writer.AddString(material->GetName());
+            record.thin = material->IsThin() ? 1u : 0u;
+
+            if (auto single = std::dynamic_pointer_cast<SingleBxdf>(material))
+            {
+                record.kind = static_cast<std::uint32_t>(SceneMaterialKind::kSingleBxdf);
+                record.type = static_cast<std::uint32_t>(single->GetBxdfType());
+            }
+            else if (auto multi = std::dynamic_pointer_cast<MultiBxdf>(material))
+            {
+                record.kind = static_cast<std::uint32_t>(SceneMaterialKind::kMultiBxdf);
+                record.type = static_cast<std::uint32_t>(multi->GetType());
+            }
+            else if (std::dynamic_pointer_cast<DisneyBxdf>(material))
+            {
+                record.kind = static_cast<std::uint32_t>(SceneMaterialKind::kDisneyBxdf);
+                record.type = 0;
+            }
+            else
+            {
+                throw std::runtime_error("Material type not supported");
             }
 
+            auto names = material->GetInputNames();
+            record.first_input = static_cast<std::uint32_t>(input_records.size());
+            record.num_inputs = static_cast<std::uint32_t>(names.size());
+
+            for (auto const& name : names)
+            {
+                auto value = material->GetInputValue(name);
+
+                SceneMaterialInputRecord input = {};
+                input.name = writer.AddString(name);
+                input.type = static_cast<std::uint32_t>(value.type);
+                input.index = -1;
+                input.value[0] = value.float_value.x;
+                input.value[1] = value.float_value.y;
+                input.value[2] = value.float_value.z;
+                input.value[3] = value.float_value.w;
+
+                if (value.type == Material::InputType::kTexture && value.tex_value)
+                {
+                    input.index = texture_indices[value.tex_value.get()];
+                }
+                else if (value.type == Material::InputType::kMaterial && value.mat_value)
+                {
+                    input.index = material_indices[value.mat_value.get()];
+                }
+
+                input_records.push_back(input);
+            }
         }
+
+        std::vector<SceneTextureRecord> texture_records(textures.size());
+        for (auto i = 0u; i < textures.size(); ++i)
+        {
+            auto name = textures[i]->GetName();
+
+            if (name.empty())
+            {
+                LogInfo("Texture ", i, " has no name and is not saved\n");
+            }
+            else if (!basepath.empty() && name.compare(0, basepath.size(), basepath) == 0)
+            {
+                // Names are stored relative to basepath
+                name = name.substr(basepath.size());
+            }
+
+            texture_records[i].name = writer.AddString(name);
+        }
+
+        std::vector<SceneCameraRecord> camera_records;
+        if (auto camera = std::dynamic_pointer_cast<PerspectiveCamera>(scene.GetCamera()))
+        {
+            SceneCameraRecord record;
+            StoreFloat3(camera->GetPosition(), record.position);
+            StoreFloat3(camera->GetForwardVector(), record.forward);
+            StoreFloat3(camera->GetUpVector(), record.up);
+            record.sensor_size[0] = camera->GetSensorSize().x;
+            record.sensor_size[1] = camera->GetSensorSize().y;
+            record.depth_range[0] = camera->GetDepthRange().x;
+            record.depth_range[1] = camera->GetDepthRange().y;
+            record.focus_distance = camera->GetFocusDistance();
+            record.focal_length = camera->GetFocalLength();
+            record.aperture = camera->GetAperture();
+            camera_records.push_back(record);
+        }
+
+        writer.WriteSection(SceneSection::kTextures, texture_records);
+        writer.WriteSection(SceneSection::kMaterials, material_records);
+        writer.WriteSection(SceneSection::kMaterialInputs, input_records);
+        writer.WriteSection(SceneSection::kMeshes, mesh_records);
+        writer.WriteSection(SceneSection::kInstances, instance_records);
+        writer.WriteSection(SceneSection::kLights, light_records);
+        writer.WriteSection(SceneSection::kCamera, camera_records);
+        writer.Finish();
     }
 }
@@ -28,12 +28,16 @@ THE SOFTWARE.
 
 namespace Baikal
 {
-    // Create fake test IO
+    // Native versioned binary scene format.
+    // File consists of 64 bytes header, table of contents and sections
+    // (meshes, instances, materials, lights, camera, texture references).
+    // Mesh arrays are 64 bytes aligned, so loaded meshes reference
+    // memory mapped file directly instead of copying the data.
     class SceneBinaryIo : public SceneIo
     {
     public:
         SceneBinaryIo() = default;
-        // Load scene (this class uses filename to determine what scene to generate)
+        // Load scene, throws std::runtime_error if the file is malformed
         Scene1::Ptr LoadScene(std::string const& filename, std::string const& basepath) const override;
         void SaveScene(Scene1 const& scene, std::string const& filename, std::string const& basepath) const override;
     };
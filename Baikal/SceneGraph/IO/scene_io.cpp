@@ -5,8 +5,12 @@
 #include "../material.h"
 #include "../light.h"
 #include "../texture.h"
+#include "obj_parser.h"
 #include "math/mathutils.h"
+#include "Utils/thread_pool.h"
 
+#include <algorithm>
+#include <chrono>
 #include <string>
 #include <map>
 
@@ -44,8 +48,22 @@ namespace Baikal
         {
             try
             {
-                LogInfo("Loading ", name, "\n");
-                auto texture = io.LoadImage(basepath + name);
+                Texture::Ptr texture;
+                auto request = m_texture_requests.find(basepath + name);
+
+                if (request != m_texture_requests.cend())
+                {
+                    // Decoded (or being decoded) on a pool thread
+                    auto future = std::move(request->second);
+                    m_texture_requests.erase(request);
+                    texture = future.get();
+                }
+                else
+                {
+                    LogInfo("Loading ", name, "\n");
+                    texture = io.LoadImage(basepath + name);
+                }
+
                 texture->SetName(name);
                 m_texture_cache[name] = texture;
                 return texture;
@@ -58,6 +76,34 @@ namespace Baikal
         }
     }
 
+    void SceneIo::LoadTextureAsync(ImageIo const& io, ThreadPool& pool, std::string const& basepath, std::string const& name) const
+    {
+        auto path = basepath + name;
+
+        if (m_texture_cache.find(name) != m_texture_cache.cend() ||
+            m_texture_requests.find(path) != m_texture_requests.cend())
+        {
+            return;
+        }
+
+        LogInfo("Loading ", name, " asynchronously\n");
+
+        m_texture_requests[path] = pool.Submit([&io, path]()
+        {
+            return io.LoadImage(path);
+        });
+    }
+
+    void SceneIo::ClearTextureRequests() const
+    {
+        m_texture_requests.clear();
+    }
+
+    void SceneIo::SaveScene(Scene1 const& scene, std::string const& filename, std::string const& basepath) const
+    {
+        CreateSceneIoBinary()->SaveScene(scene, filename, basepath);
+    }
+
     Material::Ptr SceneIoObj::TranslateMaterial(ImageIo const& image_io, tinyobj::material_t const& mat, std::string const& basepath, Scene1& scene) const
     {
         auto iter = m_material_cache.find(mat.name);
@@ -179,27 +225,69 @@ namespace Baikal
     Scene1::Ptr SceneIoObj::LoadScene(std::string const& filename, std::string const& basepath) const
     {
         using namespace tinyobj;
+        using clock = std::chrono::high_resolution_clock;
 
         auto image_io(ImageIo::CreateImageIo());
 
-        // Loader data
-        std::vector<shape_t> objshapes;
+        auto load_start = clock::now();
+
+        // Geometry is parsed on all the hardware threads, textures are decoded
+        // on a separate pool, so they are loaded while geometry is being parsed.
+        // Pools are destroyed before image_io which texture requests reference.
+        ThreadPool geometry_pool;
+        ThreadPool texture_pool(std::max(geometry_pool.GetNumThreads() / 2, std::size_t(2)));
+
+        // Requests nobody picked up (textures of unused materials or
+        // requests left by a failed load) should not outlive the load
+        struct TextureRequestsGuard
+        {
+            SceneIoObj const& io;
+            ~TextureRequestsGuard() { io.ClearTextureRequests(); }
+        } texture_requests_guard{ *this };
+
+        // Material libraries are loaded as soon as the parser finds them
         std::vector<material_t> objmaterials;
+        std::map<std::string, int> material_map;
+        MaterialFileReader read_materials(basepath);
 
-        // Try loading file
-        LogInfo("Loading a scene from OBJ: ", filename, " ... ");
-        std::string err;
-        auto res = LoadObj(objshapes, objmaterials, err, filename.c_str(), basepath.c_str());
-        if (!res)
+        auto on_material_library = [&](std::string const& name)
         {
-            throw std::runtime_error(err);
-        }
-        LogInfo("Success\n");
+            auto first = objmaterials.size();
+
+            std::string err;
+            if (!read_materials(name, objmaterials, material_map, err))
+            {
+                throw std::runtime_error(err);
+            }
+
+            // Start decoding the textures TranslateMaterial uses
+            for (auto i = first; i < objmaterials.size(); ++i)
+            {
+                auto const& mat = objmaterials[i];
+
+                for (auto const* texname : { &mat.diffuse_texname, &mat.specular_texname, &mat.bump_texname })
+                {
+                    if (!texname->empty())
+                    {
+                        LoadTextureAsync(*image_io, texture_pool, basepath, *texname);
+                    }
+                }
+            }
+        };
+
+        // Parse geometry
+        LogInfo("Loading a scene from OBJ: ", filename, "\n");
+        std::vector<ObjParser::Shape> objshapes;
+        std::vector<std::string> material_names;
+        ObjParser::Parse(filename, geometry_pool, on_material_library, objshapes, material_names);
+
+        auto geometry_time = std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - load_start).count();
+        auto phase_start = clock::now();
 
         // Allocate scene
         auto scene = Scene1::Create();
 
-        // Enumerate and translate materials
+        // Enumerate and translate materials, this waits for texture decoding
         // Keep track of emissive subset
         std::set<Material::Ptr> emissives;
         std::vector<Material::Ptr> materials(objmaterials.size());
@@ -215,46 +303,63 @@ namespace Baikal
             }
         }
 
+        // Map usemtl names to materials
+        std::vector<int> material_indices(material_names.size(), -1);
+        for (auto i = 0u; i < material_names.size(); ++i)
+        {
+            auto iter = material_map.find(material_names[i]);
+
+            if (iter != material_map.cend())
+            {
+                material_indices[i] = iter->second;
+            }
+        }
+
+        auto material_time = std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - phase_start).count();
+        phase_start = clock::now();
+
+        // Shapes and lights are attached in one batch at the end
+        std::vector<Shape::Ptr> shapes;
+        std::vector<Light::Ptr> lights;
+        shapes.reserve(objshapes.size());
+
         // Enumerate all shapes in the scene
-        for (int s = 0; s < (int)objshapes.size(); ++s)
+        for (auto& objshape : objshapes)
         {
             // Create empty mesh
             auto mesh = Mesh::Create();
 
-            // Set vertex and index data
-            auto num_vertices = objshapes[s].mesh.positions.size() / 3;
-            mesh->SetVertices(&objshapes[s].mesh.positions[0], num_vertices);
-
-            auto num_normals = objshapes[s].mesh.normals.size() / 3;
-            mesh->SetNormals(&objshapes[s].mesh.normals[0], num_normals);
-
-            auto num_uvs = objshapes[s].mesh.texcoords.size() / 2;
+            // Set vertex and index data, parser output is moved into the mesh
+            auto num_vertices = objshape.positions.size();
+            mesh->SetVertices(std::move(objshape.positions));
+            mesh->SetNormals(std::move(objshape.normals));
 
             // If we do not have UVs, generate zeroes
-            if (num_uvs)
+            if (!objshape.uvs.empty())
             {
-                mesh->SetUVs(&objshapes[s].mesh.texcoords[0], num_uvs);
+                mesh->SetUVs(std::move(objshape.uvs));
             }
             else
             {
-                std::vector<RadeonRays::float2> zero(num_vertices);
-                std::fill(zero.begin(), zero.end(), RadeonRays::float2(0, 0));
-                mesh->SetUVs(&zero[0], num_vertices);
+                mesh->SetUVs(std::vector<RadeonRays::float2>(num_vertices, RadeonRays::float2(0, 0)));
             }
 
             // Set indices
-            auto num_indices = objshapes[s].mesh.indices.size();
-            mesh->SetIndices(reinterpret_cast<std::uint32_t const*>(&objshapes[s].mesh.indices[0]), num_indices);
+            mesh->SetIndices(std::move(objshape.indices));
 
             // Set material
+            auto get_material_index = [&material_indices](int id)
+            {
+                return id >= 0 ? material_indices[id] : -1;
+            };
 
-            for (int i = 0; i < objshapes[s].mesh.material_ids.size() - 1; ++i)
+            for (auto i = 0u; i + 1 < objshape.material_ids.size(); ++i)
             {
-                if (objshapes[s].mesh.material_ids[i] != objshapes[s].mesh.material_ids[i + 1])
+                if (get_material_index(objshape.material_ids[i]) != get_material_index(objshape.material_ids[i + 1]))
                     LogInfo("Warning: Group detected\n");
             }
 
-            auto idx = objshapes[s].mesh.material_ids[0];
+            auto idx = get_material_index(objshape.material_ids[0]);
 
             if (idx >= 0)
             {
@@ -262,7 +367,7 @@ namespace Baikal
             }
 
             // Attach to the scene
-            scene->AttachShape(mesh);
+            shapes.push_back(mesh);
 
             // If the mesh has emissive material we need to add area light for it
             if (idx >= 0 && emissives.find(materials[idx]) != emissives.cend())
@@ -271,11 +376,22 @@ namespace Baikal
                 for (int l = 0; l < mesh->GetNumIndices() / 3; ++l)
                 {
                     auto light = AreaLight::Create(mesh, l);
-                    scene->AttachLight(light);
+                    lights.push_back(light);
                 }
             }
         }
 
+        scene->AttachShapes(shapes.cbegin(), shapes.cend());
+        scene->AttachLights(lights.cbegin(), lights.cend());
+
+        auto scene_time = std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - phase_start).count();
+        auto total_time = std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - load_start).count();
+
+        LogInfo("OBJ: loaded ", shapes.size(), " shapes, ", materials.size(), " materials in ", total_time, " ms\n");
+        LogInfo("    geometry: ", geometry_time, " ms\n");
+        LogInfo("    materials and textures: ", material_time, " ms\n");
+        LogInfo("    scene: ", scene_time, " ms\n");
+
         return scene;
     }
 }
@@ -31,6 +31,7 @@
 #include <string>
 #include <memory>
 #include <map>
+#include <future>
 #include "SceneGraph/texture.h"
 #include "SceneGraph/scene1.h"
 
@@ -39,6 +40,7 @@ namespace Baikal
     class Scene1;
     class Texture;
     class ImageIo;
+    class ThreadPool;
     
     /**
      \brief Interface for scene loading
@@ -68,10 +70,17 @@ namespace Baikal
         // Load the scene from file using resourse base path
         virtual Scene1::Ptr LoadScene(std::string const& filename, std::string const& basepath) const = 0;
 
-        virtual void SaveScene(Scene1 const& scene, std::string const& filename, std::string const& basepath) const {};
+        // Save the scene to file, by default scenes are saved in native binary format
+        // (see CreateSceneIoBinary), so any loaded scene can be converted to it
+        virtual void SaveScene(Scene1 const& scene, std::string const& filename, std::string const& basepath) const;
 
     protected:
         Texture::Ptr LoadTexture(ImageIo const& io, Scene1& scene, std::string const& basepath, std::string const& name) const;
+        // Start decoding the texture on the pool, LoadTexture picks the result up
+        // later. The io and the pool should outlive the request.
+        void LoadTextureAsync(ImageIo const& io, ThreadPool& pool, std::string const& basepath, std::string const& name) const;
+        // Drop requests LoadTexture has not picked up
+        void ClearTextureRequests() const;
 
     private:
         // Disallow copying
@@ -79,6 +88,8 @@ namespace Baikal
         SceneIo& operator = (SceneIo const&) = delete;
 
         mutable std::map<std::string, Texture::Ptr> m_texture_cache;
+        // Textures being decoded asynchronously, keyed by full path
+        mutable std::map<std::string, std::future<Texture::Ptr>> m_texture_requests;
 
     };
 }
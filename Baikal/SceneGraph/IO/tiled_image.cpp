@@ -0,0 +1,223 @@
+#include "tiled_image.h"
+#include "Utils/mapped_file.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace Baikal
+{
+    // File layout: header, then tiles starting at page aligned offset
+    static const std::size_t kDataOffset = 4096;
+    static const char kMagic[4] = { 'B', 'X', 'T', 'L' };
+    static const std::uint32_t kVersion = 1;
+
+    struct TiledImageHeader
+    {
+        char magic[4];
+        std::uint32_t version;
+        std::int32_t width;
+        std::int32_t height;
+        std::int32_t format;
+        std::int32_t num_levels;
+    };
+
+    static RadeonRays::int2 GetLevelSize(RadeonRays::int2 size, int level)
+    {
+        return RadeonRays::int2(std::max(size.x >> level, 1), std::max(size.y >> level, 1));
+    }
+
+    static int GetLevelCount(RadeonRays::int2 size)
+    {
+        auto max_size = std::max(size.x, size.y);
+
+        auto num_levels = 1;
+        while (num_levels < TiledImage::kMaxLevels && (max_size >> num_levels) > 0)
+        {
+            ++num_levels;
+        }
+
+        return num_levels;
+    }
+
+    static RadeonRays::int2 GetNumTiles(RadeonRays::int2 level_size, RadeonRays::int2 tile_size)
+    {
+        return RadeonRays::int2((level_size.x + tile_size.x - 1) / tile_size.x, (level_size.y + tile_size.y - 1) / tile_size.y);
+    }
+
+    RadeonRays::int2 TiledImage::GetTileSize(Texture::Format format)
+    {
+        // Keep tile byte size fixed, so a single cache can hold tiles of any format
+        switch (format)
+        {
+            case Texture::Format::kRgba8: return RadeonRays::int2(64, 64);
+            case Texture::Format::kRgba16: return RadeonRays::int2(64, 32);
+            case Texture::Format::kRgba32: return RadeonRays::int2(32, 32);
+            default: throw std::runtime_error("TiledImage: unsupported texture format");
+        }
+    }
+
+    void TiledImage::Write(std::string const& filename, Texture const& texture)
+    {
+        auto format = texture.GetFormat();
+        auto size = texture.GetSize();
+
+        if (Texture::IsBlockCompressed(format) || !texture.GetData())
+        {
+            throw std::runtime_error("TiledImage: only uncompressed texture data can be tiled");
+        }
+
+        std::ofstream out(filename, std::ios::binary);
+
+        if (!out)
+        {
+            throw std::runtime_error("Can't create " + filename);
+        }
+
+        TiledImageHeader header;
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.width = size.x;
+        header.height = size.y;
+        header.format = static_cast<std::int32_t>(format);
+        header.num_levels = GetLevelCount(size);
+
+        std::vector<char> padding(kDataOffset - sizeof(header), 0);
+        out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+        out.write(padding.data(), padding.size());
+
+        auto tile_size = GetTileSize(format);
+        auto texel_size = kTileSizeInBytes / (tile_size.x * tile_size.y);
+
+        // Mip levels are filtered in floats and converted back to texture format
+        std::vector<float> texels;
+        Texture::ReadTexels(format, texture.GetData(), size, texels);
+
+        std::vector<char> level(texture.GetData(), texture.GetData() + texture.GetSizeInBytes());
+        std::vector<char> tile(kTileSizeInBytes);
+
+        for (auto l = 0; l < header.num_levels; ++l)
+        {
+            auto level_size = Baikal::GetLevelSize(size, l);
+
+            if (l > 0)
+            {
+                std::vector<float> next_texels;
+                Texture::Downsample(texels, Baikal::GetLevelSize(size, l - 1), next_texels);
+                texels.swap(next_texels);
+
+                level.resize(Texture::GetLevelSizeInBytes(format, level_size));
+                Texture::WriteTexels(format, texels, level_size, level.data());
+            }
+
+            auto num_tiles = Baikal::GetNumTiles(level_size, tile_size);
+
+            for (auto ty = 0; ty < num_tiles.y; ++ty)
+            {
+                for (auto tx = 0; tx < num_tiles.x; ++tx)
+                {
+                    // Partial tiles are padded with zeros, those texels are never fetched
+                    std::fill(tile.begin(), tile.end(), 0);
+
+                    auto x = tx * tile_size.x;
+                    auto width = std::min(tile_size.x, level_size.x - x);
+
+                    for (auto r = 0; r < tile_size.y && ty * tile_size.y + r < level_size.y; ++r)
+                    {
+                        auto y = ty * tile_size.y + r;
+                        std::copy_n(level.data() + texel_size * (static_cast<std::size_t>(y) * level_size.x + x),
+                                    texel_size * width, tile.data() + texel_size * r * tile_size.x);
+                    }
+
+                    out.write(tile.data(), tile.size());
+                }
+            }
+        }
+
+        if (!out)
+        {
+            throw std::runtime_error("Can't write " + filename);
+        }
+    }
+
+    namespace
+    {
+        struct TiledImageConcrete : public TiledImage
+        {
+            TiledImageConcrete(std::unique_ptr<MappedFile> file) :
+            TiledImage(std::move(file)) {}
+        };
+    }
+
+    TiledImage::Ptr TiledImage::Open(std::string const& filename)
+    {
+        return std::make_shared<TiledImageConcrete>(std::unique_ptr<MappedFile>(new MappedFile(filename)));
+    }
+
+    TiledImage::TiledImage(std::unique_ptr<MappedFile> file)
+        : m_file(std::move(file))
+        , m_num_tiles(0)
+    {
+        TiledImageHeader header;
+
+        if (m_file->GetSize() < kDataOffset)
+        {
+            throw std::runtime_error("TiledImage: invalid tile file");
+        }
+
+        std::memcpy(&header, m_file->GetData(), sizeof(header));
+
+        if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion ||
+            header.width <= 0 || header.height <= 0 || header.num_levels < 1 || header.num_levels > kMaxLevels)
+        {
+            throw std::runtime_error("TiledImage: invalid tile file");
+        }
+
+        m_size = RadeonRays::int2(header.width, header.height);
+        m_format = static_cast<Texture::Format>(header.format);
+
+        auto tile_size = GetTileSize(m_format);
+
+        for (auto l = 0; l < header.num_levels; ++l)
+        {
+            auto num_tiles = Baikal::GetNumTiles(Baikal::GetLevelSize(m_size, l), tile_size);
+            m_level_tiles.push_back(m_num_tiles);
+            m_num_tiles += static_cast<std::size_t>(num_tiles.x) * num_tiles.y;
+        }
+
+        if (m_file->GetSize() < kDataOffset + m_num_tiles * kTileSizeInBytes)
+        {
+            throw std::runtime_error("TiledImage: tile file is truncated");
+        }
+    }
+
+    TiledImage::~TiledImage() = default;
+
+    RadeonRays::int2 TiledImage::GetLevelSize(int level) const
+    {
+        return Baikal::GetLevelSize(m_size, level);
+    }
+
+    RadeonRays::int2 TiledImage::GetNumTiles(int level) const
+    {
+        return Baikal::GetNumTiles(GetLevelSize(level), GetTileSize(m_format));
+    }
+
+    char const* TiledImage::GetTile(std::size_t index) const
+    {
+        return m_file->GetData() + kDataOffset + index * kTileSizeInBytes;
+    }
+
+    void TiledImage::GetTexel(int level, int x, int y, float* texel) const
+    {
+        auto tile_size = GetTileSize(m_format);
+        auto texel_size = kTileSizeInBytes / (tile_size.x * tile_size.y);
+        auto tile = GetTile(m_level_tiles[level] + (y / tile_size.y) * GetNumTiles(level).x + x / tile_size.x);
+
+        std::vector<float> texels;
+        Texture::ReadTexels(m_format, tile + texel_size * ((y % tile_size.y) * tile_size.x + x % tile_size.x),
+                            RadeonRays::int2(1, 1), texels);
+        std::copy(texels.cbegin(), texels.cend(), texel);
+    }
+}
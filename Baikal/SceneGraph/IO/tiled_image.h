@@ -0,0 +1,106 @@
+/**********************************************************************
+ Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ********************************************************************/
+
+
+/**
+ \file tiled_image.h
+ \version 1.0
+ \brief Contains on-disk tiled image used by virtual textures.
+ */
+#pragma once
+
+#include "math/int2.h"
+#include "SceneGraph/texture.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Baikal
+{
+    class MappedFile;
+
+    /**
+     \brief Tiled image file with a full mip chain.
+
+     Each mip level is split into tiles of fixed byte size which are stored one
+     after another, level by level, rows of tiles going top to bottom. The file
+     is memory mapped, so tiles are only read from disk when accessed.
+     */
+    class TiledImage
+    {
+    public:
+        using Ptr = std::shared_ptr<TiledImage>;
+
+        // Size of a single tile in bytes, tiles of all formats have the same size
+        static const std::size_t kTileSizeInBytes = 64 * 64 * 4;
+        // Max number of mip levels (enough for 32k images)
+        static const int kMaxLevels = 16;
+
+        // Write texture data and its mip chain into a tile file.
+        // Block compressed textures are not supported.
+        static void Write(std::string const& filename, Texture const& texture);
+        // Open tile file, throws std::runtime_error if the file is not valid
+        static Ptr Open(std::string const& filename);
+
+        // Tile dimensions in texels for a format
+        static RadeonRays::int2 GetTileSize(Texture::Format format);
+
+        ~TiledImage();
+
+        // Base level dimensions
+        RadeonRays::int2 GetSize() const { return m_size; }
+        Texture::Format GetFormat() const { return m_format; }
+        int GetNumLevels() const { return static_cast<int>(m_level_tiles.size()); }
+        // Dimensions of mip level in texels
+        RadeonRays::int2 GetLevelSize(int level) const;
+        // Dimensions of mip level in tiles
+        RadeonRays::int2 GetNumTiles(int level) const;
+        // Index of the first tile of mip level
+        std::size_t GetFirstTile(int level) const { return m_level_tiles[level]; }
+        // Total number of tiles
+        std::size_t GetNumTiles() const { return m_num_tiles; }
+        // Tile data by index
+        char const* GetTile(std::size_t index) const;
+        // Normalized RGBA value of a texel
+        void GetTexel(int level, int x, int y, float* texel) const;
+
+        // Disallow copying
+        TiledImage(TiledImage const&) = delete;
+        TiledImage& operator = (TiledImage const&) = delete;
+
+    protected:
+        TiledImage(std::unique_ptr<MappedFile> file);
+
+    private:
+        // Mapped file
+        std::unique_ptr<MappedFile> m_file;
+        // Base level dimensions
+        RadeonRays::int2 m_size;
+        // Texel format
+        Texture::Format m_format;
+        // First tile index of each level
+        std::vector<std::size_t> m_level_tiles;
+        std::size_t m_num_tiles;
+    };
+}
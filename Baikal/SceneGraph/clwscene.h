@@ -3,8 +3,14 @@
 #include "CLW.h"
 #include "math/float3.h"
 #include "SceneGraph/scene1.h"
+#include "SceneGraph/texture.h"
 #include "radeon_rays.h"
 #include "SceneGraph/Collector/collector.h"
+#include "Utils/range_allocator.h"
+#include "Utils/tile_cache.h"
+#include "Utils/tile_streamer.h"
+
+#include <unordered_map>
 
 
 namespace Baikal
@@ -19,6 +25,16 @@ namespace Baikal
         kFisheye
     };
 
+    // Layout of vertex pools, should match VERTEX_LAYOUT_* in kernels
+    enum class VertexLayout
+    {
+        // Separate float3 positions, float3 normals and float2 uvs
+        kFull,
+        // Positions with octahedral normals in vertices,
+        // half uvs in uvs (see CompactVertex)
+        kCompact
+    };
+
     struct ClwScene
     {
         #include "Kernels/CL/payload.cl"
@@ -36,18 +52,103 @@ namespace Baikal
         CLWBuffer<Volume> volumes;
         CLWBuffer<Texture> textures;
         CLWBuffer<char> texturedata;
+        // Virtual texture tiles (kTextureTileSizeInBytes each) and page table:
+        // x is cache slot of a tile (-1 if not resident), y is set by kernels on access
+        CLWBuffer<char> tilecache;
+        CLWBuffer<RadeonRays::int2> pagetable;
 
         CLWBuffer<Camera> camera;
         CLWBuffer<int> light_distributions;
+        CLWBuffer<LightBvhNode> light_bvh;
+        // Area light indices of emissive triangles
+        CLWBuffer<int> area_lights;
 
         std::unique_ptr<Bundle> material_bundle;
         std::unique_ptr<Bundle> texture_bundle;
 
+        // World space bounds of the scene
+        RadeonRays::bbox world_bounds;
+
         int num_lights;
         int envmapidx;
         CameraType camera_type;
 
         std::vector<RadeonRays::Shape*> isect_shapes;
         std::vector<RadeonRays::Shape*> visible_shapes;
+
+        // Shapes in GPU order: meshes, then excluded meshes (not in the scene,
+        // but referenced by instances), then instances. Rebuilt once per
+        // compile when the shape set changes.
+        std::vector<Baikal::Shape::Ptr> shape_list;
+        std::size_t num_meshes = 0;
+        std::size_t num_excluded_meshes = 0;
+        // Shape to its index in shapes buffer
+        std::unordered_map<Baikal::Shape::Ptr, int> shape_indices;
+
+        // Ranges occupied by a mesh in vertices/normals/uvs and indices pools.
+        // Vertex range is shared by all three vertex streams.
+        struct MeshAllocation
+        {
+            std::size_t vertex_offset;
+            std::size_t num_vertices;
+            std::size_t index_offset;
+            std::size_t num_indices;
+            // Mesh geometry version the ranges have been filled from
+            std::uint32_t geometry_version;
+            // Intersector shape built from this geometry
+            RadeonRays::Shape* isect_shape;
+        };
+
+        // Range occupied by a shape in materialids pool.
+        struct ShapeAllocation
+        {
+            std::size_t matid_offset;
+            std::size_t num_matids;
+            // Material index the range has been filled with
+            int material_idx;
+        };
+
+        // Range occupied by a texture in texturedata pool.
+        struct TextureAllocation
+        {
+            std::size_t offset;
+            std::size_t size;
+        };
+
+        // Layout of vertex data in vertices/normals/uvs pools
+        VertexLayout vertex_layout = VertexLayout::kFull;
+
+        // Pool allocators, capacity matches corresponding buffer size
+        RangeAllocator vertex_allocator;
+        RangeAllocator index_allocator;
+        RangeAllocator matid_allocator;
+        RangeAllocator texture_allocator;
+
+        // Allocation tables keyed by scene objects
+        std::unordered_map<SceneObject::Ptr, MeshAllocation> mesh_allocations;
+        std::unordered_map<SceneObject::Ptr, ShapeAllocation> shape_allocations;
+        std::unordered_map<SceneObject::Ptr, TextureAllocation> texture_allocations;
+
+        // Virtual textures in page table order, their first pages
+        // and tile sources for each page
+        std::vector<Baikal::Texture::Ptr> virtual_textures;
+        std::unordered_map<SceneObject::Ptr, std::size_t> page_offsets;
+        std::vector<char const*> page_sources;
+        // Tile residency and background tile loading
+        TileCache tile_residency;
+        std::unique_ptr<TileStreamer> tile_streamer;
+        // Page table access flags read back without waiting (the same array
+        // uploads refreshed page table) and tiles uploaded by the last update,
+        // both are kept alive until the readback following them completes
+        std::vector<RadeonRays::int2> pagetable_feedback;
+        CLWEvent pagetable_feedback_event;
+        bool pagetable_feedback_pending = false;
+        std::vector<TileStreamer::Tile> uploaded_tiles;
+
+        // Serialized luminance distribution of environment light (written to
+        // light_distributions after light selection distribution) and the
+        // envmap it has been built from.
+        std::vector<int> env_light_distribution;
+        SceneObject::Ptr env_light_texture;
     };
 }
@@ -3,6 +3,8 @@
 
 #include <cassert>
 #include <memory>
+#include <algorithm>
+#include <vector>
 
 namespace Baikal
 {
@@ -48,7 +50,8 @@ namespace Baikal
     // Iterator of dependent materials (plugged as inputs)
     std::unique_ptr<Iterator> Material::CreateMaterialIterator() const
     {
-        std::set<Material::Ptr> materials;
+        // Inputs are ordered by name, keep that order for reproducible collection
+        std::vector<Material::Ptr> materials;
         
         std::for_each(m_inputs.cbegin(), m_inputs.cend(),
                       [&materials](std::pair<std::string, Input> const& map_entry)
@@ -56,18 +59,21 @@ namespace Baikal
                           if (map_entry.second.value.type == InputType::kMaterial &&
                               map_entry.second.value.mat_value != nullptr)
                           {
-                              materials.insert(map_entry.second.value.mat_value);
+                              if (std::find(materials.cbegin(), materials.cend(), map_entry.second.value.mat_value) == materials.cend())
+                              {
+                                  materials.push_back(map_entry.second.value.mat_value);
+                              }
                           }
                       }
                       );
         
-        return std::make_unique<ContainerIterator<std::set<Material::Ptr>>>(std::move(materials));
+        return std::make_unique<ContainerIterator<std::vector<Material::Ptr>>>(std::move(materials));
     }
     
     // Iterator of textures (plugged as inputs)
     std::unique_ptr<Iterator> Material::CreateTextureIterator() const
     {
-        std::set<Texture::Ptr> textures;
+        std::vector<Texture::Ptr> textures;
         
         std::for_each(m_inputs.cbegin(), m_inputs.cend(),
                       [&textures](std::pair<std::string, Input> const& map_entry)
@@ -75,12 +81,15 @@ namespace Baikal
                           if (map_entry.second.value.type == InputType::kTexture &&
                               map_entry.second.value.tex_value != nullptr)
                           {
-                              textures.insert(map_entry.second.value.tex_value);
+                              if (std::find(textures.cbegin(), textures.cend(), map_entry.second.value.tex_value) == textures.cend())
+                              {
+                                  textures.push_back(map_entry.second.value.tex_value);
+                              }
                           }
                       }
                       );
         
-        return std::make_unique<ContainerIterator<std::set<Texture::Ptr>>>(std::move(textures));
+        return std::make_unique<ContainerIterator<std::vector<Texture::Ptr>>>(std::move(textures));
     }
     
     // Set input value
@@ -176,6 +185,21 @@ namespace Baikal
         }
     }
 
+    std::vector<std::string> Material::GetInputNames() const
+    {
+        std::vector<std::string> names;
+        names.reserve(m_inputs.size());
+
+        for (auto const& input : m_inputs)
+        {
+            names.push_back(input.first);
+        }
+
+        // Input map is unordered, sort to get stable order
+        std::sort(names.begin(), names.end());
+        return names;
+    }
+
     bool Material::IsThin() const
     {
         return m_thin;
@@ -32,6 +32,7 @@
 #include <unordered_map>
 #include <string>
 #include <memory>
+#include <vector>
 
 #include "math/float3.h"
 
@@ -116,6 +117,8 @@ namespace Baikal
         void SetInputValue(std::string const& name, Material::Ptr material);
 
         InputValue GetInputValue(std::string const& name) const;
+        // Names of all registered inputs in sorted order
+        std::vector<std::string> GetInputNames() const;
 
         // Check if material is thin (normal is always pointing in ray incidence
         // direction)
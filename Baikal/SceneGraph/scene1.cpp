@@ -5,23 +5,57 @@
 
 #include <vector>
 #include <list>
+#include <unordered_map>
 #include <cassert>
 #include <set>
 
 namespace Baikal
 {
-    // Data structures for shapes and lights
-    using ShapeList = std::vector<Shape::Ptr>;
-    using LightList = std::vector<Light::Ptr>;
+    // Data structures for shapes and lights: lists keep attachment order,
+    // indices provide constant time membership checks and removal
+    using ShapeList = std::list<Shape::Ptr>;
+    using LightList = std::list<Light::Ptr>;
+    using ShapeIndex = std::unordered_map<Shape::Ptr, ShapeList::iterator>;
+    using LightIndex = std::unordered_map<Light::Ptr, LightList::iterator>;
+
+    // Records objects which became dirty since last clear
+    class ChangeJournal : public SceneObject::DirtyJournal
+    {
+    public:
+        void OnDirty(SceneObject const& object) override
+        {
+            m_objects.push_back(&object);
+        }
+
+        bool IsEmpty() const
+        {
+            return m_objects.empty();
+        }
+
+        void Clear()
+        {
+            m_objects.clear();
+        }
+
+    private:
+        std::vector<SceneObject const*> m_objects;
+    };
 
     // Internal data
     struct Scene1::SceneImpl
     {
         ShapeList m_shapes;
         LightList m_lights;
+        ShapeIndex m_shape_index;
+        LightIndex m_light_index;
         Camera::Ptr m_camera;
 
         DirtyFlags m_dirty_flags;
+
+        // Attached objects report their changes here,
+        // so compile does not need to check all of them
+        ChangeJournal m_shape_journal;
+        ChangeJournal m_light_journal;
     };
 
     Scene1::Scene1()
@@ -31,7 +65,19 @@ namespace Baikal
         ClearDirtyFlags();
     }
 
-    Scene1::~Scene1() = default;
+    Scene1::~Scene1()
+    {
+        // Objects might outlive the scene
+        for (auto& shape : m_impl->m_shapes)
+        {
+            shape->RemoveDirtyJournal(&m_impl->m_shape_journal);
+        }
+
+        for (auto& light : m_impl->m_lights)
+        {
+            light->RemoveDirtyJournal(&m_impl->m_light_journal);
+        }
+    }
 
     Scene1::DirtyFlags Scene1::GetDirtyFlags() const
     {
@@ -41,6 +87,18 @@ namespace Baikal
     void Scene1::ClearDirtyFlags() const
     {
         m_impl->m_dirty_flags = 0;
+        m_impl->m_shape_journal.Clear();
+        m_impl->m_light_journal.Clear();
+    }
+
+    bool Scene1::HasDirtyShapes() const
+    {
+        return !m_impl->m_shape_journal.IsEmpty();
+    }
+
+    bool Scene1::HasDirtyLights() const
+    {
+        return !m_impl->m_light_journal.IsEmpty();
     }
 
     void Scene1::SetDirtyFlag(DirtyFlags flag) const
@@ -59,20 +117,28 @@ namespace Baikal
         return m_impl->m_camera;
     }
 
-    void Scene1::AttachLight(Light::Ptr light)
+    bool Scene1::InsertLight(Light::Ptr light)
     {
         assert(light);
 
         // Check if the light is already in the scene
-        LightList::const_iterator citer =  std::find(m_impl->m_lights.cbegin(),
-                                                     m_impl->m_lights.cend(),
-                                                     light);
-        
-        // And insert only if not
-        if (citer == m_impl->m_lights.cend())
+        if (m_impl->m_light_index.find(light) != m_impl->m_light_index.cend())
         {
-            m_impl->m_lights.push_back(light);
+            return false;
+        }
+
+        auto iter = m_impl->m_lights.insert(m_impl->m_lights.end(), light);
+        m_impl->m_light_index.emplace(light, iter);
+        light->AddDirtyJournal(&m_impl->m_light_journal);
 
+        return true;
+    }
+
+    void Scene1::AttachLight(Light::Ptr light)
+    {
+        // Insert only if the light is not in the scene yet
+        if (InsertLight(light))
+        {
             SetDirtyFlag(kLights);
         }
     }
@@ -80,14 +146,14 @@ namespace Baikal
     void Scene1::DetachLight(Light::Ptr light)
     {
         // Check if the light is in the scene
-        LightList::const_iterator citer =  std::find(m_impl->m_lights.cbegin(),
-                                                     m_impl->m_lights.cend(),
-                                                     light);
+        auto citer = m_impl->m_light_index.find(light);
         
         // And remove it if yes
-        if (citer != m_impl->m_lights.cend())
+        if (citer != m_impl->m_light_index.cend())
         {
-            m_impl->m_lights.erase(citer);
+            light->RemoveDirtyJournal(&m_impl->m_light_journal);
+            m_impl->m_lights.erase(citer->second);
+            m_impl->m_light_index.erase(citer);
             
             SetDirtyFlag(kLights);
         }
@@ -104,20 +170,28 @@ namespace Baikal
             (m_impl->m_shapes.begin(), m_impl->m_shapes.end());
     }
     
-    void Scene1::AttachShape(Shape::Ptr shape)
+    bool Scene1::InsertShape(Shape::Ptr shape)
     {
         assert(shape);
-        
+
         // Check if the shape is already in the scene
-        ShapeList::const_iterator citer =  std::find(m_impl->m_shapes.cbegin(),
-                                                     m_impl->m_shapes.cend(),
-                                                     shape);
-        
-        // And attach it if not
-        if (citer == m_impl->m_shapes.cend())
+        if (m_impl->m_shape_index.find(shape) != m_impl->m_shape_index.cend())
+        {
+            return false;
+        }
+
+        auto iter = m_impl->m_shapes.insert(m_impl->m_shapes.end(), shape);
+        m_impl->m_shape_index.emplace(shape, iter);
+        shape->AddDirtyJournal(&m_impl->m_shape_journal);
+
+        return true;
+    }
+    
+    void Scene1::AttachShape(Shape::Ptr shape)
+    {
+        // Attach only if the shape is not in the scene yet
+        if (InsertShape(shape))
         {
-            m_impl->m_shapes.push_back(shape);
-            
             SetDirtyFlag(kShapes);
         }
     }
@@ -127,14 +201,14 @@ namespace Baikal
         assert(shape);
         
         // Check if the shape is in the scene
-        ShapeList::const_iterator citer =  std::find(m_impl->m_shapes.cbegin(),
-                                                     m_impl->m_shapes.cend(),
-                                                     shape);
+        auto citer = m_impl->m_shape_index.find(shape);
         
         // And detach if yes
-        if (citer != m_impl->m_shapes.cend())
+        if (citer != m_impl->m_shape_index.cend())
         {
-            m_impl->m_shapes.erase(citer);
+            shape->RemoveDirtyJournal(&m_impl->m_shape_journal);
+            m_impl->m_shapes.erase(citer->second);
+            m_impl->m_shape_index.erase(citer);
             
             SetDirtyFlag(kShapes);
         }
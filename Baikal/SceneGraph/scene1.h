@@ -72,6 +72,9 @@ namespace Baikal
         // Add or remove lights
         void AttachLight(Light::Ptr light);
         void DetachLight(Light::Ptr light);
+        // Add a range of lights (scene is marked dirty once per batch)
+        template <typename InputIterator>
+        void AttachLights(InputIterator begin, InputIterator end);
         
         // Get the number of lights in the scene
         std::size_t GetNumLights() const;
@@ -81,6 +84,9 @@ namespace Baikal
         // Add or remove shapes
         void AttachShape(Shape::Ptr shape);
         void DetachShape(Shape::Ptr shape);
+        // Add a range of shapes (scene is marked dirty once per batch)
+        template <typename InputIterator>
+        void AttachShapes(InputIterator begin, InputIterator end);
         
         // Get number of shapes in the scene
         std::size_t GetNumShapes() const;
@@ -95,8 +101,12 @@ namespace Baikal
         DirtyFlags GetDirtyFlags() const;
         // Set specified flag in dirty state
         void SetDirtyFlag(DirtyFlags flag) const;
-        // Clear all flags
+        // Clear all flags (including shape and light change journals)
         void ClearDirtyFlags() const;
+        // Check if any of attached shapes has been changed since last clear
+        bool HasDirtyShapes() const;
+        // Check if any of attached lights has been changed since last clear
+        bool HasDirtyLights() const;
 
         // Check if the scene is ready for rendering
         bool IsValid() const;
@@ -116,8 +126,43 @@ namespace Baikal
         Scene1();
         
     private:
+        // Insert objects without touching dirty flags, return false if already attached
+        bool InsertLight(Light::Ptr light);
+        bool InsertShape(Shape::Ptr shape);
+        
         struct SceneImpl;
         std::unique_ptr<SceneImpl> m_impl;
     };
     
+    template <typename InputIterator>
+    inline void Scene1::AttachLights(InputIterator begin, InputIterator end)
+    {
+        bool attached = false;
+        
+        for (; begin != end; ++begin)
+        {
+            attached = InsertLight(*begin) || attached;
+        }
+        
+        if (attached)
+        {
+            SetDirtyFlag(kLights);
+        }
+    }
+    
+    template <typename InputIterator>
+    inline void Scene1::AttachShapes(InputIterator begin, InputIterator end)
+    {
+        bool attached = false;
+        
+        for (; begin != end; ++begin)
+        {
+            attached = InsertShape(*begin) || attached;
+        }
+        
+        if (attached)
+        {
+            SetDirtyFlag(kShapes);
+        }
+    }
 }
@@ -30,6 +30,8 @@
 
 #include <string>
 #include <memory>
+#include <vector>
+#include <algorithm>
 
 namespace Baikal
 {
@@ -38,6 +40,20 @@ namespace Baikal
     public:
         using Ptr = std::shared_ptr<SceneObject>;
         
+        /**
+         \brief Change journal interface.
+         
+         Objects notify registered journals once they become dirty, so owners
+         (scenes, collectors) can track changes without iterating over all objects.
+         */
+        class DirtyJournal
+        {
+        public:
+            virtual ~DirtyJournal() = default;
+            // Called when the object turns from clean to dirty
+            virtual void OnDirty(SceneObject const& object) = 0;
+        };
+        
         // Destructor
         virtual ~SceneObject() = 0;
 
@@ -45,6 +61,10 @@ namespace Baikal
         virtual bool IsDirty() const;
         // Set dirty flag
         virtual void SetDirty(bool dirty) const;
+        
+        // Register & unregister change journal
+        void AddDirtyJournal(DirtyJournal* journal) const;
+        void RemoveDirtyJournal(DirtyJournal* journal) const;
 
         // Set & get name
         void SetName(std::string const& name);
@@ -59,6 +79,8 @@ namespace Baikal
         
     private:
         mutable bool m_dirty;
+        // Journals to notify on change
+        mutable std::vector<DirtyJournal*> m_journals;
         
         std::string m_name;
     };
@@ -79,7 +101,31 @@ namespace Baikal
     
     inline void SceneObject::SetDirty(bool dirty) const
     {
+        auto was_dirty = m_dirty;
         m_dirty = dirty;
+        
+        if (dirty && !was_dirty)
+        {
+            for (auto journal : m_journals)
+            {
+                journal->OnDirty(*this);
+            }
+        }
+    }
+    
+    inline void SceneObject::AddDirtyJournal(DirtyJournal* journal) const
+    {
+        m_journals.push_back(journal);
+    }
+    
+    inline void SceneObject::RemoveDirtyJournal(DirtyJournal* journal) const
+    {
+        auto iter = std::find(m_journals.begin(), m_journals.end(), journal);
+        
+        if (iter != m_journals.end())
+        {
+            m_journals.erase(iter);
+        }
     }
     
     inline std::string SceneObject::GetName() const
@@ -1,9 +1,23 @@
 #include "shape.h"
+#include "Utils/mapped_file.h"
+
 #include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
 
 namespace Baikal
 {
     Mesh::Mesh() :
+    m_index_data(nullptr),
+    m_num_indices(0),
+    m_vertex_data(nullptr),
+    m_num_vertices(0),
+    m_normal_data(nullptr),
+    m_num_normals(0),
+    m_uv_data(nullptr),
+    m_num_uvs(0),
+    m_geometry_version(0),
     m_aabb_cached(false)
     {
     }
@@ -18,22 +32,33 @@ namespace Baikal
         
         std::copy(indices, indices + num_indices, &m_indices[0]);
         
+        m_index_data = m_indices.data();
+        m_num_indices = m_indices.size();
+        ReleaseExternalGeometry();
+
+        ++m_geometry_version;
         SetDirty(true);
     }
 
     void Mesh::SetIndices(std::vector<std::uint32_t>&& indices)
     {
         m_indices = std::move(indices);
+
+        m_index_data = m_indices.data();
+        m_num_indices = m_indices.size();
+        ReleaseExternalGeometry();
+
+        ++m_geometry_version;
+        SetDirty(true);
     }
 
     std::size_t Mesh::GetNumIndices() const
     {
-        return m_indices.size();
-        
+        return m_num_indices;
     }
     std::uint32_t const* Mesh::GetIndices() const
     {
-        return &m_indices[0];
+        return m_index_data;
     }
     
     void Mesh::SetVertices(RadeonRays::float3 const* vertices, std::size_t num_vertices)
@@ -46,6 +71,11 @@ namespace Baikal
 
         std::copy(vertices, vertices + num_vertices, &m_vertices[0]);
 
+        m_vertex_data = m_vertices.data();
+        m_num_vertices = m_vertices.size();
+        ReleaseExternalGeometry();
+
+        ++m_geometry_version;
         SetDirty(true);
     }
     
@@ -65,23 +95,35 @@ namespace Baikal
             m_vertices[i].w = 1;
         }
 
+        m_vertex_data = m_vertices.data();
+        m_num_vertices = m_vertices.size();
+        ReleaseExternalGeometry();
+
+        ++m_geometry_version;
         SetDirty(true);
     }
 
     void Mesh::SetVertices(std::vector<RadeonRays::float3>&& vertices)
     {
         m_vertices = std::move(vertices);
+
+        m_vertex_data = m_vertices.data();
+        m_num_vertices = m_vertices.size();
+        ReleaseExternalGeometry();
+
+        ++m_geometry_version;
+        SetDirty(true);
     }
 
     
     std::size_t Mesh::GetNumVertices() const
     {
-        return m_vertices.size();
+        return m_num_vertices;
     }
     
     RadeonRays::float3 const* Mesh::GetVertices() const
     {
-        return &m_vertices[0];
+        return m_vertex_data;
     }
     
     void Mesh::SetNormals(RadeonRays::float3 const* normals, std::size_t num_normals)
@@ -94,6 +136,11 @@ namespace Baikal
 
         std::copy(normals, normals + num_normals, &m_normals[0]);
 
+        m_normal_data = m_normals.data();
+        m_num_normals = m_normals.size();
+        ReleaseExternalGeometry();
+
+        ++m_geometry_version;
         SetDirty(true);
     }
     
@@ -113,23 +160,35 @@ namespace Baikal
             m_normals[i].w = 0;
         }
 
+        m_normal_data = m_normals.data();
+        m_num_normals = m_normals.size();
+        ReleaseExternalGeometry();
+
+        ++m_geometry_version;
         SetDirty(true);
     }
 
     void Mesh::SetNormals(std::vector<RadeonRays::float3>&& normals)
     {
         m_normals = std::move(normals);
+
+        m_normal_data = m_normals.data();
+        m_num_normals = m_normals.size();
+        ReleaseExternalGeometry();
+
+        ++m_geometry_version;
+        SetDirty(true);
     }
 
     
     std::size_t Mesh::GetNumNormals() const
     {
-        return m_normals.size();
+        return m_num_normals;
     }
 
     RadeonRays::float3 const* Mesh::GetNormals() const
     {
-        return &m_normals[0];
+        return m_normal_data;
     }
 
     void Mesh::SetUVs(RadeonRays::float2 const* uvs, std::size_t num_uvs)
@@ -142,6 +201,11 @@ namespace Baikal
 
         std::copy(uvs, uvs + num_uvs, &m_uvs[0]);
 
+        m_uv_data = m_uvs.data();
+        m_num_uvs = m_uvs.size();
+        ReleaseExternalGeometry();
+
+        ++m_geometry_version;
         SetDirty(true);
     }
     
@@ -159,22 +223,34 @@ namespace Baikal
             m_uvs[i].y = uvs[2 * i + 1];
         }
 
+        m_uv_data = m_uvs.data();
+        m_num_uvs = m_uvs.size();
+        ReleaseExternalGeometry();
+
+        ++m_geometry_version;
         SetDirty(true);
     }
 
     void Mesh::SetUVs(std::vector<RadeonRays::float2>&& uvs)
     {
         m_uvs = std::move(uvs);
+
+        m_uv_data = m_uvs.data();
+        m_num_uvs = m_uvs.size();
+        ReleaseExternalGeometry();
+
+        ++m_geometry_version;
+        SetDirty(true);
     }
 
     std::size_t Mesh::GetNumUVs() const
     {
-        return m_uvs.size();
+        return m_num_uvs;
     }
     
     RadeonRays::float2 const* Mesh::GetUVs() const
     {
-        return &m_uvs[0];
+        return m_uv_data;
     }
 
     RadeonRays::bbox Shape::GetWorldAABB() const
@@ -204,14 +280,141 @@ namespace Baikal
         return result;
     }
 
+    void Mesh::SetExternalGeometry(std::shared_ptr<void const> storage,
+                                   std::uint32_t const* indices, std::size_t num_indices,
+                                   RadeonRays::float3 const* vertices, std::size_t num_vertices,
+                                   RadeonRays::float3 const* normals, std::size_t num_normals,
+                                   RadeonRays::float2 const* uvs, std::size_t num_uvs)
+    {
+        assert(storage);
+
+        // Owned copies are not needed anymore
+        m_indices = std::vector<std::uint32_t>();
+        m_vertices = std::vector<RadeonRays::float3>();
+        m_normals = std::vector<RadeonRays::float3>();
+        m_uvs = std::vector<RadeonRays::float2>();
+
+        m_external_storage = storage;
+        m_index_data = indices;
+        m_num_indices = num_indices;
+        m_vertex_data = vertices;
+        m_num_vertices = num_vertices;
+        m_normal_data = num_normals ? normals : nullptr;
+        m_num_normals = num_normals;
+        m_uv_data = num_uvs ? uvs : nullptr;
+        m_num_uvs = num_uvs;
+
+        ++m_geometry_version;
+        SetDirty(true);
+    }
+
+    bool Mesh::HasExternalGeometry() const
+    {
+        return m_external_storage != nullptr;
+    }
+
+    void Mesh::SpillGeometry(std::string const& filename)
+    {
+        if (m_external_storage || (m_num_indices == 0 && m_num_vertices == 0))
+        {
+            return;
+        }
+
+        // Arrays are 16 byte aligned in the file (mapping itself is page aligned)
+        auto align = [](std::size_t offset) { return (offset + 15) & ~std::size_t(15); };
+        auto index_offset = std::size_t(0);
+        auto vertex_offset = align(index_offset + m_num_indices * sizeof(std::uint32_t));
+        auto normal_offset = align(vertex_offset + m_num_vertices * sizeof(RadeonRays::float3));
+        auto uv_offset = align(normal_offset + m_num_normals * sizeof(RadeonRays::float3));
+        // End of the last array written
+        auto size = std::size_t(0);
+
+        {
+            std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+
+            auto write = [&out, &size](std::size_t offset, void const* data, std::size_t data_size)
+            {
+                if (data_size > 0)
+                {
+                    out.seekp(offset);
+                    out.write(static_cast<char const*>(data), data_size);
+                    size = offset + data_size;
+                }
+            };
+
+            write(index_offset, m_index_data, m_num_indices * sizeof(std::uint32_t));
+            write(vertex_offset, m_vertex_data, m_num_vertices * sizeof(RadeonRays::float3));
+            write(normal_offset, m_normal_data, m_num_normals * sizeof(RadeonRays::float3));
+            write(uv_offset, m_uv_data, m_num_uvs * sizeof(RadeonRays::float2));
+
+            if (!out)
+            {
+                out.close();
+                std::remove(filename.c_str());
+                throw std::runtime_error("Can't write " + filename);
+            }
+        }
+
+        std::shared_ptr<MappedFile> file;
+        try
+        {
+            file.reset(new MappedFile(filename), [filename](MappedFile* file)
+            {
+                delete file;
+                std::remove(filename.c_str());
+            });
+        }
+        catch (...)
+        {
+            std::remove(filename.c_str());
+            throw;
+        }
+
+        if (file->GetSize() != size)
+        {
+            throw std::runtime_error("Can't write " + filename);
+        }
+
+        auto data = file->GetData();
+
+        m_indices = std::vector<std::uint32_t>();
+        m_vertices = std::vector<RadeonRays::float3>();
+        m_normals = std::vector<RadeonRays::float3>();
+        m_uvs = std::vector<RadeonRays::float2>();
+
+        m_external_storage = file;
+        m_index_data = reinterpret_cast<std::uint32_t const*>(data + index_offset);
+        m_vertex_data = reinterpret_cast<RadeonRays::float3 const*>(data + vertex_offset);
+        m_normal_data = m_num_normals ? reinterpret_cast<RadeonRays::float3 const*>(data + normal_offset) : nullptr;
+        m_uv_data = m_num_uvs ? reinterpret_cast<RadeonRays::float2 const*>(data + uv_offset) : nullptr;
+    }
+
+    void Mesh::ReleaseExternalGeometry()
+    {
+        // Drop the storage as soon as all the arrays have been replaced by owned ones
+        if (m_external_storage &&
+            m_index_data == m_indices.data() &&
+            m_vertex_data == m_vertices.data() &&
+            m_normal_data == m_normals.data() &&
+            m_uv_data == m_uvs.data())
+        {
+            m_external_storage.reset();
+        }
+    }
+
+    std::uint32_t Mesh::GetGeometryVersion() const
+    {
+        return m_geometry_version;
+    }
+
     RadeonRays::bbox Mesh::GetLocalAABB() const
     {
         if (!m_aabb_cached)
         {
             m_aabb = RadeonRays::bbox();
-            for (auto i = 0; i < m_indices.size(); ++i)
+            for (auto i = 0u; i < m_num_indices; ++i)
             {
-                m_aabb.grow(m_vertices[m_indices[i]]);
+                m_aabb.grow(m_vertex_data[m_index_data[i]]);
             }
             m_aabb_cached = true;
         }
@@ -149,6 +149,26 @@ namespace Baikal
         std::size_t GetNumUVs() const;
         RadeonRays::float2 const* GetUVs() const;
 
+        // Reference geometry kept in external storage (e.g. memory mapped file)
+        // instead of copying it. The storage is kept alive while any of the arrays
+        // is referenced, setters above copy data in and replace referenced arrays.
+        void SetExternalGeometry(std::shared_ptr<void const> storage,
+                                 std::uint32_t const* indices, std::size_t num_indices,
+                                 RadeonRays::float3 const* vertices, std::size_t num_vertices,
+                                 RadeonRays::float3 const* normals, std::size_t num_normals,
+                                 RadeonRays::float2 const* uvs, std::size_t num_uvs);
+        bool HasExternalGeometry() const;
+
+        // Move owned geometry into a file and reference it through memory mapping,
+        // so it only takes host memory while being read. The file is removed when
+        // not referenced anymore. Geometry version and dirty state are not changed.
+        // Throws std::runtime_error if the file can't be written.
+        void SpillGeometry(std::string const& filename);
+
+        // Geometry version is bumped each time vertex or index data changes,
+        // so consumers can tell geometry edits from property edits.
+        std::uint32_t GetGeometryVersion() const;
+
         // Local space AABB
         RadeonRays::bbox GetLocalAABB() const override;
 
@@ -164,10 +184,25 @@ namespace Baikal
         Mesh();
         
     private:
+        // Drop external storage once no array references it
+        void ReleaseExternalGeometry();
+
+        // Owned geometry
         std::vector<RadeonRays::float3> m_vertices;
         std::vector<RadeonRays::float3> m_normals;
         std::vector<RadeonRays::float2> m_uvs;
         std::vector<std::uint32_t> m_indices;
+        // Current geometry, points either to owned arrays or to external storage
+        std::uint32_t const* m_index_data;
+        std::size_t m_num_indices;
+        RadeonRays::float3 const* m_vertex_data;
+        std::size_t m_num_vertices;
+        RadeonRays::float3 const* m_normal_data;
+        std::size_t m_num_normals;
+        RadeonRays::float2 const* m_uv_data;
+        std::size_t m_num_uvs;
+        std::shared_ptr<void const> m_external_storage;
+        std::uint32_t m_geometry_version;
 
         mutable RadeonRays::bbox m_aabb;
         mutable bool m_aabb_cached;
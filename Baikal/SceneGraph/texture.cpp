@@ -1,13 +1,206 @@
 #include "texture.h"
+#include "IO/tiled_image.h"
 
 #include "Utils/half.h"
 
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
 namespace Baikal
 {
+    // Convert texel to normalized float values
+    static void LoadTexel(Texture::Format format, char const* data, std::size_t idx, float* texel)
+    {
+        switch (format)
+        {
+            case Texture::Format::kRgba8:
+            {
+                auto values = reinterpret_cast<std::uint8_t const*>(data) + 4 * idx;
+                for (auto c = 0; c < 4; ++c)
+                {
+                    texel[c] = values[c] / 255.f;
+                }
+                break;
+            }
+            case Texture::Format::kRgba16:
+            {
+                auto values = reinterpret_cast<std::uint16_t const*>(data) + 4 * idx;
+                for (auto c = 0; c < 4; ++c)
+                {
+                    half h;
+                    h.setBits(values[c]);
+                    texel[c] = h;
+                }
+                break;
+            }
+            case Texture::Format::kRgba32:
+            {
+                auto values = reinterpret_cast<float const*>(data) + 4 * idx;
+                std::copy(values, values + 4, texel);
+                break;
+            }
+            default:
+                // Block compressed formats are handled per image
+                break;
+        }
+    }
+
+    // Convert normalized float values back to texture format
+    static void StoreTexel(Texture::Format format, float const* texel, std::size_t idx, char* data)
+    {
+        switch (format)
+        {
+            case Texture::Format::kRgba8:
+            {
+                auto values = reinterpret_cast<std::uint8_t*>(data) + 4 * idx;
+                for (auto c = 0; c < 4; ++c)
+                {
+                    values[c] = static_cast<std::uint8_t>(std::min(std::max(texel[c] * 255.f + 0.5f, 0.f), 255.f));
+                }
+                break;
+            }
+            case Texture::Format::kRgba16:
+            {
+                auto values = reinterpret_cast<std::uint16_t*>(data) + 4 * idx;
+                for (auto c = 0; c < 4; ++c)
+                {
+                    values[c] = half(texel[c]).bits();
+                }
+                break;
+            }
+            case Texture::Format::kRgba32:
+            {
+                auto values = reinterpret_cast<float*>(data) + 4 * idx;
+                std::copy(texel, texel + 4, values);
+                break;
+            }
+            default:
+                // Block compressed formats are handled per image
+                break;
+        }
+    }
+
+    std::size_t Texture::GetLevelSizeInBytes(Format format, RadeonRays::int2 size)
+    {
+        switch (format)
+        {
+            case Format::kRgba16: return 8u * size.x * size.y;
+            case Format::kRgba32: return 16u * size.x * size.y;
+            case Format::kBc1:
+            case Format::kBc3:
+            case Format::kBc5:
+                return GetBlockCompressedSize(GetBlockFormat(format), size.x, size.y);
+            default: return 4u * size.x * size.y;
+        }
+    }
+
+    void Texture::ReadTexels(Format format, char const* data, RadeonRays::int2 size, std::vector<float>& texels)
+    {
+        std::size_t num_texels = size.x * size.y;
+        texels.resize(4 * num_texels);
+
+        std::vector<char> decoded;
+        if (IsBlockCompressed(format))
+        {
+            decoded.resize(4 * num_texels);
+            DecompressBlocks(GetBlockFormat(format), reinterpret_cast<std::uint8_t const*>(data),
+                             size.x, size.y, reinterpret_cast<std::uint8_t*>(decoded.data()));
+            data = decoded.data();
+            format = Format::kRgba8;
+        }
+
+        for (auto i = 0u; i < num_texels; ++i)
+        {
+            LoadTexel(format, data, i, &texels[4 * i]);
+        }
+    }
+
+    void Texture::WriteTexels(Format format, std::vector<float> const& texels, RadeonRays::int2 size, char* data)
+    {
+        std::size_t num_texels = size.x * size.y;
+
+        if (!IsBlockCompressed(format))
+        {
+            for (auto i = 0u; i < num_texels; ++i)
+            {
+                StoreTexel(format, &texels[4 * i], i, data);
+            }
+
+            return;
+        }
+
+        // Compressed images are encoded again from RGBA8 texels
+        std::vector<char> encoded(4 * num_texels);
+        for (auto i = 0u; i < num_texels; ++i)
+        {
+            StoreTexel(Format::kRgba8, &texels[4 * i], i, encoded.data());
+        }
+
+        CompressBlocks(GetBlockFormat(format), reinterpret_cast<std::uint8_t const*>(encoded.data()),
+                       size.x, size.y, reinterpret_cast<std::uint8_t*>(data));
+    }
+
+    RadeonRays::int2 Texture::Downsample(std::vector<float> const& texels, RadeonRays::int2 size, std::vector<float>& result)
+    {
+        RadeonRays::int2 next_size(std::max(size.x >> 1, 1), std::max(size.y >> 1, 1));
+        result.resize(4 * next_size.x * next_size.y);
+
+        for (auto y = 0; y < next_size.y; ++y)
+        {
+            // Odd sized levels clamp the last row/column
+            auto y0 = std::min(2 * y, size.y - 1);
+            auto y1 = std::min(2 * y + 1, size.y - 1);
+
+            for (auto x = 0; x < next_size.x; ++x)
+            {
+                auto x0 = std::min(2 * x, size.x - 1);
+                auto x1 = std::min(2 * x + 1, size.x - 1);
+
+                auto texel = &result[4 * (y * next_size.x + x)];
+
+                for (auto c = 0; c < 4; ++c)
+                {
+                    texel[c] = 0.25f * (texels[4 * (y0 * size.x + x0) + c] + texels[4 * (y0 * size.x + x1) + c] +
+                        texels[4 * (y1 * size.x + x0) + c] + texels[4 * (y1 * size.x + x1) + c]);
+                }
+            }
+        }
+
+        return next_size;
+    }
+
+    Texture::Texture(std::shared_ptr<TiledImage> tiled_image)
+        : m_size(tiled_image->GetSize())
+        , m_format(tiled_image->GetFormat())
+        , m_mipmap_enabled(true)
+        , m_tiled_image(tiled_image)
+    {
+    }
+
     RadeonRays::float3 Texture::ComputeAverageValue() const
     {
         auto avg = RadeonRays::float3();
 
+        if (m_tiled_image)
+        {
+            // The last mip level is small and already averaged
+            auto level = m_tiled_image->GetNumLevels() - 1;
+            auto level_size = m_tiled_image->GetLevelSize(level);
+
+            for (auto y = 0; y < level_size.y; ++y)
+            {
+                for (auto x = 0; x < level_size.x; ++x)
+                {
+                    float texel[4];
+                    m_tiled_image->GetTexel(level, x, y, texel);
+                    avg += RadeonRays::float3(texel[0], texel[1], texel[2]);
+                }
+            }
+
+            return avg * (1.f / (level_size.x * level_size.y));
+        }
+
         switch (m_format) {
         case Format::kRgba8:
         {
@@ -65,6 +258,24 @@ namespace Baikal
             avg *= (1.f / num_elements);
             break;
         }
+        case Format::kBc1:
+        case Format::kBc3:
+        case Format::kBc5:
+        {
+            auto num_elements = m_size.x * m_size.y;
+
+            std::vector<std::uint8_t> data(4 * num_elements);
+            DecompressBlocks(GetBlockFormat(m_format), reinterpret_cast<std::uint8_t const*>(m_data.get()),
+                             m_size.x, m_size.y, data.data());
+
+            for (auto i = 0; i < num_elements; ++i)
+            {
+                avg += RadeonRays::float3(data[4 * i] / 255.f, data[4 * i + 1] / 255.f, data[4 * i + 2] / 255.f);
+            }
+
+            avg *= (1.f / num_elements);
+            break;
+        }
         default:
             break;
         }
@@ -72,11 +283,82 @@ namespace Baikal
         return avg;
     }
 
+    RadeonRays::float3 Texture::GetTexel(int x, int y) const
+    {
+        if (m_tiled_image)
+        {
+            float texel[4];
+            m_tiled_image->GetTexel(0, x, y, texel);
+            return RadeonRays::float3(texel[0], texel[1], texel[2]);
+        }
+
+        auto idx = 4 * (y * m_size.x + x);
+
+        switch (m_format) {
+        case Format::kRgba8:
+        {
+            auto data = reinterpret_cast<std::uint8_t const*>(m_data.get());
+            return RadeonRays::float3(data[idx] / 255.f, data[idx + 1] / 255.f, data[idx + 2] / 255.f);
+        }
+        case Format::kRgba16:
+        {
+            auto data = reinterpret_cast<std::uint16_t const*>(m_data.get());
+
+            half hr, hg, hb;
+            hr.setBits(data[idx]);
+            hg.setBits(data[idx + 1]);
+            hb.setBits(data[idx + 2]);
+
+            return RadeonRays::float3(hr, hg, hb);
+        }
+        case Format::kRgba32:
+        {
+            auto data = reinterpret_cast<float const*>(m_data.get());
+            return RadeonRays::float3(data[idx], data[idx + 1], data[idx + 2]);
+        }
+        case Format::kBc1:
+        case Format::kBc3:
+        case Format::kBc5:
+        {
+            auto block_format = GetBlockFormat(m_format);
+            auto num_blocks_x = (m_size.x + 3) / 4;
+            auto block = reinterpret_cast<std::uint8_t const*>(m_data.get()) +
+                GetBlockSize(block_format) * ((y / 4) * num_blocks_x + x / 4);
+
+            std::uint8_t texels[16 * 4];
+            DecompressBlock(block_format, block, texels);
+
+            auto texel = texels + 4 * ((y % 4) * 4 + x % 4);
+            return RadeonRays::float3(texel[0] / 255.f, texel[1] / 255.f, texel[2] / 255.f);
+        }
+        default:
+            return RadeonRays::float3();
+        }
+    }
+
+    void Texture::Compress(Format format)
+    {
+        if (m_format != Format::kRgba8 || !IsBlockCompressed(format) || m_tiled_image)
+        {
+            throw std::runtime_error("Texture: only RGBA8 textures can be block compressed");
+        }
+
+        auto block_format = GetBlockFormat(format);
+        auto data = new char[GetBlockCompressedSize(block_format, m_size.x, m_size.y)];
+
+        CompressBlocks(block_format, reinterpret_cast<std::uint8_t const*>(m_data.get()), m_size.x, m_size.y,
+                       reinterpret_cast<std::uint8_t*>(data));
+
+        SetData(data, m_size, format);
+    }
+
     namespace {
         struct TextureConcrete: public Texture {
             TextureConcrete() = default;
             TextureConcrete(char* data, RadeonRays::int2 size, Format format) :
             Texture(data, size, format){}
+            TextureConcrete(std::shared_ptr<TiledImage> tiled_image) :
+            Texture(tiled_image){}
         };
     }
     
@@ -87,4 +369,8 @@ namespace Baikal
     Texture::Ptr Texture::Create(char* data, RadeonRays::int2 size, Format format) {
         return std::make_shared<TextureConcrete>(data, size, format);
     }
+
+    Texture::Ptr Texture::Create(std::shared_ptr<TiledImage> tiled_image) {
+        return std::make_shared<TextureConcrete>(tiled_image);
+    }
 }
@@ -33,12 +33,15 @@
 #include "math/int2.h"
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "scene_object.h"
+#include "Utils/block_compression.h"
 
 namespace Baikal
 {
     class Material;
+    class TiledImage;
     
     /**
      \brief Texture class.
@@ -52,12 +55,18 @@ namespace Baikal
         {
             kRgba8,
             kRgba16,
-            kRgba32
+            kRgba32,
+            // Block compressed formats (see Utils/block_compression.h)
+            kBc1,
+            kBc3,
+            kBc5
         };
         
         using Ptr = std::shared_ptr<Texture>;
         static Ptr Create(char* data, RadeonRays::int2 size, Format format);
         static Ptr Create();
+        // Virtual texture: data stays in tile file and is streamed on demand
+        static Ptr Create(std::shared_ptr<TiledImage> tiled_image);
         
         // Destructor (the data is destroyed as well)
         virtual ~Texture() = default;
@@ -74,8 +83,36 @@ namespace Baikal
         // Get data size in bytes
         std::size_t GetSizeInBytes() const;
 
+        // Check if format stores 4x4 texel blocks
+        static bool IsBlockCompressed(Format format);
+        // Block layout of compressed format
+        static BlockFormat GetBlockFormat(Format format);
+
+        // Size of image (e.g. mip level) data in bytes
+        static std::size_t GetLevelSizeInBytes(Format format, RadeonRays::int2 size);
+        // Convert image data to normalized RGBA float values and back,
+        // compressed formats are processed as decoded RGBA8 texels
+        static void ReadTexels(Format format, char const* data, RadeonRays::int2 size, std::vector<float>& texels);
+        static void WriteTexels(Format format, std::vector<float> const& texels, RadeonRays::int2 size, char* data);
+        // Next mip level of RGBA float texels (2x2 box filter), returns its size
+        static RadeonRays::int2 Downsample(std::vector<float> const& texels, RadeonRays::int2 size, std::vector<float>& result);
+        // Block compress RGBA8 data in place (format is one of kBc* formats),
+        // throws if texture is not RGBA8
+        void Compress(Format format);
+
         // Average normalized value
         RadeonRays::float3 ComputeAverageValue() const;
+        // Normalized value of a single texel (rows go top to bottom)
+        RadeonRays::float3 GetTexel(int x, int y) const;
+
+        // Tile file of virtual texture, nullptr for textures residing in memory
+        std::shared_ptr<TiledImage> GetTiledImage() const;
+        bool IsVirtual() const;
+
+        // Mip chain is generated on upload unless disabled
+        // (e.g. for lookup textures which should not be filtered)
+        void SetMipmapEnabled(bool enabled);
+        bool IsMipmapEnabled() const;
 
         // Disallow copying
         Texture(Texture const&) = delete;
@@ -86,6 +123,7 @@ namespace Baikal
         Texture();
         // Note, that texture takes ownership of its data array
         Texture(char* data, RadeonRays::int2 size, Format format);
+        Texture(std::shared_ptr<TiledImage> tiled_image);
 
     private:
         // Image data
@@ -94,12 +132,17 @@ namespace Baikal
         RadeonRays::int2 m_size;
         // Format
         Format m_format;
+        // Generate mip chain
+        bool m_mipmap_enabled;
+        // Tile file of virtual texture
+        std::shared_ptr<TiledImage> m_tiled_image;
     };
 
     inline Texture::Texture()
         : m_data(new char[16])
         , m_size(2,2)
         , m_format(Format::kRgba8)
+        , m_mipmap_enabled(true)
     {
         // Create checkerboard by default
         m_data[0] = m_data[1] = m_data[2] = m_data[3] = (char)0xFF;
@@ -112,6 +155,7 @@ namespace Baikal
     : m_data(data)
     , m_size(size)
     , m_format(format)
+    , m_mipmap_enabled(true)
     {
     }
 
@@ -120,9 +164,31 @@ namespace Baikal
         m_data.reset(data);
         m_size = size;
         m_format = format;
+        m_tiled_image.reset();
+        SetDirty(true);
+    }
+
+    inline void Texture::SetMipmapEnabled(bool enabled)
+    {
+        m_mipmap_enabled = enabled;
         SetDirty(true);
     }
 
+    inline std::shared_ptr<TiledImage> Texture::GetTiledImage() const
+    {
+        return m_tiled_image;
+    }
+
+    inline bool Texture::IsVirtual() const
+    {
+        return m_tiled_image != nullptr;
+    }
+
+    inline bool Texture::IsMipmapEnabled() const
+    {
+        return m_mipmap_enabled;
+    }
+
     inline RadeonRays::int2 Texture::GetSize() const
     {
         return m_size;
@@ -138,25 +204,24 @@ namespace Baikal
         return m_format;
     }
     
-    inline std::size_t Texture::GetSizeInBytes() const
+    inline bool Texture::IsBlockCompressed(Format format)
     {
-        std::uint32_t component_size = 1;
-        
-        switch (m_format) {
-            case Format::kRgba8:
-                component_size = 1;
-                break;
-            case Format::kRgba16:
-                component_size = 2;
-                break;
-            case Format::kRgba32:
-                component_size = 4;
-                break;
-            default:
-                break;
+        return format == Format::kBc1 || format == Format::kBc3 || format == Format::kBc5;
+    }
+
+    inline BlockFormat Texture::GetBlockFormat(Format format)
+    {
+        switch (format)
+        {
+            case Format::kBc3: return BlockFormat::kBc3;
+            case Format::kBc5: return BlockFormat::kBc5;
+            default: return BlockFormat::kBc1;
         }
-        
-        return 4 * component_size * m_size.x * m_size.y;
+    }
+
+    inline std::size_t Texture::GetSizeInBytes() const
+    {
+        return GetLevelSizeInBytes(m_format, m_size);
     }
 
 
@@ -0,0 +1,434 @@
+#include "block_compression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace Baikal
+{
+    // Texels per block side
+    static const int kBlockDim = 4;
+
+    static std::uint16_t PackColor565(float const* color)
+    {
+        auto r = static_cast<std::uint16_t>(std::min(std::max(color[0] * 31.f / 255.f + 0.5f, 0.f), 31.f));
+        auto g = static_cast<std::uint16_t>(std::min(std::max(color[1] * 63.f / 255.f + 0.5f, 0.f), 63.f));
+        auto b = static_cast<std::uint16_t>(std::min(std::max(color[2] * 31.f / 255.f + 0.5f, 0.f), 31.f));
+        return static_cast<std::uint16_t>((r << 11) | (g << 5) | b);
+    }
+
+    static void UnpackColor565(std::uint16_t packed, int* color)
+    {
+        auto r = (packed >> 11) & 0x1f;
+        auto g = (packed >> 5) & 0x3f;
+        auto b = packed & 0x1f;
+
+        // Replicate high bits to cover the full range
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    }
+
+    static std::uint16_t ReadUint16(std::uint8_t const* data)
+    {
+        return static_cast<std::uint16_t>(data[0] | (data[1] << 8));
+    }
+
+    static void WriteUint16(std::uint16_t value, std::uint8_t* data)
+    {
+        data[0] = static_cast<std::uint8_t>(value & 0xff);
+        data[1] = static_cast<std::uint8_t>(value >> 8);
+    }
+
+    // Palette of color block, four_colors is false for BC1 blocks with c0 <= c1,
+    // those have 3 colors and transparent black
+    static void GetColorPalette(std::uint16_t c0, std::uint16_t c1, bool four_colors, int palette[4][4])
+    {
+        UnpackColor565(c0, palette[0]);
+        UnpackColor565(c1, palette[1]);
+        palette[0][3] = palette[1][3] = 255;
+
+        for (auto c = 0; c < 3; ++c)
+        {
+            if (four_colors)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            else
+            {
+                palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+                palette[3][c] = 0;
+            }
+        }
+
+        palette[2][3] = 255;
+        palette[3][3] = four_colors ? 255 : 0;
+    }
+
+    static void GetAlphaPalette(int a0, int a1, int palette[8])
+    {
+        palette[0] = a0;
+        palette[1] = a1;
+
+        if (a0 > a1)
+        {
+            for (auto i = 1; i < 7; ++i)
+            {
+                palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+            }
+        }
+        else
+        {
+            for (auto i = 1; i < 5; ++i)
+            {
+                palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+            }
+
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+    }
+
+    // Color block: endpoints are the extremes of texels projected
+    // onto the principal axis of their distribution
+    static void CompressColorBlock(std::uint8_t const* texels, bool allow_alpha, std::uint8_t* block)
+    {
+        bool has_alpha = false;
+        float mean[3] = { 0.f, 0.f, 0.f };
+        auto num_opaque = 0;
+
+        for (auto i = 0; i < 16; ++i)
+        {
+            if (allow_alpha && texels[4 * i + 3] < 128)
+            {
+                has_alpha = true;
+                continue;
+            }
+
+            for (auto c = 0; c < 3; ++c)
+            {
+                mean[c] += texels[4 * i + c];
+            }
+
+            ++num_opaque;
+        }
+
+        if (num_opaque == 0)
+        {
+            // Fully transparent: 3 color mode with all texels at index 3
+            WriteUint16(0, block);
+            WriteUint16(0, block + 2);
+            std::memset(block + 4, 0xff, 4);
+            return;
+        }
+
+        for (auto c = 0; c < 3; ++c)
+        {
+            mean[c] /= num_opaque;
+        }
+
+        float cov[6] = { 0.f, 0.f, 0.f, 0.f, 0.f, 0.f };
+        for (auto i = 0; i < 16; ++i)
+        {
+            if (allow_alpha && texels[4 * i + 3] < 128)
+            {
+                continue;
+            }
+
+            auto r = texels[4 * i] - mean[0];
+            auto g = texels[4 * i + 1] - mean[1];
+            auto b = texels[4 * i + 2] - mean[2];
+
+            cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+            cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+        }
+
+        // Principal axis by power iteration
+        float axis[3] = { 1.f, 1.f, 1.f };
+        for (auto iter = 0; iter < 8; ++iter)
+        {
+            float next[3] =
+            {
+                cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+                cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+                cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]
+            };
+
+            auto len = std::max(std::max(std::fabs(next[0]), std::fabs(next[1])), std::fabs(next[2]));
+
+            if (len < 1e-6f)
+            {
+                break;
+            }
+
+            for (auto c = 0; c < 3; ++c)
+            {
+                axis[c] = next[c] / len;
+            }
+        }
+
+        auto min_proj = 0.f;
+        auto max_proj = 0.f;
+        auto min_texel = -1;
+        auto max_texel = -1;
+        for (auto i = 0; i < 16; ++i)
+        {
+            if (allow_alpha && texels[4 * i + 3] < 128)
+            {
+                continue;
+            }
+
+            auto proj = texels[4 * i] * axis[0] + texels[4 * i + 1] * axis[1] + texels[4 * i + 2] * axis[2];
+
+            if (min_texel < 0 || proj < min_proj)
+            {
+                min_proj = proj;
+                min_texel = i;
+            }
+
+            if (max_texel < 0 || proj > max_proj)
+            {
+                max_proj = proj;
+                max_texel = i;
+            }
+        }
+
+        float e0[3], e1[3];
+        for (auto c = 0; c < 3; ++c)
+        {
+            e0[c] = texels[4 * max_texel + c];
+            e1[c] = texels[4 * min_texel + c];
+        }
+
+        auto c0 = PackColor565(e0);
+        auto c1 = PackColor565(e1);
+
+        // Order of endpoints selects the mode: c0 > c1 for 4 colors
+        if (has_alpha ? c0 > c1 : c0 < c1)
+        {
+            std::swap(c0, c1);
+        }
+
+        auto four_colors = c0 > c1;
+
+        int palette[4][4];
+        GetColorPalette(c0, c1, four_colors, palette);
+
+        std::uint32_t indices = 0;
+        for (auto i = 0; i < 16; ++i)
+        {
+            auto best = 0;
+
+            if (has_alpha && texels[4 * i + 3] < 128)
+            {
+                best = 3;
+            }
+            else
+            {
+                auto best_dist = -1;
+                for (auto j = 0; j < (four_colors ? 4 : 3); ++j)
+                {
+                    auto dist = 0;
+                    for (auto c = 0; c < 3; ++c)
+                    {
+                        auto d = texels[4 * i + c] - palette[j][c];
+                        dist += d * d;
+                    }
+
+                    if (best_dist < 0 || dist < best_dist)
+                    {
+                        best_dist = dist;
+                        best = j;
+                    }
+                }
+            }
+
+            indices |= static_cast<std::uint32_t>(best) << (2 * i);
+        }
+
+        WriteUint16(c0, block);
+        WriteUint16(c1, block + 2);
+        for (auto i = 0; i < 4; ++i)
+        {
+            block[4 + i] = static_cast<std::uint8_t>(indices >> (8 * i));
+        }
+    }
+
+    // Single channel block with 8 interpolated values between min and max
+    static void CompressAlphaBlock(std::uint8_t const* texels, int channel, std::uint8_t* block)
+    {
+        int a0 = 0;
+        int a1 = 255;
+        for (auto i = 0; i < 16; ++i)
+        {
+            a0 = std::max(a0, static_cast<int>(texels[4 * i + channel]));
+            a1 = std::min(a1, static_cast<int>(texels[4 * i + channel]));
+        }
+
+        int palette[8];
+        GetAlphaPalette(a0, a1, palette);
+
+        std::uint64_t indices = 0;
+        if (a0 > a1)
+        {
+            for (auto i = 0; i < 16; ++i)
+            {
+                auto best = 0;
+                auto best_dist = 256;
+                for (auto j = 0; j < 8; ++j)
+                {
+                    auto dist = std::abs(texels[4 * i + channel] - palette[j]);
+                    if (dist < best_dist)
+                    {
+                        best_dist = dist;
+                        best = j;
+                    }
+                }
+
+                indices |= static_cast<std::uint64_t>(best) << (3 * i);
+            }
+        }
+
+        block[0] = static_cast<std::uint8_t>(a0);
+        block[1] = static_cast<std::uint8_t>(a1);
+        for (auto i = 0; i < 6; ++i)
+        {
+            block[2 + i] = static_cast<std::uint8_t>(indices >> (8 * i));
+        }
+    }
+
+    static void DecompressColorBlock(std::uint8_t const* block, bool allow_alpha, std::uint8_t* rgba)
+    {
+        auto c0 = ReadUint16(block);
+        auto c1 = ReadUint16(block + 2);
+
+        int palette[4][4];
+        GetColorPalette(c0, c1, !allow_alpha || c0 > c1, palette);
+
+        for (auto i = 0; i < 16; ++i)
+        {
+            auto idx = (block[4 + i / 4] >> (2 * (i % 4))) & 0x3;
+            for (auto c = 0; c < 4; ++c)
+            {
+                rgba[4 * i + c] = static_cast<std::uint8_t>(palette[idx][c]);
+            }
+        }
+    }
+
+    static void DecompressAlphaBlock(std::uint8_t const* block, int channel, std::uint8_t* rgba)
+    {
+        int palette[8];
+        GetAlphaPalette(block[0], block[1], palette);
+
+        std::uint64_t indices = 0;
+        for (auto i = 0; i < 6; ++i)
+        {
+            indices |= static_cast<std::uint64_t>(block[2 + i]) << (8 * i);
+        }
+
+        for (auto i = 0; i < 16; ++i)
+        {
+            rgba[4 * i + channel] = static_cast<std::uint8_t>(palette[(indices >> (3 * i)) & 0x7]);
+        }
+    }
+
+    std::size_t GetBlockSize(BlockFormat format)
+    {
+        return format == BlockFormat::kBc1 ? 8 : 16;
+    }
+
+    std::size_t GetBlockCompressedSize(BlockFormat format, int width, int height)
+    {
+        std::size_t num_blocks_x = (width + kBlockDim - 1) / kBlockDim;
+        std::size_t num_blocks_y = (height + kBlockDim - 1) / kBlockDim;
+        return num_blocks_x * num_blocks_y * GetBlockSize(format);
+    }
+
+    void DecompressBlock(BlockFormat format, std::uint8_t const* block, std::uint8_t* rgba)
+    {
+        switch (format)
+        {
+            case BlockFormat::kBc1:
+                DecompressColorBlock(block, true, rgba);
+                break;
+            case BlockFormat::kBc3:
+                DecompressColorBlock(block + 8, false, rgba);
+                DecompressAlphaBlock(block, 3, rgba);
+                break;
+            case BlockFormat::kBc5:
+                DecompressAlphaBlock(block, 0, rgba);
+                DecompressAlphaBlock(block + 8, 1, rgba);
+                for (auto i = 0; i < 16; ++i)
+                {
+                    rgba[4 * i + 2] = 0;
+                    rgba[4 * i + 3] = 255;
+                }
+                break;
+        }
+    }
+
+    void CompressBlocks(BlockFormat format, std::uint8_t const* rgba, int width, int height, std::uint8_t* blocks)
+    {
+        auto block_size = GetBlockSize(format);
+        std::uint8_t texels[16 * 4];
+
+        for (auto by = 0; by < height; by += kBlockDim)
+        {
+            for (auto bx = 0; bx < width; bx += kBlockDim)
+            {
+                // Edge texels are replicated into partial blocks
+                for (auto i = 0; i < 16; ++i)
+                {
+                    auto x = std::min(bx + i % kBlockDim, width - 1);
+                    auto y = std::min(by + i / kBlockDim, height - 1);
+                    std::memcpy(texels + 4 * i, rgba + 4 * (static_cast<std::size_t>(y) * width + x), 4);
+                }
+
+                switch (format)
+                {
+                    case BlockFormat::kBc1:
+                        CompressColorBlock(texels, true, blocks);
+                        break;
+                    case BlockFormat::kBc3:
+                        CompressAlphaBlock(texels, 3, blocks);
+                        CompressColorBlock(texels, false, blocks + 8);
+                        break;
+                    case BlockFormat::kBc5:
+                        CompressAlphaBlock(texels, 0, blocks);
+                        CompressAlphaBlock(texels, 1, blocks + 8);
+                        break;
+                }
+
+                blocks += block_size;
+            }
+        }
+    }
+
+    void DecompressBlocks(BlockFormat format, std::uint8_t const* blocks, int width, int height, std::uint8_t* rgba)
+    {
+        auto block_size = GetBlockSize(format);
+        std::uint8_t texels[16 * 4];
+
+        for (auto by = 0; by < height; by += kBlockDim)
+        {
+            for (auto bx = 0; bx < width; bx += kBlockDim)
+            {
+                DecompressBlock(format, blocks, texels);
+
+                for (auto i = 0; i < 16; ++i)
+                {
+                    auto x = bx + i % kBlockDim;
+                    auto y = by + i / kBlockDim;
+
+                    if (x < width && y < height)
+                    {
+                        std::memcpy(rgba + 4 * (static_cast<std::size_t>(y) * width + x), texels + 4 * i, 4);
+                    }
+                }
+
+                blocks += block_size;
+            }
+        }
+    }
+}
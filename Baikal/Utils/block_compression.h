@@ -0,0 +1,54 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Baikal
+{
+    ///< Block compressed texture formats. Images are split into 4x4 texel
+    ///< blocks stored row by row, partial blocks at the right and bottom
+    ///< edges are padded. Only unsigned normalized formats are supported.
+    ///<
+    enum class BlockFormat
+    {
+        // RGB with 1-bit alpha, 8 bytes per block
+        kBc1,
+        // RGBA with interpolated alpha, 16 bytes per block
+        kBc3,
+        // Two independent channels (RG), 16 bytes per block
+        kBc5
+    };
+
+    // Size of a single 4x4 block in bytes
+    std::size_t GetBlockSize(BlockFormat format);
+    // Size of compressed image in bytes
+    std::size_t GetBlockCompressedSize(BlockFormat format, int width, int height);
+
+    // Compress RGBA8 image (rows go top to bottom)
+    void CompressBlocks(BlockFormat format, std::uint8_t const* rgba, int width, int height, std::uint8_t* blocks);
+    // Decompress image into RGBA8 texels
+    void DecompressBlocks(BlockFormat format, std::uint8_t const* blocks, int width, int height, std::uint8_t* rgba);
+    // Decompress single block into 16 RGBA8 texels
+    void DecompressBlock(BlockFormat format, std::uint8_t const* block, std::uint8_t* rgba);
+}
@@ -36,6 +36,19 @@ namespace Baikal
         // Calculate normalizer
         m_func_sum = m_cdf[num_segments];
 
+        // Fall back to uniform distribution if function is zero everywhere
+        if (m_func_sum <= 0.f)
+        {
+            std::fill(m_func_values.begin(), m_func_values.end(), 1.f);
+
+            for (auto i = 0u; i < num_segments + 1; ++i)
+            {
+                m_cdf[i] = static_cast<float>(i) / num_segments;
+            }
+
+            m_func_sum = 1.f;
+        }
+
         // Normalize CDF
         for (auto i = 0u; i < num_segments + 1; ++i)
         {
@@ -69,13 +82,10 @@ namespace Baikal
 
     float Distribution1D::pdf(float u) const
     {
-        // Find the segment here u lies
-        auto iter = std::lower_bound(m_cdf.cbegin(), m_cdf.cend(), u);
-
-        // Find segment index : clamp it as last may be returned for 1
-        auto segment_idx = std::max((std::uint32_t)std::distance(m_cdf.cbegin(), iter), 1u);
+        // Find the segment here u lies (u is a value in [0,1], not a CDF value)
+        auto segment_idx = std::min(static_cast<std::uint32_t>(std::max(u, 0.f) * m_num_segments), m_num_segments - 1);
 
         // Calc pdf
-        return m_func_values[segment_idx - 1] / m_func_sum;
+        return m_func_values[segment_idx] / m_func_sum;
     }
 }
\ No newline at end of file
@@ -0,0 +1,58 @@
+#include "distribution2d.h"
+
+#include <algorithm>
+#include <numeric>
+#include <cassert>
+
+namespace Baikal
+{
+    Distribution2D::Distribution2D()
+        : m_width(0u)
+        , m_height(0u)
+    {
+    }
+
+    Distribution2D::Distribution2D(float const* values, std::uint32_t width, std::uint32_t height)
+    {
+        Set(values, width, height);
+    }
+
+    void Distribution2D::Set(float const* values, std::uint32_t width, std::uint32_t height)
+    {
+        assert(width > 0 && height > 0);
+        m_width = width;
+        m_height = height;
+        m_conditional.resize(height);
+
+        // Build row distributions and gather their integrals
+        // (computed here as empty rows fall back to uniform distribution)
+        std::vector<float> row_values(height);
+        for (auto i = 0u; i < height; ++i)
+        {
+            auto row = values + i * width;
+            m_conditional[i].Set(row, width);
+            row_values[i] = std::accumulate(row, row + width, 0.f) / width;
+        }
+
+        m_marginal.Set(&row_values[0], height);
+    }
+
+    void Distribution2D::Sample2D(float u, float v, float& x, float& y, float& pdf) const
+    {
+        float marginal_pdf = 0.f;
+        y = m_marginal.Sample1D(v, marginal_pdf);
+
+        auto row = std::min(static_cast<std::uint32_t>(y * m_height), m_height - 1);
+
+        float conditional_pdf = 0.f;
+        x = m_conditional[row].Sample1D(u, conditional_pdf);
+
+        pdf = marginal_pdf * conditional_pdf;
+    }
+
+    float Distribution2D::pdf(float x, float y) const
+    {
+        auto row = std::min(static_cast<std::uint32_t>(std::max(y, 0.f) * m_height), m_height - 1);
+        return m_marginal.pdf(y) * m_conditional[row].pdf(x);
+    }
+}
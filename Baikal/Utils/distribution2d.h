@@ -0,0 +1,59 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "distribution1d.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace Baikal
+{
+    ///< The class represents 2D piecewise constant distribution over [0,1]x[0,1].
+    ///< It is built from marginal distribution over rows and conditional
+    ///< distributions within each row (Pharr & Humphreys).
+    ///<
+    struct Distribution2D
+    {
+    public:
+        // values are function values of width x height grid stored row by row
+        Distribution2D();
+        Distribution2D(float const* values, std::uint32_t width, std::uint32_t height);
+
+        void Set(float const* values, std::uint32_t width, std::uint32_t height);
+
+        // Sample a point using this distribution
+        // u and v are uniformely distributed random vars
+        void Sample2D(float u, float v, float& x, float& y, float& pdf) const;
+
+        // PDF
+        float pdf(float x, float y) const;
+
+        // Distributions within rows
+        std::vector<Distribution1D> m_conditional;
+        // Distribution of rows
+        Distribution1D m_marginal;
+        // Grid dimensions
+        std::uint32_t m_width;
+        std::uint32_t m_height;
+    };
+}
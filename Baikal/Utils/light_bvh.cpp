@@ -0,0 +1,237 @@
+#include "light_bvh.h"
+
+#include "math/mathutils.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace Baikal
+{
+    using namespace RadeonRays;
+
+    // Bounding cone of two emission cones given by axes and half-angles
+    static void UnionCones(float3 const& axis_a, float theta_a, float3 const& axis_b, float theta_b,
+                           float3& axis, float& theta)
+    {
+        auto theta_d = std::acos(std::min(std::max(dot(axis_a, axis_b), -1.f), 1.f));
+
+        // One of the cones contains the other one
+        if (std::min(theta_d + theta_b, PI) <= theta_a)
+        {
+            axis = axis_a;
+            theta = theta_a;
+            return;
+        }
+
+        if (std::min(theta_d + theta_a, PI) <= theta_b)
+        {
+            axis = axis_b;
+            theta = theta_b;
+            return;
+        }
+
+        auto theta_o = 0.5f * (theta_a + theta_d + theta_b);
+        auto w = cross(axis_a, axis_b);
+
+        // Whole sphere of directions
+        if (theta_o >= PI || w.sqnorm() < 1e-12f)
+        {
+            axis = axis_a;
+            theta = PI;
+            return;
+        }
+
+        // Rotate axis_a towards axis_b, w is orthogonal to axis_a
+        auto theta_r = theta_o - theta_a;
+        w = normalize(w);
+        axis = normalize(axis_a * std::cos(theta_r) + cross(w, axis_a) * std::sin(theta_r));
+        theta = theta_o;
+    }
+
+    void LightBvh::Build(std::vector<Primitive> const& primitives)
+    {
+        m_nodes.clear();
+        m_paths.assign(primitives.size(), LeafPath{ 0u, -1 });
+
+        if (primitives.empty())
+        {
+            return;
+        }
+
+        // Binary tree has 2N - 1 nodes
+        m_nodes.reserve(2 * primitives.size() - 1);
+
+        std::vector<int> refs(primitives.size());
+        for (auto i = 0u; i < refs.size(); ++i)
+        {
+            refs[i] = static_cast<int>(i);
+        }
+
+        BuildNode(primitives, refs, 0, refs.size(), 0u, 0);
+    }
+
+    // Estimate contribution of a node to a point (matches LightBvh_GetImportance)
+    static float GetImportance(LightBvh::Node const& node, float3 const& p)
+    {
+        auto d = p - node.bounds.center();
+        auto d2 = d.sqnorm();
+        auto r2 = 0.25f * node.bounds.extents().sqnorm();
+
+        auto cos_theta_w = d2 > 0.f ? std::min(std::max(dot(node.axis, d) / std::sqrt(d2), -1.f), 1.f) : 1.f;
+        auto cos_theta_b = d2 > r2 ? std::sqrt(1.f - r2 / d2) : -1.f;
+
+        auto theta = std::max(std::acos(cos_theta_w) - std::acos(node.cos_theta_o) - std::acos(cos_theta_b), 0.f);
+
+        if (theta > std::acos(node.cos_theta_e))
+        {
+            return 0.f;
+        }
+
+        return node.power * std::cos(theta) / std::max(std::max(d2, r2), 1e-8f);
+    }
+
+    float LightBvh::GetLeftProbability(int idx, float3 const& p) const
+    {
+        auto left = GetImportance(m_nodes[idx + 1], p);
+        auto right = GetImportance(m_nodes[m_nodes[idx].right], p);
+        return left + right > 0.f ? left / (left + right) : -1.f;
+    }
+
+    int LightBvh::Sample(float3 const& p, float sample, float& pdf) const
+    {
+        pdf = 0.f;
+
+        if (m_nodes.empty())
+        {
+            return -1;
+        }
+
+        auto idx = 0;
+        pdf = 1.f;
+
+        while (m_nodes[idx].primitive < 0)
+        {
+            auto left = GetLeftProbability(idx, p);
+
+            if (left < 0.f)
+            {
+                pdf = 0.f;
+                return -1;
+            }
+
+            // Reuse the sample for the next level
+            if (sample < left)
+            {
+                sample = sample / left;
+                pdf *= left;
+                idx = idx + 1;
+            }
+            else
+            {
+                sample = (sample - left) / (1.f - left);
+                pdf *= 1.f - left;
+                idx = m_nodes[idx].right;
+            }
+
+            sample = std::min(sample, 0.99999994f);
+        }
+
+        return m_nodes[idx].primitive;
+    }
+
+    float LightBvh::GetPdf(int primitive, float3 const& p) const
+    {
+        auto path = m_paths[primitive];
+        auto idx = 0;
+        auto pdf = 1.f;
+
+        for (auto i = 0; i < path.depth; ++i)
+        {
+            auto left = GetLeftProbability(idx, p);
+
+            if (left < 0.f)
+            {
+                return 0.f;
+            }
+
+            if ((path.trail >> i) & 0x1)
+            {
+                pdf *= 1.f - left;
+                idx = m_nodes[idx].right;
+            }
+            else
+            {
+                pdf *= left;
+                idx = idx + 1;
+            }
+        }
+
+        return pdf;
+    }
+
+    int LightBvh::BuildNode(std::vector<Primitive> const& primitives, std::vector<int>& refs,
+                            std::size_t begin, std::size_t end, std::uint32_t trail, int depth)
+    {
+        auto idx = static_cast<int>(m_nodes.size());
+        m_nodes.emplace_back();
+
+        if (end - begin == 1)
+        {
+            auto& primitive = primitives[refs[begin]];
+            auto& node = m_nodes[idx];
+            node.bounds = primitive.bounds;
+            node.axis = primitive.axis;
+            node.cos_theta_o = primitive.cos_theta_o;
+            node.cos_theta_e = primitive.cos_theta_e;
+            node.power = primitive.power;
+            node.right = -1;
+            node.primitive = refs[begin];
+
+            m_paths[refs[begin]] = LeafPath{ trail, depth };
+            return idx;
+        }
+
+        // Median split along the largest extent of primitive centroids,
+        // this keeps the tree balanced and within kMaxDepth
+        assert(depth < kMaxDepth);
+
+        bbox centroids;
+        for (auto i = begin; i < end; ++i)
+        {
+            centroids.grow(primitives[refs[i]].bounds.center());
+        }
+
+        auto extents = centroids.extents();
+        auto axis = extents.x > extents.y ? (extents.x > extents.z ? 0 : 2) : (extents.y > extents.z ? 1 : 2);
+        auto middle = begin + (end - begin) / 2;
+
+        std::nth_element(refs.begin() + begin, refs.begin() + middle, refs.begin() + end,
+                         [&primitives, axis](int a, int b)
+                         {
+                             return primitives[a].bounds.center()[axis] < primitives[b].bounds.center()[axis];
+                         });
+
+        auto left = BuildNode(primitives, refs, begin, middle, trail, depth + 1);
+        auto right = BuildNode(primitives, refs, middle, end, trail | (1u << depth), depth + 1);
+
+        // Children are built, merge their bounds (m_nodes might have been reallocated)
+        auto const& l = m_nodes[left];
+        auto const& r = m_nodes[right];
+
+        float3 cone_axis;
+        float theta_o = 0.f;
+        UnionCones(l.axis, std::acos(l.cos_theta_o), r.axis, std::acos(r.cos_theta_o), cone_axis, theta_o);
+
+        auto& node = m_nodes[idx];
+        node.bounds = bboxunion(l.bounds, r.bounds);
+        node.axis = cone_axis;
+        node.cos_theta_o = std::cos(theta_o);
+        node.cos_theta_e = std::min(l.cos_theta_e, r.cos_theta_e);
+        node.power = l.power + r.power;
+        node.right = right;
+        node.primitive = -1;
+
+        return idx;
+    }
+}
@@ -0,0 +1,100 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "math/float3.h"
+#include "math/bbox.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace Baikal
+{
+    ///< The class represents bounding volume hierarchy over light sources.
+    ///< Each node bounds positions of its lights and the cone of their
+    ///< emission directions, which gives a conservative estimate of the subtree
+    ///< contribution to a point (Conty Estevez & Kulla, "Importance sampling
+    ///< of many lights with adaptive tree splitting").
+    ///<
+    struct LightBvh
+    {
+    public:
+        // Light source as seen by the hierarchy
+        struct Primitive
+        {
+            // World space bounds
+            RadeonRays::bbox bounds;
+            // Emission cone: all emission normals are within theta_o
+            // of the axis, light is emitted up to theta_e past the normals
+            RadeonRays::float3 axis;
+            float cos_theta_o;
+            float cos_theta_e;
+            // Emitted power (luminance)
+            float power;
+        };
+
+        // Nodes are stored depth first: left child goes right after its parent
+        struct Node
+        {
+            RadeonRays::bbox bounds;
+            RadeonRays::float3 axis;
+            float cos_theta_o;
+            float cos_theta_e;
+            float power;
+            // Index of right child, -1 for leaves
+            int right;
+            // Index of primitive for leaves, -1 for interior nodes
+            int primitive;
+        };
+
+        // Path from the root to a leaf: bit i of trail is set
+        // if the path goes to the right child at depth i
+        struct LeafPath
+        {
+            std::uint32_t trail;
+            int depth;
+        };
+
+        // Max depth of the tree, limited by trail bits
+        static const int kMaxDepth = 32;
+
+        void Build(std::vector<Primitive> const& primitives);
+
+        // Pick a primitive by estimated contribution to p, returns -1 if
+        // nothing contributes (matches LightBvh_Sample in kernels)
+        int Sample(RadeonRays::float3 const& p, float sample, float& pdf) const;
+        // Probability of picking a primitive by Sample (matches LightBvh_GetPdf)
+        float GetPdf(int primitive, RadeonRays::float3 const& p) const;
+
+        // Hierarchy nodes, root is the first one
+        std::vector<Node> m_nodes;
+        // Leaf paths indexed by primitive index
+        std::vector<LeafPath> m_paths;
+
+    private:
+        // Probability of choosing left child of an interior node, -1 if none contributes
+        float GetLeftProbability(int idx, RadeonRays::float3 const& p) const;
+
+        int BuildNode(std::vector<Primitive> const& primitives, std::vector<int>& refs,
+                      std::size_t begin, std::size_t end, std::uint32_t trail, int depth);
+    };
+}
@@ -0,0 +1,113 @@
+#include "mapped_file.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Baikal
+{
+#ifdef _WIN32
+    MappedFile::MappedFile(std::string const& filename)
+        : m_data(nullptr)
+        , m_size(0)
+        , m_file(INVALID_HANDLE_VALUE)
+        , m_mapping(nullptr)
+    {
+        m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL, nullptr);
+
+        LARGE_INTEGER size;
+        if (m_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_file, &size))
+        {
+            if (m_file != INVALID_HANDLE_VALUE)
+            {
+                CloseHandle(m_file);
+            }
+
+            throw std::runtime_error("Can't open " + filename);
+        }
+
+        m_size = static_cast<std::size_t>(size.QuadPart);
+
+        if (m_size > 0)
+        {
+            m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            m_data = m_mapping ? static_cast<char const*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+
+            if (!m_data)
+            {
+                if (m_mapping)
+                {
+                    CloseHandle(m_mapping);
+                }
+
+                CloseHandle(m_file);
+                throw std::runtime_error("Can't map " + filename);
+            }
+        }
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if (m_data)
+        {
+            UnmapViewOfFile(m_data);
+            CloseHandle(m_mapping);
+        }
+
+        CloseHandle(m_file);
+    }
+#else
+    MappedFile::MappedFile(std::string const& filename)
+        : m_data(nullptr)
+        , m_size(0)
+    {
+        auto fd = open(filename.c_str(), O_RDONLY);
+
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0)
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+
+            throw std::runtime_error("Can't open " + filename);
+        }
+
+        m_size = static_cast<std::size_t>(st.st_size);
+
+        if (m_size > 0)
+        {
+            auto data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (data == MAP_FAILED)
+            {
+                close(fd);
+                throw std::runtime_error("Can't map " + filename);
+            }
+
+            m_data = static_cast<char const*>(data);
+        }
+
+        // Mapping stays valid after the descriptor is closed
+        close(fd);
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if (m_data)
+        {
+            munmap(const_cast<char*>(m_data), m_size);
+        }
+    }
+#endif
+}
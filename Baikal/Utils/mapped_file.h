@@ -0,0 +1,54 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace Baikal
+{
+    ///< Read-only memory mapped file. Pages are loaded by the OS on first access,
+    ///< so only the parts of the file which are actually read take memory.
+    ///<
+    class MappedFile
+    {
+    public:
+        // Throws std::runtime_error if the file can't be mapped
+        explicit MappedFile(std::string const& filename);
+        ~MappedFile();
+
+        char const* GetData() const { return m_data; }
+        std::size_t GetSize() const { return m_size; }
+
+        // Disallow copying
+        MappedFile(MappedFile const&) = delete;
+        MappedFile& operator = (MappedFile const&) = delete;
+
+    private:
+        char const* m_data;
+        std::size_t m_size;
+#ifdef _WIN32
+        void* m_file;
+        void* m_mapping;
+#endif
+    };
+}
@@ -0,0 +1,119 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "range_allocator.h"
+
+#include <cassert>
+#include <iterator>
+
+namespace Baikal
+{
+    const std::size_t RangeAllocator::kInvalidOffset;
+
+    RangeAllocator::RangeAllocator()
+        : m_capacity(0)
+        , m_used_size(0)
+    {
+    }
+
+    RangeAllocator::RangeAllocator(std::size_t capacity)
+    {
+        Reset(capacity);
+    }
+
+    void RangeAllocator::Reset(std::size_t capacity)
+    {
+        m_free_ranges.clear();
+        m_capacity = capacity;
+        m_used_size = 0;
+
+        if (capacity > 0)
+        {
+            m_free_ranges.emplace(0, capacity);
+        }
+    }
+
+    std::size_t RangeAllocator::Allocate(std::size_t size)
+    {
+        // Zero sized ranges do not occupy anything
+        if (size == 0)
+        {
+            return 0;
+        }
+
+        // First fit
+        for (auto iter = m_free_ranges.begin(); iter != m_free_ranges.end(); ++iter)
+        {
+            if (iter->second >= size)
+            {
+                auto offset = iter->first;
+                auto remaining = iter->second - size;
+
+                m_free_ranges.erase(iter);
+
+                // Put the tail back
+                if (remaining > 0)
+                {
+                    m_free_ranges.emplace(offset + size, remaining);
+                }
+
+                m_used_size += size;
+                return offset;
+            }
+        }
+
+        return kInvalidOffset;
+    }
+
+    void RangeAllocator::Free(std::size_t offset, std::size_t size)
+    {
+        if (size == 0)
+        {
+            return;
+        }
+
+        assert(offset + size <= m_capacity);
+        assert(m_used_size >= size);
+
+        m_used_size -= size;
+
+        auto iter = m_free_ranges.emplace(offset, size).first;
+
+        // Merge with the next range
+        auto next = std::next(iter);
+        if (next != m_free_ranges.end() && iter->first + iter->second == next->first)
+        {
+            iter->second += next->second;
+            m_free_ranges.erase(next);
+        }
+
+        // Merge with the previous range
+        if (iter != m_free_ranges.begin())
+        {
+            auto prev = std::prev(iter);
+            if (prev->first + prev->second == iter->first)
+            {
+                prev->second += iter->second;
+                m_free_ranges.erase(iter);
+            }
+        }
+    }
+}
@@ -0,0 +1,63 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <map>
+
+namespace Baikal
+{
+    ///< The class manages ranges of a linear pool (typically a GPU buffer).
+    ///< It does first-fit allocation and coalesces adjacent free ranges on release.
+    ///< Offsets and sizes are expressed in pool elements, not in bytes.
+    ///<
+    class RangeAllocator
+    {
+    public:
+        // Returned by Allocate if there is no free range large enough
+        static const std::size_t kInvalidOffset = ~std::size_t(0);
+
+        RangeAllocator();
+        explicit RangeAllocator(std::size_t capacity);
+
+        // Drop all allocations and set new pool capacity
+        void Reset(std::size_t capacity);
+
+        // Allocate size elements, returns kInvalidOffset on failure
+        std::size_t Allocate(std::size_t size);
+        // Return previously allocated range back to the pool
+        void Free(std::size_t offset, std::size_t size);
+
+        // Total pool capacity
+        std::size_t GetCapacity() const { return m_capacity; }
+        // Number of elements currently allocated
+        std::size_t GetUsedSize() const { return m_used_size; }
+
+    private:
+        // Free ranges: offset -> size
+        std::map<std::size_t, std::size_t> m_free_ranges;
+        // Pool capacity
+        std::size_t m_capacity;
+        // Allocated elements
+        std::size_t m_used_size;
+    };
+}
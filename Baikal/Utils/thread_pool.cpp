@@ -0,0 +1,59 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace Baikal
+{
+    ThreadPool::ThreadPool(std::size_t num_threads)
+        : m_stop(false)
+    {
+        if (num_threads == 0)
+        {
+            num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+
+        for (auto i = 0u; i < num_threads; ++i)
+        {
+            m_threads.emplace_back(&ThreadPool::Run, this);
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+
+        m_condition.notify_all();
+
+        for (auto& thread : m_threads)
+        {
+            thread.join();
+        }
+    }
+
+    void ThreadPool::Run()
+    {
+        for (;;)
+        {
+            std::function<void()> task;
+
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_condition.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+
+                // Queue is drained before stopping
+                if (m_tasks.empty())
+                {
+                    return;
+                }
+
+                task = std::move(m_tasks.front());
+                m_tasks.pop_front();
+            }
+
+            task();
+        }
+    }
+}
@@ -0,0 +1,107 @@
+#include "tile_cache.h"
+
+#include <algorithm>
+
+namespace Baikal
+{
+    void TileCache::Reset(std::size_t num_slots, std::size_t num_pages)
+    {
+        m_page_slots.assign(num_pages, -1);
+        m_slots.assign(num_slots, Slot{ -1, 0u, false });
+        m_free_slots.resize(num_slots);
+        m_eviction_order.clear();
+        m_eviction_order_valid = false;
+        m_frame = 0;
+
+        // Slots are taken from the back
+        for (auto i = 0u; i < num_slots; ++i)
+        {
+            m_free_slots[i] = static_cast<int>(num_slots - i - 1);
+        }
+    }
+
+    void TileCache::Update(std::vector<int> const& accessed_pages, std::vector<int>& misses)
+    {
+        ++m_frame;
+        misses.clear();
+
+        for (auto page : accessed_pages)
+        {
+            auto slot = m_page_slots[page];
+
+            if (slot >= 0)
+            {
+                m_slots[slot].last_used = m_frame;
+            }
+            else
+            {
+                misses.push_back(page);
+            }
+        }
+
+        m_eviction_order_valid = false;
+    }
+
+    int TileCache::Insert(int page)
+    {
+        if (m_page_slots[page] >= 0)
+        {
+            return m_page_slots[page];
+        }
+
+        int slot = -1;
+
+        if (!m_free_slots.empty())
+        {
+            slot = m_free_slots.back();
+            m_free_slots.pop_back();
+        }
+        else
+        {
+            if (!m_eviction_order_valid)
+            {
+                // Pages used by the current frame can't be evicted
+                m_eviction_order.clear();
+                for (auto i = 0u; i < m_slots.size(); ++i)
+                {
+                    if (!m_slots[i].pinned && m_slots[i].last_used < m_frame)
+                    {
+                        m_eviction_order.push_back(static_cast<int>(i));
+                    }
+                }
+
+                std::sort(m_eviction_order.begin(), m_eviction_order.end(), [this](int a, int b)
+                {
+                    return m_slots[a].last_used > m_slots[b].last_used;
+                });
+
+                m_eviction_order_valid = true;
+            }
+
+            if (m_eviction_order.empty())
+            {
+                return -1;
+            }
+
+            slot = m_eviction_order.back();
+            m_eviction_order.pop_back();
+            m_page_slots[m_slots[slot].page] = -1;
+        }
+
+        m_slots[slot] = Slot{ page, m_frame, false };
+        m_page_slots[page] = slot;
+        return slot;
+    }
+
+    int TileCache::Pin(int page)
+    {
+        auto slot = Insert(page);
+
+        if (slot >= 0)
+        {
+            m_slots[slot].pinned = true;
+        }
+
+        return slot;
+    }
+}
@@ -0,0 +1,73 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace Baikal
+{
+    ///< Residency of virtual texture tiles (pages) in a fixed number of cache slots.
+    ///< Pages used by the last frame are kept, least recently used ones are
+    ///< evicted first. Pinned pages are never evicted.
+    ///<
+    class TileCache
+    {
+    public:
+        TileCache() = default;
+
+        // Drop all pages and set capacity
+        void Reset(std::size_t num_slots, std::size_t num_pages);
+
+        // Start new frame with the pages accessed during the last one,
+        // missing pages are returned in misses
+        void Update(std::vector<int> const& accessed_pages, std::vector<int>& misses);
+        // Make page resident, evicting least recently used page if needed.
+        // Returns slot index or -1 if all slots are in use by the current frame.
+        int Insert(int page);
+        // Make page resident and never evict it
+        int Pin(int page);
+
+        // Slot of a page, -1 if page is not resident
+        int GetSlot(int page) const { return m_page_slots[page]; }
+        std::size_t GetNumSlots() const { return m_slots.size(); }
+        std::size_t GetNumPages() const { return m_page_slots.size(); }
+
+    private:
+        struct Slot
+        {
+            int page;
+            std::uint64_t last_used;
+            bool pinned;
+        };
+
+        // Page to slot mapping
+        std::vector<int> m_page_slots;
+        std::vector<Slot> m_slots;
+        // Never used slots
+        std::vector<int> m_free_slots;
+        // Eviction candidates of the current frame, most recently used go first
+        std::vector<int> m_eviction_order;
+        bool m_eviction_order_valid = false;
+        std::uint64_t m_frame = 0;
+    };
+}
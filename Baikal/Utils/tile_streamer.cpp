@@ -0,0 +1,90 @@
+#include "tile_streamer.h"
+
+namespace Baikal
+{
+    TileStreamer::TileStreamer()
+        : m_busy(false)
+        , m_stop(false)
+    {
+        m_thread = std::thread(&TileStreamer::Run, this);
+    }
+
+    TileStreamer::~TileStreamer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+
+        m_condition.notify_one();
+        m_thread.join();
+    }
+
+    void TileStreamer::Push(std::vector<Request> const& requests)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            for (auto const& request : requests)
+            {
+                if (m_pending.insert(request.page).second)
+                {
+                    m_requests.push_back(request);
+                }
+            }
+        }
+
+        m_condition.notify_one();
+    }
+
+    void TileStreamer::Pop(std::vector<Tile>& tiles)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        for (auto const& tile : m_tiles)
+        {
+            m_pending.erase(tile.page);
+        }
+
+        tiles.swap(m_tiles);
+        m_tiles.clear();
+    }
+
+    void TileStreamer::Clear()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle.wait(lock, [this] { return !m_busy; });
+
+        m_requests.clear();
+        m_tiles.clear();
+        m_pending.clear();
+    }
+
+    void TileStreamer::Run()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        for (;;)
+        {
+            m_condition.wait(lock, [this] { return m_stop || !m_requests.empty(); });
+
+            if (m_stop)
+            {
+                return;
+            }
+
+            auto request = m_requests.front();
+            m_requests.pop_front();
+            m_busy = true;
+
+            // Copy without holding the lock, this is where the file is actually read
+            lock.unlock();
+            Tile tile{ request.page, std::vector<char>(request.source, request.source + request.size) };
+            lock.lock();
+
+            m_busy = false;
+            m_tiles.push_back(std::move(tile));
+            m_idle.notify_all();
+        }
+    }
+}
@@ -0,0 +1,85 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace Baikal
+{
+    ///< Background thread reading tiles from (memory mapped) files,
+    ///< so page faults and disk reads do not stall rendering.
+    ///<
+    class TileStreamer
+    {
+    public:
+        struct Request
+        {
+            // Page the tile is loaded for
+            int page;
+            // Tile data in mapped file
+            char const* source;
+            std::size_t size;
+        };
+
+        struct Tile
+        {
+            int page;
+            std::vector<char> data;
+        };
+
+        TileStreamer();
+        ~TileStreamer();
+
+        // Queue tiles for loading, pages which are already queued are skipped
+        void Push(std::vector<Request> const& requests);
+        // Get tiles loaded so far
+        void Pop(std::vector<Tile>& tiles);
+        // Drop all queued and loaded tiles, waits for the tile being
+        // loaded, so sources can be released afterwards
+        void Clear();
+
+        // Disallow copying
+        TileStreamer(TileStreamer const&) = delete;
+        TileStreamer& operator = (TileStreamer const&) = delete;
+
+    private:
+        void Run();
+
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        std::condition_variable m_idle;
+        std::deque<Request> m_requests;
+        std::vector<Tile> m_tiles;
+        // Pages queued or loaded, but not popped yet
+        std::unordered_set<int> m_pending;
+        // Worker is reading a tile
+        bool m_busy;
+        bool m_stop;
+        std::thread m_thread;
+    };
+}
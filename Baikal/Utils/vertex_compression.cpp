@@ -0,0 +1,82 @@
+#include "vertex_compression.h"
+
+#include "Utils/half.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Baikal
+{
+    using namespace RadeonRays;
+
+    std::uint32_t PackOctNormal(float3 const& n)
+    {
+        auto l = std::abs(n.x) + std::abs(n.y) + std::abs(n.z) + 1e-8f;
+        auto x = n.x / l;
+        auto y = n.y / l;
+
+        if (n.z < 0.f)
+        {
+            auto ox = x;
+            x = (1.f - std::abs(y)) * (ox >= 0.f ? 1.f : -1.f);
+            y = (1.f - std::abs(ox)) * (y >= 0.f ? 1.f : -1.f);
+        }
+
+        auto qx = static_cast<std::int32_t>(std::round(std::min(std::max(x, -1.f), 1.f) * 32767.f));
+        auto qy = static_cast<std::int32_t>(std::round(std::min(std::max(y, -1.f), 1.f) * 32767.f));
+        return (static_cast<std::uint32_t>(qx) & 0xFFFF) | (static_cast<std::uint32_t>(qy) << 16);
+    }
+
+    float3 UnpackOctNormal(std::uint32_t value)
+    {
+        auto x = static_cast<std::int16_t>(value & 0xFFFF) / 32767.f;
+        auto y = static_cast<std::int16_t>(value >> 16) / 32767.f;
+        float3 n(x, y, 1.f - std::abs(x) - std::abs(y));
+
+        if (n.z < 0.f)
+        {
+            n.x = (1.f - std::abs(y)) * (x >= 0.f ? 1.f : -1.f);
+            n.y = (1.f - std::abs(x)) * (y >= 0.f ? 1.f : -1.f);
+        }
+
+        return normalize(n);
+    }
+
+    void CompressVertices(float3 const* vertices, std::size_t num_vertices,
+                          float3 const* normals, std::size_t num_normals,
+                          float2 const* uvs, std::size_t num_uvs,
+                          CompactVertex* out, std::uint32_t* out_uvs)
+    {
+        for (auto i = 0u; i < num_vertices; ++i)
+        {
+            auto& v = out[i];
+            v.position[0] = vertices[i].x;
+            v.position[1] = vertices[i].y;
+            v.position[2] = vertices[i].z;
+            v.normal = i < num_normals ? PackOctNormal(normals[i]) : 0u;
+
+            if (i < num_uvs)
+            {
+                out_uvs[i] = static_cast<std::uint32_t>(half(uvs[i].x).bits()) |
+                    (static_cast<std::uint32_t>(half(uvs[i].y).bits()) << 16);
+            }
+            else
+            {
+                out_uvs[i] = 0u;
+            }
+        }
+    }
+
+    void DecompressVertex(CompactVertex const& vertex, std::uint32_t packed_uv,
+                          float3& position, float3& normal, float2& uv)
+    {
+        position = float3(vertex.position[0], vertex.position[1], vertex.position[2]);
+        normal = UnpackOctNormal(vertex.normal);
+
+        half u;
+        half v;
+        u.setBits(static_cast<unsigned short>(packed_uv & 0xFFFF));
+        v.setBits(static_cast<unsigned short>(packed_uv >> 16));
+        uv = float2(u, v);
+    }
+}
@@ -0,0 +1,59 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "math/float3.h"
+#include "math/float2.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Baikal
+{
+    ///< Compact vertex layout, 20 bytes instead of 40 bytes of separate float3
+    ///< position, float3 normal and float2 uv. Positions keep full precision,
+    ///< since shading points and ray origins are built from them. Octahedral
+    ///< encoded normal (2 x 16 bit snorm) takes the padding lane of the position,
+    ///< uv is a pair of half floats in a separate 4 byte stream.
+    ///<
+    struct CompactVertex
+    {
+        float position[3];
+        std::uint32_t normal;
+    };
+
+    static_assert(sizeof(CompactVertex) == sizeof(RadeonRays::float3), "CompactVertex should fit float3 pool element");
+
+    // Octahedral normal encoding, matches Output_PackOctNormal in kernels,
+    // also used by compact normal outputs
+    std::uint32_t PackOctNormal(RadeonRays::float3 const& n);
+    RadeonRays::float3 UnpackOctNormal(std::uint32_t value);
+
+    // Compress mesh vertices, missing normals and uvs are zeroed
+    void CompressVertices(RadeonRays::float3 const* vertices, std::size_t num_vertices,
+                          RadeonRays::float3 const* normals, std::size_t num_normals,
+                          RadeonRays::float2 const* uvs, std::size_t num_uvs,
+                          CompactVertex* out, std::uint32_t* out_uvs);
+    // Decompress single vertex
+    void DecompressVertex(CompactVertex const& vertex, std::uint32_t packed_uv,
+                          RadeonRays::float3& position, RadeonRays::float3& normal, RadeonRays::float2& uv);
+}
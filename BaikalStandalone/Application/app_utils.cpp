@@ -26,7 +26,7 @@ THE SOFTWARE.
 namespace
 {
     char const* kHelpMessage =
-        "Baikal [-p path_to_models][-f model_name][-b][-r][-ns number_of_shadow_rays][-ao ao_radius][-w window_width][-h window_height][-nb number_of_indirect_bounces]";
+        "Baikal [-p path_to_models][-f model_name][-b][-r][-ns number_of_shadow_rays][-ao ao_radius][-w window_width][-h window_height][-nb number_of_indirect_bounces][-estimator_benchmark]";
 }
 
 namespace Baikal
@@ -114,6 +114,9 @@ namespace Baikal
         char* light_set = GetCmdOption(argv, argv + argc, "-light_set");
         s.light_set = light_set ? light_set : s.light_set;
 
+        char* geometry_spill_path = GetCmdOption(argv, argv + argc, "-spill_path");
+        s.geometry_spill_path = geometry_spill_path ? geometry_spill_path : s.geometry_spill_path;
+
         char* interop = GetCmdOption(argv, argv + argc, "-interop");
         s.interop = interop ? (atoi(interop) > 0) : s.interop;
 
@@ -153,6 +156,11 @@ namespace Baikal
             s.cmd_line_mode = true;
         }
 
+        if (CmdOptionExists(argv, argv + argc, "-estimator_benchmark"))
+        {
+            s.estimator_benchmark = true;
+        }
+
         if (CmdOptionExists(argv, argv + argc, "-save_aov"))
         {
             s.save_aov = true;
@@ -219,6 +227,7 @@ namespace Baikal
         , aov_samples(2048)
         , save_aov(false)
         , light_set("")
+        , geometry_spill_path("")
 
         //app
         , progressive(false)
@@ -230,6 +239,7 @@ namespace Baikal
         , rt_benchmarked(false)
         , time_benchmark(false)
         , time_benchmark_time(0.f)
+        , estimator_benchmark(false)
         //unused
         , num_shadow_rays(1)
         , samplecount(0)
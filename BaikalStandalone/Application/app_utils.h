@@ -80,6 +80,9 @@ namespace Baikal
         //file with scene lights description
         std::string light_set;
 
+        //folder to spill mesh geometry to
+        std::string geometry_spill_path;
+
 
         //app
         bool progressive;
@@ -94,6 +97,8 @@ namespace Baikal
         bool rt_benchmarked;
         bool time_benchmark;
         float time_benchmark_time;
+        // Compare estimators in command line mode
+        bool estimator_benchmark;
 
         //unused
         int num_shadow_rays;
@@ -633,6 +633,13 @@ namespace Baikal
             std::cout << "\tPrimary: " << m_settings.stats.primary_throughput * 1e-6f << " Mrays/s\n";
             std::cout << "\tSecondary: " << m_settings.stats.secondary_throughput * 1e-6f << " Mrays/s\n";
             std::cout << "\tShadow: " << m_settings.stats.shadow_throughput * 1e-6f << " Mrays/s\n";
+            std::cout << "\tSecondary sorted: " << m_settings.stats.sorted_secondary_throughput * 1e-6f << " Mrays/s\n";
+            std::cout << "\tRay sorting: " << m_settings.stats.ray_sort_time << " ms\n";
+
+            if (m_settings.estimator_benchmark)
+            {
+                m_cl->RunEstimatorBenchmark(m_settings);
+            }
         }
     }
 
@@ -642,6 +649,9 @@ namespace Baikal
         static float focal_length = 35.f;
         static float focus_distance = 1.f;
         static int num_bounces = 5;
+        static bool compacted_launch = false;
+        static bool material_sorting = false;
+        static bool ray_sorting = false;
         static char const* outputs =
             "Color\0"
             "World position\0"
@@ -679,6 +689,9 @@ namespace Baikal
             ImGui::Text("Number of instances: %d", m_num_instances);
             ImGui::Separator();
             ImGui::SliderInt("GI bounces", &num_bounces, 1, 10);
+            auto compacted_launch_changed = ImGui::Checkbox("Compacted launches", &compacted_launch);
+            auto material_sorting_changed = ImGui::Checkbox("Sort hits by material", &material_sorting);
+            auto ray_sorting_changed = ImGui::Checkbox("Sort secondary rays", &ray_sorting);
             ImGui::SliderFloat("Aperture(mm)", &aperture, 0.0f, 100.0f);
             ImGui::SliderFloat("Focal length(mm)", &focal_length, 5.f, 200.0f);
             ImGui::SliderFloat("Focus distance(m)", &focus_distance, 0.05f, 20.f);
@@ -712,6 +725,21 @@ namespace Baikal
                 update = true;
             }
 
+            if (compacted_launch_changed)
+            {
+                m_cl->SetCompactedLaunch(compacted_launch);
+            }
+
+            if (material_sorting_changed)
+            {
+                m_cl->SetMaterialSorting(material_sorting);
+            }
+
+            if (ray_sorting_changed)
+            {
+                m_cl->SetRaySorting(ray_sorting);
+            }
+
             auto gui_out_type = static_cast<Baikal::Renderer::OutputType>(output);
 
             if (gui_out_type != m_cl->GetOutputType())
@@ -725,6 +753,15 @@ namespace Baikal
             ImGui::Text("Number of samples: %d", m_settings.samplecount);
             ImGui::Text("Frame time %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
             ImGui::Text("Renderer performance %.3f Msamples/s", (ImGui::GetIO().Framerate *m_settings.width * m_settings.height) / 1000000.f);
+
+            if (compacted_launch)
+            {
+                auto active_rays = m_cl->GetActiveRayCounts();
+                for (auto i = 0u; i < active_rays.size(); ++i)
+                {
+                    ImGui::Text("Bounce %u active rays: %u", i, active_rays[i]);
+                }
+            }
             ImGui::Separator();
 
             if (m_settings.time_benchmark)
@@ -784,6 +821,8 @@ namespace Baikal
                 ImGui::Text("Primary rays: %f Mrays/s", stats.primary_throughput * 1e-6f);
                 ImGui::Text("Secondary rays: %f Mrays/s", stats.secondary_throughput * 1e-6f);
                 ImGui::Text("Shadow rays: %f Mrays/s", stats.shadow_throughput * 1e-6f);
+                ImGui::Text("Sorted secondary rays: %f Mrays/s", stats.sorted_secondary_throughput * 1e-6f);
+                ImGui::Text("Ray sorting: %f ms", stats.ray_sort_time);
             }
 
 #ifdef ENABLE_DENOISER
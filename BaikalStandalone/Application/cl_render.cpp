@@ -62,12 +62,12 @@ namespace Baikal
         //create cl context
         try
         {
-            ConfigManager::CreateConfigs(settings.mode, settings.interop, m_cfgs, settings.num_bounces);
+            ConfigManager::CreateConfigs(settings.mode, settings.interop, m_cfgs, settings.num_bounces, settings.geometry_spill_path);
         }
         catch (CLWException &)
         {
             force_disable_itnerop = true;
-            ConfigManager::CreateConfigs(settings.mode, false, m_cfgs, settings.num_bounces);
+            ConfigManager::CreateConfigs(settings.mode, false, m_cfgs, settings.num_bounces, settings.geometry_spill_path);
         }
 
 
@@ -166,9 +166,12 @@ namespace Baikal
             // Load OBJ scene
             bool is_fbx = filename.find(".fbx") != std::string::npos;
             bool is_gltf = filename.find(".gltf") != std::string::npos;
+            bool is_binary = filename.find(".bxs") != std::string::npos;
             std::unique_ptr<Baikal::SceneIo> scene_io;
             if (is_gltf)
                 scene_io = Baikal::SceneIo::CreateSceneIoGltf();
+            else if (is_binary)
+                scene_io = Baikal::SceneIo::CreateSceneIoBinary();
             else
                 scene_io = is_fbx ? Baikal::SceneIo::CreateSceneIoFbx() : Baikal::SceneIo::CreateSceneIoObj();
             auto scene_io1 = Baikal::SceneIo::CreateSceneIoTest();
@@ -612,6 +615,7 @@ namespace Baikal
         auto output = m_outputs[cd.idx].output.get();
 
         auto updatetime = std::chrono::high_resolution_clock::now();
+        bool readback_requested = false;
 
         while (!cd.stop.load())
         {
@@ -632,10 +636,18 @@ namespace Baikal
 
             update = update || (std::chrono::duration_cast<std::chrono::seconds>(now - updatetime).count() > 1);
 
-            if (update)
+            // Copy is done asynchronously, rendering continues meanwhile
+            if (update && !readback_requested)
             {
-                m_outputs[cd.idx].output->GetData(&m_outputs[cd.idx].fdata[0]);
+                output->RequestData();
+                readback_requested = true;
                 updatetime = now;
+            }
+
+            if (readback_requested && output->IsDataReady())
+            {
+                output->GetRequestedData(&m_outputs[cd.idx].fdata[0]);
+                readback_requested = false;
                 cd.newdata.store(1);
             }
 
@@ -715,6 +727,69 @@ namespace Baikal
         static_cast<MonteCarloRenderer*>(m_cfgs[m_primary].renderer.get())->Benchmark(scene, settings.stats);
     }
 
+    void AppClRender::RunEstimatorBenchmark(AppSettings& settings)
+    {
+        std::cout << "Running estimator benchmark...\n";
+
+        auto& config = m_cfgs[m_primary];
+        auto& scene = config.controller->GetCachedScene(m_scene);
+
+        using RendererType = Baikal::RenderFactory<Baikal::ClwScene>::RendererType;
+
+        struct Variant
+        {
+            char const* name;
+            RendererType type;
+        };
+
+        Variant const variants[] =
+        {
+            { "Wavefront", RendererType::kUnidirectionalPathTracer },
+            { "Persistent", RendererType::kPersistentPathTracer }
+        };
+
+        // Launch overhead matters most for small batches, so go down from the window size
+        int const divisors[] = { 16, 8, 4, 2, 1 };
+        auto const num_frames = 32;
+
+        for (auto divisor : divisors)
+        {
+            auto width = std::max(settings.width / divisor, 1);
+            auto height = std::max(settings.height / divisor, 1);
+
+            std::cout << "\t" << width << "x" << height << ":";
+
+            for (auto const& variant : variants)
+            {
+                auto renderer = config.factory->CreateRenderer(variant.type);
+                auto output = config.factory->CreateOutput(width, height);
+                renderer->SetOutput(Renderer::OutputType::kColor, output.get());
+                static_cast<MonteCarloRenderer*>(renderer.get())->SetMaxBounces(settings.num_bounces);
+                renderer->Clear(float3(0, 0, 0), *output);
+
+                // Warm up: compile kernels and allocate work buffers
+                renderer->Render(scene);
+                config.context.Finish(0);
+
+                auto start_time = std::chrono::high_resolution_clock::now();
+
+                for (auto i = 0; i < num_frames; ++i)
+                {
+                    renderer->Render(scene);
+                }
+
+                config.context.Finish(0);
+
+                auto delta = std::chrono::duration_cast<std::chrono::microseconds>
+                    (std::chrono::high_resolution_clock::now() - start_time).count();
+
+                std::cout << " " << variant.name << " " << delta / 1000.f / num_frames << " ms/frame";
+            }
+
+            std::cout << "\n";
+        }
+    }
+
     void AppClRender::SetNumBounces(int num_bounces)
     {
         for (int i = 0; i < m_cfgs.size(); ++i)
@@ -723,6 +798,40 @@ namespace Baikal
         }
     }
 
+    void AppClRender::SetCompactedLaunch(bool enable)
+    {
+        for (int i = 0; i < m_cfgs.size(); ++i)
+        {
+            static_cast<Baikal::MonteCarloRenderer*>(m_cfgs[i].renderer.get())->SetCompactedLaunch(enable);
+        }
+    }
+
+    void AppClRender::SetMaterialSorting(bool enable)
+    {
+        for (int i = 0; i < m_cfgs.size(); ++i)
+        {
+            static_cast<Baikal::MonteCarloRenderer*>(m_cfgs[i].renderer.get())->SetMaterialSorting(enable);
+        }
+    }
+
+    void AppClRender::SetRaySorting(bool enable)
+    {
+        for (int i = 0; i < m_cfgs.size(); ++i)
+        {
+            auto renderer = static_cast<Baikal::MonteCarloRenderer*>(m_cfgs[i].renderer.get());
+
+            for (auto bounce = 1u; bounce < 32u; ++bounce)
+            {
+                renderer->SetRaySorting(bounce, enable);
+            }
+        }
+    }
+
+    std::vector<std::uint32_t> AppClRender::GetActiveRayCounts()
+    {
+        return static_cast<Baikal::MonteCarloRenderer*>(m_cfgs[m_primary].renderer.get())->GetActiveRayCounts();
+    }
+
     void AppClRender::SetOutputType(Renderer::OutputType type)
     {
         for (int i = 0; i < m_cfgs.size(); ++i)
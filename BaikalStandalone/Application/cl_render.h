@@ -82,6 +82,8 @@ namespace Baikal
         void StartRenderThreads();
         void StopRenderThreads();
         void RunBenchmark(AppSettings& settings);
+        // Compare wavefront and persistent threads estimators at several resolutions
+        void RunEstimatorBenchmark(AppSettings& settings);
 
         //save cl frame buffer to file
         void SaveFrameBuffer(AppSettings& settings);
@@ -95,6 +97,12 @@ namespace Baikal
         Renderer::OutputType GetOutputType() { return m_output_type; };
 
         void SetNumBounces(int num_bounces);
+        void SetCompactedLaunch(bool enable);
+        void SetMaterialSorting(bool enable);
+        // Sort rays of all secondary bounces
+        void SetRaySorting(bool enable);
+        // Active rays per bounce of the primary device
+        std::vector<std::uint32_t> GetActiveRayCounts();
         void SetOutputType(Renderer::OutputType type);
         //this will enable additional aov outputs
         void EnableOutputType(Renderer::OutputType type);
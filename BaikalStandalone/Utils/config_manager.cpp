@@ -39,7 +39,7 @@ THE SOFTWARE.
 #include <GL/glx.h>
 #endif
 
-void ConfigManager::CreateConfigs(Mode mode, bool interop, std::vector<Config>& configs, int initial_num_bounces)
+void ConfigManager::CreateConfigs(Mode mode, bool interop, std::vector<Config>& configs, int initial_num_bounces, std::string const& geometry_spill_path)
 {
     std::vector<CLWPlatform> platforms;
 
@@ -151,14 +151,16 @@ void ConfigManager::CreateConfigs(Mode mode, bool interop, std::vector<Config>&
 
     for (int i = 0; i < configs.size(); ++i)
     {
-        configs[i].factory = std::make_unique<Baikal::ClwRenderFactory>(configs[i].context);
+        auto factory = std::make_unique<Baikal::ClwRenderFactory>(configs[i].context);
+        factory->SetGeometrySpillPath(geometry_spill_path);
+        configs[i].factory = std::move(factory);
         configs[i].controller = configs[i].factory->CreateSceneController();
         configs[i].renderer = configs[i].factory->CreateRenderer(Baikal::ClwRenderFactory::RendererType::kUnidirectionalPathTracer);
     }
 }
 
 #else
-void ConfigManager::CreateConfigs(Mode mode, bool interop, std::vector<Config>& configs, int initial_num_bounces)
+void ConfigManager::CreateConfigs(Mode mode, bool interop, std::vector<Config>& configs, int initial_num_bounces, std::string const& geometry_spill_path)
 {
     std::vector<CLWPlatform> platforms;
 
@@ -207,7 +209,9 @@ void ConfigManager::CreateConfigs(Mode mode, bool interop, std::vector<Config>&
 
     for (int i = 0; i < configs.size(); ++i)
     {
-        configs[i].factory = std::make_unique<Baikal::ClwRenderFactory>(configs[i].context);
+        auto factory = std::make_unique<Baikal::ClwRenderFactory>(configs[i].context);
+        factory->SetGeometrySpillPath(geometry_spill_path);
+        configs[i].factory = std::move(factory);
         configs[i].controller = configs[i].factory->CreateSceneController();
         configs[i].renderer = configs[i].factory->CreateRenderer(Baikal::ClwRenderFactory::RendererType::kUnidirectionalPathTracer);
     }
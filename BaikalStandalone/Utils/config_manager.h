@@ -27,6 +27,7 @@ THE SOFTWARE.
 #include "Renderers/renderer.h"
 #include <vector>
 #include <memory>
+#include <string>
 
 namespace Baikal
 {
@@ -70,7 +71,8 @@ public:
         }
     };
 
-    static void CreateConfigs(Mode mode, bool interop, std::vector<Config>& renderers, int initial_num_bounces);
+    static void CreateConfigs(Mode mode, bool interop, std::vector<Config>& renderers, int initial_num_bounces,
+                              std::string const& geometry_spill_path = "");
 
 private:
 
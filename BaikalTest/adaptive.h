@@ -0,0 +1,230 @@
+/**********************************************************************
+ Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ********************************************************************/
+#pragma once
+
+#include "basic.h"
+#include "Renderers/adaptive_renderer.h"
+#include "Output/clwoutput.h"
+
+class AdaptiveTest : public BasicTest
+{
+public:
+    // Output is split into 16x16 tiles for variance estimation
+    static int constexpr kNumTilesX = 4;
+    static int constexpr kNumTilesY = 2;
+    static int constexpr kNumTiles = kNumTilesX * kNumTilesY;
+
+    virtual void SetUp()
+    {
+        BasicTest::SetUp();
+
+        if (HasFatalFailure())
+        {
+            return;
+        }
+
+        ASSERT_NO_THROW(m_renderer = m_factory->CreateRenderer(Baikal::ClwRenderFactory::RendererType::kAdaptive));
+        ASSERT_NO_THROW(m_output = m_factory->CreateOutput(kNumTilesX * 16, kNumTilesY * 16));
+        ASSERT_NO_THROW(m_renderer->SetOutput(Baikal::Renderer::OutputType::kColor, m_output.get()));
+        ASSERT_NO_THROW(m_renderer->SetRandomSeed(0));
+    }
+
+    // Factory creates adaptive renderer, tests reach its internals directly
+    Baikal::AdaptiveRenderer& GetAdaptiveRenderer()
+    {
+        return static_cast<Baikal::AdaptiveRenderer&>(*m_renderer);
+    }
+
+    // Build tile distribution from given tile errors and read it back
+    void BuildTileDistribution(std::vector<float> const& tile_error, float threshold,
+                               std::vector<int>& distribution, std::vector<int>& converged)
+    {
+        auto& renderer = GetAdaptiveRenderer();
+
+        m_context.WriteBuffer(0, renderer.GetVarianceBuffer(), &tile_error[0], tile_error.size()).Wait();
+        renderer.UpdateTileDistribution(threshold);
+
+        distribution.resize(2 + 2 * kNumTiles);
+        converged.resize(kNumTiles);
+        m_context.ReadBuffer(0, renderer.GetTileDistributionBuffer(), &distribution[0], distribution.size()).Wait();
+        m_context.ReadBuffer(0, renderer.GetConvergedBuffer(), &converged[0], converged.size()).Wait();
+        m_context.Finish(0);
+    }
+};
+
+TEST_F(AdaptiveTest, Adaptive_TileDistribution)
+{
+    std::vector<float> tile_error = { 0.5f, 0.01f, 1.f, 0.02f, 2.f, 0.5f, 0.03f, 1.f };
+    float const threshold = 0.1f;
+
+    std::vector<int> distribution;
+    std::vector<int> converged;
+    BuildTileDistribution(tile_error, threshold, distribution, converged);
+
+    ASSERT_EQ(distribution[0], static_cast<int>(kNumTiles));
+    auto cdf = reinterpret_cast<float const*>(&distribution[1]);
+    auto pdf = cdf + kNumTiles + 1;
+
+    // Host reference, converged tiles do not receive samples
+    float total = 0.f;
+    for (auto value : tile_error)
+    {
+        total += value < threshold ? 0.f : value;
+    }
+
+    float running = 0.f;
+    for (auto i = 0; i < kNumTiles; ++i)
+    {
+        auto value = tile_error[i] < threshold ? 0.f : tile_error[i];
+
+        ASSERT_EQ(converged[i], tile_error[i] < threshold ? 1 : 0);
+        ASSERT_NEAR(cdf[i], running / total, 1e-5f);
+        ASSERT_NEAR(pdf[i], value * kNumTiles / total, 1e-4f);
+
+        running += value;
+    }
+
+    ASSERT_EQ(cdf[kNumTiles], 1.f);
+    ASSERT_FALSE(m_renderer->IsConverged());
+}
+
+TEST_F(AdaptiveTest, Adaptive_ConvergenceMask)
+{
+    std::vector<int> distribution;
+    std::vector<int> converged;
+    BuildTileDistribution({ 0.5f, 0.01f, 1.f, 0.02f, 2.f, 0.5f, 0.03f, 1.f }, 0.1f, distribution, converged);
+
+    // Converged tiles stay converged even if their estimate goes up
+    std::vector<float> tile_error(kNumTiles, 0.05f);
+    tile_error[1] = 5.f;
+    BuildTileDistribution(tile_error, 0.1f, distribution, converged);
+
+    for (auto i = 0; i < kNumTiles; ++i)
+    {
+        ASSERT_EQ(converged[i], 1);
+    }
+
+    // Everything has converged, distribution falls back to uniform one
+    auto cdf = reinterpret_cast<float const*>(&distribution[1]);
+    auto pdf = cdf + kNumTiles + 1;
+    for (auto i = 0; i < kNumTiles; ++i)
+    {
+        ASSERT_NEAR(cdf[i], static_cast<float>(i) / kNumTiles, 1e-5f);
+        ASSERT_EQ(pdf[i], 1.f);
+    }
+
+    // Convergence is visible through renderer interface
+    ASSERT_TRUE(m_renderer->IsConverged());
+
+    // Clear starts over
+    ClearOutput();
+    ASSERT_FALSE(m_renderer->IsConverged());
+}
+
+TEST_F(AdaptiveTest, Adaptive_Moments)
+{
+    using namespace RadeonRays;
+
+    auto& renderer = GetAdaptiveRenderer();
+    auto width = static_cast<int>(m_output->width());
+    auto height = static_cast<int>(m_output->height());
+    auto num_pixels = width * height;
+
+    // Every pixel gets several samples within a single launch
+    int const num_samples_per_pixel = 4;
+    auto num_samples = num_pixels * num_samples_per_pixel;
+
+    std::vector<float3> samples(num_samples);
+    std::vector<int> indices(num_samples);
+    for (auto i = 0; i < num_samples; ++i)
+    {
+        samples[i] = float3(rand_float(), rand_float(), rand_float()) * 4.f;
+        indices[i] = (i * 7) % num_pixels;
+    }
+
+    if (renderer.m_estimator->GetWorkBufferSize() < static_cast<std::size_t>(num_samples))
+    {
+        renderer.m_estimator->SetWorkBufferSize(num_samples);
+    }
+
+    auto sample_buffer = m_context.CreateBuffer<float3>(num_samples, CL_MEM_READ_ONLY);
+    m_context.WriteBuffer(0, sample_buffer, &samples[0], num_samples).Wait();
+    m_context.WriteBuffer(0, renderer.m_estimator->GetOutputIndexBuffer(), &indices[0], num_samples).Wait();
+
+    ClearOutput();
+    renderer.AccumulateSamples(sample_buffer, static_cast<Baikal::ClwOutput*>(m_output.get())->data(), num_samples);
+    renderer.EstimateVariance(renderer.GetMomentsBuffer(), width, height);
+
+    std::vector<float3> moments(num_pixels);
+    std::vector<float3> accumulated(num_pixels);
+    std::vector<float> tile_error(kNumTiles);
+    m_context.ReadBuffer(0, renderer.GetMomentsBuffer(), &moments[0], num_pixels).Wait();
+    m_context.ReadBuffer(0, static_cast<Baikal::ClwOutput*>(m_output.get())->data(), &accumulated[0], num_pixels).Wait();
+    m_context.ReadBuffer(0, renderer.GetVarianceBuffer(), &tile_error[0], kNumTiles).Wait();
+
+    // Host reference
+    std::vector<float3> reference_moments(num_pixels);
+    std::vector<float3> reference_accumulated(num_pixels);
+    for (auto i = 0; i < num_samples; ++i)
+    {
+        auto value = 0.2126f * samples[i].x + 0.7152f * samples[i].y + 0.0722f * samples[i].z;
+        reference_moments[indices[i]] += float3(1.f, value, value * value);
+        reference_accumulated[indices[i]] += float3(samples[i].x, samples[i].y, samples[i].z, 1.f);
+    }
+
+    std::vector<float> reference_tile_error(kNumTiles, 0.f);
+    for (auto i = 0; i < num_pixels; ++i)
+    {
+        ASSERT_EQ(moments[i].x, reference_moments[i].x);
+        ASSERT_NEAR(moments[i].y, reference_moments[i].y, 1e-4f * reference_moments[i].y);
+        ASSERT_NEAR(moments[i].z, reference_moments[i].z, 1e-4f * reference_moments[i].z);
+        ASSERT_EQ(accumulated[i].w, reference_accumulated[i].w);
+        ASSERT_NEAR(accumulated[i].x, reference_accumulated[i].x, 1e-4f * reference_accumulated[i].x);
+
+        // Relative error of pixel mean, averaged over 16x16 tiles
+        auto const& m = reference_moments[i];
+        auto mean = m.y / m.x;
+        auto variance = std::max(m.z - m.y * mean, 0.f) / (m.x - 1.f);
+        auto tile = (i / width / 16) * kNumTilesX + (i % width) / 16;
+        reference_tile_error[tile] += std::sqrt(variance / m.x) / (mean + 0.1f) / 256.f;
+    }
+
+    for (auto i = 0; i < kNumTiles; ++i)
+    {
+        // Kernel uses native_sqrt
+        ASSERT_NEAR(tile_error[i], reference_tile_error[i], 1e-2f * reference_tile_error[i]);
+    }
+}
+
+TEST_F(AdaptiveTest, Adaptive_AovOnly)
+{
+    auto aov = m_factory->CreateOutput(m_output->width(), m_output->height());
+
+    ASSERT_NO_THROW(m_renderer->SetOutput(Baikal::Renderer::OutputType::kColor, nullptr));
+    ASSERT_NO_THROW(m_renderer->SetOutput(Baikal::Renderer::OutputType::kWorldShadingNormal, aov.get()));
+
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+    auto& scene = m_controller->GetCachedScene(m_scene);
+
+    ASSERT_NO_THROW(m_renderer->Render(scene));
+    ASSERT_NO_THROW(m_renderer->SetOutput(Baikal::Renderer::OutputType::kWorldShadingNormal, nullptr));
+}
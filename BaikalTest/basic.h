@@ -25,9 +25,12 @@ THE SOFTWARE.
 
 #include "CLW.h"
 #include "Renderers/renderer.h"
+#include "Renderers/monte_carlo_renderer.h"
 #include "RenderFactory/clw_render_factory.h"
 #include "Output/output.h"
 #include "SceneGraph/camera.h"
+#include "SceneGraph/material.h"
+#include "SceneGraph/shape.h"
 #include "SceneGraph/IO/scene_io.h"
 
 #include "OpenImageIO/imageio.h"
@@ -113,6 +116,7 @@ public:
         auto platform = platforms[platform_index];
         auto device = platform.GetDevice(device_index);
         auto context = CLWContext::Create(device);
+        m_context = context;
 
         ASSERT_NO_THROW(m_factory = std::make_unique<Baikal::ClwRenderFactory>(context, "cache"));
         ASSERT_NO_THROW(m_renderer = m_factory->CreateRenderer(Baikal::ClwRenderFactory::RendererType::kUnidirectionalPathTracer));
@@ -270,6 +274,7 @@ public:
         return std::find(begin, end, option) != end;
     }
 
+    CLWContext m_context;
     std::unique_ptr<Baikal::Renderer> m_renderer;
     std::unique_ptr<Baikal::SceneController<Baikal::ClwScene>> m_controller;
     std::unique_ptr<Baikal::RenderFactory<Baikal::ClwScene>> m_factory;
@@ -308,6 +313,125 @@ TEST_F(BasicTest, RenderTestScene)
     ASSERT_TRUE(CompareToReference(test_name() + ".png"));
 }
 
+TEST_F(BasicTest, WorkBufferBudget)
+{
+    auto& renderer = static_cast<Baikal::MonteCarloRenderer&>(*m_renderer);
+    auto item_size = renderer.m_estimator->GetWorkBufferItemSize();
+
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+    auto& scene = m_controller->GetCachedScene(m_scene);
+
+    // Budget for 20 rows splits the output into row tiles
+    renderer.SetWorkBufferBudget(item_size * kOutputWidth * 20);
+    ASSERT_EQ(renderer.GetWorkBufferBudget(), item_size * kOutputWidth * 20);
+
+    ClearOutput();
+    ASSERT_NO_THROW(m_renderer->Render(scene));
+
+    ASSERT_EQ(renderer.m_tile_size.x, static_cast<int>(kOutputWidth));
+    ASSERT_EQ(renderer.m_tile_size.y, 20);
+    ASSERT_GE(renderer.m_estimator->GetWorkBufferSize(), kOutputWidth * 20);
+    ASSERT_LE(renderer.m_estimator->GetWorkBufferSize(), 2 * kOutputWidth * 20);
+
+    // Every pixel is covered by exactly one tile
+    std::vector<RadeonRays::float3> data(kOutputWidth * kOutputHeight);
+    m_output->GetData(&data[0]);
+    for (auto const& pixel : data)
+    {
+        ASSERT_EQ(pixel.w, 1.f);
+    }
+
+    // Budget below the minimum work buffer size (64 x 64 items) is rounded up
+    renderer.SetWorkBufferBudget(1);
+    ASSERT_NO_THROW(m_renderer->Render(scene));
+
+    ASSERT_EQ(renderer.m_tile_size.x, static_cast<int>(kOutputWidth));
+    ASSERT_EQ(renderer.m_tile_size.y, 64 * 64 / static_cast<int>(kOutputWidth));
+}
+
+// Editing geometry of a single mesh should only move that mesh in the pools,
+// geometry which does not fit triggers a repack of everything.
+TEST_F(BasicTest, Scene_IncrementalGeometryUpdate)
+{
+    using namespace RadeonRays;
+
+    auto material = Baikal::SingleBxdf::Create(Baikal::SingleBxdf::BxdfType::kLambert);
+
+    float3 vertices[] = { float3(0.f, 0.f, 0.f), float3(1.f, 0.f, 0.f), float3(0.f, 1.f, 0.f) };
+    float3 normals[] = { float3(0.f, 0.f, -1.f), float3(0.f, 0.f, -1.f), float3(0.f, 0.f, -1.f) };
+    float2 uvs[] = { float2(0.f, 0.f), float2(1.f, 0.f), float2(0.f, 1.f) };
+    std::uint32_t indices[] = { 0, 1, 2 };
+
+    std::vector<Baikal::Mesh::Ptr> meshes;
+    for (auto i = 0u; i < 3; ++i)
+    {
+        auto mesh = Baikal::Mesh::Create();
+        mesh->SetVertices(vertices, 3);
+        mesh->SetNormals(normals, 3);
+        mesh->SetUVs(uvs, 3);
+        mesh->SetIndices(indices, 3);
+        mesh->SetMaterial(material);
+        m_scene->AttachShape(mesh);
+        meshes.push_back(mesh);
+    }
 
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+    auto& scene = m_controller->GetCachedScene(m_scene);
+
+    auto allocations = scene.mesh_allocations;
+    auto vertex_capacity = scene.vertex_allocator.GetCapacity();
+    auto index_capacity = scene.index_allocator.GetCapacity();
 
+    // Same sized geometry goes back into the range it has been released from
+    auto edited = meshes[1];
+    float3 moved[] = { float3(0.f, 0.f, 1.f), float3(1.f, 0.f, 1.f), float3(0.f, 1.f, 1.f) };
+    edited->SetVertices(moved, 3);
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+    ASSERT_EQ(scene.vertex_allocator.GetCapacity(), vertex_capacity);
+    ASSERT_EQ(scene.index_allocator.GetCapacity(), index_capacity);
+    ASSERT_EQ(scene.mesh_allocations.size(), allocations.size());
 
+    for (auto const& item : allocations)
+    {
+        auto const& allocation = scene.mesh_allocations.at(item.first);
+
+        if (item.first == edited)
+        {
+            ASSERT_EQ(allocation.geometry_version, edited->GetGeometryVersion());
+            continue;
+        }
+
+        ASSERT_EQ(allocation.vertex_offset, item.second.vertex_offset);
+        ASSERT_EQ(allocation.index_offset, item.second.index_offset);
+        ASSERT_EQ(allocation.geometry_version, item.second.geometry_version);
+    }
+
+    // Geometry larger than the pools forces them to grow and repack
+    std::vector<float3> large_vertices(vertex_capacity + 1, float3(0.f, 0.f, 0.f));
+    std::vector<float3> large_normals(vertex_capacity + 1, float3(0.f, 0.f, -1.f));
+    std::vector<float2> large_uvs(vertex_capacity + 1, float2(0.f, 0.f));
+    edited->SetVertices(&large_vertices[0], large_vertices.size());
+    edited->SetNormals(&large_normals[0], large_normals.size());
+    edited->SetUVs(&large_uvs[0], large_uvs.size());
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+    ASSERT_GT(scene.vertex_allocator.GetCapacity(), vertex_capacity);
+
+    // Repacked ranges stay inside the pools and do not overlap
+    std::vector<std::pair<std::size_t, std::size_t>> ranges;
+    for (auto const& item : scene.mesh_allocations)
+    {
+        auto const& allocation = item.second;
+        ASSERT_NE(allocation.vertex_offset, Baikal::RangeAllocator::kInvalidOffset);
+        ASSERT_LE(allocation.vertex_offset + allocation.num_vertices, scene.vertex_allocator.GetCapacity());
+        ASSERT_LE(allocation.index_offset + allocation.num_indices, scene.index_allocator.GetCapacity());
+        ranges.emplace_back(allocation.vertex_offset, allocation.num_vertices);
+    }
+
+    std::sort(ranges.begin(), ranges.end());
+    for (auto i = 1u; i < ranges.size(); ++i)
+    {
+        ASSERT_LE(ranges[i - 1].first + ranges[i - 1].second, ranges[i].first);
+    }
+}
@@ -21,12 +21,54 @@ THE SOFTWARE.
 ********************************************************************/
 #include "gtest/gtest.h"
 
+#include "Baikal/Output/output.h"
 #include "Baikal/Utils/distribution1d.h"
+#include "Baikal/Utils/distribution2d.h"
+#include "Baikal/Utils/light_bvh.h"
+#include "Baikal/Utils/range_allocator.h"
+#include "Baikal/Utils/thread_pool.h"
+#include "Baikal/Utils/tile_cache.h"
+#include "Baikal/Utils/vertex_compression.h"
+#include "Baikal/SceneGraph/IO/tiled_image.h"
+#include "Baikal/SceneGraph/IO/scene_io.h"
+#include "Baikal/SceneGraph/IO/obj_parser.h"
+#include "Baikal/SceneGraph/Collector/collector.h"
+#include "Baikal/SceneGraph/iterator.h"
+#include "Baikal/SceneGraph/material.h"
+#include "Baikal/SceneGraph/scene1.h"
+#include "Baikal/SceneGraph/shape.h"
+#include "Baikal/SceneGraph/light.h"
+#include "Baikal/SceneGraph/camera.h"
+#include "Baikal/SceneGraph/texture.h"
 #include "math/mathutils.h"
 
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
 class InternalTest : public ::testing::Test
 {
+public:
+    // Test files go to system temp directory, not to the working one
+    static std::string GetTempFilePath(std::string const& name)
+    {
+        for (auto var : { "TMPDIR", "TMP", "TEMP" })
+        {
+            if (auto dir = std::getenv(var))
+            {
+                return std::string(dir) + "/" + name;
+            }
+        }
 
+#ifdef _WIN32
+        return name;
+#else
+        return "/tmp/" + name;
+#endif
+    }
 };
 
 TEST_F(InternalTest, Distribuiton1D)
@@ -46,4 +88,881 @@ TEST_F(InternalTest, Distribuiton1D)
     }
 
     cnts[0] += cnts[1];
-}
\ No newline at end of file
+}
+TEST_F(InternalTest, Distribution2D)
+{
+    // Single bright cell in 4x2 grid
+    float vals[] = { 1, 1, 1, 1,
+                     1, 1, 10, 1 };
+    Baikal::Distribution2D dist(vals, 4, 2);
+
+    int bright = 0;
+
+    for (auto i = 0u; i < 1000; ++i)
+    {
+        float x = 0.f, y = 0.f, pdf = 0.f;
+        dist.Sample2D(RadeonRays::rand_float(), RadeonRays::rand_float(), x, y, pdf);
+
+        // Sampling PDF should match evaluated one
+        ASSERT_NEAR(pdf, dist.pdf(x, y), 1e-4f);
+
+        bright += (std::min((int)(x * 4), 3) == 2 && std::min((int)(y * 2), 1) == 1) ? 1 : 0;
+    }
+
+    // Bright cell holds 10/17 of the integral
+    ASSERT_GT(bright, 450);
+    ASSERT_NEAR(dist.pdf(0.6f, 0.6f), 10.f / (17.f / 8.f), 1e-4f);
+}
+
+TEST_F(InternalTest, Collector_StableIndices)
+{
+    using namespace Baikal;
+
+    std::vector<SceneObject::Ptr> materials;
+    for (auto i = 0u; i < 4; ++i)
+    {
+        materials.push_back(SingleBxdf::Create(SingleBxdf::BxdfType::kLambert));
+    }
+
+    auto collect = [](Collector& collector, std::vector<SceneObject::Ptr> items)
+    {
+        ContainerIterator<std::vector<SceneObject::Ptr>> iter(std::move(items));
+        collector.Collect(iter, [](SceneObject::Ptr item) { return std::vector<SceneObject::Ptr>{ item }; });
+        collector.Commit();
+    };
+
+    Collector collector;
+    collect(collector, materials);
+    std::unique_ptr<Bundle> bundle(collector.CreateBundle());
+    collector.Finalize([](SceneObject::Ptr item) { item->SetDirty(false); });
+
+    for (auto i = 0u; i < materials.size(); ++i)
+    {
+        ASSERT_EQ(collector.GetItemIndex(materials[i]), i);
+    }
+
+    // Same set: no update is needed
+    collect(collector, materials);
+    ASSERT_FALSE(collector.NeedsUpdate(bundle.get(), [](SceneObject::Ptr item) { return item->IsDirty(); }));
+
+    // Dirty object requires update, but keeps its index
+    materials[2]->SetDirty(true);
+    collect(collector, materials);
+    ASSERT_TRUE(collector.NeedsUpdate(bundle.get(), [](SceneObject::Ptr item) { return item->IsDirty(); }));
+    ASSERT_EQ(collector.GetItemIndex(materials[2]), 2u);
+    collector.Finalize([](SceneObject::Ptr item) { item->SetDirty(false); });
+
+    // Removed object releases its index, others stay in place
+    collect(collector, { materials[0], materials[2], materials[3] });
+    ASSERT_TRUE(collector.NeedsUpdate(bundle.get(), [](SceneObject::Ptr item) { return item->IsDirty(); }));
+    ASSERT_EQ(collector.GetItemIndex(materials[3]), 3u);
+    ASSERT_EQ(collector.GetNumItems(), 4u);
+    ASSERT_THROW(collector.GetItemIndex(materials[1]), std::runtime_error);
+
+    // New object reuses released index
+    auto material = SingleBxdf::Create(SingleBxdf::BxdfType::kLambert);
+    collect(collector, { materials[0], materials[2], materials[3], material });
+    ASSERT_EQ(collector.GetItemIndex(material), 1u);
+    ASSERT_EQ(collector.GetNumItems(), 4u);
+}
+
+TEST_F(InternalTest, Scene_DirtyJournal)
+{
+    using namespace Baikal;
+
+    auto scene = Scene1::Create();
+    auto mesh = Mesh::Create();
+    auto light = PointLight::Create();
+
+    scene->AttachShape(mesh);
+    scene->AttachLight(light);
+    scene->ClearDirtyFlags();
+    mesh->SetDirty(false);
+    light->SetDirty(false);
+
+    ASSERT_FALSE(scene->HasDirtyShapes());
+    ASSERT_FALSE(scene->HasDirtyLights());
+
+    // Changes are reported to the scene
+    mesh->SetTransform(RadeonRays::matrix());
+    ASSERT_TRUE(scene->HasDirtyShapes());
+    ASSERT_FALSE(scene->HasDirtyLights());
+
+    light->SetEmittedRadiance(RadeonRays::float3(1.f, 1.f, 1.f));
+    ASSERT_TRUE(scene->HasDirtyLights());
+
+    scene->ClearDirtyFlags();
+    mesh->SetDirty(false);
+
+    // Detached objects are not tracked anymore
+    scene->DetachShape(mesh);
+    scene->ClearDirtyFlags();
+    mesh->SetTransform(RadeonRays::matrix());
+    ASSERT_FALSE(scene->HasDirtyShapes());
+}
+
+TEST_F(InternalTest, Scene_AttachShapes)
+{
+    using namespace Baikal;
+
+    auto scene = Scene1::Create();
+
+    std::vector<Shape::Ptr> shapes;
+    for (auto i = 0u; i < 16; ++i)
+    {
+        shapes.push_back(Mesh::Create());
+    }
+
+    scene->AttachShapes(shapes.cbegin(), shapes.cend());
+    ASSERT_EQ(scene->GetNumShapes(), shapes.size());
+    ASSERT_TRUE(scene->GetDirtyFlags() & Scene1::kShapes);
+
+    // Already attached shapes are skipped
+    scene->ClearDirtyFlags();
+    scene->AttachShapes(shapes.cbegin(), shapes.cend());
+    ASSERT_EQ(scene->GetNumShapes(), shapes.size());
+    ASSERT_EQ(scene->GetDirtyFlags(), 0u);
+
+    // Attachment order is preserved after detach
+    scene->DetachShape(shapes[3]);
+    shapes.erase(shapes.begin() + 3);
+
+    auto iter = scene->CreateShapeIterator();
+    for (auto& shape : shapes)
+    {
+        ASSERT_TRUE(iter->IsValid());
+        ASSERT_EQ(iter->Item(), shape);
+        iter->Next();
+    }
+
+    ASSERT_FALSE(iter->IsValid());
+}
+
+TEST_F(InternalTest, LightBvh)
+{
+    using namespace Baikal;
+    using namespace RadeonRays;
+
+    std::vector<LightBvh::Primitive> primitives(100);
+
+    float total_power = 0.f;
+    for (auto& primitive : primitives)
+    {
+        auto p = float3(rand_float(), rand_float(), rand_float()) * 10.f;
+        primitive.bounds = bbox(p, p + float3(0.1f, 0.1f, 0.1f));
+        primitive.axis = normalize(float3(rand_float() - 0.5f, rand_float() - 0.5f, rand_float() - 0.5f));
+        primitive.cos_theta_o = 1.f;
+        primitive.cos_theta_e = 0.f;
+        primitive.power = rand_float();
+        total_power += primitive.power;
+    }
+
+    LightBvh bvh;
+    bvh.Build(primitives);
+
+    ASSERT_EQ(bvh.m_nodes.size(), 2 * primitives.size() - 1);
+    ASSERT_NEAR(bvh.m_nodes[0].power, total_power, 1e-3f);
+
+    // Interior nodes bound their children
+    for (auto i = 0u; i < bvh.m_nodes.size(); ++i)
+    {
+        auto const& node = bvh.m_nodes[i];
+
+        if (node.primitive >= 0)
+        {
+            continue;
+        }
+
+        for (auto child : { bvh.m_nodes[i + 1], bvh.m_nodes[node.right] })
+        {
+            // Child cone is within parent one, cone of all directions contains anything
+            if (node.cos_theta_o > -1.f)
+            {
+                auto theta_d = std::acos(std::min(dot(node.axis, child.axis), 1.f));
+                ASSERT_LE(theta_d + std::acos(child.cos_theta_o), std::acos(node.cos_theta_o) + 1e-3f);
+            }
+
+            ASSERT_LE(node.bounds.pmin.x, child.bounds.pmin.x);
+            ASSERT_GE(node.bounds.pmax.y, child.bounds.pmax.y);
+        }
+    }
+
+    // Leaf paths lead to their primitives
+    for (auto i = 0u; i < primitives.size(); ++i)
+    {
+        auto path = bvh.m_paths[i];
+        ASSERT_LE(path.depth, 7);
+
+        auto idx = 0;
+        for (auto d = 0; d < path.depth; ++d)
+        {
+            idx = (path.trail >> d) & 0x1 ? bvh.m_nodes[idx].right : idx + 1;
+        }
+
+        ASSERT_EQ(bvh.m_nodes[idx].primitive, static_cast<int>(i));
+    }
+}
+
+TEST_F(InternalTest, LightBvh_Pdf)
+{
+    using namespace Baikal;
+    using namespace RadeonRays;
+
+    std::vector<LightBvh::Primitive> primitives(16);
+
+    for (auto i = 0u; i < primitives.size(); ++i)
+    {
+        auto p = float3(static_cast<float>(i % 4), 0.f, static_cast<float>(i / 4)) * 2.f;
+        primitives[i].bounds = bbox(p, p + float3(0.5f, 0.f, 0.5f));
+        primitives[i].axis = float3(0.f, 1.f, 0.f);
+        primitives[i].cos_theta_o = 1.f;
+        primitives[i].cos_theta_e = 0.f;
+        primitives[i].power = 1.f + static_cast<float>(i % 3);
+    }
+
+    LightBvh bvh;
+    bvh.Build(primitives);
+
+    auto p = float3(1.f, 2.f, 3.f);
+
+    // Pdfs of all primitives make a distribution
+    std::vector<float> pdfs(primitives.size());
+    float total = 0.f;
+    for (auto i = 0u; i < primitives.size(); ++i)
+    {
+        pdfs[i] = bvh.GetPdf(static_cast<int>(i), p);
+        total += pdfs[i];
+    }
+
+    ASSERT_NEAR(total, 1.f, 1e-4f);
+
+    // Selection frequencies follow the pdf, sampled pdf is the one MIS evaluates
+    const int num_samples = 100000;
+    std::vector<int> counts(primitives.size(), 0);
+    for (auto i = 0; i < num_samples; ++i)
+    {
+        float pdf = 0.f;
+        auto primitive = bvh.Sample(p, (i + 0.5f) / num_samples, pdf);
+
+        ASSERT_GE(primitive, 0);
+        ASSERT_NEAR(pdf, pdfs[primitive], 1e-5f);
+        ++counts[primitive];
+    }
+
+    for (auto i = 0u; i < primitives.size(); ++i)
+    {
+        ASSERT_NEAR(static_cast<float>(counts[i]) / num_samples, pdfs[i], 1e-3f);
+    }
+
+    // Nothing is emitted below the lights
+    float pdf = 1.f;
+    ASSERT_EQ(bvh.Sample(float3(1.f, -2.f, 3.f), 0.5f, pdf), -1);
+    ASSERT_EQ(pdf, 0.f);
+    ASSERT_EQ(bvh.GetPdf(0, float3(1.f, -2.f, 3.f)), 0.f);
+}
+
+TEST_F(InternalTest, RangeAllocator_FirstFit)
+{
+    Baikal::RangeAllocator allocator(100);
+
+    ASSERT_EQ(allocator.GetCapacity(), 100u);
+    ASSERT_EQ(allocator.Allocate(10), 0u);
+    ASSERT_EQ(allocator.Allocate(20), 10u);
+    ASSERT_EQ(allocator.Allocate(30), 30u);
+    ASSERT_EQ(allocator.GetUsedSize(), 60u);
+
+    // Zero sized ranges do not occupy the pool
+    ASSERT_EQ(allocator.Allocate(0), 0u);
+    ASSERT_EQ(allocator.GetUsedSize(), 60u);
+
+    // First hole large enough is taken, the rest goes to the tail
+    allocator.Free(0, 10);
+    ASSERT_EQ(allocator.Allocate(5), 0u);
+    ASSERT_EQ(allocator.Allocate(8), 60u);
+    ASSERT_EQ(allocator.Allocate(5), 5u);
+    ASSERT_EQ(allocator.GetUsedSize(), 68u);
+}
+
+TEST_F(InternalTest, RangeAllocator_Coalesce)
+{
+    Baikal::RangeAllocator allocator(40);
+
+    std::size_t offsets[4];
+    for (auto i = 0u; i < 4; ++i)
+    {
+        offsets[i] = allocator.Allocate(10);
+        ASSERT_EQ(offsets[i], i * 10u);
+    }
+
+    // Free ranges out of order, neighbours are merged with previous and next ranges
+    allocator.Free(offsets[1], 10);
+    allocator.Free(offsets[3], 10);
+    allocator.Free(offsets[2], 10);
+    ASSERT_EQ(allocator.GetUsedSize(), 10u);
+
+    // Merged range fits an allocation larger than any of its parts
+    ASSERT_EQ(allocator.Allocate(30), 10u);
+
+    allocator.Free(10, 30);
+    allocator.Free(offsets[0], 10);
+    ASSERT_EQ(allocator.GetUsedSize(), 0u);
+    ASSERT_EQ(allocator.Allocate(40), 0u);
+}
+
+TEST_F(InternalTest, RangeAllocator_Fragmentation)
+{
+    Baikal::RangeAllocator allocator(64);
+
+    for (auto i = 0u; i < 8; ++i)
+    {
+        ASSERT_EQ(allocator.Allocate(8), i * 8u);
+    }
+
+    // Pool is exhausted
+    ASSERT_EQ(allocator.Allocate(1), Baikal::RangeAllocator::kInvalidOffset);
+
+    // Free every other range: half of the pool is free, but no hole exceeds 8
+    for (auto i = 0u; i < 8; i += 2)
+    {
+        allocator.Free(i * 8, 8);
+    }
+
+    ASSERT_EQ(allocator.GetUsedSize(), 32u);
+    ASSERT_EQ(allocator.Allocate(9), Baikal::RangeAllocator::kInvalidOffset);
+    ASSERT_EQ(allocator.GetUsedSize(), 32u);
+    ASSERT_EQ(allocator.Allocate(8), 0u);
+
+    // Reset drops all allocations
+    allocator.Reset(128);
+    ASSERT_EQ(allocator.GetCapacity(), 128u);
+    ASSERT_EQ(allocator.GetUsedSize(), 0u);
+    ASSERT_EQ(allocator.Allocate(128), 0u);
+
+    // Empty pool can not allocate anything
+    Baikal::RangeAllocator empty;
+    ASSERT_EQ(empty.Allocate(1), Baikal::RangeAllocator::kInvalidOffset);
+}
+
+TEST_F(InternalTest, Texture_BlockCompression)
+{
+    using namespace Baikal;
+
+    // Color and alpha gradients with partial blocks on the edges
+    const int width = 13;
+    const int height = 9;
+
+    std::vector<std::uint8_t> rgba(4 * width * height);
+    for (auto y = 0; y < height; ++y)
+    {
+        for (auto x = 0; x < width; ++x)
+        {
+            auto texel = &rgba[4 * (y * width + x)];
+            texel[0] = static_cast<std::uint8_t>(x * 255 / (width - 1));
+            texel[1] = static_cast<std::uint8_t>(255 - texel[0]);
+            texel[2] = static_cast<std::uint8_t>(texel[0] / 2);
+            texel[3] = static_cast<std::uint8_t>(y * 255 / (height - 1));
+        }
+    }
+
+    for (auto format : { Texture::Format::kBc1, Texture::Format::kBc3, Texture::Format::kBc5 })
+    {
+        auto data = new char[rgba.size()];
+        std::copy(rgba.cbegin(), rgba.cend(), data);
+
+        auto texture = Texture::Create(data, RadeonRays::int2(width, height), Texture::Format::kRgba8);
+        texture->Compress(format);
+
+        // 4x3 blocks, BC1 is 8x smaller than RGBA8, the rest are 4x smaller
+        auto block_format = Texture::GetBlockFormat(format);
+        ASSERT_EQ(texture->GetFormat(), format);
+        ASSERT_EQ(texture->GetSizeInBytes(), 12u * GetBlockSize(block_format));
+
+        std::vector<std::uint8_t> decoded(rgba.size());
+        DecompressBlocks(block_format, reinterpret_cast<std::uint8_t const*>(texture->GetData()),
+                         width, height, decoded.data());
+
+        // BC1 alpha is 1-bit, BC5 stores red and green only
+        auto num_channels = format == Texture::Format::kBc5 ? 2 : (format == Texture::Format::kBc1 ? 3 : 4);
+
+        for (auto i = 0; i < width * height; ++i)
+        {
+            // BC1 texels with alpha below 0.5 become transparent black
+            if (format == Texture::Format::kBc1 && rgba[4 * i + 3] < 128)
+            {
+                ASSERT_EQ(decoded[4 * i + 3], 0);
+                continue;
+            }
+
+            for (auto c = 0; c < num_channels; ++c)
+            {
+                ASSERT_NEAR(decoded[4 * i + c], rgba[4 * i + c], 12);
+            }
+        }
+
+        auto texel = texture->GetTexel(width - 1, height - 1);
+        ASSERT_NEAR(texel.x, decoded[4 * (width * height - 1)] / 255.f, 1e-5f);
+        ASSERT_NEAR(texel.y, decoded[4 * (width * height - 1) + 1] / 255.f, 1e-5f);
+    }
+}
+
+TEST_F(InternalTest, TileCache)
+{
+    using namespace Baikal;
+
+    TileCache cache;
+    cache.Reset(3, 8);
+
+    // Pinned page stays resident
+    ASSERT_GE(cache.Pin(7), 0);
+
+    std::vector<int> misses;
+    cache.Update({ 0, 1, 7 }, misses);
+    ASSERT_EQ(misses, std::vector<int>({ 0, 1 }));
+
+    ASSERT_GE(cache.Insert(0), 0);
+    ASSERT_GE(cache.Insert(1), 0);
+
+    // All slots are used by the current frame
+    ASSERT_EQ(cache.Insert(2), -1);
+
+    // Page 1 is the least recently used one
+    cache.Update({ 0 }, misses);
+    cache.Update({ 2 }, misses);
+    ASSERT_EQ(misses, std::vector<int>({ 2 }));
+
+    auto slot = cache.Insert(2);
+    ASSERT_GE(slot, 0);
+    ASSERT_EQ(cache.GetSlot(1), -1);
+    ASSERT_GE(cache.GetSlot(0), 0);
+    ASSERT_GE(cache.GetSlot(7), 0);
+    ASSERT_EQ(cache.GetSlot(2), slot);
+}
+
+TEST_F(InternalTest, TiledImage)
+{
+    auto path = GetTempFilePath("tiled_image_test.tiles");
+    using namespace Baikal;
+
+    auto width = 100;
+    auto height = 70;
+    auto data = new char[width * height * 4];
+
+    for (auto i = 0; i < width * height; ++i)
+    {
+        data[4 * i] = static_cast<char>(i % width);
+        data[4 * i + 1] = static_cast<char>(i / width);
+        data[4 * i + 2] = static_cast<char>(i & 0xff);
+        data[4 * i + 3] = static_cast<char>(255);
+    }
+
+    auto texture = Texture::Create(data, RadeonRays::int2(width, height), Texture::Format::kRgba8);
+    TiledImage::Write(path, *texture);
+
+    auto tiled_image = TiledImage::Open(path);
+    auto virtual_texture = Texture::Create(tiled_image);
+
+    // 100x70 -> 1x1 is 7 levels, base level is 2x2 tiles of 64x64
+    ASSERT_EQ(tiled_image->GetNumLevels(), 7);
+    ASSERT_EQ(tiled_image->GetNumTiles(0).x, 2);
+    ASSERT_EQ(tiled_image->GetNumTiles(0).y, 2);
+    ASSERT_EQ(tiled_image->GetFirstTile(1), 4u);
+    ASSERT_EQ(tiled_image->GetNumTiles(), 10u);
+    ASSERT_TRUE(virtual_texture->IsVirtual());
+
+    for (auto y = 0; y < height; y += 3)
+    {
+        for (auto x = 0; x < width; x += 7)
+        {
+            auto expected = texture->GetTexel(x, y);
+            auto texel = virtual_texture->GetTexel(x, y);
+            ASSERT_NEAR(texel.x, expected.x, 1e-5f);
+            ASSERT_NEAR(texel.y, expected.y, 1e-5f);
+            ASSERT_NEAR(texel.z, expected.z, 1e-5f);
+            ASSERT_NEAR(texel.w, expected.w, 1e-5f);
+        }
+    }
+
+    virtual_texture.reset();
+    tiled_image.reset();
+    std::remove(path.c_str());
+}
+
+TEST_F(InternalTest, OutputFormat_Decode)
+{
+    using namespace Baikal;
+
+    ASSERT_EQ(GetOutputFormatSize(OutputFormat::kRGBA32F), 16u);
+    ASSERT_EQ(GetOutputFormatSize(OutputFormat::kRGBA16F), 8u);
+    ASSERT_EQ(GetOutputFormatSize(OutputFormat::kOctNormal), 4u);
+
+    // +Z and -Z in octahedral encoding
+    std::uint32_t normals[] = { 0u, 0x7fffu | (0x7fffu << 16) };
+    RadeonRays::float3 decoded[2];
+    DecodeOutputData(OutputFormat::kOctNormal, normals, 2, decoded);
+
+    ASSERT_NEAR(decoded[0].z, 1.f, 1e-5f);
+    ASSERT_NEAR(decoded[1].x, 0.f, 1e-5f);
+    ASSERT_NEAR(decoded[1].y, 0.f, 1e-5f);
+    ASSERT_NEAR(decoded[1].z, -1.f, 1e-5f);
+    ASSERT_EQ(decoded[1].w, 1.f);
+
+    std::uint32_t albedo = 0xff8040u;
+    DecodeOutputData(OutputFormat::kRGBA8, &albedo, 1, decoded);
+
+    ASSERT_NEAR(decoded[0].x, 64.f / 255.f, 1e-5f);
+    ASSERT_NEAR(decoded[0].y, 128.f / 255.f, 1e-5f);
+    ASSERT_NEAR(decoded[0].z, 1.f, 1e-5f);
+
+    // 1, 0.5, 2 in half precision
+    std::uint16_t color[] = { 0x3c00u, 0x3800u, 0x4000u, 0x3c00u };
+    DecodeOutputData(OutputFormat::kRGBA16F, color, 1, decoded);
+
+    ASSERT_EQ(decoded[0].x, 1.f);
+    ASSERT_EQ(decoded[0].y, 0.5f);
+    ASSERT_EQ(decoded[0].z, 2.f);
+}
+
+TEST_F(InternalTest, SceneBinaryIo_RoundTrip)
+{
+    auto path = GetTempFilePath("scene_binary_io_test.bxs");
+    using namespace Baikal;
+
+    auto scene = Scene1::Create();
+
+    std::uint32_t indices[] = { 0, 1, 2, 0, 2, 3 };
+    RadeonRays::float3 vertices[] = { { -1.f, 0.f, -1.f }, { 1.f, 0.f, -1.f }, { 1.f, 0.f, 1.f }, { -1.f, 0.f, 1.f } };
+    RadeonRays::float3 normals[] = { { 0.f, 1.f, 0.f }, { 0.f, 1.f, 0.f }, { 0.f, 1.f, 0.f }, { 0.f, 1.f, 0.f } };
+    RadeonRays::float2 uvs[] = { { 0.f, 0.f }, { 1.f, 0.f }, { 1.f, 1.f }, { 0.f, 1.f } };
+
+    auto base = SingleBxdf::Create(SingleBxdf::BxdfType::kLambert);
+    base->SetInputValue("albedo", RadeonRays::float4(0.1f, 0.2f, 0.3f, 1.f));
+    auto top = SingleBxdf::Create(SingleBxdf::BxdfType::kMicrofacetGGX);
+    top->SetInputValue("roughness", RadeonRays::float4(0.25f));
+    auto layered = MultiBxdf::Create(MultiBxdf::Type::kFresnelBlend);
+    layered->SetInputValue("base_material", base);
+    layered->SetInputValue("top_material", top);
+    layered->SetInputValue("ior", RadeonRays::float4(1.5f));
+
+    auto mesh = Mesh::Create();
+    mesh->SetIndices(indices, 6);
+    mesh->SetVertices(vertices, 4);
+    mesh->SetNormals(normals, 4);
+    mesh->SetUVs(uvs, 4);
+    mesh->SetMaterial(layered);
+    mesh->SetName("floor");
+    scene->AttachShape(mesh);
+
+    RadeonRays::matrix transform;
+    transform.m13 = 2.f;
+
+    auto instance = Instance::Create(mesh);
+    instance->SetTransform(transform);
+    instance->SetMaterial(base);
+    scene->AttachShape(instance);
+
+    auto spot = SpotLight::Create();
+    spot->SetPosition(RadeonRays::float3(0.f, 5.f, 0.f));
+    spot->SetConeShape(RadeonRays::float2(0.1f, 0.2f));
+    scene->AttachLight(spot);
+    scene->AttachLight(AreaLight::Create(instance, 1));
+
+    auto camera = PerspectiveCamera::Create(RadeonRays::float3(0.f, 1.f, 5.f), RadeonRays::float3(0.f, 1.f, 0.f), RadeonRays::float3(0.f, 1.f, 0.f));
+    camera->SetAperture(0.01f);
+    scene->SetCamera(camera);
+
+    auto io = SceneIo::CreateSceneIoBinary();
+    io->SaveScene(*scene, path, "");
+
+    {
+        auto loaded = io->LoadScene(path, "");
+        ASSERT_EQ(loaded->GetNumShapes(), 2u);
+        ASSERT_EQ(loaded->GetNumLights(), 2u);
+
+        auto shape_iter = loaded->CreateShapeIterator();
+        auto loaded_mesh = shape_iter->ItemAs<Mesh>();
+        shape_iter->Next();
+        auto loaded_instance = shape_iter->ItemAs<Instance>();
+
+        // Geometry references mapped file
+        ASSERT_TRUE(loaded_mesh->HasExternalGeometry());
+        ASSERT_EQ(loaded_mesh->GetName(), "floor");
+        ASSERT_EQ(loaded_mesh->GetNumIndices(), 6u);
+        ASSERT_EQ(loaded_mesh->GetNumUVs(), 4u);
+        ASSERT_EQ(reinterpret_cast<std::uintptr_t>(loaded_mesh->GetVertices()) % 64, 0u);
+        for (auto i = 0; i < 4; ++i)
+        {
+            ASSERT_EQ(loaded_mesh->GetVertices()[i].x, vertices[i].x);
+            ASSERT_EQ(loaded_mesh->GetVertices()[i].z, vertices[i].z);
+            ASSERT_EQ(loaded_mesh->GetUVs()[i].y, uvs[i].y);
+        }
+
+        ASSERT_EQ(loaded_instance->GetBaseShape(), loaded_mesh);
+        ASSERT_EQ(loaded_instance->GetTransform().m13, 2.f);
+
+        auto loaded_layered = std::dynamic_pointer_cast<MultiBxdf>(loaded_mesh->GetMaterial());
+        ASSERT_NE(loaded_layered, nullptr);
+        ASSERT_EQ(loaded_layered->GetType(), MultiBxdf::Type::kFresnelBlend);
+        ASSERT_EQ(loaded_layered->GetInputValue("ior").float_value.x, 1.5f);
+
+        // Shared materials are restored as shared
+        auto loaded_base = loaded_layered->GetInputValue("base_material").mat_value;
+        ASSERT_EQ(loaded_instance->GetMaterial(), loaded_base);
+        ASSERT_EQ(loaded_base->GetInputValue("albedo").float_value.y, 0.2f);
+        auto loaded_top = std::dynamic_pointer_cast<SingleBxdf>(loaded_layered->GetInputValue("top_material").mat_value);
+        ASSERT_EQ(loaded_top->GetBxdfType(), SingleBxdf::BxdfType::kMicrofacetGGX);
+
+        auto light_iter = loaded->CreateLightIterator();
+        auto loaded_spot = std::dynamic_pointer_cast<SpotLight>(light_iter->ItemAs<Light>());
+        ASSERT_NE(loaded_spot, nullptr);
+        ASSERT_EQ(loaded_spot->GetConeShape().y, 0.2f);
+        light_iter->Next();
+        auto loaded_area = std::dynamic_pointer_cast<AreaLight>(light_iter->ItemAs<Light>());
+        ASSERT_NE(loaded_area, nullptr);
+        ASSERT_EQ(loaded_area->GetShape(), loaded_instance);
+        ASSERT_EQ(loaded_area->GetPrimitiveIdx(), 1u);
+
+        auto loaded_camera = std::dynamic_pointer_cast<PerspectiveCamera>(loaded->GetCamera());
+        ASSERT_NE(loaded_camera, nullptr);
+        ASSERT_NEAR(loaded_camera->GetPosition().z, 5.f, 1e-5f);
+        ASSERT_NEAR(loaded_camera->GetForwardVector().z, -1.f, 1e-5f);
+        ASSERT_EQ(loaded_camera->GetAperture(), 0.01f);
+
+        // Replacing an array copies it, mapping is released once nothing references it
+        loaded_mesh->SetIndices(indices, 6);
+        loaded_mesh->SetVertices(vertices, 4);
+        loaded_mesh->SetNormals(normals, 4);
+        ASSERT_TRUE(loaded_mesh->HasExternalGeometry());
+        loaded_mesh->SetUVs(uvs, 4);
+        ASSERT_FALSE(loaded_mesh->HasExternalGeometry());
+    }
+
+    std::remove(path.c_str());
+}
+
+TEST_F(InternalTest, SceneBinaryIo_BadIndex)
+{
+    auto path = GetTempFilePath("scene_binary_io_bad_index.bxs");
+    using namespace Baikal;
+
+    auto scene = Scene1::Create();
+
+    std::uint32_t indices[] = { 0, 1, 2, 0, 2, 3 };
+    RadeonRays::float3 vertices[] = { { -1.f, 0.f, -1.f }, { 1.f, 0.f, -1.f }, { 1.f, 0.f, 1.f }, { -1.f, 0.f, 1.f } };
+
+    auto mesh = Mesh::Create();
+    mesh->SetIndices(indices, 6);
+    mesh->SetVertices(vertices, 4);
+    scene->AttachShape(mesh);
+
+    auto io = SceneIo::CreateSceneIoBinary();
+    io->SaveScene(*scene, path, "");
+
+    // Point the last index past vertex data
+    std::string data;
+    {
+        std::ifstream in(path, std::ios::binary);
+        data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    auto pos = data.find(std::string(reinterpret_cast<char const*>(indices), sizeof(indices)));
+    ASSERT_NE(pos, std::string::npos);
+
+    std::uint32_t bad_index = 4;
+    data.replace(pos + 5 * sizeof(std::uint32_t), sizeof(bad_index), reinterpret_cast<char const*>(&bad_index), sizeof(bad_index));
+
+    {
+        std::ofstream out(path, std::ios::binary);
+        out.write(data.data(), data.size());
+    }
+
+    ASSERT_THROW(io->LoadScene(path, ""), std::runtime_error);
+
+    std::remove(path.c_str());
+}
+
+TEST_F(InternalTest, ObjParser)
+{
+    auto path = GetTempFilePath("obj_parser_test.obj");
+    using namespace Baikal;
+
+    std::ofstream out(path);
+    out << "mtllib test.mtl\n";
+    out << "o quads\n";
+    out << "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n";
+    out << "vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n";
+    out << "usemtl a\nf 1/1 2/2 3/3 4/4\n";
+    out << "usemtl b\nf 1/1 3/3 4/4\n";
+    out << "g triangles\n";
+
+    // Large enough to be split into several chunks
+    const int kNumTriangles = 100000;
+    for (auto i = 0; i < kNumTriangles; ++i)
+    {
+        out << "v " << i << " 0 0\nv " << i << " 1 0\nv " << i << " 0 1.5e-1\nf -3 -2 -1\n";
+    }
+
+    out.close();
+
+    ThreadPool pool(4);
+    std::vector<std::string> libraries;
+    std::vector<ObjParser::Shape> shapes;
+    std::vector<std::string> material_names;
+    ObjParser::Parse(path, pool,
+                     [&libraries](std::string const& name) { libraries.push_back(name); },
+                     shapes, material_names);
+
+    std::remove(path.c_str());
+
+    ASSERT_EQ(libraries.size(), 1u);
+    ASSERT_EQ(libraries[0], "test.mtl");
+    ASSERT_EQ(material_names.size(), 2u);
+    ASSERT_EQ(shapes.size(), 2u);
+
+    // Quad is split into two triangles, material change starts new vertex group
+    auto const& quads = shapes[0];
+    ASSERT_EQ(quads.name, "quads");
+    ASSERT_EQ(quads.indices.size(), 9u);
+    ASSERT_EQ(quads.positions.size(), 7u);
+    ASSERT_EQ(quads.uvs.size(), 7u);
+    ASSERT_EQ(quads.material_ids.size(), 3u);
+    ASSERT_EQ(quads.material_ids[1], 0);
+    ASSERT_EQ(quads.material_ids[2], 1);
+    ASSERT_EQ(quads.positions[quads.indices[4]].x, 1.f);
+    ASSERT_EQ(quads.positions[quads.indices[4]].y, 1.f);
+    ASSERT_EQ(quads.uvs[quads.indices[8]].y, 1.f);
+
+    // Relative indices are resolved across chunks, material persists across groups
+    auto const& triangles = shapes[1];
+    ASSERT_EQ(triangles.name, "triangles");
+    ASSERT_EQ(triangles.indices.size(), 3u * kNumTriangles);
+    ASSERT_EQ(triangles.positions.size(), 3u * kNumTriangles);
+    ASSERT_TRUE(triangles.normals.empty());
+
+    for (auto i = 0; i < kNumTriangles; i += 997)
+    {
+        ASSERT_EQ(triangles.positions[triangles.indices[3 * i]].x, static_cast<float>(i));
+        ASSERT_EQ(triangles.positions[triangles.indices[3 * i + 1]].y, 1.f);
+        ASSERT_NEAR(triangles.positions[triangles.indices[3 * i + 2]].z, 0.15f, 1e-6f);
+        ASSERT_EQ(triangles.material_ids[i], 1);
+    }
+}
+
+TEST_F(InternalTest, VertexCompression)
+{
+    using namespace RadeonRays;
+    using namespace Baikal;
+
+    std::vector<float3> vertices;
+    std::vector<float3> normals;
+    std::vector<float2> uvs;
+
+    // Millimeter scale scene, 10 meters across
+    for (auto i = 0; i < 100; ++i)
+    {
+        auto t = static_cast<float>(i) / 100.f;
+        vertices.push_back(float3(-5000.f + 10000.f * t, 2500.f * t * t, 300.f - 0.37f * i));
+        normals.push_back(normalize(float3(std::cos(7.f * t), std::sin(13.f * t), t - 0.5f)));
+        uvs.push_back(float2(t, 1.f - 2.f * t));
+    }
+
+    // Last vertex has no uv
+    std::vector<CompactVertex> compact(vertices.size());
+    std::vector<std::uint32_t> compact_uvs(vertices.size());
+    CompressVertices(vertices.data(), vertices.size(), normals.data(), normals.size(), uvs.data(), uvs.size() - 1, compact.data(), compact_uvs.data());
+
+    std::vector<float3> positions(vertices.size());
+    for (auto i = 0u; i < vertices.size(); ++i)
+    {
+        float3 n;
+        float2 uv;
+        DecompressVertex(compact[i], compact_uvs[i], positions[i], n, uv);
+
+        ASSERT_EQ(positions[i].x, vertices[i].x);
+        ASSERT_EQ(positions[i].y, vertices[i].y);
+        ASSERT_EQ(positions[i].z, vertices[i].z);
+        ASSERT_GT(dot(n, normals[i]), 0.9999f);
+
+        if (i < uvs.size() - 1)
+        {
+            ASSERT_NEAR(uv.x, uvs[i].x, 1e-3f);
+            ASSERT_NEAR(uv.y, uvs[i].y, 1e-3f);
+        }
+        else
+        {
+            ASSERT_EQ(uv.x, 0.f);
+            ASSERT_EQ(uv.y, 0.f);
+        }
+    }
+
+    // Shading points are interpolated from decoded positions and have to stay
+    // within ray offset (CRAZY_LOW_DISTANCE in kernels) from the hit surface
+    float const ray_epsilon = 0.001f;
+    for (auto i = 0u; i + 2 < vertices.size(); ++i)
+    {
+        for (auto j = 0; j < 16; ++j)
+        {
+            auto u = static_cast<float>(j % 4) / 4.f;
+            auto v = static_cast<float>(j / 4) / 4.f * (1.f - u);
+            auto expected = vertices[i] * (1.f - u - v) + vertices[i + 1] * u + vertices[i + 2] * v;
+            auto decoded = positions[i] * (1.f - u - v) + positions[i + 1] * u + positions[i + 2] * v;
+            ASSERT_LT((decoded - expected).sqnorm(), ray_epsilon * ray_epsilon);
+        }
+    }
+}
+
+TEST_F(InternalTest, Mesh_SpillGeometry)
+{
+    auto path = GetTempFilePath("mesh_spill_test.bin");
+    using namespace RadeonRays;
+    using namespace Baikal;
+
+    std::vector<float3> vertices;
+    std::vector<float2> uvs;
+    std::vector<std::uint32_t> indices;
+
+    for (auto i = 0u; i < 1000; ++i)
+    {
+        vertices.push_back(float3(static_cast<float>(i), 1.f, 2.f));
+        uvs.push_back(float2(static_cast<float>(i), 0.5f));
+        indices.push_back(999 - i);
+    }
+
+    auto mesh = Mesh::Create();
+    mesh->SetVertices(vertices.data(), vertices.size());
+    mesh->SetUVs(uvs.data(), uvs.size());
+    mesh->SetIndices(indices.data(), indices.size());
+    mesh->SetDirty(false);
+
+    auto version = mesh->GetGeometryVersion();
+    auto aabb = mesh->GetLocalAABB();
+
+    mesh->SpillGeometry(path);
+
+    // Data is read back from the file, nothing else changes
+    ASSERT_TRUE(mesh->HasExternalGeometry());
+    ASSERT_EQ(mesh->GetGeometryVersion(), version);
+    ASSERT_FALSE(mesh->IsDirty());
+    ASSERT_EQ(mesh->GetNumVertices(), vertices.size());
+    ASSERT_EQ(mesh->GetNumNormals(), 0u);
+    ASSERT_EQ(mesh->GetNormals(), nullptr);
+    ASSERT_EQ(mesh->GetNumUVs(), uvs.size());
+    ASSERT_EQ(mesh->GetNumIndices(), indices.size());
+    ASSERT_EQ(mesh->GetLocalAABB().pmax.x, aabb.pmax.x);
+
+    for (auto i = 0u; i < vertices.size(); ++i)
+    {
+        ASSERT_EQ(mesh->GetVertices()[i].x, vertices[i].x);
+        ASSERT_EQ(mesh->GetUVs()[i].x, uvs[i].x);
+        ASSERT_EQ(mesh->GetIndices()[i], indices[i]);
+    }
+
+    ASSERT_TRUE(std::ifstream(path).good());
+
+    // File goes away once all the arrays are replaced
+    mesh->SetVertices(vertices.data(), vertices.size());
+    mesh->SetUVs(uvs.data(), uvs.size());
+    ASSERT_TRUE(std::ifstream(path).good());
+    mesh->SetIndices(indices.data(), indices.size());
+    ASSERT_FALSE(mesh->HasExternalGeometry());
+    ASSERT_FALSE(std::ifstream(path).good());
+}
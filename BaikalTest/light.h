@@ -28,6 +28,7 @@ THE SOFTWARE.
 
 #define _USE_MATH_DEFINES
 #include <math.h>
+#include <chrono>
 
 using namespace RadeonRays;
 
@@ -596,3 +597,63 @@ TEST_F(LightTest, Light_DirectionalAndEmissiveSphere)
         ASSERT_TRUE(CompareToReference(oss.str()));
     }
 }
+
+// Area lights find their shapes through the shape index map built once per
+// shape update. Light only updates should reuse it and keep light to shape
+// mapping consistent for a large number of emissive shapes.
+TEST_F(LightTest, Light_AreaLightUpdateScaling)
+{
+    auto emission = Baikal::SingleBxdf::Create(Baikal::SingleBxdf::BxdfType::kEmissive);
+    emission->SetInputValue("albedo", float3(2.f, 2.f, 2.f));
+
+    float3 vertices[] = { float3(0.f, 0.f, 0.f), float3(0.1f, 0.f, 0.f), float3(0.f, 0.1f, 0.f) };
+    float3 normals[] = { float3(0.f, 0.f, -1.f), float3(0.f, 0.f, -1.f), float3(0.f, 0.f, -1.f) };
+    float2 uvs[] = { float2(0.f, 0.f), float2(1.f, 0.f), float2(0.f, 1.f) };
+    std::uint32_t indices[] = { 0, 1, 2 };
+
+    const std::size_t kNumLights = 4000;
+
+    // Test scene and camera are set up by the fixture
+    auto num_scene_lights = m_scene->GetNumLights();
+    std::vector<Baikal::Shape::Ptr> meshes;
+    std::vector<Baikal::Light::Ptr> lights;
+
+    for (auto i = 0u; i < kNumLights; ++i)
+    {
+        auto mesh = Baikal::Mesh::Create();
+        mesh->SetVertices(vertices, 3);
+        mesh->SetNormals(normals, 3);
+        mesh->SetUVs(uvs, 3);
+        mesh->SetIndices(indices, 3);
+        mesh->SetMaterial(emission);
+        mesh->SetTransform(RadeonRays::translation(float3(0.f, 0.01f * i, 2.f)));
+        m_scene->AttachShape(mesh);
+        meshes.push_back(mesh);
+
+        auto light = Baikal::AreaLight::Create(mesh, 0);
+        m_scene->AttachLight(light);
+        lights.push_back(light);
+    }
+
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+    auto& compiled = m_controller->GetCachedScene(m_scene);
+    auto shape_list = compiled.shape_list;
+
+    // Touch a single light to force light update only
+    lights[0]->SetEmittedRadiance(float3(1.f, 1.f, 1.f));
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+    // Shape order is not rebuilt by light update
+    ASSERT_EQ(compiled.shape_list, shape_list);
+    ASSERT_EQ(compiled.shape_indices.size(), compiled.shape_list.size());
+    ASSERT_EQ(compiled.num_lights, static_cast<int>(num_scene_lights + kNumLights));
+
+    // Every emissive shape is reachable through the index map
+    for (auto const& mesh : meshes)
+    {
+        auto iter = compiled.shape_indices.find(mesh);
+        ASSERT_NE(iter, compiled.shape_indices.cend());
+        ASSERT_EQ(compiled.shape_list[iter->second], mesh);
+    }
+}
@@ -29,6 +29,7 @@ THE SOFTWARE.
 #include "light.h"
 #include "material.h"
 #include "aov.h"
+#include "adaptive.h"
 #include "test_scenes.h"
 
 int g_argc;
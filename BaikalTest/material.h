@@ -26,10 +26,12 @@ THE SOFTWARE.
 #include "SceneGraph/shape.h"
 #include "SceneGraph/material.h"
 #include "SceneGraph/IO/image_io.h"
+#include "Controllers/clw_scene_controller.h"
 
 #define _USE_MATH_DEFINES
 #include <math.h>
 
+
 using namespace RadeonRays;
 
 class MaterialTest : public BasicTest
@@ -887,3 +889,72 @@ TEST_F(MaterialTest, Material_Translucent)
         }
     }
 }
+
+TEST_F(MaterialTest, Material_MipmapBandwidth)
+{
+    // Grazing view of a floor covered with texel sized checker,
+    // so most of the texture is heavily minified
+    m_camera->LookAt(
+        RadeonRays::float3(0.f, 0.5f, -8.f),
+        RadeonRays::float3(0.f, 0.f, 8.f),
+        RadeonRays::float3(0.f, 1.f, 0.f));
+
+    auto const size = 4096;
+    auto data = new char[4 * size * size];
+    for (auto y = 0; y < size; ++y)
+        for (auto x = 0; x < size; ++x)
+        {
+            auto value = static_cast<char>(((x ^ y) & 0x1) ? 0xFF : 0x00);
+            std::fill(data + 4 * (y * size + x), data + 4 * (y * size + x + 1), value);
+        }
+
+    auto texture = Baikal::Texture::Create(data, RadeonRays::int2(size, size), Baikal::Texture::Format::kRgba8);
+
+    auto material = Baikal::SingleBxdf::Create(Baikal::SingleBxdf::BxdfType::kLambert);
+    material->SetInputValue("albedo", texture);
+
+    ApplyMaterialToObject("quad", material);
+
+    auto controller = static_cast<Baikal::ClwSceneController*>(m_controller.get());
+
+    for (auto mipmap : { false, true })
+    {
+        ClearOutput();
+
+        texture->SetMipmapEnabled(mipmap);
+
+        ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+        auto& scene = m_controller->GetCachedScene(m_scene);
+
+        // Minified lookups can only save bandwidth if the whole chain is there:
+        // 4096 -> 1 takes 13 levels, each level a quarter of the previous one
+        Baikal::ClwScene::Texture desc;
+        controller->WriteTexture(*texture, 0, &desc);
+
+        if (mipmap)
+        {
+            ASSERT_EQ(desc.num_levels, 13);
+
+            auto level_size = 4 * size * size;
+            for (auto i = 1; i < desc.num_levels; ++i)
+            {
+                ASSERT_EQ(desc.mip_offsets[i] - desc.mip_offsets[i - 1], level_size);
+                level_size = std::max(level_size / 4, 4);
+            }
+        }
+        else
+        {
+            ASSERT_EQ(desc.num_levels, 1);
+        }
+
+        for (auto i = 0u; i < kNumIterations; ++i)
+        {
+            ASSERT_NO_THROW(m_renderer->Render(scene));
+        }
+
+        std::ostringstream oss;
+        oss << test_name() << "_" << (mipmap ? "mipmap" : "base") << ".png";
+        SaveOutput(oss.str());
+    }
+}
@@ -36,6 +36,8 @@ THE SOFTWARE.
 #include "SceneGraph/light.h"
 
 #include "RenderFactory/render_factory.h"
+#include "RenderFactory/clw_render_factory.h"
+#include "Controllers/clw_scene_controller.h"
 
 namespace
 {
@@ -93,6 +95,7 @@ namespace
     { RPR_CONTEXT_GPU6_NAME,{ "gpu6name", "Name of the GPU index 6 in context. Constant value.", RPR_PARAMETER_TYPE_STRING } },
     { RPR_CONTEXT_GPU7_NAME,{ "gpu7name", "Name of the GPU index 7 in context. Constant value.", RPR_PARAMETER_TYPE_STRING } },
     { RPR_CONTEXT_CPU_NAME,{ "cpuname", "Name of the CPU in context. Constant value.", RPR_PARAMETER_TYPE_STRING } },
+    { RPR_CONTEXT_OOC_CACHE_PATH,{ "ooccachepath", "Directory to spill mesh geometry to", RPR_PARAMETER_TYPE_STRING } },
     };
 
     std::map<uint32_t, Baikal::Renderer::OutputType> kOutputTypeMap = { {RPR_AOV_COLOR, Baikal::Renderer::OutputType::kColor},
@@ -356,6 +359,16 @@ void ContextObject::SetParameter(const std::string& input, const std::string& va
     {
         throw Exception(RPR_ERROR_INVALID_PARAMETER_TYPE, "ContextObject: invalid context input type.");
     }
+
+    // Spill geometry of meshes uploaded from now on
+    if (input == kContextParameterDescriptions.at(RPR_CONTEXT_OOC_CACHE_PATH).name)
+    {
+        for (auto& c : m_cfgs)
+        {
+            static_cast<Baikal::ClwRenderFactory*>(c.factory.get())->SetGeometrySpillPath(value);
+            static_cast<Baikal::ClwSceneController*>(c.controller.get())->SetGeometrySpillPath(value);
+        }
+    }
 }
 
 void ContextObject::PrepareScene()
@@ -83,6 +83,19 @@ void FramebufferObject::GetData(void* out_data)
     m_output->GetData(static_cast<RadeonRays::float3*>(out_data));
 }
 
+bool FramebufferObject::GetDataAsync(void* out_data)
+{
+    // Return the last completed copy and queue the next one
+    bool ready = m_output->IsDataReady();
+    if (ready)
+    {
+        m_output->GetRequestedData(static_cast<RadeonRays::float3*>(out_data));
+    }
+
+    m_output->RequestData();
+    return ready;
+}
+
 void FramebufferObject::Clear()
 {
     Baikal::ClwOutput* output = dynamic_cast<Baikal::ClwOutput*>(m_output);
@@ -45,6 +45,9 @@ public:
     int Width();
     int Height();
     void GetData(void* out_data);
+    //doesn't stall rendering: copies the last completed readback if there is one,
+    //returns false if nothing has completed yet, and queues the next readback
+    bool GetDataAsync(void* out_data);
 
     void Clear();
     void SaveToFile(const char* path);
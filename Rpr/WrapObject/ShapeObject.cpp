@@ -20,53 +20,59 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 ********************************************************************/
 
+#include <algorithm>
 #include <vector>
 #include <iostream>
+#include <unordered_map>
 
 #include "WrapObject/ShapeObject.h"
 #include "WrapObject/Exception.h"
 #include "SceneGraph/shape.h"
+#include "Utils/log.h"
 
 
 using namespace Baikal;
 
 namespace
 {
-    template<typename T, int size = 3> std::vector<T> merge(const T* in_data, size_t in_data_num, rpr_int in_data_stride,
-        rpr_int const * in_data_indices, rpr_int in_didx_stride,
-        rpr_int const * in_num_face_vertices, size_t in_num_faces)
+    // Face corner: indices into input positions, normals and uvs, -1 if the stream is missing
+    struct Corner
     {
-        std::vector<T> result;
-        if (!in_data || !in_data_indices)
-        {
-            std::cout << "Warning: missing mesh data, fill it with NULL.\n";
-            int count = 0;
-            for (int i = 0; i < in_num_faces; ++i)
-            {
-                count +=in_num_face_vertices[i];
-            }
-            result.resize(count * size);
-            std::fill(result.begin(), result.end(), 0.f);
+        rpr_int v;
+        rpr_int n;
+        rpr_int t;
+    };
 
-            return result;
-        }
+    inline bool operator == (Corner const& a, Corner const& b)
+    {
+        return a.v == b.v && a.n == b.n && a.t == b.t;
+    }
 
-        int indent = 0;
-        for (int i = 0; i < in_num_faces; ++i)
+    struct CornerHash
+    {
+        std::size_t operator()(Corner const& c) const
         {
-            int face = in_num_face_vertices[i];
-            for (int f = indent; f < face + indent; ++f)
-            {
-                int index = in_data_stride / sizeof(T) * in_data_indices[f*in_didx_stride / sizeof(rpr_int)];
-                for (int s = 0; s < size; ++s)
-                {
-                    result.push_back(in_data[index + s]);
-                }
-            }
+            auto h = static_cast<std::size_t>(static_cast<std::uint32_t>(c.v));
+            h = h * 31 + static_cast<std::uint32_t>(c.n);
+            h = h * 31 + static_cast<std::uint32_t>(c.t);
+            return h;
+        }
+    };
 
-            indent += face;
+    // Strides are in bytes
+    inline rpr_int GetIndex(rpr_int const* indices, rpr_int stride, std::size_t corner)
+    {
+        return indices ? indices[corner * stride / sizeof(rpr_int)] : -1;
+    }
+
+    inline float const* GetElement(float const* data, size_t num, rpr_int stride, rpr_int index)
+    {
+        if (index < 0 || static_cast<size_t>(index) >= num)
+        {
+            throw Exception(RPR_ERROR_INVALID_PARAMETER, "ShapeObject: index out of range.");
         }
-        return result;
+
+        return data + index * stride / sizeof(float);
     }
 }
 
@@ -107,50 +113,153 @@ ShapeObject* ShapeObject::CreateMesh(rpr_float const * in_vertices, size_t in_nu
                         rpr_int const * in_texcoord_indices, rpr_int in_tidx_stride,
                         rpr_int const * in_num_face_vertices, size_t in_num_faces)
 {
-    //merge data
-    std::vector<float> verts = merge(in_vertices, in_num_vertices, in_vertex_stride,
-        in_vertex_indices, in_vidx_stride,
-        in_num_face_vertices, in_num_faces);
-    std::vector<float> normals = merge(in_normals, in_num_normals, in_normal_stride,
-        in_normal_indices, in_nidx_stride,
-        in_num_face_vertices, in_num_faces);
-    std::vector<float> uvs = merge<float, 2>(in_texcoords, in_num_texcoords, in_texcoord_stride,
-        in_texcoord_indices, in_tidx_stride,
-        in_num_face_vertices, in_num_faces);
+    if (!in_vertices || !in_vertex_indices)
+    {
+        throw Exception(RPR_ERROR_INVALID_PARAMETER, "ShapeObject: missing vertex data.");
+    }
+
+    //only triangles and quads supported
+    size_t num_corners = 0;
+    size_t num_triangles = 0;
+    for (size_t i = 0; i < in_num_faces; ++i)
+    {
+        int face = in_num_face_vertices[i];
+        if (face != 3 && face != 4)
+        {
+            throw Exception(RPR_ERROR_INVALID_PARAMETER, "ShapeObject: invalid face value.");
+        }
+
+        num_corners += face;
+        num_triangles += face - 2;
+    }
+
+    bool has_normals = in_normals && in_normal_indices;
+    bool has_uvs = in_texcoords && in_texcoord_indices;
+    if (!has_normals || !has_uvs)
+    {
+        std::cout << "Warning: missing mesh data, fill it with NULL.\n";
+    }
+
+    std::vector<RadeonRays::float3> verts;
+    std::vector<RadeonRays::float3> normals;
+    std::vector<RadeonRays::float2> uvs;
+    //welded vertex of each face corner
+    std::vector<std::uint32_t> corner_vertices(num_corners);
+
+    auto add_vertex = [&](Corner const& c)
+    {
+        auto v = GetElement(in_vertices, in_num_vertices, in_vertex_stride, c.v);
+        verts.push_back(RadeonRays::float3(v[0], v[1], v[2], 1.f));
+
+        if (has_normals)
+        {
+            auto n = GetElement(in_normals, in_num_normals, in_normal_stride, c.n);
+            normals.push_back(RadeonRays::float3(n[0], n[1], n[2], 0.f));
+        }
+        else
+        {
+            normals.push_back(RadeonRays::float3(0.f, 0.f, 0.f, 0.f));
+        }
+
+        if (has_uvs)
+        {
+            auto t = GetElement(in_texcoords, in_num_texcoords, in_texcoord_stride, c.t);
+            uvs.push_back(RadeonRays::float2(t[0], t[1]));
+        }
+        else
+        {
+            uvs.push_back(RadeonRays::float2(0.f, 0.f));
+        }
+    };
+
+    //all the streams share indices: input is already indexed, use it as is
+    bool shared_indices =
+        (!has_normals || (in_normal_indices == in_vertex_indices && in_nidx_stride == in_vidx_stride && in_num_normals >= in_num_vertices)) &&
+        (!has_uvs || (in_texcoord_indices == in_vertex_indices && in_tidx_stride == in_vidx_stride && in_num_texcoords >= in_num_vertices));
+
+    if (shared_indices)
+    {
+        //copy vertices up to the last referenced one only
+        rpr_int num_used = 0;
+        for (size_t i = 0; i < num_corners; ++i)
+        {
+            auto v = GetIndex(in_vertex_indices, in_vidx_stride, i);
+            if (v < 0 || static_cast<size_t>(v) >= in_num_vertices)
+            {
+                throw Exception(RPR_ERROR_INVALID_PARAMETER, "ShapeObject: index out of range.");
+            }
+
+            corner_vertices[i] = static_cast<std::uint32_t>(v);
+            num_used = std::max(num_used, v + 1);
+        }
+
+        verts.reserve(num_used);
+        normals.reserve(num_used);
+        uvs.reserve(num_used);
+
+        for (rpr_int i = 0; i < num_used; ++i)
+        {
+            add_vertex({ i, has_normals ? i : -1, has_uvs ? i : -1 });
+        }
+    }
+    else
+    {
+        //weld corners referencing the same (position, normal, uv) tuple
+        std::unordered_map<Corner, std::uint32_t, CornerHash> welded;
+        welded.reserve(num_corners);
+        verts.reserve(num_corners);
+        normals.reserve(num_corners);
+        uvs.reserve(num_corners);
+
+        for (size_t i = 0; i < num_corners; ++i)
+        {
+            Corner c = {
+                GetIndex(in_vertex_indices, in_vidx_stride, i),
+                has_normals ? GetIndex(in_normal_indices, in_nidx_stride, i) : -1,
+                has_uvs ? GetIndex(in_texcoord_indices, in_tidx_stride, i) : -1
+            };
+
+            auto res = welded.emplace(c, static_cast<std::uint32_t>(verts.size()));
+            if (res.second)
+            {
+                add_vertex(c);
+            }
+
+            corner_vertices[i] = res.first->second;
+        }
+    }
 
     //generate indices
     std::vector<std::uint32_t> inds;
-    std::uint32_t indent = 0;
-    for (std::uint32_t i = 0; i < in_num_faces; ++i)
+    inds.reserve(num_triangles * 3);
+    size_t indent = 0;
+    for (size_t i = 0; i < in_num_faces; ++i)
     {
-        inds.push_back(indent);
-        inds.push_back(indent + 1);
-        inds.push_back(indent + 2);
+        inds.push_back(corner_vertices[indent]);
+        inds.push_back(corner_vertices[indent + 1]);
+        inds.push_back(corner_vertices[indent + 2]);
 
         int face = in_num_face_vertices[i];
 
         //triangulation
         if (face == 4)
         {
-            inds.push_back(indent + 0);
-            inds.push_back(indent + 2);
-            inds.push_back(indent + 3);
-
-        }
-        //only triangles and quads supported
-        else if (face != 3)
-        {
-            throw Exception(RPR_ERROR_INVALID_PARAMETER, "ShapeObject: invalid face value.");
+            inds.push_back(corner_vertices[indent + 0]);
+            inds.push_back(corner_vertices[indent + 2]);
+            inds.push_back(corner_vertices[indent + 3]);
         }
+
         indent += face;
     }
 
+    Baikal::LogInfo("ShapeObject: ", num_corners, " face vertices welded into ", verts.size(), " vertices\n");
+
     //create mesh
     auto mesh = Baikal::Mesh::Create();
-    mesh->SetVertices(verts.data(), verts.size() / 3);
-    mesh->SetNormals(normals.data(), normals.size() / 3);
-    mesh->SetUVs(uvs.data(), uvs.size() / 2);
-    mesh->SetIndices(inds.data(), inds.size());
+    mesh->SetVertices(std::move(verts));
+    mesh->SetNormals(std::move(normals));
+    mesh->SetUVs(std::move(uvs));
+    mesh->SetIndices(std::move(inds));
 
     return new ShapeObject(mesh, nullptr);
 }
@@ -169,6 +169,148 @@ void MeshCreationTest()
 
 }
 
+void MeshWeldingTest()
+{
+    rpr_float positions[] =
+    {
+        0.f, 0.f, 0.f,
+        1.f, 0.f, 0.f,
+        1.f, 1.f, 0.f,
+        0.f, 1.f, 0.f
+    };
+
+    rpr_float normals[] = { 0.f, 0.f, 1.f };
+
+    rpr_float uvs[] =
+    {
+        0.f, 0.f,
+        1.f, 0.f,
+        1.f, 1.f,
+        0.f, 1.f,
+        0.5f, 0.5f
+    };
+
+    rpr_int num_face_vertices[] = { 3, 3 };
+
+    rpr_int status = RPR_SUCCESS;
+    rpr_context context = nullptr;
+    status = rprCreateContext(RPR_API_VERSION, nullptr, 0, RPR_CREATION_FLAGS_ENABLE_GPU0, NULL, NULL, &context);
+    assert(status == RPR_SUCCESS);
+
+    // Separate index streams: corners sharing (position, normal, uv) are welded,
+    // position 0 with a different uv splits into its own vertex
+    {
+        rpr_int vertex_indices[] = { 0, 1, 2, 0, 2, 3 };
+        rpr_int normal_indices[] = { 0, 0, 0, 0, 0, 0 };
+        rpr_int uv_indices[] = { 0, 1, 2, 4, 2, 3 };
+
+        rpr_shape mesh = NULL; status = rprContextCreateMesh(context,
+            positions, 4, 3 * sizeof(rpr_float),
+            normals, 1, 3 * sizeof(rpr_float),
+            uvs, 5, 2 * sizeof(rpr_float),
+            vertex_indices, sizeof(rpr_int),
+            normal_indices, sizeof(rpr_int),
+            uv_indices, sizeof(rpr_int),
+            num_face_vertices, 2, &mesh);
+        assert(status == RPR_SUCCESS);
+
+        uint64_t num_vertices = 0;
+        status = rprMeshGetInfo(mesh, RPR_MESH_VERTEX_COUNT, sizeof(num_vertices), &num_vertices, nullptr);
+        assert(status == RPR_SUCCESS);
+        assert(num_vertices == 5);
+
+        rpr_uint indices[6];
+        status = rprMeshGetInfo(mesh, RPR_MESH_VERTEX_INDEX_ARRAY, sizeof(indices), indices, nullptr);
+        assert(status == RPR_SUCCESS);
+        rpr_uint expected_indices[] = { 0, 1, 2, 3, 2, 4 };
+        for (int i = 0; i < 6; ++i)
+        {
+            assert(indices[i] == expected_indices[i]);
+        }
+
+        // Split vertex keeps the position it has been split from
+        rpr_float vertices[15];
+        status = rprMeshGetInfo(mesh, RPR_MESH_VERTEX_ARRAY, sizeof(vertices), vertices, nullptr);
+        assert(status == RPR_SUCCESS);
+        for (int i = 0; i < 3; ++i)
+        {
+            assert(vertices[9 + i] == positions[i]);
+        }
+
+        status = rprObjectDelete(mesh); mesh = NULL;
+        assert(status == RPR_SUCCESS);
+    }
+
+    // Shared index stream: indexed input is used as is
+    {
+        rpr_float normals_per_vertex[] =
+        {
+            0.f, 0.f, 1.f,
+            0.f, 0.f, 1.f,
+            0.f, 0.f, 1.f,
+            0.f, 0.f, 1.f
+        };
+        rpr_int indices[] = { 3, 1, 0, 2, 1, 3 };
+
+        rpr_shape mesh = NULL; status = rprContextCreateMesh(context,
+            positions, 4, 3 * sizeof(rpr_float),
+            normals_per_vertex, 4, 3 * sizeof(rpr_float),
+            uvs, 4, 2 * sizeof(rpr_float),
+            indices, sizeof(rpr_int),
+            indices, sizeof(rpr_int),
+            indices, sizeof(rpr_int),
+            num_face_vertices, 2, &mesh);
+        assert(status == RPR_SUCCESS);
+
+        uint64_t num_vertices = 0;
+        status = rprMeshGetInfo(mesh, RPR_MESH_VERTEX_COUNT, sizeof(num_vertices), &num_vertices, nullptr);
+        assert(status == RPR_SUCCESS);
+        assert(num_vertices == 4);
+
+        rpr_uint out_indices[6];
+        status = rprMeshGetInfo(mesh, RPR_MESH_VERTEX_INDEX_ARRAY, sizeof(out_indices), out_indices, nullptr);
+        assert(status == RPR_SUCCESS);
+        for (int i = 0; i < 6; ++i)
+        {
+            assert(out_indices[i] == static_cast<rpr_uint>(indices[i]));
+        }
+
+        status = rprObjectDelete(mesh); mesh = NULL;
+        assert(status == RPR_SUCCESS);
+    }
+
+    // Out of range indices are rejected on both paths
+    {
+        rpr_int bad_indices[] = { 0, 1, 2, 0, 2, 4 };
+        rpr_int uv_indices[] = { 0, 1, 2, 0, 2, 3 };
+
+        rpr_shape mesh = NULL; status = rprContextCreateMesh(context,
+            positions, 4, 3 * sizeof(rpr_float),
+            nullptr, 0, 0,
+            nullptr, 0, 0,
+            bad_indices, sizeof(rpr_int),
+            nullptr, 0,
+            nullptr, 0,
+            num_face_vertices, 2, &mesh);
+        assert(status == RPR_ERROR_INVALID_PARAMETER);
+        assert(mesh == NULL);
+
+        status = rprContextCreateMesh(context,
+            positions, 4, 3 * sizeof(rpr_float),
+            nullptr, 0, 0,
+            uvs, 5, 2 * sizeof(rpr_float),
+            bad_indices, sizeof(rpr_int),
+            nullptr, 0,
+            uv_indices, sizeof(rpr_int),
+            num_face_vertices, 2, &mesh);
+        assert(status == RPR_ERROR_INVALID_PARAMETER);
+        assert(mesh == NULL);
+    }
+
+    status = rprObjectDelete(context);
+    assert(status == RPR_SUCCESS);
+}
+
 void SimpleRenderTest()
 {
     rpr_int status = RPR_SUCCESS;
@@ -3376,6 +3518,7 @@ void ArithmeticMul()
 int main(int argc, char* argv[])
 {
     MeshCreationTest();
+    MeshWeldingTest();
     SimpleRenderTest();
     ComplexRenderTest();
     EnvLightClearTest();